@@ -220,6 +220,59 @@ void BiLiOBSMainWid::mSltInvokeProcdure(QVariant proc)
 	delete pProc;
 }
 
+/* modules whose types neither the saved scenes nor the configuration use
+ * are loaded after the window is up.  libobs remembers the other types the
+ * window creates while it starts (see obs_load_modules_for_types) */
+static void LoadModulesForSavedScenes(config_t *basicConfig)
+{
+	std::vector<std::string> ids;
+	std::vector<const char*> idPtrs;
+
+	const char *configIds[] = {
+		App()->mInputAudioSource(),
+		App()->mOutputAudioSource(),
+		config_get_string(basicConfig, "AdvOut", "Encoder"),
+		config_get_string(basicConfig, "AdvOut", "RecEncoder")
+	};
+	for (const char *id : configIds) {
+		if (id)
+			ids.push_back(id);
+	}
+
+	obs_data_t *sceneData = BiliConfigFile::LoadSceneData();
+	if (sceneData) {
+		obs_data_array_t *sources = obs_data_get_array(sceneData,
+			"sources");
+		size_t count = obs_data_array_count(sources);
+
+		for (size_t i = 0; i < count; i++) {
+			obs_data_t *source = obs_data_array_item(sources, i);
+			obs_data_array_t *filters = obs_data_get_array(source,
+				"filters");
+			size_t filterCount = obs_data_array_count(filters);
+
+			ids.push_back(obs_data_get_string(source, "id"));
+			for (size_t j = 0; j < filterCount; j++) {
+				obs_data_t *filter =
+					obs_data_array_item(filters, j);
+				ids.push_back(obs_data_get_string(filter, "id"));
+				obs_data_release(filter);
+			}
+
+			obs_data_array_release(filters);
+			obs_data_release(source);
+		}
+
+		obs_data_array_release(sources);
+		obs_data_release(sceneData);
+	}
+
+	for (const std::string &id : ids)
+		idPtrs.push_back(id.c_str());
+
+	obs_load_modules_for_types(idPtrs.data(), idPtrs.size());
+}
+
 void BiLiOBSMainWid::mOBSInit() {
 
 	ProfileScope("BiLiOBSMainWid::mOBSInit");
@@ -278,7 +331,7 @@ void BiLiOBSMainWid::mOBSInit() {
 
 	mInitOBSAudioCallbacks();
 	AddExtraModulePaths();
-	obs_load_all_modules();
+	LoadModulesForSavedScenes(mBasicConfig);
 	blog(LOG_INFO, MAIN_SEPARATOR);
 	if (!mInitService())
 		throw "Failed to initialize service";
@@ -298,6 +351,12 @@ void BiLiOBSMainWid::mOBSInit() {
 	//TimedCheckForUpdates();
 	mLoaded = true;
 
+	/* must run on the UI thread, which loaded the other modules and is
+	 * where sources, outputs and encoders are created by type id */
+	QTimer::singleShot(0, [](){
+		obs_load_deferred_modules();
+	});
+
 	bool previewEnabled = config_get_bool(App()->mGetGlobalConfig(),
 		"BasicWindow", "PreviewEnabled");
 	if (!previewEnabled)
@@ -873,6 +932,8 @@ int  BiLiOBSMainWid::mResetVideo(){
 	ovi.adapter = 0;
 	ovi.gpu_conversion = true;
 	ovi.scale_type = GetScaleType(mBasicConfig);
+	ovi.readback_depth = (uint32_t)config_get_uint(mBasicConfig,
+		"Video", "ReadbackDepth");
 
 	ret = AttemptToResetVideo(&ovi);
 	if (IS_WIN32 && ret != OBS_VIDEO_SUCCESS) {
@@ -911,6 +972,7 @@ bool BiLiOBSMainWid::mResetAudio(){
 		ai.speakers = SPEAKERS_STEREO;
 
 	ai.buffer_ms = config_get_uint(mBasicConfig, "Audio", "BufferingTime");
+	ai.low_latency = config_get_bool(mBasicConfig, "Audio", "LowLatency");
 
 	return obs_reset_audio(&ai);
 }
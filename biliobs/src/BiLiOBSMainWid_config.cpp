@@ -86,6 +86,8 @@ bool BiLiOBSMainWid::mInitBasicConfigDefaults() {
 			GetDefaultVideoSavePath().c_str());
 	config_set_default_string(mBasicConfig, "SimpleOutput", "RecFormat",
 			"flv");
+	config_set_default_bool  (mBasicConfig, "SimpleOutput", "RecFragmented",
+			false);
 	config_set_default_uint  (mBasicConfig, "SimpleOutput", "VBitrate",
 			1200);
 	config_set_default_uint  (mBasicConfig, "SimpleOutput", "ABitrate", 80);
@@ -111,6 +113,7 @@ bool BiLiOBSMainWid::mInitBasicConfigDefaults() {
 	config_set_default_string(mBasicConfig, "AdvOut", "RecFilePath",
 			GetDefaultVideoSavePath().c_str());
 	config_set_default_string(mBasicConfig, "AdvOut", "RecFormat", "flv");
+	config_set_default_bool  (mBasicConfig, "AdvOut", "RecFragmented", false);
 	config_set_default_bool  (mBasicConfig, "AdvOut", "RecUseRescale",
 			false);
 	config_set_default_uint  (mBasicConfig, "AdvOut", "RecTracks", (1<<0));
@@ -194,11 +197,13 @@ bool BiLiOBSMainWid::mInitBasicConfigDefaults() {
 	config_set_default_string(mBasicConfig, "Video", "ColorSpace", "601");
 	config_set_default_string(mBasicConfig, "Video", "ColorRange",
 			"Partial");
+	config_set_default_uint  (mBasicConfig, "Video", "ReadbackDepth", 0);
 
 	config_set_default_uint  (mBasicConfig, "Audio", "SampleRate", 44100);
 	config_set_default_string(mBasicConfig, "Audio", "ChannelSetup",
 			"Stereo");
 	config_set_default_uint  (mBasicConfig, "Audio", "BufferingTime", 1000);
+	config_set_default_bool  (mBasicConfig, "Audio", "LowLatency", false);
 
     //danmaku history
     config_set_default_int(mBasicConfig, "DanmakuHistory", "DanmakuRefreshMode", 0);
@@ -186,6 +186,8 @@ void BiLiOBSMainWid::ResetPreview() {
 	ovi.adapter = 0;
 	ovi.gpu_conversion = true;
 	ovi.scale_type = OBS_SCALE_LANCZOS;
+	ovi.readback_depth = (uint32_t)config_get_uint(mBasicConfig,
+		"Video", "ReadbackDepth");
 
 	mGetConfigFPS(ovi.fps_num, ovi.fps_den);
 
@@ -514,6 +514,13 @@ bool SimpleOutput::StartRecording()
 	obs_data_set_string(settings, ffmpegOutput ? "url" : "path",
 			strPath.c_str());
 
+	/* mp4/mov recordings stay playable if they're cut off, the setting is
+	 * ignored for other formats */
+	if (!ffmpegOutput)
+		obs_data_set_bool(settings, "fragmented",
+				config_get_bool(biliMain->Config(),
+					"SimpleOutput", "RecFragmented"));
+
 	obs_output_update(fileOutput, settings);
 
 	obs_data_release(settings);
@@ -1025,6 +1032,11 @@ bool AdvancedOutput::StartRecording()
 				ffmpegRecording ? "url" : "path",
 				strPath.c_str());
 
+		if (!ffmpegRecording)
+			obs_data_set_bool(settings, "fragmented",
+					config_get_bool(biliMain->Config(),
+						"AdvOut", "RecFragmented"));
+
 		obs_output_update(fileOutput, settings);
 
 		obs_data_release(settings);
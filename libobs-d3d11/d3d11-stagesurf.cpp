@@ -41,4 +41,14 @@ gs_stage_surface::gs_stage_surface(gs_device_t *device, uint32_t width,
 	hr = device->device->CreateTexture2D(&td, NULL, texture.Assign());
 	if (FAILED(hr))
 		throw HRError("Failed to create 2D texture", hr);
+
+	D3D11_QUERY_DESC qd;
+	memset(&qd, 0, sizeof(qd));
+	qd.Query = D3D11_QUERY_EVENT;
+
+	/* without the query the surface just always reports ready */
+	hr = device->device->CreateQuery(&qd, query.Assign());
+	if (FAILED(hr))
+		blog(LOG_WARNING, "gs_stage_surface: Failed to create event "
+		                  "query (%08lX)", hr);
 }
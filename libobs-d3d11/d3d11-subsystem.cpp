@@ -1219,6 +1219,11 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 
 		device->CopyTex(dst->texture, 0, 0, src, 0, 0, 0, 0);
 
+		if (dst->query) {
+			device->context->End(dst->query);
+			dst->queryPending = true;
+		}
+
 	} catch (const char *error) {
 		blog(LOG_ERROR, "device_copy_texture (D3D11): %s", error);
 	}
@@ -1796,6 +1801,20 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 	stagesurf->device->context->Unmap(stagesurf->texture, 0);
 }
 
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	if (!stagesurf->queryPending)
+		return true;
+
+	HRESULT hr = stagesurf->device->context->GetData(stagesurf->query,
+			NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	if (hr == S_FALSE)
+		return false;
+
+	stagesurf->queryPending = false;
+	return true;
+}
+
 
 void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
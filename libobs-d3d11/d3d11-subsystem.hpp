@@ -334,6 +334,10 @@ struct gs_zstencil_buffer {
 struct gs_stage_surface {
 	ComPtr<ID3D11Texture2D> texture;
 
+	/* event query issued after each copy into the surface */
+	ComPtr<ID3D11Query>     query;
+	bool                    queryPending = false;
+
 	gs_device       *device;
 	uint32_t        width, height;
 	gs_color_format format;
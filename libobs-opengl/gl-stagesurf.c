@@ -42,6 +42,31 @@ static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
 	return success;
 }
 
+static inline bool gl_has_sync(void)
+{
+	return GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync;
+}
+
+static void delete_fence(struct gs_stage_surface *surf)
+{
+	if (surf->fence) {
+		glDeleteSync(surf->fence);
+		surf->fence = NULL;
+	}
+}
+
+/* lets gs_stagesurface_ready tell when the transfer is done instead of
+ * having glMapBuffer block on it */
+static void insert_fence(struct gs_stage_surface *surf)
+{
+	delete_fence(surf);
+
+	if (gl_has_sync()) {
+		surf->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		gl_success("glFenceSync");
+	}
+}
+
 gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
 		uint32_t height, enum gs_color_format color_format)
 {
@@ -68,6 +93,7 @@ gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
 void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
 {
 	if (stagesurf) {
+		delete_fence(stagesurf);
 		if (stagesurf->pack_buffer)
 			gl_delete_buffers(1, &stagesurf->pack_buffer);
 
@@ -141,6 +167,7 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glReadPixels"))
 		goto failed_unbind_all;
 
+	insert_fence(dst);
 	success = true;
 
 failed_unbind_all:
@@ -172,6 +199,8 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glGetTexImage"))
 		goto failed;
 
+	insert_fence(dst);
+
 	gl_bind_texture(GL_TEXTURE_2D, 0);
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 	return;
@@ -232,3 +261,21 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 }
+
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	GLenum ret;
+
+	if (!stagesurf->fence)
+		return true;
+
+	ret = glClientWaitSync(stagesurf->fence, 0, 0);
+	if (ret == GL_TIMEOUT_EXPIRED)
+		return false;
+
+	if (ret == GL_WAIT_FAILED)
+		gl_success("glClientWaitSync");
+
+	delete_fence(stagesurf);
+	return true;
+}
@@ -437,6 +437,9 @@ struct gs_stage_surface {
 	GLint                gl_internal_format;
 	GLenum               gl_type;
 	GLuint               pack_buffer;
+
+	/* signaled once the last transfer into pack_buffer has completed */
+	GLsync               fence;
 };
 
 struct gs_zstencil_buffer {
@@ -121,15 +121,25 @@ static inline void cd_set_first_param(calldata_t *data, const char *name,
 	uint8_t *pos;
 	size_t capacity;
 	size_t name_len = strlen(name)+1;
+	bool fixed = (data->capacity & CALLDATA_FIXED) != 0;
 
 	capacity = sizeof(size_t)*3 + name_len + size;
 	data->size = capacity;
 
-	if (capacity < 128)
-		capacity = 128;
+	if (fixed && capacity > (data->capacity & ~CALLDATA_FIXED)) {
+		fixed = false;
+		data->stack = NULL;
+	}
+
+	if (!fixed) {
+		bfree(data->stack);
 
-	data->capacity = capacity;
-	data->stack    = bmalloc(capacity);
+		if (capacity < 128)
+			capacity = 128;
+
+		data->capacity = capacity;
+		data->stack    = bmalloc(capacity);
+	}
 
 	pos = data->stack;
 	cd_copy_string(&pos, name, name_len);
@@ -141,18 +151,26 @@ static inline void cd_ensure_capacity(calldata_t *data, uint8_t **pos,
 		size_t new_size)
 {
 	size_t offset;
+	size_t capacity = data->capacity & ~CALLDATA_FIXED;
 	size_t new_capacity;
 
-	if (new_size < data->capacity)
+	if (new_size < capacity)
 		return;
 
 	offset = *pos - data->stack;
 
-	new_capacity = data->capacity * 2;
+	new_capacity = capacity * 2;
 	if (new_capacity < new_size)
 		new_capacity = new_size;
 
-	data->stack    = brealloc(data->stack, new_capacity);
+	if (data->capacity & CALLDATA_FIXED) {
+		uint8_t *stack = bmalloc(new_capacity);
+		memcpy(stack, data->stack, data->size);
+		data->stack = stack;
+	} else {
+		data->stack = brealloc(data->stack, new_capacity);
+	}
+
 	data->capacity = new_capacity;
 
 	*pos = data->stack + offset;
@@ -188,7 +206,7 @@ void calldata_set_data(calldata_t *data, const char *name, const void *in,
 	if (!data || !name || !*name)
 		return;
 
-	if (!data->stack) {
+	if (!data->stack || !data->size) {
 		cd_set_first_param(data, name, in, size);
 		return;
 	}
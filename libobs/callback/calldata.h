@@ -49,6 +49,11 @@ struct calldata {
 	uint8_t *stack;
 };
 
+/* set in the capacity while the stack is a buffer owned by the caller.  It
+ * is kept in the capacity so the structure keeps its size and layout for
+ * plugins built against older headers. */
+#define CALLDATA_FIXED ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
 typedef struct calldata calldata_t;
 
 static inline void calldata_init(struct calldata *data)
@@ -56,9 +61,23 @@ static inline void calldata_init(struct calldata *data)
 	memset(data, 0, sizeof(struct calldata));
 }
 
+/*
+ * Uses a buffer provided by the caller (usually on the stack) for the
+ * parameters, for signals that are sent often.  If the parameters outgrow
+ * it, they are moved to an allocated stack as usual.
+ */
+static inline void calldata_init_fixed(struct calldata *data, uint8_t *stack,
+		size_t size)
+{
+	data->size     = 0;
+	data->capacity = size | CALLDATA_FIXED;
+	data->stack    = stack;
+}
+
 static inline void calldata_free(struct calldata *data)
 {
-	bfree(data->stack);
+	if ((data->capacity & CALLDATA_FIXED) == 0)
+		bfree(data->stack);
 }
 
 EXPORT bool calldata_get_data(const calldata_t *data, const char *name,
@@ -1305,6 +1305,7 @@ static void ep_compile_param(struct effect_parser *ep, size_t idx)
 	param->name    = bstrdup(param_in->name);
 	param->section = EFFECT_PARAM;
 	param->effect  = ep->effect;
+	param->version = 1;
 	da_move(param->default_val, param_in->default_val);
 
 	if (strcmp(param_in->type, "bool") == 0)
@@ -56,25 +56,21 @@ gs_technique_t *gs_effect_get_current_technique(const gs_effect_t *effect)
 	return effect->cur_technique;
 }
 
-bool gs_effect_loop(gs_effect_t *effect, const char *name)
+bool gs_effect_loop_technique(gs_effect_t *effect, gs_technique_t *tech)
 {
 	if (!effect) {
 		return false;
 	}
 
 	if (!effect->looping) {
-		gs_technique_t *tech;
-
 		if (!!gs_get_effect()) {
 			blog(LOG_WARNING, "gs_effect_loop: An effect is "
 			                  "already active");
 			return false;
 		}
 
-		tech = gs_effect_get_technique(effect, name);
-		if (!tech) {
-			blog(LOG_WARNING, "gs_effect_loop: Technique '%s' "
-			                  "not found.", name);
+		if (!tech || tech->effect != effect) {
+			blog(LOG_WARNING, "gs_effect_loop: Invalid technique");
 			return false;
 		}
 
@@ -96,6 +92,34 @@ bool gs_effect_loop(gs_effect_t *effect, const char *name)
 	return true;
 }
 
+bool gs_effect_loop(gs_effect_t *effect, const char *name)
+{
+	gs_technique_t *tech;
+
+	if (!effect) {
+		return false;
+	}
+
+	if (effect->looping)
+		return gs_effect_loop_technique(effect, effect->cur_technique);
+
+	/* most callers loop the same technique every frame, so check the
+	 * last one used before walking the technique list */
+	tech = effect->loop_tech;
+	if (!tech || strcmp(tech->name, name) != 0) {
+		tech = gs_effect_get_technique(effect, name);
+		if (!tech) {
+			blog(LOG_WARNING, "gs_effect_loop: Technique '%s' "
+			                  "not found.", name);
+			return false;
+		}
+
+		effect->loop_tech = tech;
+	}
+
+	return gs_effect_loop_technique(effect, tech);
+}
+
 size_t gs_technique_begin(gs_technique_t *tech)
 {
 	if (!tech) return 0;
@@ -120,24 +144,35 @@ void gs_technique_end(gs_technique_t *tech)
 	tech->effect->cur_technique = NULL;
 	tech->effect->graphics->cur_effect = NULL;
 
-	for (i = 0; i < effect->params.num; i++) {
-		struct gs_effect_param *param = params+i;
-
-		da_free(param->cur_val);
-		param->changed = false;
-	}
+	/* values revert to their defaults unless they are set again before
+	 * the next upload.  the current value is kept around so that setting
+	 * the same value again does not count as a change. */
+	for (i = 0; i < effect->params.num; i++)
+		params[i].reset_pending = true;
 }
 
-static inline void reset_params(struct darray *shaderparams)
+static void effect_setval_inline(gs_eparam_t *param,
+		const void *data, size_t size);
+
+static inline void apply_pending_reset(struct gs_effect_param *eparam)
 {
-	struct pass_shaderparam *params = shaderparams->array;
-	size_t i;
+	if (!eparam->reset_pending)
+		return;
 
-	for (i = 0; i < shaderparams->num; i++)
-		params[i].eparam->changed = false;
+	/* a value without a default goes back to not being set, so a
+	 * texture from an earlier technique is never bound again after it
+	 * may have been destroyed */
+	if (eparam->default_val.num)
+		effect_setval_inline(eparam, eparam->default_val.array,
+				eparam->default_val.num);
+	else
+		da_resize(eparam->cur_val, 0);
+
+	eparam->reset_pending = false;
 }
 
-static void upload_shader_params(struct darray *pass_params, bool changed_only)
+static void upload_shader_params(struct gs_effect *effect,
+		struct darray *pass_params)
 {
 	struct pass_shaderparam *params = pass_params->array;
 	size_t i;
@@ -147,23 +182,31 @@ static void upload_shader_params(struct darray *pass_params, bool changed_only)
 		struct gs_effect_param *eparam = param->eparam;
 		gs_sparam_t *sparam = param->sparam;
 
-		if (changed_only && !eparam->changed)
-			continue;
+		apply_pending_reset(eparam);
 
 		if (!eparam->cur_val.num) {
 			if (eparam->default_val.num)
-				da_copy(eparam->cur_val, eparam->default_val);
+				effect_setval_inline(eparam,
+						eparam->default_val.array,
+						eparam->default_val.num);
 			else
 				continue;
 		}
 
+		if (param->uploaded_version == eparam->version)
+			continue;
+
 		gs_shader_set_val(sparam, eparam->cur_val.array,
 				eparam->cur_val.num);
+		param->uploaded_version = eparam->version;
+
+		if (eparam->type != GS_SHADER_PARAM_TEXTURE)
+			effect->graphics->uniform_bytes_uploaded +=
+				eparam->cur_val.num;
 	}
 }
 
-static inline void upload_parameters(struct gs_effect *effect,
-		bool changed_only)
+static inline void upload_parameters(struct gs_effect *effect)
 {
 	struct darray *vshader_params, *pshader_params;
 
@@ -173,16 +216,14 @@ static inline void upload_parameters(struct gs_effect *effect,
 	vshader_params = &effect->cur_pass->vertshader_params.da;
 	pshader_params = &effect->cur_pass->pixelshader_params.da;
 
-	upload_shader_params(vshader_params, changed_only);
-	upload_shader_params(pshader_params, changed_only);
-	reset_params(vshader_params);
-	reset_params(pshader_params);
+	upload_shader_params(effect, vshader_params);
+	upload_shader_params(effect, pshader_params);
 }
 
 void gs_effect_update_params(gs_effect_t *effect)	
 {
 	if (effect)
-		upload_parameters(effect, true);
+		upload_parameters(effect);
 }
 
 bool gs_technique_begin_pass(gs_technique_t *tech, size_t idx)
@@ -199,7 +240,7 @@ bool gs_technique_begin_pass(gs_technique_t *tech, size_t idx)
 	tech->effect->cur_pass = cur_pass;
 	gs_load_vertexshader(cur_pass->vertshader);
 	gs_load_pixelshader(cur_pass->pixelshader);
-	upload_parameters(tech->effect, false);
+	upload_parameters(tech->effect);
 
 	return true;
 }
@@ -230,8 +271,10 @@ static inline void clear_tex_params(struct darray *in_params)
 		struct gs_shader_param_info info;
 
 		gs_shader_get_param_info(param->sparam, &info);
-		if (info.type == GS_SHADER_PARAM_TEXTURE)
+		if (info.type == GS_SHADER_PARAM_TEXTURE) {
 			gs_shader_set_texture(param->sparam, NULL);
+			param->uploaded_version = 0;
+		}
 	}
 }
 
@@ -301,7 +344,7 @@ void gs_effect_get_param_info(const gs_eparam_t *param,
 	info->type = param->type;
 }
 
-static inline void effect_setval_inline(gs_eparam_t *param,
+static void effect_setval_inline(gs_eparam_t *param,
 		const void *data, size_t size)
 {
 	bool size_changed;
@@ -316,6 +359,7 @@ static inline void effect_setval_inline(gs_eparam_t *param,
 		return;
 	}
 
+	param->reset_pending = false;
 	size_changed = param->cur_val.num != size;
 
 	if (size_changed)
@@ -323,7 +367,7 @@ static inline void effect_setval_inline(gs_eparam_t *param,
 
 	if (size_changed || memcmp(param->cur_val.array, data, size) != 0) {
 		memcpy(param->cur_val.array, data, size);
-		param->changed = true;
+		param->version++;
 	}
 }
 
@@ -52,7 +52,8 @@ struct gs_effect_param {
 
 	enum gs_shader_param_type type;
 
-	bool changed;
+	bool reset_pending;
+	size_t version;
 	DARRAY(uint8_t) cur_val;
 	DARRAY(uint8_t) default_val;
 
@@ -80,9 +81,15 @@ EXPORT void effect_param_parse_property(gs_eparam_t *param,
 
 /* ------------------------------------------------------------------------- */
 
+/*
+ * uploaded_version is the eparam version last written to the shader
+ * param.  0 means the shader param has not been written (or was cleared),
+ * so the next pass begin must upload it.
+ */
 struct pass_shaderparam {
 	struct gs_effect_param *eparam;
 	gs_sparam_t *sparam;
+	size_t uploaded_version;
 };
 
 struct gs_effect_pass {
@@ -151,6 +158,7 @@ struct gs_effect {
 
 	struct gs_effect *next;
 
+	struct gs_effect_technique *loop_tech;
 	size_t loop_pass;
 	bool looping;
 };
@@ -177,10 +185,6 @@ static inline void effect_free(gs_effect_t *effect)
 	effect->effect_dir = NULL;
 }
 
-EXPORT void effect_upload_params(gs_effect_t *effect, bool changed_only);
-EXPORT void effect_upload_shader_params(gs_effect_t *effect,
-		gs_shader_t *shader, struct darray *pass_params,
-		bool changed_only);
 
 #ifdef __cplusplus
 }
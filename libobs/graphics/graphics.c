@@ -661,6 +661,19 @@ gs_effect_t *gs_get_effect(void)
 	return thread_graphics ? thread_graphics->cur_effect : NULL;
 }
 
+uint64_t gs_get_uniform_bytes_uploaded(bool reset)
+{
+	uint64_t bytes;
+
+	if (!thread_graphics)
+		return 0;
+
+	bytes = thread_graphics->uniform_bytes_uploaded;
+	if (reset)
+		thread_graphics->uniform_bytes_uploaded = 0;
+	return bytes;
+}
+
 static inline struct gs_effect *find_cached_effect(const char *filename)
 {
 	struct gs_effect *effect = thread_graphics->first_effect;
@@ -1964,6 +1977,17 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 	graphics->exports.gs_stagesurface_unmap(stagesurf);
 }
 
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics || !stagesurf) return false;
+
+	if (graphics->exports.gs_stagesurface_ready)
+		return graphics->exports.gs_stagesurface_ready(stagesurf);
+	else
+		return true;
+}
+
 void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
 	if (!thread_graphics || !zstencil) return;
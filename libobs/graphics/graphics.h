@@ -371,6 +371,11 @@ EXPORT gs_eparam_t *gs_effect_get_param_by_name(const gs_effect_t *effect,
  * unloading. */
 EXPORT bool gs_effect_loop(gs_effect_t *effect, const char *name);
 
+/** Same as gs_effect_loop, but with a technique handle resolved beforehand
+ * via gs_effect_get_technique, avoiding the name lookup each frame. */
+EXPORT bool gs_effect_loop_technique(gs_effect_t *effect,
+		gs_technique_t *technique);
+
 /** used internally */
 EXPORT void gs_effect_update_params(gs_effect_t *effect);
 
@@ -491,6 +496,10 @@ EXPORT void gs_texcoord2v(const struct vec2 *v, int unit);
 EXPORT input_t *gs_get_input(void);
 EXPORT gs_effect_t *gs_get_effect(void);
 
+/** Returns the number of bytes of effect parameter values uploaded to
+ * shaders on the current graphics context, optionally resetting the count */
+EXPORT uint64_t gs_get_uniform_bytes_uploaded(bool reset);
+
 EXPORT gs_effect_t *gs_effect_create_from_file(const char *file,
 		char **error_string);
 EXPORT gs_effect_t *gs_effect_create(const char *effect_string,
@@ -703,6 +712,13 @@ EXPORT bool     gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		uint32_t *linesize);
 EXPORT void     gs_stagesurface_unmap(gs_stagesurf_t *stagesurf);
 
+/**
+ * Returns whether the last gs_stage_texture into this surface has completed
+ * on the GPU, meaning gs_stagesurface_map will not have to wait for it.
+ * Always true if the graphics module can't tell.
+ */
+EXPORT bool     gs_stagesurface_ready(gs_stagesurf_t *stagesurf);
+
 EXPORT void     gs_zstencil_destroy(gs_zstencil_t *zstencil);
 
 EXPORT void     gs_samplerstate_destroy(gs_samplerstate_t *samplerstate);
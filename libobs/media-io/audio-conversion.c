@@ -0,0 +1,411 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "audio-conversion.h"
+
+/* scaling matches swresample so switching between the two paths doesn't
+ * change the output */
+#define S16_SCALE 32768.0f
+#define S32_SCALE 2147483648.0
+#define U8_SCALE  128.0f
+
+static inline enum audio_format sample_type(enum audio_format format)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT_PLANAR: return AUDIO_FORMAT_U8BIT;
+	case AUDIO_FORMAT_16BIT_PLANAR: return AUDIO_FORMAT_16BIT;
+	case AUDIO_FORMAT_32BIT_PLANAR: return AUDIO_FORMAT_32BIT;
+	case AUDIO_FORMAT_FLOAT_PLANAR: return AUDIO_FORMAT_FLOAT;
+	default:                        return format;
+	}
+}
+
+/* rounds to nearest even through the SSE unit, same as lrintf */
+static inline int32_t round_float(float val)
+{
+	return _mm_cvtss_si32(_mm_set_ss(val));
+}
+
+static inline int32_t clamp_int(int32_t val, int32_t min, int32_t max)
+{
+	return val < min ? min : (val > max ? max : val);
+}
+
+/* ------------------------------------------------------------------------- */
+/* sample type conversion, contiguous samples                                */
+
+static void float_to_s16(int16_t *out, const float *in, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(S16_SCALE);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i lo = _mm_cvtps_epi32(
+				_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+		__m128i hi = _mm_cvtps_epi32(
+				_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+
+		/* packs saturates, which also handles out of range samples */
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+	}
+
+	for (; i < count; i++)
+		out[i] = (int16_t)clamp_int(round_float(in[i] * S16_SCALE),
+				INT16_MIN, INT16_MAX);
+}
+
+static void s16_to_float(float *out, const int16_t *in, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / S16_SCALE);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i val = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i lo  = _mm_srai_epi32(_mm_unpacklo_epi16(val, val), 16);
+		__m128i hi  = _mm_srai_epi32(_mm_unpackhi_epi16(val, val), 16);
+
+		_mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+
+	for (; i < count; i++)
+		out[i] = (float)in[i] * (1.0f / S16_SCALE);
+}
+
+static void s32_to_float(float *out, const int32_t *in, size_t count)
+{
+	const __m128 scale = _mm_set1_ps((float)(1.0 / S32_SCALE));
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i val = _mm_loadu_si128((const __m128i*)(in + i));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(val), scale));
+	}
+
+	for (; i < count; i++)
+		out[i] = (float)in[i] * (float)(1.0 / S32_SCALE);
+}
+
+static inline int32_t float_to_s32_sample(float val)
+{
+	double scaled = (double)val * S32_SCALE;
+
+	if (scaled >= 2147483647.0)
+		return INT32_MAX;
+	if (scaled <= -2147483648.0)
+		return INT32_MIN;
+
+	return _mm_cvtsd_si32(_mm_set_sd(scaled));
+}
+
+static void float_to_s32(int32_t *out, const float *in, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = float_to_s32_sample(in[i]);
+}
+
+/* anything else (8 bit and integer to integer) goes through float one
+ * sample at a time; none of those are common enough to need kernels */
+static inline float read_sample(const uint8_t *in, enum audio_format type,
+		size_t i)
+{
+	switch (type) {
+	case AUDIO_FORMAT_U8BIT:
+		return ((float)in[i] - 128.0f) * (1.0f / U8_SCALE);
+	case AUDIO_FORMAT_16BIT:
+		return (float)((const int16_t*)in)[i] * (1.0f / S16_SCALE);
+	case AUDIO_FORMAT_32BIT:
+		return (float)((const int32_t*)in)[i] *
+			(float)(1.0 / S32_SCALE);
+	case AUDIO_FORMAT_FLOAT:
+		return ((const float*)in)[i];
+	default:
+		return 0.0f;
+	}
+}
+
+static inline void write_sample(uint8_t *out, enum audio_format type,
+		size_t i, float val)
+{
+	switch (type) {
+	case AUDIO_FORMAT_U8BIT:
+		out[i] = (uint8_t)clamp_int(round_float(val * U8_SCALE) + 128,
+				0, UINT8_MAX);
+		break;
+	case AUDIO_FORMAT_16BIT:
+		((int16_t*)out)[i] = (int16_t)clamp_int(
+				round_float(val * S16_SCALE),
+				INT16_MIN, INT16_MAX);
+		break;
+	case AUDIO_FORMAT_32BIT:
+		((int32_t*)out)[i] = float_to_s32_sample(val);
+		break;
+	case AUDIO_FORMAT_FLOAT:
+		((float*)out)[i] = val;
+		break;
+	default:
+		break;
+	}
+}
+
+static void convert_samples(uint8_t *out, enum audio_format out_type,
+		const uint8_t *in, enum audio_format in_type, size_t count)
+{
+	if (out_type == in_type) {
+		memcpy(out, in, count * get_audio_bytes_per_channel(in_type));
+
+	} else if (out_type == AUDIO_FORMAT_16BIT &&
+	           in_type  == AUDIO_FORMAT_FLOAT) {
+		float_to_s16((int16_t*)out, (const float*)in, count);
+
+	} else if (out_type == AUDIO_FORMAT_FLOAT &&
+	           in_type  == AUDIO_FORMAT_16BIT) {
+		s16_to_float((float*)out, (const int16_t*)in, count);
+
+	} else if (out_type == AUDIO_FORMAT_32BIT &&
+	           in_type  == AUDIO_FORMAT_FLOAT) {
+		float_to_s32((int32_t*)out, (const float*)in, count);
+
+	} else if (out_type == AUDIO_FORMAT_FLOAT &&
+	           in_type  == AUDIO_FORMAT_32BIT) {
+		s32_to_float((float*)out, (const int32_t*)in, count);
+
+	} else {
+		for (size_t i = 0; i < count; i++)
+			write_sample(out, out_type, i,
+					read_sample(in, in_type, i));
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* layout conversion, same sample type                                       */
+
+static void interleave_stereo_32(uint32_t *out, const uint32_t *left,
+		const uint32_t *right, uint32_t frames)
+{
+	uint32_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 l = _mm_loadu_ps((const float*)(left + i));
+		__m128 r = _mm_loadu_ps((const float*)(right + i));
+
+		_mm_storeu_ps((float*)(out + i * 2),     _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps((float*)(out + i * 2 + 4), _mm_unpackhi_ps(l, r));
+	}
+
+	for (; i < frames; i++) {
+		out[i * 2]     = left[i];
+		out[i * 2 + 1] = right[i];
+	}
+}
+
+static void deinterleave_stereo_32(uint32_t *left, uint32_t *right,
+		const uint32_t *in, uint32_t frames)
+{
+	uint32_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 a = _mm_loadu_ps((const float*)(in + i * 2));
+		__m128 b = _mm_loadu_ps((const float*)(in + i * 2 + 4));
+
+		_mm_storeu_ps((float*)(left + i),
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps((float*)(right + i),
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+
+	for (; i < frames; i++) {
+		left[i]  = in[i * 2];
+		right[i] = in[i * 2 + 1];
+	}
+}
+
+static void interleave_stereo_16(uint16_t *out, const uint16_t *left,
+		const uint16_t *right, uint32_t frames)
+{
+	uint32_t i = 0;
+
+	for (; i + 8 <= frames; i += 8) {
+		__m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+		__m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+
+		_mm_storeu_si128((__m128i*)(out + i * 2),
+				_mm_unpacklo_epi16(l, r));
+		_mm_storeu_si128((__m128i*)(out + i * 2 + 8),
+				_mm_unpackhi_epi16(l, r));
+	}
+
+	for (; i < frames; i++) {
+		out[i * 2]     = left[i];
+		out[i * 2 + 1] = right[i];
+	}
+}
+
+static void deinterleave_stereo_16(uint16_t *left, uint16_t *right,
+		const uint16_t *in, uint32_t frames)
+{
+	uint32_t i = 0;
+
+	for (; i + 8 <= frames; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(in + i * 2));
+		__m128i b = _mm_loadu_si128((const __m128i*)(in + i * 2 + 8));
+
+		/* sign extend each half to 32 bits so packs can't saturate */
+		__m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		__m128i lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		__m128i ra = _mm_srai_epi32(a, 16);
+		__m128i rb = _mm_srai_epi32(b, 16);
+
+		_mm_storeu_si128((__m128i*)(left + i),  _mm_packs_epi32(la, lb));
+		_mm_storeu_si128((__m128i*)(right + i), _mm_packs_epi32(ra, rb));
+	}
+
+	for (; i < frames; i++) {
+		left[i]  = in[i * 2];
+		right[i] = in[i * 2 + 1];
+	}
+}
+
+#define interleave_type(type, out, in, channels, frames)                      \
+do {                                                                          \
+	for (size_t ch = 0; ch < channels; ch++) {                            \
+		const type *src = (const type*)in[ch];                        \
+		type *dst = (type*)out + ch;                                  \
+		for (uint32_t i = 0; i < frames; i++)                         \
+			dst[i * channels] = src[i];                           \
+	}                                                                     \
+} while (false)
+
+#define deinterleave_type(type, out, in, channels, frames)                    \
+do {                                                                          \
+	for (size_t ch = 0; ch < channels; ch++) {                            \
+		const type *src = (const type*)in + ch;                       \
+		type *dst = (type*)out[ch];                                   \
+		for (uint32_t i = 0; i < frames; i++)                         \
+			dst[i] = src[i * channels];                           \
+	}                                                                     \
+} while (false)
+
+static void interleave(uint8_t *out, const uint8_t *const in[],
+		size_t sample_size, size_t channels, uint32_t frames)
+{
+	if (sample_size == 4 && channels == 2) {
+		interleave_stereo_32((uint32_t*)out, (const uint32_t*)in[0],
+				(const uint32_t*)in[1], frames);
+		return;
+	} else if (sample_size == 2 && channels == 2) {
+		interleave_stereo_16((uint16_t*)out, (const uint16_t*)in[0],
+				(const uint16_t*)in[1], frames);
+		return;
+	}
+
+	switch (sample_size) {
+	case 1: interleave_type(uint8_t,  out, in, channels, frames); break;
+	case 2: interleave_type(uint16_t, out, in, channels, frames); break;
+	case 4: interleave_type(uint32_t, out, in, channels, frames); break;
+	}
+}
+
+static void deinterleave(uint8_t *const out[], const uint8_t *in,
+		size_t sample_size, size_t channels, uint32_t frames)
+{
+	if (sample_size == 4 && channels == 2) {
+		deinterleave_stereo_32((uint32_t*)out[0], (uint32_t*)out[1],
+				(const uint32_t*)in, frames);
+		return;
+	} else if (sample_size == 2 && channels == 2) {
+		deinterleave_stereo_16((uint16_t*)out[0], (uint16_t*)out[1],
+				(const uint16_t*)in, frames);
+		return;
+	}
+
+	switch (sample_size) {
+	case 1: deinterleave_type(uint8_t,  out, in, channels, frames); break;
+	case 2: deinterleave_type(uint16_t, out, in, channels, frames); break;
+	case 4: deinterleave_type(uint32_t, out, in, channels, frames); break;
+	}
+}
+
+static void convert_layout(uint8_t *const output[], bool out_planar,
+		const uint8_t *const input[], size_t sample_size,
+		size_t channels, uint32_t frames)
+{
+	if (out_planar)
+		deinterleave(output, input[0], sample_size, channels, frames);
+	else
+		interleave(output[0], input, sample_size, channels, frames);
+}
+
+/* ------------------------------------------------------------------------- */
+
+size_t audio_convert_temp_size(enum audio_format out_format,
+		enum audio_format in_format, size_t channels, uint32_t frames)
+{
+	if (is_audio_planar(out_format) == is_audio_planar(in_format) ||
+	    sample_type(out_format) == sample_type(in_format))
+		return 0;
+
+	return frames * channels * get_audio_bytes_per_channel(out_format);
+}
+
+void audio_convert(uint8_t *const output[], enum audio_format out_format,
+		const uint8_t *const input[], enum audio_format in_format,
+		size_t channels, uint32_t frames, uint8_t *temp)
+{
+	enum audio_format out_type = sample_type(out_format);
+	enum audio_format in_type  = sample_type(in_format);
+	bool out_planar = is_audio_planar(out_format);
+	bool in_planar  = is_audio_planar(in_format);
+	size_t out_size = get_audio_bytes_per_channel(out_format);
+
+	if (out_planar == in_planar) {
+		size_t planes = in_planar ? channels : 1;
+		size_t count  = in_planar ? frames : frames * channels;
+
+		for (size_t i = 0; i < planes; i++)
+			convert_samples(output[i], out_type, input[i], in_type,
+					count);
+
+	} else if (out_type == in_type) {
+		convert_layout(output, out_planar, input, out_size, channels,
+				frames);
+
+	} else {
+		/* convert the samples in the input layout first, then
+		 * (de)interleave the already converted samples */
+		uint8_t *temp_planes[MAX_AV_PLANES] = {temp};
+
+		if (in_planar) {
+			for (size_t i = 0; i < channels; i++) {
+				temp_planes[i] = temp + i * frames * out_size;
+				convert_samples(temp_planes[i], out_type,
+						input[i], in_type, frames);
+			}
+		} else {
+			convert_samples(temp, out_type, input[0], in_type,
+					frames * channels);
+		}
+
+		convert_layout(output, out_planar,
+				(const uint8_t *const*)temp_planes, out_size,
+				channels, frames);
+	}
+}
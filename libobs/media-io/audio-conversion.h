@@ -0,0 +1,56 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "audio-io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Functions for converting audio between sample formats and between planar
+ * and interleaved layouts without changing the sample rate or channel
+ * layout.  Conversion follows the same scaling and rounding as swresample.
+ */
+
+/**
+ * Converts frames of audio from one sample format to another.
+ *
+ * @param  output      Output planes, sized for the output format
+ * @param  out_format  Output sample format
+ * @param  input       Input planes
+ * @param  in_format   Input sample format
+ * @param  channels    Number of channels, the same on both sides
+ * @param  frames      Number of frames to convert
+ * @param  temp        Scratch buffer of at least
+ *                     frames * channels * sizeof(float) bytes, only used
+ *                     when both the sample type and the layout change
+ */
+EXPORT void audio_convert(uint8_t *const output[], enum audio_format out_format,
+		const uint8_t *const input[], enum audio_format in_format,
+		size_t channels, uint32_t frames, uint8_t *temp);
+
+/** Returns the scratch size audio_convert needs for the given conversion */
+EXPORT size_t audio_convert_temp_size(enum audio_format out_format,
+		enum audio_format in_format, size_t channels, uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
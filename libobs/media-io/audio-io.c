@@ -46,13 +46,22 @@ static inline void audio_input_free(struct audio_input *input)
 	audio_resampler_destroy(input->resampler);
 }
 
+/* size of the per-line input rings.  capture threads only ever write into
+ * these, the audio thread moves the data into the line buffers when mixing */
+#define AUDIO_LINE_RING_MS      500
+#define AUDIO_LINE_RING_PACKETS 256
+
+struct audio_line_packet {
+	uint64_t                   timestamp;
+	uint32_t                   frames;
+};
+
 struct audio_line {
 	char                       *name;
 
 	struct audio_output        *audio;
 	struct circlebuf           buffers[MAX_AV_PLANES];
-	pthread_mutex_t            mutex;
-	DARRAY(uint8_t)            volume_buffers[MAX_AV_PLANES];
+	DARRAY(uint8_t)            wrap_buffers[MAX_AV_PLANES];
 	uint64_t                   base_timestamp;
 	uint64_t                   last_timestamp;
 
@@ -63,7 +72,24 @@ struct audio_line {
 
 	/* states whether this line is still being used.  if not, then when the
 	 * buffer is depleted, it's destroyed */
-	bool                       alive;
+	volatile long              alive;
+
+	/* single producer/single consumer input ring.  sample data is stored
+	 * in one byte ring per plane, timestamps in a separate packet ring.
+	 * the write side is only touched by audio_line_output, the read side
+	 * only by the audio thread. */
+	uint8_t                    *ring_data[MAX_AV_PLANES];
+	size_t                     ring_size;
+	struct audio_line_packet   packets[AUDIO_LINE_RING_PACKETS];
+	unsigned long              bytes_written;
+	volatile long              bytes_read;
+	volatile long              packets_written;
+	volatile long              packets_read;
+
+	/* packets dropped because the ring was full */
+	volatile long              overflows;
+	long                       overflows_reported;
+	bool                       ring_overflowing;
 
 	/* gets set when audio is getting cut off in the front of the buffer */
 	bool                       audio_getting_cut_off;
@@ -80,10 +106,10 @@ static inline void audio_line_destroy_data(struct audio_line *line)
 {
 	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
 		circlebuf_free(&line->buffers[i]);
-		da_free(line->volume_buffers[i]);
+		da_free(line->wrap_buffers[i]);
+		bfree(line->ring_data[i]);
 	}
 
-	pthread_mutex_destroy(&line->mutex);
 	bfree(line->name);
 	bfree(line);
 }
@@ -104,6 +130,12 @@ struct audio_output {
 
 	bool                       initialized;
 
+	/* frames mixed per audio clock tick */
+	uint32_t                   quantum_frames;
+
+	pthread_mutex_t            stats_mutex;
+	struct audio_output_stats  stats;
+
 	pthread_mutex_t            line_mutex;
 	struct audio_line          *first_line;
 
@@ -112,6 +144,8 @@ struct audio_output {
 	struct audio_mix           mixes[MAX_AUDIO_MIXES];
 };
 
+static void audio_line_drain(struct audio_line *line);
+
 static inline void audio_output_removeline(struct audio_output *audio,
 		struct audio_line *line)
 {
@@ -163,6 +197,15 @@ static inline uint64_t conv_frames_to_time(const audio_t *audio,
 		(uint64_t)audio->info.samples_per_sec;
 }
 
+/* same as above, but safe for frame counts of any length */
+static inline uint64_t conv_total_frames_to_time(const audio_t *audio,
+		uint64_t frames)
+{
+	uint64_t rate = (uint64_t)audio->info.samples_per_sec;
+	return frames / rate * 1000000000ULL +
+		frames % rate * 1000000000ULL / rate;
+}
+
 /* ------------------------------------------------------------------------- */
 
 /* this only really happens with the very initial data insertion.  can be
@@ -323,6 +366,9 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 {
 	size_t float_size = bytes / sizeof(float);
 
+	/* inputs can be connected or disconnected from other threads */
+	pthread_mutex_lock(&audio->input_mutex);
+
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
@@ -342,14 +388,14 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 			}
 		}
 	}
+
+	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
-		uint64_t prev_time)
+static void mix_and_output(struct audio_output *audio, uint64_t audio_time,
+		uint64_t prev_time, uint32_t frames)
 {
 	struct audio_line *line = audio->first_line;
-	uint32_t frames = (uint32_t)ts_diff_frames(audio, audio_time,
-	                                           prev_time);
 	size_t bytes = frames * audio->block_size;
 
 #ifdef DEBUG_AUDIO
@@ -357,10 +403,6 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 			audio_time, prev_time, bytes);
 #endif
 
-	/* return an adjusted audio_time according to the amount
-	 * of data that was sampled to ensure seamless transmission */
-	audio_time = prev_time + conv_frames_to_time(audio, frames);
-
 	/* resize and clear mix buffers */
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
@@ -375,17 +417,17 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 	while (line) {
 		struct audio_line *next = line->next;
 
+		audio_line_drain(line);
+
 		/* if line marked for removal, destroy and move to the next */
 		if (!line->buffers[0].size) {
-			if (!line->alive) {
+			if (!os_atomic_load_long(&line->alive)) {
 				audio_output_removeline(audio, line);
 				line = next;
 				continue;
 			}
 		}
 
-		pthread_mutex_lock(&line->mutex);
-
 		if (line->buffers[0].size && line->base_timestamp < prev_time) {
 			clear_excess_audio_data(line, prev_time);
 			line->base_timestamp = prev_time;
@@ -400,8 +442,6 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 		if (mix_audio_line(audio, line, bytes, prev_time))
 			line->base_timestamp = audio_time;
 
-		pthread_mutex_unlock(&line->mutex);
-
 		line = next;
 	}
 
@@ -411,39 +451,90 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 	/* output */
 	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
 		do_audio_output(audio, i, prev_time, frames);
-
-	return audio_time;
 }
 
-/* sample audio 40 times a second */
-#define AUDIO_WAIT_TIME (1000/40)
+/* the audio clock mixes whole quanta of frames, waking up exactly when the
+ * next quantum becomes due instead of polling */
+#define AUDIO_QUANTUM_FRAMES             1024
+#define AUDIO_QUANTUM_FRAMES_LOW_LATENCY 256
+
+static inline void update_stats(struct audio_output *audio, uint64_t frames,
+		uint64_t lateness)
+{
+	struct audio_output_stats *stats = &audio->stats;
+	uint64_t late_threshold =
+		conv_frames_to_time(audio, audio->quantum_frames) / 2;
+
+	pthread_mutex_lock(&audio->stats_mutex);
+
+	stats->mixes++;
+	stats->mixed_frames      += frames;
+	stats->total_lateness_ns += lateness;
+	if (lateness > stats->max_lateness_ns)
+		stats->max_lateness_ns = lateness;
+	if (lateness > late_threshold)
+		stats->late_wakeups++;
+
+	pthread_mutex_unlock(&audio->stats_mutex);
+}
 
 static void *audio_thread(void *param)
 {
 	struct audio_output *audio = param;
 	uint64_t buffer_time = audio->info.buffer_ms * 1000000;
-	uint64_t prev_time = os_gettime_ns() - buffer_time;
-	uint64_t audio_time;
+	uint64_t quantum = audio->quantum_frames;
+	uint64_t start_time = os_gettime_ns() - buffer_time;
+	uint64_t total_frames = 0;
 
 	os_set_thread_name("audio-io: audio thread");
+	os_apply_thread_class_sched(OS_THREAD_CLASS_AUDIO);
 
 	const char *audio_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
 				"audio_thread(%s)", audio->info.name);
-	
+	const char *lateness_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				"audio_thread(%s) wakeup lateness (us)",
+				audio->info.name);
+
 	while (os_event_try(audio->stop_event) == EAGAIN) {
-		os_sleep_ms(AUDIO_WAIT_TIME);
+		uint64_t prev_time = start_time +
+			conv_total_frames_to_time(audio, total_frames);
+		uint64_t deadline = start_time + buffer_time +
+			conv_total_frames_to_time(audio,
+					total_frames + quantum);
+		uint64_t audio_time, now, lateness;
+		int64_t due_frames;
+
+		os_sleepto_ns(deadline);
+
+		now = os_gettime_ns();
+		lateness = now > deadline ? now - deadline : 0;
+
+		/* mix every whole quantum that is due, so a stalled thread
+		 * catches up in a single pass without drifting */
+		due_frames = ts_diff_frames(audio, now - buffer_time,
+				start_time) - (int64_t)total_frames;
+		due_frames -= due_frames % (int64_t)quantum;
+		if (due_frames < (int64_t)quantum)
+			due_frames = (int64_t)quantum;
+
+		audio_time = start_time + conv_total_frames_to_time(audio,
+				total_frames + (uint64_t)due_frames);
 
 		profile_start(audio_thread_name);
 		pthread_mutex_lock(&audio->line_mutex);
 
-		audio_time = os_gettime_ns() - buffer_time;
-		audio_time = mix_and_output(audio, audio_time, prev_time);
-		prev_time  = audio_time;
+		mix_and_output(audio, audio_time, prev_time,
+				(uint32_t)due_frames);
 
 		pthread_mutex_unlock(&audio->line_mutex);
+		profile_record_counter(lateness_name, lateness / 1000);
 		profile_end(audio_thread_name);
 
+		total_frames += (uint64_t)due_frames;
+		update_stats(audio, (uint64_t)due_frames, lateness);
+
 		profile_reenable_thread();
 	}
 
@@ -583,6 +674,10 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 	out->planes     = planar ? out->channels : 1;
 	out->block_size = (planar ? 1 : out->channels) *
 	                  get_audio_bytes_per_channel(info->format);
+	out->quantum_frames = info->low_latency ?
+		AUDIO_QUANTUM_FRAMES_LOW_LATENCY : AUDIO_QUANTUM_FRAMES;
+	out->stats.quantum_frames = out->quantum_frames;
+	pthread_mutex_init_value(&out->stats_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
@@ -592,6 +687,8 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&out->stats_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&out->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 	if (pthread_create(&out->thread, NULL, audio_thread, out) != 0)
@@ -640,6 +737,7 @@ void audio_output_close(audio_t *audio)
 
 	os_event_destroy(audio->stop_event);
 	pthread_mutex_destroy(&audio->line_mutex);
+	pthread_mutex_destroy(&audio->stats_mutex);
 	bfree(audio);
 }
 
@@ -649,16 +747,19 @@ audio_line_t *audio_output_create_line(audio_t *audio, const char *name,
 	if (!audio) return NULL;
 
 	struct audio_line *line = bzalloc(sizeof(struct audio_line));
-	line->alive = true;
+	size_t ring_size = (size_t)audio->info.samples_per_sec *
+		AUDIO_LINE_RING_MS / 1000 * audio->block_size;
+
+	line->alive = 1;
 	line->audio = audio;
 	line->mixers = mixers;
 
-	if (pthread_mutex_init(&line->mutex, NULL) != 0) {
-		blog(LOG_ERROR, "audio_output_createline: Failed to create "
-		                "mutex");
-		bfree(line);
-		return NULL;
-	}
+	/* power of two so ring positions can wrap freely */
+	line->ring_size = 4096;
+	while (line->ring_size < ring_size)
+		line->ring_size *= 2;
+	for (size_t i = 0; i < audio->planes; i++)
+		line->ring_data[i] = bmalloc(line->ring_size);
 
 	pthread_mutex_lock(&audio->line_mutex);
 
@@ -681,14 +782,25 @@ const struct audio_output_info *audio_output_get_info(const audio_t *audio)
 	return audio ? &audio->info : NULL;
 }
 
+void audio_output_get_stats(const audio_t *audio,
+		struct audio_output_stats *stats)
+{
+	struct audio_output *out = (struct audio_output*)audio;
+
+	if (!audio || !stats)
+		return;
+
+	pthread_mutex_lock(&out->stats_mutex);
+	*stats = out->stats;
+	pthread_mutex_unlock(&out->stats_mutex);
+}
+
+/* the audio thread owns the line's buffers, so it removes the line itself
+ * once everything queued has been mixed */
 void audio_line_destroy(struct audio_line *line)
 {
-	if (line) {
-		if (!line->buffers[0].size)
-			audio_output_removeline(line->audio, line);
-		else
-			line->alive = false;
-	}
+	if (line)
+		os_atomic_set_long(&line->alive, 0);
 }
 
 bool audio_output_active(const audio_t *audio)
@@ -733,31 +845,29 @@ static inline void mul_vol_float(float *array, float volume, size_t count)
 }
 
 static void audio_line_place_data_pos(struct audio_line *line,
-		const struct audio_data *data, size_t position)
+		const struct audio_line_packet *packet, size_t ring_pos,
+		size_t position)
 {
-	bool   planar     = line->audio->planes > 1;
-	size_t total_num  = data->frames * (planar ? 1 : line->audio->channels);
-	size_t total_size = data->frames * line->audio->block_size;
+	size_t total_size = packet->frames * line->audio->block_size;
+	size_t mask       = line->ring_size - 1;
+	size_t offset     = ring_pos & mask;
 
 	for (size_t i = 0; i < line->audio->planes; i++) {
-		da_copy_array(line->volume_buffers[i], data->data[i],
-				total_size);
+		const uint8_t *array = line->ring_data[i] + offset;
+
+		/* packet wraps around the end of the ring */
+		if (offset + total_size > line->ring_size) {
+			size_t first = line->ring_size - offset;
 
-		uint8_t *array = line->volume_buffers[i].array;
-
-		switch (line->audio->info.format) {
-		case AUDIO_FORMAT_FLOAT:
-		case AUDIO_FORMAT_FLOAT_PLANAR:
-			mul_vol_float((float*)array, data->volume, total_num);
-			break;
-		default:
-			blog(LOG_ERROR, "audio_line_place_data_pos: "
-			                "Unsupported or unknown format");
-			break;
+			da_resize(line->wrap_buffers[i], total_size);
+			memcpy(line->wrap_buffers[i].array, array, first);
+			memcpy(line->wrap_buffers[i].array + first,
+					line->ring_data[i], total_size - first);
+			array = line->wrap_buffers[i].array;
 		}
 
-		circlebuf_place(&line->buffers[i], position,
-				line->volume_buffers[i].array, total_size);
+		circlebuf_place(&line->buffers[i], position, array,
+				total_size);
 	}
 }
 
@@ -781,10 +891,10 @@ static inline uint64_t smooth_ts(struct audio_line *line, uint64_t timestamp)
 }
 
 static bool audio_line_place_data(struct audio_line *line,
-		const struct audio_data *data)
+		const struct audio_line_packet *packet, size_t ring_pos)
 {
 	int64_t pos;
-	uint64_t timestamp = smooth_ts(line, data->timestamp);
+	uint64_t timestamp = smooth_ts(line, packet->timestamp);
 
 	pos = ts_diff_bytes(line->audio, timestamp, line->base_timestamp);
 
@@ -793,17 +903,17 @@ static bool audio_line_place_data(struct audio_line *line,
 	}
 
 	line->next_ts_min =
-		timestamp + conv_frames_to_time(line->audio, data->frames);
+		timestamp + conv_frames_to_time(line->audio, packet->frames);
 
 #ifdef DEBUG_AUDIO
-	blog(LOG_DEBUG, "data->timestamp: %llu, line->base_timestamp: %llu, "
+	blog(LOG_DEBUG, "packet->timestamp: %llu, line->base_timestamp: %llu, "
 			"pos: %lu, bytes: %lu, buf size: %lu",
 			timestamp, line->base_timestamp, pos,
-			data->frames * line->audio->block_size,
+			packet->frames * line->audio->block_size,
 			line->buffers[0].size);
 #endif
 
-	audio_line_place_data_pos(line, data, (size_t)pos);
+	audio_line_place_data_pos(line, packet, ring_pos, (size_t)pos);
 	return true;
 }
 
@@ -818,21 +928,18 @@ static inline bool valid_timestamp_range(struct audio_line *line, uint64_t ts)
 	return ts >= line->base_timestamp && ts < max_ts;
 }
 
-void audio_line_output(audio_line_t *line, const struct audio_data *data)
+static void audio_line_insert_packet(struct audio_line *line,
+		const struct audio_line_packet *packet, size_t ring_pos)
 {
 	bool inserted_audio = false;
 
-	if (!line || !data) return;
-
-	pthread_mutex_lock(&line->mutex);
-
 	if (!line->buffers[0].size) {
-		line->base_timestamp = data->timestamp -
+		line->base_timestamp = packet->timestamp -
 		                       line->audio->info.buffer_ms * 1000000;
-		inserted_audio = audio_line_place_data(line, data);
+		inserted_audio = audio_line_place_data(line, packet, ring_pos);
 
-	} else if (valid_timestamp_range(line, data->timestamp)) {
-		inserted_audio = audio_line_place_data(line, data);
+	} else if (valid_timestamp_range(line, packet->timestamp)) {
+		inserted_audio = audio_line_place_data(line, packet, ring_pos);
 	}
 
 	if (!inserted_audio) {
@@ -846,10 +953,10 @@ void audio_line_output(audio_line_t *line, const struct audio_data *data)
 		}
 
 		/*blog(LOG_DEBUG, "Bad timestamp for audio line '%s', "
-		                "data->timestamp: %"PRIu64", "
+		                "packet->timestamp: %"PRIu64", "
 		                "line->base_timestamp: %"PRIu64".  This can "
 		                "sometimes happen when there's a pause in "
-		                "the threads.", line->name, data->timestamp,
+		                "the threads.", line->name, packet->timestamp,
 		                line->base_timestamp);*/
 
 	} else if (line->audio_data_out_of_bounds) {
@@ -857,8 +964,126 @@ void audio_line_output(audio_line_t *line, const struct audio_data *data)
 		                  "out of bounds audio data.", line->name);
 		line->audio_data_out_of_bounds = false;
 	}
+}
+
+/* called from the audio thread: moves everything the capture thread has
+ * queued so far into the line's buffers */
+static void audio_line_drain(struct audio_line *line)
+{
+	unsigned long written = os_atomic_load_long(&line->packets_written);
+	unsigned long read    = line->packets_read;
+	unsigned long pos     = line->bytes_read;
+	long overflows;
+
+	while (read != written) {
+		const struct audio_line_packet *packet =
+			&line->packets[read % AUDIO_LINE_RING_PACKETS];
+
+		audio_line_insert_packet(line, packet, pos);
+		pos += packet->frames * (unsigned long)line->audio->block_size;
+		read++;
+	}
+
+	/* release the ring space before the packet slots so the producer can
+	 * never see a free slot without the matching bytes */
+	os_atomic_set_long(&line->bytes_read, (long)pos);
+	os_atomic_set_long(&line->packets_read, (long)read);
+
+	overflows = os_atomic_load_long(&line->overflows);
+	if (overflows != line->overflows_reported) {
+		struct audio_output *audio = line->audio;
+
+		pthread_mutex_lock(&audio->stats_mutex);
+		audio->stats.dropped_packets +=
+			(unsigned long)(overflows - line->overflows_reported);
+		pthread_mutex_unlock(&audio->stats_mutex);
+
+		line->overflows_reported = overflows;
+	}
+}
+
+static inline void audio_line_apply_volume(struct audio_line *line,
+		uint8_t *array, size_t size, float volume)
+{
+	switch (line->audio->info.format) {
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		mul_vol_float((float*)array, volume, size / sizeof(float));
+		break;
+	default:
+		blog(LOG_ERROR, "audio_line_apply_volume: "
+		                "Unsupported or unknown format");
+		break;
+	}
+}
+
+/* called from the capture thread.  there is only ever one producer per line
+ * (sources serialize their audio output), so no lock is taken here; the
+ * audio thread picks the packet up on its next mix. */
+void audio_line_output(audio_line_t *line, const struct audio_data *data)
+{
+	struct audio_line_packet *packet;
+	unsigned long packets_read;
+	unsigned long bytes_used;
+	size_t total_size;
+	size_t mask;
+	size_t offset;
+
+	if (!line || !data) return;
+
+	total_size   = data->frames * line->audio->block_size;
+	mask         = line->ring_size - 1;
+	offset       = line->bytes_written & mask;
+	packets_read = os_atomic_load_long(&line->packets_read);
+	bytes_used   = line->bytes_written -
+		(unsigned long)os_atomic_load_long(&line->bytes_read);
+
+	if ((unsigned long)line->packets_written - packets_read >=
+			AUDIO_LINE_RING_PACKETS ||
+	    bytes_used + total_size > line->ring_size) {
+		os_atomic_inc_long(&line->overflows);
+
+		if (!line->ring_overflowing) {
+			blog(LOG_WARNING, "Audio line '%s' input ring is "
+			                  "full, dropping audio data.  The "
+			                  "audio thread is not keeping up.",
+			                  line->name);
+			line->ring_overflowing = true;
+		}
+		return;
+	}
+
+	if (line->ring_overflowing) {
+		blog(LOG_WARNING, "Audio line '%s' input ring no longer "
+		                  "full.", line->name);
+		line->ring_overflowing = false;
+	}
+
+	for (size_t i = 0; i < line->audio->planes; i++) {
+		size_t first = min_size(total_size, line->ring_size - offset);
+
+		memcpy(line->ring_data[i] + offset, data->data[i], first);
+		audio_line_apply_volume(line, line->ring_data[i] + offset,
+				first, data->volume);
+
+		if (first < total_size) {
+			memcpy(line->ring_data[i], data->data[i] + first,
+					total_size - first);
+			audio_line_apply_volume(line, line->ring_data[i],
+					total_size - first, data->volume);
+		}
+	}
+
+	packet = &line->packets[line->packets_written %
+		AUDIO_LINE_RING_PACKETS];
+	packet->timestamp = data->timestamp;
+	packet->frames    = data->frames;
+
+	line->bytes_written += (unsigned long)total_size;
 
-	pthread_mutex_unlock(&line->mutex);
+	/* publishes the packet to the audio thread */
+	os_atomic_set_long(&line->packets_written,
+			(long)((unsigned long)line->packets_written + 1));
 }
 
 void audio_line_set_mixers(audio_line_t *line, uint32_t mixers)
@@ -78,6 +78,24 @@ struct audio_output_info {
 	enum audio_format   format;
 	enum speaker_layout speakers;
 	uint64_t            buffer_ms;
+
+	/* mix in smaller quanta to reduce latency at the cost of more
+	 * frequent wakeups */
+	bool                low_latency;
+};
+
+struct audio_output_stats {
+	uint32_t            quantum_frames;
+	uint64_t            mixes;
+	uint64_t            mixed_frames;
+
+	/* how late the audio thread woke up relative to its deadline */
+	uint64_t            late_wakeups;
+	uint64_t            total_lateness_ns;
+	uint64_t            max_lateness_ns;
+
+	/* packets dropped because a line's input ring was full */
+	uint64_t            dropped_packets;
 };
 
 struct audio_convert_info {
@@ -191,6 +209,8 @@ EXPORT size_t audio_output_get_channels(const audio_t *audio);
 EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
 EXPORT const struct audio_output_info *audio_output_get_info(
 		const audio_t *audio);
+EXPORT void audio_output_get_stats(const audio_t *audio,
+		struct audio_output_stats *stats);
 
 EXPORT audio_line_t *audio_output_create_line(audio_t *audio, const char *name,
 		uint32_t mixers);
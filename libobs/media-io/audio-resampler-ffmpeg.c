@@ -17,6 +17,7 @@
 
 #include "../util/bmem.h"
 #include "audio-resampler.h"
+#include "audio-conversion.h"
 #include "audio-io.h"
 #include <libavutil/avutil.h>
 #include <libavformat/avformat.h>
@@ -37,6 +38,14 @@ struct audio_resampler {
 	uint32_t            output_ch;
 	uint32_t            output_freq;
 	uint32_t            output_planes;
+
+	/* same rate and speaker layout: only the sample format and/or planar
+	 * layout differ, so swresample is bypassed entirely */
+	bool                convert_only;
+	enum audio_format   input_audio_format;
+	enum audio_format   output_audio_format;
+	uint8_t             *temp;
+	size_t              temp_size;
 };
 
 static inline enum AVSampleFormat convert_audio_format(enum audio_format format)
@@ -94,6 +103,18 @@ audio_resampler_t *audio_resampler_create(const struct resample_info *dst,
 	rs->output_format = convert_audio_format(dst->format);
 	rs->output_planes = is_audio_planar(dst->format) ? rs->output_ch : 1;
 
+	rs->input_audio_format  = src->format;
+	rs->output_audio_format = dst->format;
+	rs->convert_only =
+		src->samples_per_sec == dst->samples_per_sec &&
+		src->speakers        == dst->speakers        &&
+		src->format          != AUDIO_FORMAT_UNKNOWN &&
+		dst->format          != AUDIO_FORMAT_UNKNOWN &&
+		rs->output_ch        != 0;
+
+	if (rs->convert_only)
+		return rs;
+
 	rs->context = swr_alloc_set_opts(NULL,
 		rs->output_layout, rs->output_format, dst->samples_per_sec,
 		rs->input_layout,  rs->input_format,  src->samples_per_sec,
@@ -124,16 +145,59 @@ void audio_resampler_destroy(audio_resampler_t *rs)
 		if (rs->output_buffer[0])
 			av_freep(&rs->output_buffer[0]);
 
+		bfree(rs->temp);
 		bfree(rs);
 	}
 }
 
+static bool convert_audio(struct audio_resampler *rs,
+		uint8_t *output[], uint32_t *out_frames, uint64_t *ts_offset,
+		const uint8_t *const input[], uint32_t in_frames)
+{
+	size_t temp_size = audio_convert_temp_size(rs->output_audio_format,
+			rs->input_audio_format, rs->output_ch, in_frames);
+
+	if ((int)in_frames > rs->output_size) {
+		if (rs->output_buffer[0])
+			av_freep(&rs->output_buffer[0]);
+
+		if (av_samples_alloc(rs->output_buffer, NULL, rs->output_ch,
+				(int)in_frames, rs->output_format, 0) < 0) {
+			blog(LOG_ERROR, "av_samples_alloc failed");
+			rs->output_size = 0;
+			return false;
+		}
+
+		rs->output_size = (int)in_frames;
+	}
+
+	if (temp_size > rs->temp_size) {
+		rs->temp      = brealloc(rs->temp, temp_size);
+		rs->temp_size = temp_size;
+	}
+
+	audio_convert(rs->output_buffer, rs->output_audio_format,
+			input, rs->input_audio_format,
+			rs->output_ch, in_frames, rs->temp);
+
+	for (uint32_t i = 0; i < rs->output_planes; i++)
+		output[i] = rs->output_buffer[i];
+
+	*out_frames = in_frames;
+	*ts_offset  = 0;
+	return true;
+}
+
 bool audio_resampler_resample(audio_resampler_t *rs,
 		 uint8_t *output[], uint32_t *out_frames, uint64_t *ts_offset,
 		 const uint8_t *const input[], uint32_t in_frames)
 {
 	if (!rs) return false;
 
+	if (rs->convert_only)
+		return convert_audio(rs, output, out_frames, ts_offset, input,
+				in_frames);
+
 	struct SwrContext *context = rs->context;
 	int ret;
 
@@ -32,6 +32,9 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
 
+/* frames are often posted just as the video thread finishes the last one */
+#define UPDATE_SPIN_NS 20000
+
 struct cached_frame_info {
 	struct video_data frame;
 	int count;
@@ -164,6 +167,7 @@ static void *video_thread(void *param)
 	struct video_output *video = param;
 
 	os_set_thread_name("video-io: video thread");
+	os_apply_thread_class_sched(OS_THREAD_CLASS_VIDEO);
 
 	const char *video_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
@@ -239,6 +243,7 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		goto fail;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail;
+	os_sem_set_spin(out->update_semaphore, UPDATE_SPIN_NS);
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
 		goto fail;
 
@@ -211,9 +211,10 @@ static void signal_levels_updated(signal_handler_t *sh,
 		const float level, const float magnitude, const float peak,
 		bool muted)
 {
+	uint8_t stack[256];
 	struct calldata data;
 
-	calldata_init(&data);
+	calldata_init_fixed(&data, stack, sizeof(stack));
 
 	calldata_set_ptr  (&data, "volmeter",  volmeter);
 	calldata_set_float(&data, "level",     level);
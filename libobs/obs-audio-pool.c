@@ -0,0 +1,163 @@
+#include "util/platform.h"
+#include "util/profiler.h"
+#include "obs-internal.h"
+
+/* sources hand their captured audio to this pool instead of resampling and
+ * filtering it on the capture thread.  a source is only ever processed by
+ * one worker at a time, so its packets reach the audio line in the order
+ * they were captured.
+ *
+ * workers hold a reference to the source they process.  if the last other
+ * reference goes away meanwhile (even from a callback on the worker
+ * itself), the source is destroyed when the worker releases it, once it is
+ * no longer marked as processing. */
+
+static void *audio_pool_thread(void *param)
+{
+	struct obs_core_audio_pool *pool = &obs->audio_pool;
+	const char *worker_name = profile_store_name(
+			obs_get_profiler_name_store(),
+			"obs_audio_worker(%d)", (int)(intptr_t)param);
+
+	profile_register_root(worker_name, 0);
+	os_apply_thread_class_sched(OS_THREAD_CLASS_AUDIO);
+
+	while (os_sem_wait(pool->sem) == 0) {
+		struct obs_source *source = NULL;
+
+		if (os_atomic_load_long(&pool->stop))
+			break;
+
+		pthread_mutex_lock(&pool->mutex);
+		if (pool->ready.num) {
+			source = pool->ready.array[0];
+			da_erase(pool->ready, 0);
+
+			/* a source that is already being destroyed is
+			 * removed by obs_audio_pool_remove, which waits for
+			 * the pool mutex */
+			if (obs_source_get_ref(source)) {
+				source->audio_processing = true;
+			} else {
+				source->audio_scheduled = false;
+				source = NULL;
+			}
+		}
+		pthread_mutex_unlock(&pool->mutex);
+
+		/* the source was removed after being scheduled */
+		if (!source)
+			continue;
+
+		profile_start(worker_name);
+		obs_source_process_audio_queue(source);
+		profile_end(worker_name);
+
+		/* anything captured while processing goes back to the end of
+		 * the queue so one busy source can't starve the others */
+		pthread_mutex_lock(&pool->mutex);
+		source->audio_processing = false;
+		pthread_cond_broadcast(&pool->processed);
+		if (obs_source_audio_queue_pending(source)) {
+			da_push_back(pool->ready, &source);
+			os_sem_post(pool->sem);
+		} else {
+			source->audio_scheduled = false;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+
+		obs_source_release(source);
+		profile_reenable_thread();
+	}
+
+	return NULL;
+}
+
+bool obs_init_audio_pool(void)
+{
+	struct obs_core_audio_pool *pool = &obs->audio_pool;
+
+	pthread_mutex_init_value(&pool->mutex);
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		return false;
+	if (pthread_cond_init(&pool->processed, NULL) != 0)
+		return false;
+	pool->processed_initialized = true;
+	if (os_sem_init(&pool->sem, 0) != 0)
+		return false;
+
+	for (size_t i = 0; i < OBS_AUDIO_POOL_THREADS; i++) {
+		if (pthread_create(&pool->threads[i], NULL, audio_pool_thread,
+					(void*)(intptr_t)i) != 0) {
+			blog(LOG_ERROR, "obs_init_audio_pool: Failed to "
+			                "create worker thread %d", (int)i);
+			break;
+		}
+
+		pool->num_threads++;
+	}
+
+	pool->initialized = pool->num_threads != 0;
+	return pool->initialized;
+}
+
+void obs_free_audio_pool(void)
+{
+	struct obs_core_audio_pool *pool = &obs->audio_pool;
+	void *thread_ret;
+
+	if (pool->initialized) {
+		os_atomic_set_long(&pool->stop, 1);
+
+		for (size_t i = 0; i < pool->num_threads; i++)
+			os_sem_post(pool->sem);
+		for (size_t i = 0; i < pool->num_threads; i++)
+			pthread_join(pool->threads[i], &thread_ret);
+	}
+
+	da_free(pool->ready);
+	os_sem_destroy(pool->sem);
+	if (pool->processed_initialized)
+		pthread_cond_destroy(&pool->processed);
+	pthread_mutex_destroy(&pool->mutex);
+
+	memset(pool, 0, sizeof(*pool));
+}
+
+void obs_audio_pool_schedule(struct obs_source *source)
+{
+	struct obs_core_audio_pool *pool = &obs->audio_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (!source->audio_scheduled) {
+		source->audio_scheduled = true;
+		da_push_back(pool->ready, &source);
+		os_sem_post(pool->sem);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/* called when the source is being destroyed and its capture has already
+ * stopped.  a worker processing the source holds a reference to it, so
+ * audio_processing is only ever set here if the source was destroyed
+ * without its references being released; wait that out as well. */
+void obs_audio_pool_remove(struct obs_source *source)
+{
+	struct obs_core_audio_pool *pool = &obs->audio_pool;
+
+	if (!pool->initialized)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (source->audio_processing)
+		pthread_cond_wait(&pool->processed, &pool->mutex);
+
+	if (source->audio_scheduled) {
+		da_erase_item(pool->ready, &source);
+		source->audio_scheduled = false;
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
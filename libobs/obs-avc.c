@@ -19,6 +19,8 @@
 #include "obs-avc.h"
 #include "util/array-serializer.h"
 
+#include <emmintrin.h>
+
 bool obs_avc_keyframe(const uint8_t *data, size_t size)
 {
 	const uint8_t *nal_start, *nal_end;
@@ -44,50 +46,49 @@ bool obs_avc_keyframe(const uint8_t *data, size_t size)
 	return false;
 }
 
-/* NOTE: I noticed that FFmpeg does some unusual special handling of certain
- * scenarios that I was unaware of, so instead of just searching for {0, 0, 1}
- * we'll just use the code from FFmpeg - http://www.ffmpeg.org/ */
-static const uint8_t *ff_avc_find_startcode_internal(const uint8_t *p,
+/* returns the first {0, 0, 1} that has at least one byte after it, or end
+ * (matching the FFmpeg scanner this replaced).  each step compares 16
+ * candidate positions at once by testing the block and the same block
+ * shifted by one and two bytes, so it never reads past end. */
+static const uint8_t *find_startcode_internal(const uint8_t *p,
 		const uint8_t *end)
 {
-	const uint8_t *a = p + 4 - ((intptr_t)p & 3);
-
-	for (end -= 3; p < a && p < end; p++) {
-		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-			return p;
-	}
-
-	for (end -= 3; p < end; p += 4) {
-		uint32_t x = *(const uint32_t*)p;
-
-		if ((x - 0x01010101) & (~x) & 0x80808080) {
-			if (p[1] == 0) {
-				if (p[0] == 0 && p[2] == 1)
-					return p;
-				if (p[2] == 0 && p[3] == 1)
-					return p+1;
-			}
-
-			if (p[3] == 0) {
-				if (p[2] == 0 && p[4] == 1)
-					return p+2;
-				if (p[4] == 0 && p[5] == 1)
-					return p+3;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one  = _mm_set1_epi8(1);
+
+	while (end - p >= 19) {
+		__m128i b0 = _mm_loadu_si128((const __m128i*)p);
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(p + 1));
+		__m128i b2 = _mm_loadu_si128((const __m128i*)(p + 2));
+		int mask;
+
+		b0 = _mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+				_mm_cmpeq_epi8(b1, zero));
+		mask = _mm_movemask_epi8(_mm_and_si128(b0,
+				_mm_cmpeq_epi8(b2, one)));
+
+		if (mask) {
+			while (!(mask & 1)) {
+				mask >>= 1;
+				p++;
 			}
+			return p;
 		}
+
+		p += 16;
 	}
 
-	for (end += 3; p < end; p++) {
+	for (; end - p > 3; p++) {
 		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
 			return p;
 	}
 
-	return end + 3;
+	return end;
 }
 
 const uint8_t *obs_avc_find_startcode(const uint8_t *p, const uint8_t *end)
 {
-	const uint8_t *out= ff_avc_find_startcode_internal(p, end);
+	const uint8_t *out = find_startcode_internal(p, end);
 	if (p < out && out < end && !out[-1]) out--;
 	return out;
 }
@@ -138,15 +139,30 @@ void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 	struct array_output_data output;
 	struct serializer s;
 
-	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
+	/* already length-prefixed, the encoder filled in the rest */
+	if (src->avcc) {
+		avc_packet->data          = bmemdup(src->data, src->size);
+		avc_packet->drop_priority = get_drop_priority(src->priority);
+		obs_frame_stats_add_copied_bytes(src->size);
+		return;
+	}
+
+	array_output_serializer_init(&s, &output);
+
+	/* 4 byte start codes become 4 byte sizes, 3 byte ones grow by one */
+	da_reserve(output.bytes, src->size + 64);
+
 	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
 			&avc_packet->priority);
 
 	avc_packet->data          = output.bytes.array;
 	avc_packet->size          = output.bytes.num;
+	avc_packet->avcc          = true;
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
+
+	obs_frame_stats_add_copied_bytes(avc_packet->size);
 }
 
 static inline bool has_start_code(const uint8_t *data)
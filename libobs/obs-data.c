@@ -1472,6 +1472,11 @@ enum obs_data_type obs_data_item_gettype(obs_data_item_t *item)
 	return item ? item->type : OBS_DATA_NULL;
 }
 
+const char *obs_data_item_get_name(obs_data_item_t *item)
+{
+	return item ? get_item_name(item) : NULL;
+}
+
 enum obs_data_number_type obs_data_item_numtype(obs_data_item_t *item)
 {
 	struct obs_data_number *num;
@@ -194,6 +194,7 @@ EXPORT void obs_data_item_remove(obs_data_item_t **item);
 /* Gets Item type */
 EXPORT enum obs_data_type obs_data_item_gettype(obs_data_item_t *item);
 EXPORT enum obs_data_number_type obs_data_item_numtype(obs_data_item_t *item);
+EXPORT const char *obs_data_item_get_name(obs_data_item_t *item);
 
 /* Item set functions */
 EXPORT void obs_data_item_set_string(obs_data_item_t **item, const char *val);
@@ -17,6 +17,7 @@
 
 #include "obs.h"
 #include "obs-internal.h"
+#include "obs-avc.h"
 
 
 /*
@@ -26,14 +27,11 @@
 
 struct obs_encoder_info *find_encoder(const char *id)
 {
-	for (size_t i = 0; i < obs->encoder_types.num; i++) {
-		struct obs_encoder_info *info = obs->encoder_types.array+i;
+	obs_module_note_type_lookup(id);
 
-		if (strcmp(info->id, id) == 0)
-			return info;
-	}
-
-	return NULL;
+	return obs_type_index_find(&obs->encoder_type_index,
+			&obs->encoder_types.da, sizeof(struct obs_encoder_info),
+			id);
 }
 
 const char *obs_encoder_get_display_name(const char *id)
@@ -109,7 +107,8 @@ static struct obs_encoder *create_encoder(const char *id,
 
 	obs_context_data_insert(&encoder->context,
 			&obs->data.encoders_mutex,
-			&obs->data.first_encoder);
+			&obs->data.first_encoder,
+			&obs->data.encoder_names);
 
 	blog(LOG_INFO, "encoder '%s' (%s) created", name, id);
 	return encoder;
@@ -325,10 +324,22 @@ obs_properties_t *obs_encoder_properties(const obs_encoder_t *encoder)
 	return NULL;
 }
 
+static bool settings_would_change(obs_encoder_t *encoder,
+		obs_data_t *settings);
+
 void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings)
 {
 	if (!encoder) return;
 
+	/* outputs sharing this encoder didn't ask for the new settings */
+	if (os_atomic_load_long(&encoder->shared_outputs) &&
+	    settings_would_change(encoder, settings)) {
+		blog(LOG_WARNING, "encoder '%s': Cannot change the settings "
+		                  "while other outputs share the encoder",
+		                  obs_encoder_get_name(encoder));
+		return;
+	}
+
 	obs_data_apply(encoder->context.settings, settings);
 
 	if (encoder->info.update && encoder->context.data)
@@ -632,8 +643,27 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 		return;
 	}
 
-	da_push_back_array(data, sei, size);
+	da_reserve(data, size + packet->size + 16);
+
+	/* the SEI comes from the encoder in annex-b form, so it has to be
+	 * converted to match a packet that is already length prefixed */
+	if (packet->avcc) {
+		struct encoder_packet sei_packet = {0};
+		struct encoder_packet avcc_sei;
+
+		sei_packet.data = sei;
+		sei_packet.size = size;
+		sei_packet.type = OBS_ENCODER_VIDEO;
+
+		obs_parse_avc_packet(&avcc_sei, &sei_packet);
+		da_push_back_array(data, avcc_sei.data, avcc_sei.size);
+		obs_free_encoder_packet(&avcc_sei);
+	} else {
+		da_push_back_array(data, sei, size);
+	}
+
 	da_push_back_array(data, packet->data, packet->size);
+	obs_frame_stats_add_copied_bytes(data.num);
 
 	first_packet      = *packet;
 	first_packet.data = data.array;
@@ -706,6 +736,14 @@ static inline void do_encode(struct obs_encoder *encoder,
 		 * you do not want to use relative timestamps here */
 		pkt.dts_usec = encoder->start_ts / 1000 + packet_dts_usec(&pkt);
 
+		if (pkt.type == OBS_ENCODER_VIDEO && pkt.pts >= 0) {
+			pkt.frame_ts = encoder->start_ts + (uint64_t)(
+				(double)pkt.pts * 1000000000.0 /
+				(double)pkt.timebase_den);
+			obs_frame_stats_record(OBS_FRAME_STAGE_ENCODED,
+					pkt.frame_ts);
+		}
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
@@ -738,6 +776,8 @@ static void receive_video(void *param, struct video_data *frame)
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
+	obs_frame_stats_record(OBS_FRAME_STAGE_ENCODE_START, frame->timestamp);
+
 	enc_frame.frames = 1;
 	enc_frame.pts    = encoder->cur_pts;
 
@@ -867,6 +907,9 @@ void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 {
 	*dst = *src;
 	dst->data = bmemdup(src->data, src->size);
+
+	if (src->type == OBS_ENCODER_VIDEO)
+		obs_frame_stats_add_copied_bytes(src->size);
 }
 
 void obs_free_encoder_packet(struct encoder_packet *packet)
@@ -973,3 +1016,175 @@ void *obs_encoder_get_type_data(obs_encoder_t *encoder)
 	return obs_encoder_valid(encoder, "obs_encoder_get_type_data")
 		? encoder->info.type_data : NULL;
 }
+
+/* ------------------------------------------------------------------------- */
+/* Encoder sharing */
+
+static int cmp_setting_str(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+static void append_item_value(struct dstr *str, obs_data_item_t *item)
+{
+	obs_data_t       *obj;
+	obs_data_array_t *array;
+
+	switch (obs_data_item_gettype(item)) {
+	case OBS_DATA_STRING:
+		dstr_cat(str, obs_data_item_get_string(item));
+		break;
+
+	case OBS_DATA_NUMBER:
+		if (obs_data_item_numtype(item) == OBS_DATA_NUM_INT)
+			dstr_catf(str, "%lld", obs_data_item_get_int(item));
+		else
+			dstr_catf(str, "%g", obs_data_item_get_double(item));
+		break;
+
+	case OBS_DATA_BOOLEAN:
+		dstr_cat(str, obs_data_item_get_bool(item) ? "true" : "false");
+		break;
+
+	case OBS_DATA_OBJECT:
+		obj = obs_data_item_get_obj(item);
+		dstr_cat(str, obs_data_get_json(obj));
+		obs_data_release(obj);
+		break;
+
+	case OBS_DATA_ARRAY:
+		array = obs_data_item_get_array(item);
+		for (size_t i = 0; i < obs_data_array_count(array); i++) {
+			obj = obs_data_array_item(array, i);
+			dstr_cat(str, obs_data_get_json(obj));
+			obs_data_release(obj);
+		}
+		obs_data_array_release(array);
+		break;
+
+	case OBS_DATA_NULL:
+		break;
+	}
+}
+
+/* whether applying settings would change any of the encoder's effective
+ * settings */
+static bool settings_would_change(obs_encoder_t *encoder,
+		obs_data_t *settings)
+{
+	obs_data_item_t *item = obs_data_first(settings);
+	struct dstr new_value = {0};
+	struct dstr cur_value = {0};
+	bool changed = false;
+
+	for (; item != NULL && !changed; obs_data_item_next(&item)) {
+		const char *name = obs_data_item_get_name(item);
+		obs_data_item_t *cur = obs_data_item_byname(
+				encoder->context.settings, name);
+
+		if (!obs_data_item_has_user_value(item)) {
+			obs_data_item_release(&cur);
+			continue;
+		}
+
+		if (!cur) {
+			changed = true;
+			continue;
+		}
+
+		dstr_free(&new_value);
+		dstr_free(&cur_value);
+		append_item_value(&new_value, item);
+		append_item_value(&cur_value, cur);
+		changed = dstr_cmp(&new_value, cur_value.array) != 0;
+
+		obs_data_item_release(&cur);
+	}
+
+	obs_data_item_release(&item);
+	dstr_free(&new_value);
+	dstr_free(&cur_value);
+	return changed;
+}
+
+/* builds a canonical string from the encoder id and its effective settings
+ * (user values with defaults applied, sorted by name) so that equal settings
+ * compare equal regardless of the order or the way they were set */
+static void get_normalized_settings(obs_encoder_t *encoder, struct dstr *str)
+{
+	obs_data_item_t *item = obs_data_first(encoder->context.settings);
+	DARRAY(char*) values;
+
+	da_init(values);
+
+	for (; item != NULL; obs_data_item_next(&item)) {
+		struct dstr value = {0};
+
+		dstr_printf(&value, "%s=", obs_data_item_get_name(item));
+		append_item_value(&value, item);
+		da_push_back(values, &value.array);
+	}
+
+	qsort(values.array, values.num, sizeof(char*), cmp_setting_str);
+
+	dstr_copy(str, encoder->info.id);
+	dstr_cat_ch(str, '\n');
+
+	for (size_t i = 0; i < values.num; i++) {
+		dstr_cat(str, values.array[i]);
+		dstr_cat_ch(str, '\n');
+		bfree(values.array[i]);
+	}
+
+	da_free(values);
+}
+
+static inline bool same_video_output(const obs_encoder_t *a,
+		const obs_encoder_t *b)
+{
+	return a->media == b->media &&
+	       obs_encoder_get_width(a)  == obs_encoder_get_width(b) &&
+	       obs_encoder_get_height(a) == obs_encoder_get_height(b) &&
+	       a->preferred_format == b->preferred_format;
+}
+
+obs_encoder_t *obs_encoder_find_shareable(obs_encoder_t *encoder)
+{
+	struct obs_encoder *cur;
+	struct obs_encoder *shared = NULL;
+	struct dstr        key     = {0};
+	struct dstr        cur_key = {0};
+
+	if (!obs || !encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return NULL;
+
+	pthread_mutex_lock(&obs->data.encoders_mutex);
+
+	cur = obs->data.first_encoder;
+	while (cur) {
+		if (cur != encoder && cur->active &&
+		    cur->info.type == OBS_ENCODER_VIDEO &&
+		    strcmp(cur->info.id, encoder->info.id) == 0 &&
+		    same_video_output(cur, encoder)) {
+			if (dstr_is_empty(&key))
+				get_normalized_settings(encoder, &key);
+			get_normalized_settings(cur, &cur_key);
+
+			/* taken under the mutex so the encoder can't be
+			 * destroyed before the caller gets to use it */
+			if (dstr_cmp(&key, cur_key.array) == 0) {
+				shared = obs_encoder_get_ref(cur);
+				if (shared)
+					break;
+			}
+		}
+
+		cur = (struct obs_encoder*)cur->context.next;
+	}
+
+	pthread_mutex_unlock(&obs->data.encoders_mutex);
+
+	dstr_free(&key);
+	dstr_free(&cur_key);
+	return shared;
+}
@@ -50,6 +50,13 @@ struct encoder_packet {
 
 	bool                  keyframe;     /**< Is a keyframe */
 
+	/**
+	 * Video data is length-prefixed (AVCC) rather than Annex-B, and the
+	 * encoder has already set keyframe and priority.  Outputs can use it
+	 * without scanning for start codes.
+	 */
+	bool                  avcc;
+
 	/* ---------------------------------------------------------------- */
 	/* Internal video variables (will be parsed automatically) */
 
@@ -77,6 +84,13 @@ struct encoder_packet {
 
 	/** Encoder from which the track originated from */
 	obs_encoder_t         *encoder;
+
+	/**
+	 * Video clock timestamp (in nanoseconds) of the raw frame this packet
+	 * was encoded from, used to trace frame latency (video only, set
+	 * automatically)
+	 */
+	uint64_t              frame_ts;
 };
 
 /** Encoder input frame */
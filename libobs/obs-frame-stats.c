@@ -0,0 +1,229 @@
+#include "util/dstr.h"
+#include "util/platform.h"
+#include "obs-internal.h"
+
+static const char *stage_names[OBS_FRAME_STAGE_COUNT] = {
+	"rendered",
+	"encode_start",
+	"encoded",
+	"interleaved",
+	"sent"
+};
+
+static const char *drop_names[OBS_FRAME_DROP_COUNT] = {
+	"render_lag_drops",
+	"encoder_lag_drops",
+	"network_drops"
+};
+
+static inline size_t latency_bucket(uint64_t latency_ns)
+{
+	uint64_t ms = latency_ns / 1000000;
+	size_t bucket = 0;
+
+	while (ms && bucket < OBS_LATENCY_BUCKETS - 1) {
+		ms >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static inline uint64_t bucket_upper_bound_ns(size_t bucket)
+{
+	return ((uint64_t)1 << bucket) * 1000000;
+}
+
+void obs_frame_stats_record(enum obs_frame_stage stage, uint64_t frame_ts)
+{
+	struct obs_latency_histogram *histogram;
+	uint64_t now;
+	uint64_t latency;
+
+	if (!obs || !frame_ts || stage >= OBS_FRAME_STAGE_COUNT)
+		return;
+
+	now = os_gettime_ns();
+	latency = now > frame_ts ? now - frame_ts : 0;
+
+	pthread_mutex_lock(&obs->data.frame_stats_mutex);
+
+	histogram = &obs->data.frame_stats.latency[stage];
+	obs_latency_histogram_add(histogram, latency);
+
+	if (stage == OBS_FRAME_STAGE_RENDERED)
+		obs->data.frame_stats.rendered_frames++;
+
+	pthread_mutex_unlock(&obs->data.frame_stats_mutex);
+}
+
+void obs_frame_stats_add_drops(enum obs_frame_drop_cause cause,
+		uint64_t count)
+{
+	if (!obs || !count || cause >= OBS_FRAME_DROP_COUNT)
+		return;
+
+	pthread_mutex_lock(&obs->data.frame_stats_mutex);
+	obs->data.frame_stats.drops[cause] += count;
+	pthread_mutex_unlock(&obs->data.frame_stats_mutex);
+}
+
+void obs_frame_stats_add_copied_bytes(uint64_t bytes)
+{
+	if (!obs || !bytes)
+		return;
+
+	pthread_mutex_lock(&obs->data.frame_stats_mutex);
+	obs->data.frame_stats.video_bytes_copied += bytes;
+	pthread_mutex_unlock(&obs->data.frame_stats_mutex);
+}
+
+void obs_get_frame_stats(struct obs_frame_stats *stats)
+{
+	if (!stats)
+		return;
+
+	if (!obs) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	pthread_mutex_lock(&obs->data.frame_stats_mutex);
+	*stats = obs->data.frame_stats;
+	pthread_mutex_unlock(&obs->data.frame_stats_mutex);
+}
+
+void obs_reset_frame_stats(void)
+{
+	if (!obs)
+		return;
+
+	pthread_mutex_lock(&obs->data.frame_stats_mutex);
+	memset(&obs->data.frame_stats, 0, sizeof(obs->data.frame_stats));
+	pthread_mutex_unlock(&obs->data.frame_stats_mutex);
+}
+
+void obs_latency_histogram_add(struct obs_latency_histogram *histogram,
+		uint64_t latency_ns)
+{
+	histogram->count++;
+	histogram->total_ns += latency_ns;
+	histogram->buckets[latency_bucket(latency_ns)]++;
+	if (histogram->max_ns < latency_ns)
+		histogram->max_ns = latency_ns;
+}
+
+uint64_t obs_latency_histogram_percentile(
+		const struct obs_latency_histogram *histogram,
+		double percentile)
+{
+	uint64_t target;
+	uint64_t accum = 0;
+
+	if (!histogram || !histogram->count)
+		return 0;
+
+	target = (uint64_t)((double)histogram->count * percentile + 0.5);
+	if (!target)
+		target = 1;
+
+	for (size_t i = 0; i < OBS_LATENCY_BUCKETS; i++) {
+		accum += histogram->buckets[i];
+		if (accum >= target)
+			return i == OBS_LATENCY_BUCKETS - 1 ?
+				histogram->max_ns : bucket_upper_bound_ns(i);
+	}
+
+	return histogram->max_ns;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline double ns_to_ms(uint64_t ns)
+{
+	return (double)ns / 1000000.0;
+}
+
+static void set_stage_stats(calldata_t *cd, const char *stage,
+		const struct obs_latency_histogram *histogram,
+		struct dstr *name)
+{
+	double avg = histogram->count ?
+		ns_to_ms(histogram->total_ns / histogram->count) : 0.0;
+
+	dstr_printf(name, "%s_count", stage);
+	calldata_set_int(cd, name->array, (long long)histogram->count);
+	dstr_printf(name, "%s_avg_ms", stage);
+	calldata_set_float(cd, name->array, avg);
+	dstr_printf(name, "%s_p50_ms", stage);
+	calldata_set_float(cd, name->array, ns_to_ms(
+			obs_latency_histogram_percentile(histogram, 0.5)));
+	dstr_printf(name, "%s_p99_ms", stage);
+	calldata_set_float(cd, name->array, ns_to_ms(
+			obs_latency_histogram_percentile(histogram, 0.99)));
+	dstr_printf(name, "%s_max_ms", stage);
+	calldata_set_float(cd, name->array, ns_to_ms(histogram->max_ns));
+}
+
+static void get_frame_stats_proc(void *data, calldata_t *cd)
+{
+	struct obs_frame_stats stats;
+	struct dstr name = {0};
+
+	obs_get_frame_stats(&stats);
+
+	calldata_set_int(cd, "rendered_frames",
+			(long long)stats.rendered_frames);
+
+	for (size_t i = 0; i < OBS_FRAME_DROP_COUNT; i++)
+		calldata_set_int(cd, drop_names[i], (long long)stats.drops[i]);
+
+	calldata_set_int(cd, "video_bytes_copied",
+			(long long)stats.video_bytes_copied);
+
+	for (size_t i = 0; i < OBS_FRAME_STAGE_COUNT; i++)
+		set_stage_stats(cd, stage_names[i], &stats.latency[i], &name);
+
+	dstr_free(&name);
+	UNUSED_PARAMETER(data);
+}
+
+static void reset_frame_stats_proc(void *data, calldata_t *cd)
+{
+	obs_reset_frame_stats();
+
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(cd);
+}
+
+void obs_frame_stats_add_procs(proc_handler_t *handler)
+{
+	static const char *stage_fields[] = {
+		"int %s_count", "float %s_avg_ms", "float %s_p50_ms",
+		"float %s_p99_ms", "float %s_max_ms"
+	};
+	struct dstr decl = {0};
+
+	dstr_copy(&decl, "void get_frame_stats(out int rendered_frames");
+
+	for (size_t i = 0; i < OBS_FRAME_DROP_COUNT; i++)
+		dstr_catf(&decl, ", out int %s", drop_names[i]);
+
+	dstr_cat(&decl, ", out int video_bytes_copied");
+
+	for (size_t i = 0; i < OBS_FRAME_STAGE_COUNT; i++) {
+		for (size_t j = 0; j < sizeof(stage_fields) /
+				sizeof(stage_fields[0]); j++) {
+			dstr_cat(&decl, ", out ");
+			dstr_catf(&decl, stage_fields[j], stage_names[i]);
+		}
+	}
+
+	dstr_cat(&decl, ")");
+
+	proc_handler_add(handler, decl.array, get_frame_stats_proc, NULL);
+	proc_handler_add(handler, "void reset_frame_stats()",
+			reset_frame_stats_proc, NULL);
+
+	dstr_free(&decl);
+}
@@ -36,6 +36,10 @@
 #include "obs.h"
 
 #define NUM_TEXTURES 2
+
+/* bounds for obs_video_info::readback_depth */
+#define DEFAULT_READBACK_DEPTH 3
+#define MAX_READBACK_DEPTH     8
 #define MICROSECOND_DEN 1000000
 
 static inline int64_t packet_dts_usec(struct encoder_packet *packet)
@@ -43,6 +47,9 @@ static inline int64_t packet_dts_usec(struct encoder_packet *packet)
 	return packet->dts * MICROSECOND_DEN / packet->timebase_den;
 }
 
+/* in obs-frame-stats.c */
+extern void obs_frame_stats_add_procs(proc_handler_t *handler);
+
 struct draw_callback {
 	void (*draw)(void *param, uint32_t cx, uint32_t cy);
 	void *param;
@@ -103,11 +110,30 @@ struct obs_module {
 	const char *(*description)(void);
 	const char *(*author)(void);
 
+	/* ids of the types registered by obs_module_load, for the cache */
+	DARRAY(char*) types;
+
 	struct obs_module *next;
 };
 
 extern void free_module(struct obs_module *mod);
 
+/* a module the module cache says isn't needed yet, see obs-module-loader.c */
+struct obs_deferred_module {
+	char          *bin_path;
+	char          *data_path;
+	DARRAY(char*) types;
+};
+
+extern int obs_open_module_file(struct obs_module **module, const char *path,
+		const char *data_path);
+extern void obs_link_module(struct obs_module *module);
+
+extern bool obs_init_module_loader(void);
+extern void obs_free_module_loader(void);
+extern void obs_module_add_type(const char *id);
+extern void obs_module_note_type_lookup(const char *id);
+
 struct obs_module_path {
 	char *bin;
 	char *data;
@@ -231,15 +257,36 @@ struct obs_vframe_info {
 	int count;
 };
 
+/* conversion effect handles, resolved once instead of by name each frame */
+struct obs_conversion_params {
+	gs_technique_t                  *tech;
+	gs_eparam_t                     *image;
+	gs_eparam_t                     *u_plane_offset;
+	gs_eparam_t                     *v_plane_offset;
+	gs_eparam_t                     *width;
+	gs_eparam_t                     *height;
+	gs_eparam_t                     *width_i;
+	gs_eparam_t                     *height_i;
+	gs_eparam_t                     *width_d2;
+	gs_eparam_t                     *height_d2;
+	gs_eparam_t                     *width_d2_i;
+	gs_eparam_t                     *height_d2_i;
+	gs_eparam_t                     *input_width;
+	gs_eparam_t                     *input_height;
+	gs_eparam_t                     *input_width_i;
+	gs_eparam_t                     *input_height_i;
+	gs_eparam_t                     *input_width_i_d2;
+	gs_eparam_t                     *input_height_i_d2;
+};
+
 struct obs_core_video {
 	graphics_t                      *graphics;
-	gs_stagesurf_t                  *copy_surfaces[NUM_TEXTURES];
+	gs_stagesurf_t                  *copy_surfaces[MAX_READBACK_DEPTH];
 	gs_texture_t                    *render_textures[NUM_TEXTURES];
 	gs_texture_t                    *output_textures[NUM_TEXTURES];
 	gs_texture_t                    *convert_textures[NUM_TEXTURES];
 	bool                            textures_rendered[NUM_TEXTURES];
 	bool                            textures_output[NUM_TEXTURES];
-	bool                            textures_copied[NUM_TEXTURES];
 	bool                            textures_converted[NUM_TEXTURES];
 	struct circlebuf                vframe_info_buffer;
 	gs_effect_t                     *default_effect;
@@ -250,9 +297,17 @@ struct obs_core_video {
 	gs_effect_t                     *bicubic_effect;
 	gs_effect_t                     *lanczos_effect;
 	gs_effect_t                     *bilinear_lowres_effect;
-	gs_stagesurf_t                  *mapped_surface;
 	int                             cur_texture;
 
+	/* readback ring: output frames are staged into copy_surfaces in
+	 * order and mapped from copy_read once the GPU is done with them.
+	 * the surfaces mapped in one frame stay mapped until the next. */
+	gs_stagesurf_t                  *mapped_surfaces[MAX_READBACK_DEPTH];
+	size_t                          num_mapped_surfaces;
+	uint32_t                        readback_depth;
+	uint32_t                        copy_read;
+	uint32_t                        copy_pending;
+
 	uint64_t                        video_time;
 	video_t                         *video;
 	pthread_t                       video_thread;
@@ -260,6 +315,7 @@ struct obs_core_video {
 
 	bool                            gpu_conversion;
 	const char                      *conversion_tech;
+	struct obs_conversion_params    conversion_params;
 	uint32_t                        conversion_height;
 	uint32_t                        plane_offsets[3];
 	uint32_t                        plane_sizes[3];
@@ -281,6 +337,84 @@ struct obs_core_audio {
 	float                           present_volume;
 };
 
+/* workers that resample and filter captured source audio */
+#define OBS_AUDIO_POOL_THREADS 2
+
+struct obs_core_audio_pool {
+	pthread_t                       threads[OBS_AUDIO_POOL_THREADS];
+	size_t                          num_threads;
+	os_sem_t                        *sem;
+	volatile long                   stop;
+	bool                            initialized;
+
+	/* sources with queued audio, in the order they were scheduled */
+	pthread_mutex_t                 mutex;
+	DARRAY(struct obs_source*)      ready;
+
+	/* broadcast with mutex held whenever a worker finishes a source */
+	pthread_cond_t                  processed;
+	bool                            processed_initialized;
+};
+
+extern bool obs_init_audio_pool(void);
+extern void obs_free_audio_pool(void);
+extern void obs_audio_pool_schedule(struct obs_source *source);
+extern void obs_audio_pool_remove(struct obs_source *source);
+
+/* ------------------------------------------------------------------------- */
+/* hashed lookups (obs-registry.c) */
+
+static inline uint32_t obs_hash_string(const char *str)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*str) {
+		hash ^= (uint8_t)*(str++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/* id -> registered type.  every *_info structure starts with its id, the
+ * table stores indices into the type array (+1, 0 being empty). */
+struct obs_type_index {
+	size_t                          *slots;
+	size_t                          num_slots;
+	size_t                          num;
+};
+
+extern void obs_type_index_update(struct obs_type_index *index,
+		const struct darray *types, size_t type_size);
+extern void *obs_type_index_find(const struct obs_type_index *index,
+		const struct darray *types, size_t type_size, const char *id);
+extern void obs_type_index_free(struct obs_type_index *index);
+
+/* name -> context, chained through obs_context_data::name_next.  the index
+ * is only touched with its mutex held.  when several contexts share a name,
+ * chains are kept in insertion order so lookups return the oldest one, or
+ * the newest one with newest_first, the same as the lists they index.
+ * renaming a context keeps its place in that order. */
+struct obs_context_data;
+
+struct obs_name_index {
+	pthread_mutex_t                 *mutex;
+	struct obs_context_data         **buckets;
+	size_t                          num_buckets;
+	size_t                          num;
+	uint64_t                        next_seq;
+	bool                            newest_first;
+};
+
+extern void obs_name_index_init(struct obs_name_index *index,
+		pthread_mutex_t *mutex, bool newest_first);
+extern void obs_name_index_free(struct obs_name_index *index);
+extern void obs_name_index_insert(struct obs_name_index *index,
+		struct obs_context_data *context);
+extern void obs_name_index_remove(struct obs_context_data *context);
+extern struct obs_context_data *obs_name_index_find(
+		const struct obs_name_index *index, const char *name);
+
 /* user sources, output channels, and displays */
 struct obs_core_data {
 	pthread_mutex_t                 user_sources_mutex;
@@ -298,8 +432,21 @@ struct obs_core_data {
 	pthread_mutex_t                 encoders_mutex;
 	pthread_mutex_t                 services_mutex;
 
+	/* user sources by name (source_names_mutex), outputs, encoders and
+	 * services by name (their list mutexes).  source_names_mutex is only
+	 * ever taken last, so it can be locked from under sources_mutex
+	 * (tick callbacks) and user_sources_mutex (enum and load) alike. */
+	pthread_mutex_t                 source_names_mutex;
+	struct obs_name_index           source_names;
+	struct obs_name_index           output_names;
+	struct obs_name_index           encoder_names;
+	struct obs_name_index           service_names;
+
 	struct obs_view                 main_view;
 
+	pthread_mutex_t                 frame_stats_mutex;
+	struct obs_frame_stats          frame_stats;
+
 	volatile long                   active_transitions;
 
 	long long                       unnamed_index;
@@ -346,6 +493,23 @@ struct obs_core {
 	struct obs_module               *first_module;
 	DARRAY(struct obs_module_path)  module_paths;
 
+	/* held while a module initializes, loading_module is the module whose
+	 * obs_module_load is running */
+	pthread_mutex_t                 modules_mutex;
+	struct obs_module               *loading_module;
+
+	/* the type arrays are read without locking, so deferred modules are
+	 * only loaded on the thread that loaded the others */
+	DARRAY(struct obs_deferred_module) deferred_modules;
+	pthread_t                       modules_thread;
+	bool                            modules_thread_set;
+
+	/* type ids looked up before the deferred modules are loaded.  they
+	 * are saved to the module cache, and the next start loads their
+	 * modules up front.  protected by modules_mutex */
+	DARRAY(char*)                   startup_types;
+	volatile long                   startup_types_saved;
+
 	DARRAY(struct obs_source_info)  input_types;
 	DARRAY(struct obs_source_info)  filter_types;
 	DARRAY(struct obs_source_info)  transition_types;
@@ -355,6 +519,13 @@ struct obs_core {
 	DARRAY(struct obs_modal_ui)     modal_ui_callbacks;
 	DARRAY(struct obs_modeless_ui)  modeless_ui_callbacks;
 
+	struct obs_type_index           input_type_index;
+	struct obs_type_index           filter_type_index;
+	struct obs_type_index           transition_type_index;
+	struct obs_type_index           output_type_index;
+	struct obs_type_index           encoder_type_index;
+	struct obs_type_index           service_type_index;
+
 	signal_handler_t                *signals;
 	proc_handler_t                  *procs;
 
@@ -367,6 +538,7 @@ struct obs_core {
 	 * clean and organized */
 	struct obs_core_video           video;
 	struct obs_core_audio           audio;
+	struct obs_core_audio_pool      audio_pool;
 	struct obs_core_data            data;
 	struct obs_core_hotkeys         hotkeys;
 };
@@ -401,6 +573,11 @@ struct obs_context_data {
 	pthread_mutex_t                 *mutex;
 	struct obs_context_data         *next;
 	struct obs_context_data         **prev_next;
+
+	struct obs_name_index           *name_index;
+	uint64_t                        name_seq;
+	struct obs_context_data         *name_next;
+	uint32_t                        name_hash;
 };
 
 extern bool obs_context_data_init(
@@ -411,7 +588,8 @@ extern bool obs_context_data_init(
 extern void obs_context_data_free(struct obs_context_data *context);
 
 extern void obs_context_data_insert(struct obs_context_data *context,
-		pthread_mutex_t *mutex, void *first);
+		pthread_mutex_t *mutex, void *first,
+		struct obs_name_index *names);
 extern void obs_context_data_remove(struct obs_context_data *context);
 
 extern void obs_context_data_setname(struct obs_context_data *context,
@@ -528,6 +706,19 @@ struct obs_source {
 	float                           present_volume;
 	int64_t                         sync_offset;
 
+	/* captured audio waiting for the audio pool.  audio_scheduled and
+	 * audio_processing are protected by the pool mutex */
+	pthread_mutex_t                 audio_queue_mutex;
+	struct circlebuf                audio_queue;
+	size_t                          audio_queue_packets;
+	bool                            audio_queue_overflowing;
+	DARRAY(uint8_t)                 audio_queue_data[MAX_AV_PLANES];
+	bool                            audio_scheduled;
+	bool                            audio_processing;
+
+	/* profiler entry used when this source runs as an audio filter */
+	const char                      *audio_filter_profile_name;
+
 	/* async video data */
 	gs_texture_t                    *async_texture;
 	gs_texrender_t                  *async_convert_texrender;
@@ -575,10 +766,17 @@ struct obs_source {
 	uint64_t                        push_to_talk_delay;
 	uint64_t                        push_to_talk_stop_time;
 
-	/* referred by output channel flag */
-	bool                            ref_by_output_flag;
+	/* number of edges leading to the source from the output channels, the
+	 * source is only ticked while this is non-zero */
+	volatile long                   output_refs;
+
+	/* children added with obs_source_add_child (filter_mutex, not used
+	 * by scenes), each holding a reference.  These are the edges
+	 * output_refs follows besides scene items and filters. */
+	DARRAY(struct obs_source*)      child_sources;
 };
 
+extern struct obs_type_index *get_source_type_index(struct darray *list);
 extern const struct obs_source_info *find_source(struct darray *list,
 		const char *id);
 extern bool obs_source_init_context(struct obs_source *source,
@@ -589,6 +787,9 @@ extern bool obs_source_init(struct obs_source *source,
 
 extern void obs_source_destroy(struct obs_source *source);
 
+extern void obs_source_process_audio_queue(struct obs_source *source);
+extern bool obs_source_audio_queue_pending(struct obs_source *source);
+
 enum view_type {
 	MAIN_VIEW,
 	AUX_VIEW
@@ -600,7 +801,10 @@ extern void obs_source_video_tick(obs_source_t *source, float seconds);
 extern float obs_source_get_target_volume(obs_source_t *source,
 		obs_source_t *target);
 
-extern void obs_mark_output_sources(bool always_mark_async_source);
+extern void obs_source_add_output_ref(obs_source_t *source);
+extern void obs_source_remove_output_ref(obs_source_t *source);
+extern void obs_scene_add_output_ref(obs_scene_t *scene);
+extern void obs_scene_remove_output_ref(obs_scene_t *scene);
 
 /* ------------------------------------------------------------------------- */
 /* outputs  */
@@ -664,6 +868,12 @@ struct obs_output {
 	obs_service_t                   *service;
 	size_t                          mixer_idx;
 
+	/* while video_encoder is another output's encoder (holding a
+	 * reference to it), the encoder set on this output */
+	bool                            video_encoder_shared;
+	obs_encoder_t                   *own_video_encoder;
+	bool                            video_encoder_sharing_disabled;
+
 	uint32_t                        scaled_width;
 	uint32_t                        scaled_height;
 
@@ -767,6 +977,11 @@ struct obs_encoder {
 
 	bool                            destroy_on_stop;
 
+	/* number of outputs using this encoder in place of their own one
+	 * (see obs_encoder_find_shareable).  changing the settings while
+	 * this is nonzero would change their streams as well. */
+	volatile long                   shared_outputs;
+
 	/* stores the video/audio media output pointer.  video_t *or audio_t **/
 	void                            *media;
 
@@ -779,6 +994,11 @@ struct obs_encoder {
 extern struct obs_encoder_info *find_encoder(const char *id);
 
 extern bool obs_encoder_initialize(obs_encoder_t *encoder);
+
+/* returns a new reference to an active video encoder with the same id,
+ * effective settings, video output and scaled size as the given encoder,
+ * or NULL */
+extern obs_encoder_t *obs_encoder_find_shareable(obs_encoder_t *encoder);
 extern void obs_encoder_shutdown(obs_encoder_t *encoder);
 
 extern void obs_encoder_start(obs_encoder_t *encoder,
@@ -0,0 +1,755 @@
+#include <sys/stat.h>
+
+#include "util/platform.h"
+#include "util/threading.h"
+#include "util/dstr.h"
+#include "obs-internal.h"
+
+/* module files are opened on a few worker threads and then initialized one
+ * after another on the calling thread, in the order they were found.  the
+ * ids each module registers are written to a cache in the module config
+ * directory, keyed by the size and modification time of the file, so that
+ * the next start can leave modules whose types aren't used unopened until
+ * obs_load_deferred_modules.
+ *
+ * the cache also keeps the ids that were looked up before the deferred
+ * modules were loaded, so types the program creates while it starts don't
+ * have to be listed by the caller. */
+
+#define MODULE_LOADER_THREADS 4
+#define MODULE_CACHE_FILE     "module-cache.json"
+#define MODULE_CACHE_VERSION  2
+
+struct module_file {
+	char              *bin_path;
+	char              *data_path;
+	long long         size;
+	long long         mtime;
+
+	obs_data_t        *cache_entry;
+	bool              deferred;
+	bool              opened;
+	bool              initialized;
+
+	struct obs_module *module;
+	int               errorcode;
+	uint64_t          open_ns;
+	uint64_t          init_ns;
+};
+
+struct module_loader {
+	DARRAY(struct module_file) files;
+	volatile long              next_file;
+	obs_data_t                 *cache;
+};
+
+bool obs_init_module_loader(void)
+{
+	pthread_mutexattr_t attr;
+	bool success = false;
+
+	pthread_mutex_init_value(&obs->modules_mutex);
+
+	if (pthread_mutexattr_init(&attr) != 0)
+		return false;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) == 0)
+		success = pthread_mutex_init(&obs->modules_mutex, &attr) == 0;
+
+	pthread_mutexattr_destroy(&attr);
+	return success;
+}
+
+static void free_deferred_module(struct obs_deferred_module *dm)
+{
+	for (size_t i = 0; i < dm->types.num; i++)
+		bfree(dm->types.array[i]);
+	da_free(dm->types);
+	bfree(dm->bin_path);
+	bfree(dm->data_path);
+}
+
+void obs_free_module_loader(void)
+{
+	for (size_t i = 0; i < obs->deferred_modules.num; i++)
+		free_deferred_module(obs->deferred_modules.array + i);
+	da_free(obs->deferred_modules);
+
+	for (size_t i = 0; i < obs->startup_types.num; i++)
+		bfree(obs->startup_types.array[i]);
+	da_free(obs->startup_types);
+
+	pthread_mutex_destroy(&obs->modules_mutex);
+}
+
+void obs_module_add_type(const char *id)
+{
+	struct obs_module *module = obs->loading_module;
+
+	if (module && id) {
+		char *copy = bstrdup(id);
+		da_push_back(module->types, &copy);
+	}
+}
+
+static bool startup_type_known(const char *id)
+{
+	for (size_t i = 0; i < obs->startup_types.num; i++) {
+		if (strcmp(obs->startup_types.array[i], id) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static void add_startup_type(const char *id)
+{
+	if (*id && !startup_type_known(id)) {
+		char *copy = bstrdup(id);
+		da_push_back(obs->startup_types, &copy);
+	}
+}
+
+/* called by the type lookups.  lookups made while a module registers its
+ * types are only duplicate checks. */
+void obs_module_note_type_lookup(const char *id)
+{
+	if (!id || os_atomic_load_long(&obs->startup_types_saved))
+		return;
+
+	pthread_mutex_lock(&obs->modules_mutex);
+
+	if (obs->modules_thread_set && !obs->loading_module &&
+	    !os_atomic_load_long(&obs->startup_types_saved))
+		add_startup_type(id);
+
+	pthread_mutex_unlock(&obs->modules_mutex);
+}
+
+/* type lookup that isn't noted as a startup type */
+static bool type_registered(const char *id)
+{
+	return obs_type_index_find(&obs->input_type_index,
+			&obs->input_types.da, sizeof(struct obs_source_info),
+			id) ||
+		obs_type_index_find(&obs->filter_type_index,
+			&obs->filter_types.da, sizeof(struct obs_source_info),
+			id) ||
+		obs_type_index_find(&obs->transition_type_index,
+			&obs->transition_types.da,
+			sizeof(struct obs_source_info), id) ||
+		obs_type_index_find(&obs->output_type_index,
+			&obs->output_types.da, sizeof(struct obs_output_info),
+			id) ||
+		obs_type_index_find(&obs->encoder_type_index,
+			&obs->encoder_types.da,
+			sizeof(struct obs_encoder_info), id) ||
+		obs_type_index_find(&obs->service_type_index,
+			&obs->service_types.da,
+			sizeof(struct obs_service_info), id);
+}
+
+/* ------------------------------------------------------------------------- */
+/* module cache */
+
+static char *get_module_cache_path(void)
+{
+	struct dstr path = {0};
+
+	if (!obs->module_config_path || !*obs->module_config_path)
+		return NULL;
+
+	dstr_copy(&path, obs->module_config_path);
+	if (dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	dstr_cat(&path, MODULE_CACHE_FILE);
+	return path.array;
+}
+
+/* what the cached ids depend on besides the module files themselves.  a
+ * different libobs may reject modules or change what they register. */
+static void get_cache_environment(struct dstr *env)
+{
+	dstr_printf(env, "%d/%u", MODULE_CACHE_VERSION,
+			(unsigned)LIBOBS_API_VER);
+}
+
+static obs_data_t *load_module_cache(void)
+{
+	char *path = get_module_cache_path();
+	obs_data_t *cache = path ? obs_data_create_from_json_file(path) : NULL;
+	struct dstr env = {0};
+
+	get_cache_environment(&env);
+
+	if (cache && strcmp(obs_data_get_string(cache, "environment"),
+				env.array) != 0) {
+		blog(LOG_INFO, "Module cache was written by a different "
+		               "libobs, loading every module");
+		obs_data_release(cache);
+		cache = NULL;
+	}
+
+	dstr_free(&env);
+	bfree(path);
+	return cache;
+}
+
+static void load_startup_types(obs_data_t *cache)
+{
+	obs_data_array_t *types = obs_data_get_array(cache, "startup_types");
+	size_t count = obs_data_array_count(types);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *type = obs_data_array_item(types, i);
+		add_startup_type(obs_data_get_string(type, "id"));
+		obs_data_release(type);
+	}
+
+	obs_data_array_release(types);
+}
+
+static void set_startup_types(obs_data_t *cache)
+{
+	obs_data_array_t *types = obs_data_array_create();
+
+	for (size_t i = 0; i < obs->startup_types.num; i++) {
+		obs_data_t *type = obs_data_create();
+		obs_data_set_string(type, "id", obs->startup_types.array[i]);
+		obs_data_array_push_back(types, type);
+		obs_data_release(type);
+	}
+
+	obs_data_set_array(cache, "startup_types", types);
+	obs_data_array_release(types);
+}
+
+static bool write_module_cache(obs_data_t *cache)
+{
+	char *path = get_module_cache_path();
+	struct dstr env = {0};
+	bool success;
+
+	if (!path)
+		return false;
+
+	get_cache_environment(&env);
+	obs_data_set_string(cache, "environment", env.array);
+	set_startup_types(cache);
+
+	os_mkdirs(obs->module_config_path);
+	success = obs_data_save_json_safe(cache, path, "tmp", "bak");
+	if (!success)
+		blog(LOG_WARNING, "Failed to save module cache '%s'", path);
+
+	dstr_free(&env);
+	bfree(path);
+	return success;
+}
+
+static obs_data_t *find_cache_entry(obs_data_array_t *modules,
+		const struct module_file *file)
+{
+	size_t count = obs_data_array_count(modules);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *entry = obs_data_array_item(modules, i);
+
+		if (strcmp(obs_data_get_string(entry, "file"),
+					file->bin_path) == 0 &&
+		    obs_data_get_int(entry, "size")  == file->size &&
+		    obs_data_get_int(entry, "mtime") == file->mtime)
+			return entry;
+
+		obs_data_release(entry);
+	}
+
+	return NULL;
+}
+
+static void set_entry_types(obs_data_t *entry, const struct obs_module *module)
+{
+	obs_data_array_t *types = obs_data_array_create();
+
+	for (size_t i = 0; i < module->types.num; i++) {
+		obs_data_t *type = obs_data_create();
+		obs_data_set_string(type, "id", module->types.array[i]);
+		obs_data_array_push_back(types, type);
+		obs_data_release(type);
+	}
+
+	obs_data_set_array(entry, "types", types);
+	obs_data_array_release(types);
+}
+
+static obs_data_t *create_cache_entry(const struct module_file *file)
+{
+	obs_data_t *entry = obs_data_create();
+
+	obs_data_set_string(entry, "file", file->bin_path);
+	obs_data_set_int(entry, "size", file->size);
+	obs_data_set_int(entry, "mtime", file->mtime);
+	set_entry_types(entry, file->module);
+	return entry;
+}
+
+static void save_module_cache(struct module_loader *loader)
+{
+	obs_data_t *cache;
+	obs_data_array_t *modules;
+
+	cache   = obs_data_create();
+	modules = obs_data_array_create();
+
+	for (size_t i = 0; i < loader->files.num; i++) {
+		struct module_file *file = loader->files.array + i;
+
+		/* modules that failed to open are retried on every start */
+		if (file->deferred) {
+			obs_data_array_push_back(modules, file->cache_entry);
+		} else if (file->module) {
+			obs_data_t *entry = create_cache_entry(file);
+			obs_data_array_push_back(modules, entry);
+			obs_data_release(entry);
+		}
+	}
+
+	obs_data_set_array(cache, "modules", modules);
+	write_module_cache(cache);
+
+	obs_data_array_release(modules);
+	obs_data_release(cache);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool module_file_known(const char *bin_path)
+{
+	struct obs_module *module = obs->first_module;
+
+	while (module) {
+		if (strcmp(module->bin_path, bin_path) == 0)
+			return true;
+		module = module->next;
+	}
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		if (strcmp(obs->deferred_modules.array[i].bin_path,
+					bin_path) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static void add_module_file(void *param, const struct obs_module_info *info)
+{
+	struct module_loader *loader = param;
+	struct module_file file = {0};
+	struct stat st;
+
+	if (module_file_known(info->bin_path))
+		return;
+
+	file.bin_path  = bstrdup(info->bin_path);
+	file.data_path = bstrdup(info->data_path);
+
+	if (os_stat(file.bin_path, &st) == 0) {
+		file.size  = (long long)st.st_size;
+		file.mtime = (long long)st.st_mtime;
+	}
+
+	da_push_back(loader->files, &file);
+}
+
+static bool types_used(obs_data_t *entry, const char *const *ids,
+		size_t num_ids, bool *has_types)
+{
+	obs_data_array_t *types = obs_data_get_array(entry, "types");
+	size_t count = obs_data_array_count(types);
+	bool used = false;
+
+	for (size_t i = 0; i < count && !used; i++) {
+		obs_data_t *type = obs_data_array_item(types, i);
+		const char *id = obs_data_get_string(type, "id");
+
+		for (size_t j = 0; j < num_ids; j++) {
+			if (ids[j] && strcmp(ids[j], id) == 0) {
+				used = true;
+				break;
+			}
+		}
+
+		obs_data_release(type);
+	}
+
+	*has_types = count != 0;
+	obs_data_array_release(types);
+	return used;
+}
+
+static void defer_module(struct module_file *file)
+{
+	struct obs_deferred_module dm = {0};
+	obs_data_array_t *types = obs_data_get_array(file->cache_entry,
+			"types");
+	size_t count = obs_data_array_count(types);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *type = obs_data_array_item(types, i);
+		char *id = bstrdup(obs_data_get_string(type, "id"));
+
+		da_push_back(dm.types, &id);
+		obs_data_release(type);
+	}
+
+	dm.bin_path  = bstrdup(file->bin_path);
+	dm.data_path = bstrdup(file->data_path);
+	da_push_back(obs->deferred_modules, &dm);
+
+	file->deferred = true;
+	obs_data_array_release(types);
+}
+
+/* modules the cache knows about that don't provide any of the requested
+ * types are deferred.  modules that register nothing are always loaded, as
+ * they may exist for what obs_module_load does rather than for types. */
+static void select_deferred_modules(struct module_loader *loader,
+		const char *const *ids, size_t num_ids)
+{
+	obs_data_array_t *cache = obs_data_get_array(loader->cache, "modules");
+	const char *const *startup_ids =
+		(const char *const *)obs->startup_types.array;
+	size_t num_startup_ids = obs->startup_types.num;
+
+	for (size_t i = 0; i < loader->files.num; i++) {
+		struct module_file *file = loader->files.array + i;
+		bool has_types;
+
+		file->cache_entry = find_cache_entry(cache, file);
+		if (!file->cache_entry)
+			continue;
+
+		if (!types_used(file->cache_entry, ids, num_ids, &has_types) &&
+		    !types_used(file->cache_entry, startup_ids,
+			    num_startup_ids, &has_types) &&
+		    has_types)
+			defer_module(file);
+	}
+
+	obs_data_array_release(cache);
+}
+
+static bool types_missing(const char *const *ids, size_t num_ids)
+{
+	for (size_t i = 0; i < num_ids; i++) {
+		if (ids[i] && *ids[i] && !type_registered(ids[i])) {
+			blog(LOG_INFO, "Type '%s' was requested but no loaded "
+			               "module registered it", ids[i]);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* the cache may be out of date for a deferred module, for example when a
+ * library the module depends on changed, so a requested type that is still
+ * missing loads the deferred modules as well */
+static void undefer_modules(struct module_loader *loader)
+{
+	for (size_t i = 0; i < loader->files.num; i++) {
+		struct module_file *file = loader->files.array + i;
+
+		if (file->deferred) {
+			obs_data_release(file->cache_entry);
+			file->cache_entry = NULL;
+			file->deferred    = false;
+		}
+	}
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++)
+		free_deferred_module(obs->deferred_modules.array + i);
+	da_free(obs->deferred_modules);
+
+	loader->next_file = 0;
+}
+
+static void *open_modules_thread(void *param)
+{
+	struct module_loader *loader = param;
+	long idx;
+
+	while ((idx = os_atomic_inc_long(&loader->next_file) - 1) <
+			(long)loader->files.num) {
+		struct module_file *file = loader->files.array + idx;
+		uint64_t start;
+
+		if (file->deferred || file->opened)
+			continue;
+
+		start = os_gettime_ns();
+		file->errorcode = obs_open_module_file(&file->module,
+				file->bin_path, file->data_path);
+		file->open_ns = os_gettime_ns() - start;
+		file->opened  = true;
+	}
+
+	return NULL;
+}
+
+static void open_modules(struct module_loader *loader)
+{
+	pthread_t threads[MODULE_LOADER_THREADS];
+	size_t num_threads = 0;
+
+	for (size_t i = 0; i < MODULE_LOADER_THREADS; i++) {
+		if (pthread_create(&threads[i], NULL, open_modules_thread,
+					loader) != 0)
+			break;
+		num_threads++;
+	}
+
+	/* whatever the workers didn't get to is opened right here */
+	open_modules_thread(loader);
+
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static void init_modules(struct module_loader *loader)
+{
+	for (size_t i = 0; i < loader->files.num; i++) {
+		struct module_file *file = loader->files.array + i;
+		uint64_t start;
+
+		if (file->deferred || file->initialized)
+			continue;
+
+		file->initialized = true;
+
+		if (file->errorcode != MODULE_SUCCESS) {
+			blog(LOG_DEBUG, "Failed to load module file '%s': %d",
+					file->bin_path, file->errorcode);
+			file->module = NULL;
+			continue;
+		}
+
+		blog(LOG_INFO, "---------------------------------");
+		blog(LOG_INFO, "Loading module: %s", file->module->file);
+
+		obs_link_module(file->module);
+
+		start = os_gettime_ns();
+		obs_init_module(file->module);
+		file->init_ns = os_gettime_ns() - start;
+	}
+}
+
+static void log_module_load_times(struct module_loader *loader,
+		uint64_t total_ns)
+{
+	size_t loaded = 0;
+	size_t deferred = 0;
+
+	blog(LOG_INFO, "---------------------------------");
+	blog(LOG_INFO, "Module load times (open / init):");
+
+	for (size_t i = 0; i < loader->files.num; i++) {
+		struct module_file *file = loader->files.array + i;
+
+		if (file->deferred) {
+			deferred++;
+		} else if (file->module) {
+			blog(LOG_INFO, "\t%s: %.2f ms / %.2f ms",
+					file->module->file,
+					(double)file->open_ns / 1000000.0,
+					(double)file->init_ns / 1000000.0);
+			loaded++;
+		}
+	}
+
+	blog(LOG_INFO, "%d modules loaded, %d deferred, in %.2f ms",
+			(int)loaded, (int)deferred,
+			(double)total_ns / 1000000.0);
+}
+
+static void free_module_loader(struct module_loader *loader)
+{
+	for (size_t i = 0; i < loader->files.num; i++) {
+		struct module_file *file = loader->files.array + i;
+
+		obs_data_release(file->cache_entry);
+		bfree(file->bin_path);
+		bfree(file->data_path);
+	}
+
+	da_free(loader->files);
+	obs_data_release(loader->cache);
+}
+
+static const char *obs_load_modules_name = "obs_load_modules_for_types";
+void obs_load_modules_for_types(const char *const *ids, size_t num_ids)
+{
+	struct module_loader loader = {0};
+	uint64_t start;
+
+	if (!obs)
+		return;
+
+	profile_start(obs_load_modules_name);
+	start = os_gettime_ns();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	obs->modules_thread     = pthread_self();
+	obs->modules_thread_set = true;
+	pthread_mutex_unlock(&obs->modules_mutex);
+
+	obs_find_modules(add_module_file, &loader);
+
+	loader.cache = load_module_cache();
+	if (loader.cache) {
+		pthread_mutex_lock(&obs->modules_mutex);
+		load_startup_types(loader.cache);
+		pthread_mutex_unlock(&obs->modules_mutex);
+	}
+
+	if (ids)
+		select_deferred_modules(&loader, ids, num_ids);
+
+	open_modules(&loader);
+	init_modules(&loader);
+
+	if (obs->deferred_modules.num && types_missing(ids, num_ids)) {
+		undefer_modules(&loader);
+		open_modules(&loader);
+		init_modules(&loader);
+	}
+
+	save_module_cache(&loader);
+
+	log_module_load_times(&loader, os_gettime_ns() - start);
+	free_module_loader(&loader);
+
+	if (!ids)
+		obs_load_deferred_modules();
+
+	profile_end(obs_load_modules_name);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool same_types(const struct obs_deferred_module *dm,
+		const struct obs_module *module)
+{
+	if (dm->types.num != module->types.num)
+		return false;
+
+	for (size_t i = 0; i < dm->types.num; i++) {
+		if (strcmp(dm->types.array[i], module->types.array[i]) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/* replaces the cached ids of a deferred module that registered something
+ * else than the cache said it would */
+static void update_cache_entry(obs_data_t *cache,
+		const struct obs_deferred_module *dm,
+		const struct obs_module *module)
+{
+	obs_data_array_t *modules = obs_data_get_array(cache, "modules");
+	size_t count = obs_data_array_count(modules);
+
+	blog(LOG_INFO, "Module cache was out of date for '%s'", module->file);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *entry = obs_data_array_item(modules, i);
+
+		if (strcmp(obs_data_get_string(entry, "file"),
+					dm->bin_path) == 0)
+			set_entry_types(entry, module);
+
+		obs_data_release(entry);
+	}
+
+	obs_data_array_release(modules);
+}
+
+static void load_deferred(struct obs_deferred_module *dm, obs_data_t *cache)
+{
+	struct obs_module *module;
+	uint64_t start = os_gettime_ns();
+	int code;
+
+	code = obs_open_module_file(&module, dm->bin_path, dm->data_path);
+	if (code != MODULE_SUCCESS) {
+		blog(LOG_WARNING, "Failed to load deferred module file "
+		                  "'%s': %d", dm->bin_path, code);
+		return;
+	}
+
+	obs_link_module(module);
+	obs_init_module(module);
+
+	if (cache && !same_types(dm, module))
+		update_cache_entry(cache, dm, module);
+
+	blog(LOG_INFO, "Loaded deferred module: %s (%.2f ms)", module->file,
+			(double)(os_gettime_ns() - start) / 1000000.0);
+}
+
+/* keeps the startup types that exist now that every module is loaded, the
+ * rest were only probed for */
+static void prune_startup_types(void)
+{
+	size_t idx = 0;
+
+	while (idx < obs->startup_types.num) {
+		if (type_registered(obs->startup_types.array[idx])) {
+			idx++;
+		} else {
+			bfree(obs->startup_types.array[idx]);
+			da_erase(obs->startup_types, idx);
+		}
+	}
+}
+
+void obs_load_deferred_modules(void)
+{
+	obs_data_t *cache = NULL;
+
+	if (!obs)
+		return;
+
+	if (obs->modules_thread_set &&
+	    !pthread_equal(obs->modules_thread, pthread_self())) {
+		blog(LOG_ERROR, "obs_load_deferred_modules: Called from a "
+		                "different thread than the modules were "
+		                "loaded on");
+		return;
+	}
+
+	pthread_mutex_lock(&obs->modules_mutex);
+
+	if (!os_atomic_load_long(&obs->startup_types_saved))
+		cache = load_module_cache();
+
+	while (obs->deferred_modules.num) {
+		struct obs_deferred_module dm = obs->deferred_modules.array[0];
+
+		da_erase(obs->deferred_modules, 0);
+		load_deferred(&dm, cache);
+		free_deferred_module(&dm);
+	}
+
+	/* only the first call saves, later ones have nothing deferred */
+	if (cache) {
+		prune_startup_types();
+		write_module_cache(cache);
+		obs_data_release(cache);
+	}
+
+	os_atomic_set_long(&obs->startup_types_saved, 1);
+	pthread_mutex_unlock(&obs->modules_mutex);
+}
@@ -75,18 +75,19 @@ static inline char *get_module_name(const char *file)
 extern void reset_win32_symbol_paths(void);
 #endif
 
-int obs_open_module(obs_module_t **module, const char *path,
+int obs_open_module_file(struct obs_module **module, const char *path,
 		const char *data_path)
 {
 	struct obs_module mod = {0};
 	int errorcode;
 
-	if (!module || !path || !obs)
-		return MODULE_ERROR;
-
-	blog(LOG_INFO, "---------------------------------");
-
+	/* os_dlopen changes the process wide dll search path on windows, so
+	 * files are only opened one at a time even when the rest of the work
+	 * happens on the module loader's threads */
+	pthread_mutex_lock(&obs->modules_mutex);
 	mod.module = os_dlopen(path);
+	pthread_mutex_unlock(&obs->modules_mutex);
+
 	if (!mod.module) {
 		blog(LOG_WARNING, "Module '%s' not found", path);
 		return MODULE_FILE_NOT_FOUND;
@@ -101,22 +102,43 @@ int obs_open_module(obs_module_t **module, const char *path,
 	mod.file      = (!mod.file) ? mod.bin_path : (mod.file + 1);
 	mod.mod_name  = get_module_name(mod.file);
 	mod.data_path = bstrdup(data_path);
-	mod.next      = obs->first_module;
-
-	if (mod.file) {
-		blog(LOG_INFO, "Loading module: %s", mod.file);
-	}
 
 	*module = bmemdup(&mod, sizeof(mod));
-	obs->first_module = (*module);
 	mod.set_pointer(*module);
 
 	if (mod.set_locale)
 		mod.set_locale(obs->locale);
 
+	return MODULE_SUCCESS;
+}
+
+void obs_link_module(struct obs_module *module)
+{
+	module->next      = obs->first_module;
+	obs->first_module = module;
+
 #ifdef _WIN32
 	reset_win32_symbol_paths();
 #endif
+}
+
+int obs_open_module(obs_module_t **module, const char *path,
+		const char *data_path)
+{
+	int errorcode;
+
+	if (!module || !path || !obs)
+		return MODULE_ERROR;
+
+	blog(LOG_INFO, "---------------------------------");
+
+	errorcode = obs_open_module_file(module, path, data_path);
+	if (errorcode != MODULE_SUCCESS)
+		return errorcode;
+
+	blog(LOG_INFO, "Loading module: %s", (*module)->file);
+
+	obs_link_module(*module);
 	return MODULE_SUCCESS;
 }
 
@@ -132,11 +154,18 @@ bool obs_init_module(obs_module_t *module)
 				"obs_init_module(%s)", module->file);
 	profile_start(profile_name);
 
+	pthread_mutex_lock(&obs->modules_mutex);
+	struct obs_module *prev_loading = obs->loading_module;
+	obs->loading_module = module;
+
 	module->loaded = module->load();
 	if (!module->loaded)
 		blog(LOG_WARNING, "Failed to initialize module '%s'",
 				module->file);
 
+	obs->loading_module = prev_loading;
+	pthread_mutex_unlock(&obs->modules_mutex);
+
 	profile_end(profile_name);
 	return module->loaded;
 }
@@ -216,28 +245,9 @@ void obs_add_module_path(const char *bin, const char *data)
 	da_push_back(obs->module_paths, &omp);
 }
 
-static void load_all_callback(void *param, const struct obs_module_info *info)
-{
-	obs_module_t *module;
-
-	int code = obs_open_module(&module, info->bin_path, info->data_path);
-	if (code != MODULE_SUCCESS) {
-		blog(LOG_DEBUG, "Failed to load module file '%s': %d",
-				info->bin_path, code);
-		return;
-	}
-
-	obs_init_module(module);
-
-	UNUSED_PARAMETER(param);
-}
-
-static const char *obs_load_all_modules_name = "obs_load_all_modules";
 void obs_load_all_modules(void)
 {
-	profile_start(obs_load_all_modules_name);
-	obs_find_modules(load_all_callback, NULL);
-	profile_end(obs_load_all_modules_name);
+	obs_load_modules_for_types(NULL, 0);
 }
 
 static inline void make_data_dir(struct dstr *parsed_data_dir,
@@ -267,9 +277,11 @@ static char *make_data_directory(const char *module_name, const char *data_dir)
 static bool parse_binary_from_directory(struct dstr *parsed_bin_path,
 		const char *bin_path, const char *file)
 {
-	struct dstr directory = {0};
+	char directory_buf[512];
+	struct dstr directory;
 	bool found = true;
 
+	dstr_init_small(&directory, directory_buf, sizeof(directory_buf));
 	dstr_copy(&directory, bin_path);
 	dstr_replace(&directory, "%module%", file);
 	if (dstr_end(&directory) != '/')
@@ -418,6 +430,10 @@ void free_module(struct obs_module *mod)
 		/* os_dlclose(mod->module); */
 	}
 
+	for (size_t i = 0; i < mod->types.num; i++)
+		bfree(mod->types.array[i]);
+	da_free(mod->types);
+
 	bfree(mod->mod_name);
 	bfree(mod->bin_path);
 	bfree(mod->data_path);
@@ -571,6 +587,9 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 	}
 
 	darray_push_back(sizeof(struct obs_source_info), array, &data);
+	obs_type_index_update(get_source_type_index(array), array,
+			sizeof(struct obs_source_info));
+	obs_module_add_type(info->id);
 	return;
 
 error:
@@ -607,6 +626,9 @@ void obs_register_output_s(const struct obs_output_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_output_info, obs->output_types, info);
+	obs_type_index_update(&obs->output_type_index, &obs->output_types.da,
+			sizeof(struct obs_output_info));
+	obs_module_add_type(info->id);
 	return;
 
 error:
@@ -633,6 +655,9 @@ void obs_register_encoder_s(const struct obs_encoder_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_encoder_info, obs->encoder_types, info);
+	obs_type_index_update(&obs->encoder_type_index, &obs->encoder_types.da,
+			sizeof(struct obs_encoder_info));
+	obs_module_add_type(info->id);
 	return;
 
 error:
@@ -655,6 +680,9 @@ void obs_register_service_s(const struct obs_service_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_service_info, obs->service_types, info);
+	obs_type_index_update(&obs->service_type_index, &obs->service_types.da,
+			sizeof(struct obs_service_info));
+	obs_module_add_type(info->id);
 	return;
 
 error:
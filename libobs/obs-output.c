@@ -24,12 +24,11 @@ static inline void signal_stop(struct obs_output *output, int code);
 
 const struct obs_output_info *find_output(const char *id)
 {
-	size_t i;
-	for (i = 0; i < obs->output_types.num; i++)
-		if (strcmp(obs->output_types.array[i].id, id) == 0)
-			return obs->output_types.array+i;
+	obs_module_note_type_lookup(id);
 
-	return NULL;
+	return obs_type_index_find(&obs->output_type_index,
+			&obs->output_types.da, sizeof(struct obs_output_info),
+			id);
 }
 
 const char *obs_output_get_display_name(const char *id)
@@ -112,7 +111,8 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 
 	obs_context_data_insert(&output->context,
 			&obs->data.outputs_mutex,
-			&obs->data.first_output);
+			&obs->data.first_output,
+			&obs->data.output_names);
 
 	blog(LOG_INFO, "output '%s' (%s) created", name, id);
 	return output;
@@ -129,6 +129,23 @@ static inline void free_packets(struct obs_output *output)
 	da_free(output->interleaved_packets);
 }
 
+/* switches an output that was attached to another output's encoder back to
+ * its own encoder */
+static void restore_video_encoder(struct obs_output *output)
+{
+	obs_encoder_t *shared = output->video_encoder;
+
+	if (!output->video_encoder_shared)
+		return;
+
+	output->video_encoder        = output->own_video_encoder;
+	output->own_video_encoder    = NULL;
+	output->video_encoder_shared = false;
+
+	os_atomic_dec_long(&shared->shared_outputs);
+	obs_encoder_release(shared);
+}
+
 void obs_output_destroy(obs_output_t *output)
 {
 	if (output) {
@@ -146,6 +163,8 @@ void obs_output_destroy(obs_output_t *output)
 		if (output->context.data)
 			output->info.destroy(output->context.data);
 
+		restore_video_encoder(output);
+
 		if (output->video_encoder) {
 			obs_encoder_remove_output(output->video_encoder,
 					output);
@@ -424,7 +443,10 @@ void obs_output_remove_encoder(struct obs_output *output,
 {
 	if (!output) return;
 
-	if (output->video_encoder == encoder) {
+	if (output->video_encoder_shared &&
+	    output->own_video_encoder == encoder) {
+		output->own_video_encoder = NULL;
+	} else if (output->video_encoder == encoder) {
 		output->video_encoder = NULL;
 	} else {
 		for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
@@ -437,19 +459,36 @@ void obs_output_remove_encoder(struct obs_output *output,
 void obs_output_set_video_encoder(obs_output_t *output, obs_encoder_t *encoder)
 {
 	if (!output) return;
-	if (output->video_encoder == encoder) return;
 	if (encoder && encoder->info.type != OBS_ENCODER_VIDEO) return;
 
-	obs_encoder_remove_output(output->video_encoder, output);
-	obs_encoder_add_output(encoder, output);
-	output->video_encoder = encoder;
+	/* while attached to a shared encoder, replace the output's own
+	 * encoder, which it goes back to once it stops */
+	if (output->video_encoder_shared) {
+		if (output->own_video_encoder == encoder) return;
+
+		obs_encoder_remove_output(output->own_video_encoder, output);
+		obs_encoder_add_output(encoder, output);
+		output->own_video_encoder = encoder;
+	} else {
+		if (output->video_encoder == encoder) return;
+
+		obs_encoder_remove_output(output->video_encoder, output);
+		obs_encoder_add_output(encoder, output);
+		output->video_encoder = encoder;
+	}
 
 	/* set the preferred resolution on the encoder */
 	if (output->scaled_width && output->scaled_height)
-		obs_encoder_set_scaled_size(output->video_encoder,
+		obs_encoder_set_scaled_size(encoder,
 				output->scaled_width, output->scaled_height);
 }
 
+void obs_output_set_video_encoder_sharing(obs_output_t *output, bool enable)
+{
+	if (output)
+		output->video_encoder_sharing_disabled = !enable;
+}
+
 void obs_output_set_audio_encoder(obs_output_t *output, obs_encoder_t *encoder,
 		size_t idx)
 {
@@ -779,11 +818,9 @@ static inline void apply_interleaved_packet_offset(struct obs_output *output,
 	out->pts -= offset;
 
 	/* convert the newly adjusted dts to relative dts time to ensure proper
-	 * interleaving.  if we're using an audio encoder that's already been
-	 * started on another output, then the first audio packet may not be
-	 * quite perfectly synced up in terms of system time (and there's
-	 * nothing we can really do about that), but it will always at least be
-	 * within a 23ish millisecond threshold (at least for AAC) */
+	 * interleaving.  if the audio and video encoders weren't started
+	 * together, the audio offset keeps the delay between the first video
+	 * and audio packets (see audio_start_delay) */
 	out->dts_usec = packet_dts_usec(out);
 }
 
@@ -806,10 +843,14 @@ static inline void send_interleaved(struct obs_output *output)
 	if (!has_higher_opposing_ts(output, &out))
 		return;
 
-	if (out.type == OBS_ENCODER_VIDEO)
+	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
+		obs_frame_stats_record(OBS_FRAME_STAGE_INTERLEAVED,
+				out.frame_ts);
+	}
 
 	da_erase(output->interleaved_packets, 0);
+	da_shrink(output->interleaved_packets);
 	if (!output->stopped)
 		output->info.encoded_packet(output->context.data, &out);
 	obs_free_encoder_packet(&out);
@@ -866,6 +907,7 @@ static void prune_interleaved_packets(struct obs_output *output)
 		}
 
 		da_erase_range(output->interleaved_packets, 0, start_idx);
+		da_shrink(output->interleaved_packets);
 	}
 }
 
@@ -889,6 +931,18 @@ static struct encoder_packet *find_first_packet_type(struct obs_output *output,
 	return NULL;
 }
 
+/* a video encoder that is already running (shared with another output)
+ * starts this output at its next keyframe, which isn't aligned to the audio
+ * packets the way paired encoders are.  the first audio packet left after
+ * pruning can start up to one packet after the first video frame, so it
+ * keeps that delay instead of being moved to 0 along with the video. */
+static inline int64_t audio_start_delay(struct encoder_packet *video,
+		struct encoder_packet *audio)
+{
+	return (audio->dts_usec > video->dts_usec) ?
+		audio->dts_usec - video->dts_usec : 0;
+}
+
 static bool initialize_interleaved_packets(struct obs_output *output)
 {
 	struct encoder_packet *video;
@@ -914,10 +968,13 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	/* get new offsets */
 	output->video_offset = video->dts;
 	for (size_t i = 0; i < audio_mixes; i++)
-		output->audio_offsets[i] = audio[i]->dts;
+		output->audio_offsets[i] = audio[i]->dts -
+			audio_start_delay(video, audio[i]) *
+			audio[i]->timebase_den / MICROSECOND_DEN;
 
 	/* subtract offsets from highest TS offset variables */
-	output->highest_audio_ts -= audio[0]->dts_usec;
+	output->highest_audio_ts -= audio[0]->dts_usec -
+		audio_start_delay(video, audio[0]);
 	output->highest_video_ts -= video->dts_usec;
 
 	/* apply new offsets to all existing packet DTS/PTS values */
@@ -1008,6 +1065,9 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 
 	if (packet->type == OBS_ENCODER_AUDIO)
 		packet->track_idx = get_track_index(output, packet);
+	else
+		obs_frame_stats_record(OBS_FRAME_STAGE_INTERLEAVED,
+				packet->frame_ts);
 
 	if (!output->stopped)
 		output->info.encoded_packet(output->context.data, packet);
@@ -1201,6 +1261,40 @@ static inline bool pair_encoders(obs_output_t *output, size_t num_mixes)
 	return true;
 }
 
+/* if another output is already running an encoder that would produce the
+ * exact same stream, attach to that encoder instead of starting a second
+ * one.  the encoder keeps running until its last output stops.  the output
+ * keeps its own encoder and only uses the shared one until it stops. */
+static void share_video_encoder(obs_output_t *output)
+{
+	obs_encoder_t *encoder;
+	obs_encoder_t *shared;
+
+	/* a previous start that failed before capturing may have left the
+	 * output attached */
+	restore_video_encoder(output);
+
+	encoder = output->video_encoder;
+	if (!encoder || encoder->active ||
+	    output->video_encoder_sharing_disabled)
+		return;
+
+	shared = obs_encoder_find_shareable(encoder);
+	if (!shared)
+		return;
+
+	blog(LOG_INFO, "Output '%s': sharing active video encoder '%s' "
+			"instead of starting '%s' with identical settings",
+			output->context.name, shared->context.name,
+			encoder->context.name);
+
+	output->own_video_encoder    = encoder;
+	output->video_encoder        = shared;
+	output->video_encoder_shared = true;
+
+	os_atomic_inc_long(&shared->shared_outputs);
+}
+
 bool obs_output_initialize_encoders(obs_output_t *output, uint32_t flags)
 {
 	bool encoded, has_video, has_audio, has_service;
@@ -1216,6 +1310,8 @@ bool obs_output_initialize_encoders(obs_output_t *output, uint32_t flags)
 		return false;
 	if (has_service && !obs_service_initialize(output->service, output))
 		return false;
+	if (has_video)
+		share_video_encoder(output);
 	if (has_video && !obs_encoder_initialize(output->video_encoder))
 		return false;
 	if (has_audio && !initialize_audio_encoders(output, num_mixes))
@@ -1345,6 +1441,8 @@ void obs_output_end_data_capture(obs_output_t *output)
 	if (output->active_delay_ns)
 		obs_output_cleanup_delay(output);
 
+	restore_video_encoder(output);
+
 	do_output_signal(output, "deactivate");
 	output->active = false;
 }
@@ -0,0 +1,211 @@
+#include "obs-internal.h"
+
+/* hash tables behind obs_get_*_by_name and the type lookups used when an
+ * object is created.  names change at runtime and are indexed by chaining
+ * the contexts themselves, registered types only grow and are kept in an
+ * open addressed table of array indices. */
+
+#define NAME_INDEX_MIN_BUCKETS 64
+#define TYPE_INDEX_MIN_SLOTS   32
+
+static inline const char *type_id(const struct darray *types, size_t type_size,
+		size_t idx)
+{
+	return *(const char**)((uint8_t*)types->array + idx * type_size);
+}
+
+static void type_index_place(struct obs_type_index *index, const char *id,
+		size_t idx)
+{
+	size_t mask = index->num_slots - 1;
+	size_t slot = obs_hash_string(id) & mask;
+
+	while (index->slots[slot])
+		slot = (slot + 1) & mask;
+
+	index->slots[slot] = idx + 1;
+}
+
+void obs_type_index_update(struct obs_type_index *index,
+		const struct darray *types, size_t type_size)
+{
+	size_t num_slots = index->num_slots;
+
+	if (!num_slots)
+		num_slots = TYPE_INDEX_MIN_SLOTS;
+	while (num_slots < types->num * 2)
+		num_slots *= 2;
+
+	/* keep the load factor under one half so probes stay short */
+	if (num_slots != index->num_slots) {
+		bfree(index->slots);
+		index->slots     = bzalloc(num_slots * sizeof(size_t));
+		index->num_slots = num_slots;
+		index->num       = 0;
+	}
+
+	for (; index->num < types->num; index->num++)
+		type_index_place(index, type_id(types, type_size, index->num),
+				index->num);
+}
+
+void *obs_type_index_find(const struct obs_type_index *index,
+		const struct darray *types, size_t type_size, const char *id)
+{
+	size_t mask, slot;
+
+	/* types pushed without updating the index are still found */
+	if (index->num != types->num) {
+		for (size_t i = 0; i < types->num; i++) {
+			if (strcmp(type_id(types, type_size, i), id) == 0)
+				return (uint8_t*)types->array + i * type_size;
+		}
+		return NULL;
+	}
+
+	if (!index->num_slots)
+		return NULL;
+
+	mask = index->num_slots - 1;
+	slot = obs_hash_string(id) & mask;
+
+	while (index->slots[slot]) {
+		size_t idx = index->slots[slot] - 1;
+
+		if (strcmp(type_id(types, type_size, idx), id) == 0)
+			return (uint8_t*)types->array + idx * type_size;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return NULL;
+}
+
+void obs_type_index_free(struct obs_type_index *index)
+{
+	bfree(index->slots);
+	memset(index, 0, sizeof(*index));
+}
+
+/* ------------------------------------------------------------------------- */
+
+void obs_name_index_init(struct obs_name_index *index, pthread_mutex_t *mutex,
+		bool newest_first)
+{
+	memset(index, 0, sizeof(*index));
+	index->mutex        = mutex;
+	index->newest_first = newest_first;
+}
+
+void obs_name_index_free(struct obs_name_index *index)
+{
+	bfree(index->buckets);
+	index->buckets     = NULL;
+	index->num_buckets = 0;
+	index->num         = 0;
+}
+
+/* links the context into its chain, ordered by when it was inserted */
+static void name_index_link(struct obs_name_index *index,
+		struct obs_context_data **buckets, size_t num_buckets,
+		struct obs_context_data *context)
+{
+	struct obs_context_data **link;
+
+	link = &buckets[context->name_hash & (num_buckets - 1)];
+	while (*link && (index->newest_first ?
+				(*link)->name_seq > context->name_seq :
+				(*link)->name_seq < context->name_seq))
+		link = &(*link)->name_next;
+
+	context->name_next = *link;
+	*link              = context;
+}
+
+static void name_index_grow(struct obs_name_index *index)
+{
+	size_t num_buckets = index->num_buckets ?
+		index->num_buckets * 2 : NAME_INDEX_MIN_BUCKETS;
+	struct obs_context_data **buckets;
+
+	buckets = bzalloc(num_buckets * sizeof(struct obs_context_data*));
+
+	for (size_t i = 0; i < index->num_buckets; i++) {
+		struct obs_context_data *context = index->buckets[i];
+
+		while (context) {
+			struct obs_context_data *next = context->name_next;
+
+			name_index_link(index, buckets, num_buckets, context);
+			context = next;
+		}
+	}
+
+	bfree(index->buckets);
+	index->buckets     = buckets;
+	index->num_buckets = num_buckets;
+}
+
+void obs_name_index_insert(struct obs_name_index *index,
+		struct obs_context_data *context)
+{
+	if (context->name_index || !context->name)
+		return;
+
+	if (index->num >= index->num_buckets)
+		name_index_grow(index);
+
+	if (!context->name_seq)
+		context->name_seq = ++index->next_seq;
+
+	context->name_hash  = obs_hash_string(context->name);
+	context->name_index = index;
+
+	name_index_link(index, index->buckets, index->num_buckets, context);
+	index->num++;
+}
+
+void obs_name_index_remove(struct obs_context_data *context)
+{
+	struct obs_name_index *index = context->name_index;
+	struct obs_context_data **link;
+
+	if (!index)
+		return;
+
+	link = &index->buckets[context->name_hash & (index->num_buckets - 1)];
+	while (*link && *link != context)
+		link = &(*link)->name_next;
+
+	if (*link) {
+		*link = context->name_next;
+		index->num--;
+	}
+
+	context->name_index = NULL;
+	context->name_next  = NULL;
+	context->name_seq   = 0;
+}
+
+struct obs_context_data *obs_name_index_find(
+		const struct obs_name_index *index, const char *name)
+{
+	struct obs_context_data *context;
+	uint32_t hash;
+
+	if (!index->num || !name)
+		return NULL;
+
+	hash    = obs_hash_string(name);
+	context = index->buckets[hash & (index->num_buckets - 1)];
+
+	while (context) {
+		if (context->name_hash == hash &&
+		    strcmp(context->name, name) == 0)
+			return context;
+
+		context = context->name_next;
+	}
+
+	return NULL;
+}
@@ -127,6 +127,33 @@ static void scene_enum_sources(void *data,
 	pthread_mutex_unlock(&scene->mutex);
 }
 
+/* a visible item of a scene that is reachable from an output holds one of
+ * its source's output references (see obs_source_add_output_ref).  These
+ * take the item source's lock under scene->mutex, parent before child. */
+static void update_item_visibility(struct obs_scene_item *item, bool visible)
+{
+	struct obs_scene *scene = item->parent;
+
+	if (!scene) {
+		item->visible = visible;
+		return;
+	}
+
+	pthread_mutex_lock(&scene->mutex);
+
+	if (item->visible != visible && !item->removed &&
+	    scene->source->output_refs) {
+		if (visible)
+			obs_source_add_output_ref(item->source);
+		else
+			obs_source_remove_output_ref(item->source);
+	}
+
+	item->visible = visible;
+
+	pthread_mutex_unlock(&scene->mutex);
+}
+
 static inline void detach_sceneitem(struct obs_scene_item *item)
 {
 	if (item->prev)
@@ -367,7 +394,7 @@ static void scene_load_item(struct obs_scene *scene, obs_data_t *item_data)
 
 	item->rot     = (float)obs_data_get_double(item_data, "rot");
 	item->align   = (uint32_t)obs_data_get_int(item_data, "align");
-	item->visible = obs_data_get_bool(item_data, "visible");
+	update_item_visibility(item, obs_data_get_bool(item_data, "visible"));
 	obs_data_get_vec2(item_data, "pos",    &item->pos);
 	obs_data_get_vec2(item_data, "scale",  &item->scale);
 
@@ -493,7 +520,7 @@ obs_scene_t *obs_scene_duplicate(obs_scene_t *scene, const char *name)
 			struct obs_scene_item *new_item =
 				obs_scene_add(new_scene, source);
 
-			new_item->visible = item->visible;
+			update_item_visibility(new_item, item->visible);
 			new_item->selected = item->selected;
 			new_item->pos = item->pos;
 			new_item->scale = item->scale;
@@ -540,6 +567,38 @@ obs_scene_t *obs_scene_from_source(const obs_source_t *source)
 	return source->context.data;
 }
 
+void obs_scene_add_output_ref(obs_scene_t *scene)
+{
+	struct obs_scene_item *item;
+
+	pthread_mutex_lock(&scene->mutex);
+
+	if (os_atomic_inc_long(&scene->source->output_refs) == 1) {
+		for (item = scene->first_item; item; item = item->next) {
+			if (item->visible)
+				obs_source_add_output_ref(item->source);
+		}
+	}
+
+	pthread_mutex_unlock(&scene->mutex);
+}
+
+void obs_scene_remove_output_ref(obs_scene_t *scene)
+{
+	struct obs_scene_item *item;
+
+	pthread_mutex_lock(&scene->mutex);
+
+	if (os_atomic_dec_long(&scene->source->output_refs) == 0) {
+		for (item = scene->first_item; item; item = item->next) {
+			if (item->visible)
+				obs_source_remove_output_ref(item->source);
+		}
+	}
+
+	pthread_mutex_unlock(&scene->mutex);
+}
+
 obs_sceneitem_t *obs_scene_find_source(obs_scene_t *scene, const char *name)
 {
 	struct obs_scene_item *item;
@@ -713,6 +772,9 @@ obs_sceneitem_t *obs_scene_add(obs_scene_t *scene, obs_source_t *source)
 		item->prev = last;
 	}
 
+	if (scene->source->output_refs)
+		obs_source_add_output_ref(source);
+
 	pthread_mutex_unlock(&scene->mutex);
 
 	init_hotkeys(scene, item, obs_source_get_name(source));
@@ -775,6 +837,9 @@ void obs_sceneitem_remove(obs_sceneitem_t *item)
 	assert(scene->source != NULL);
 	obs_source_remove_child(scene->source, item->source);
 
+	if (item->visible && scene->source->output_refs)
+		obs_source_remove_output_ref(item->source);
+
 	signal_item_remove(item);
 	detach_sceneitem(item);
 
@@ -1057,7 +1122,7 @@ void obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible)
 	if (!item)
 		return;
 
-	item->visible = visible;
+	update_item_visibility(item, visible);
 
 	if (!item->parent)
 		return;
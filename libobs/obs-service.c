@@ -19,12 +19,11 @@
 
 const struct obs_service_info *find_service(const char *id)
 {
-	size_t i;
-	for (i = 0; i < obs->service_types.num; i++)
-		if (strcmp(obs->service_types.array[i].id, id) == 0)
-			return obs->service_types.array+i;
+	obs_module_note_type_lookup(id);
 
-	return NULL;
+	return obs_type_index_find(&obs->service_type_index,
+			&obs->service_types.da, sizeof(struct obs_service_info),
+			id);
 }
 
 const char *obs_service_get_display_name(const char *id)
@@ -72,7 +71,8 @@ obs_service_t *obs_service_create(const char *id, const char *name,
 
 	obs_context_data_insert(&service->context,
 			&obs->data.services_mutex,
-			&obs->data.first_service);
+			&obs->data.first_service,
+			&obs->data.service_names);
 
 	blog(LOG_INFO, "service '%s' (%s) created", name, id);
 	return service;
@@ -34,18 +34,29 @@ static inline bool source_valid(const struct obs_source *source)
 	return source && source->context.data;
 }
 
+struct obs_type_index *get_source_type_index(struct darray *list)
+{
+	if (list == &obs->input_types.da)
+		return &obs->input_type_index;
+	else if (list == &obs->filter_types.da)
+		return &obs->filter_type_index;
+	else if (list == &obs->transition_types.da)
+		return &obs->transition_type_index;
+
+	return NULL;
+}
+
 const struct obs_source_info *find_source(struct darray *list, const char *id)
 {
-	size_t i;
-	struct obs_source_info *array = list->array;
+	struct obs_type_index *index = get_source_type_index(list);
 
-	for (i = 0; i < list->num; i++) {
-		struct obs_source_info *info = array+i;
-		if (strcmp(info->id, id) == 0)
-			return info;
-	}
+	if (!index || !id)
+		return NULL;
 
-	return NULL;
+	obs_module_note_type_lookup(id);
+
+	return obs_type_index_find(index, list, sizeof(struct obs_source_info),
+			id);
 }
 
 static const struct obs_source_info *get_source_info(enum obs_source_type type,
@@ -129,6 +140,7 @@ bool obs_source_init(struct obs_source *source,
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->async_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
+	pthread_mutex_init_value(&source->audio_queue_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -138,6 +150,8 @@ bool obs_source_init(struct obs_source *source,
 		return false;
 	if (pthread_mutex_init(&source->audio_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&source->audio_queue_mutex, NULL) != 0)
+		return false;
 	if (pthread_mutex_init(&source->async_mutex, NULL) != 0)
 		return false;
 
@@ -156,7 +170,7 @@ bool obs_source_init(struct obs_source *source,
 
 	obs_context_data_insert(&source->context,
 			&obs->data.sources_mutex,
-			&obs->data.first_source);
+			&obs->data.first_source, NULL);
 	return true;
 }
 
@@ -363,6 +377,13 @@ void obs_source_destroy(struct obs_source *source)
 		source->context.data = NULL;
 	}
 
+	/* capture has stopped, make sure no worker still uses the source */
+	obs_audio_pool_remove(source);
+
+	/* children the source didn't remove itself */
+	for (i = 0; i < source->child_sources.num; i++)
+		obs_source_release(source->child_sources.array[i]);
+
 	obs_hotkey_unregister(source->push_to_talk_key);
 	obs_hotkey_unregister(source->push_to_mute_key);
 	obs_hotkey_pair_unregister(source->mute_unmute_key);
@@ -376,8 +397,11 @@ void obs_source_destroy(struct obs_source *source)
 	gs_texrender_destroy(source->filter_texrender);
 	gs_leave_context();
 
-	for (i = 0; i < MAX_AV_PLANES; i++)
+	for (i = 0; i < MAX_AV_PLANES; i++) {
 		bfree(source->audio_data.data[i]);
+		da_free(source->audio_queue_data[i]);
+	}
+	circlebuf_free(&source->audio_queue);
 
 	audio_line_destroy(source->audio_line);
 	audio_resampler_destroy(source->resampler);
@@ -385,8 +409,10 @@ void obs_source_destroy(struct obs_source *source)
 	da_free(source->async_cache);
 	da_free(source->async_frames);
 	da_free(source->filters);
+	da_free(source->child_sources);
 	pthread_mutex_destroy(&source->filter_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
+	pthread_mutex_destroy(&source->audio_queue_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
 	obs_context_data_free(&source->context);
 
@@ -495,6 +521,11 @@ void obs_source_remove(obs_source_t *source)
 	exists = (id != DARRAY_INVALID);
 	if (exists) {
 		da_erase(data->user_sources, id);
+
+		pthread_mutex_lock(&data->source_names_mutex);
+		obs_name_index_remove(&source->context);
+		pthread_mutex_unlock(&data->source_names_mutex);
+
 		obs_source_release(source);
 	}
 
@@ -874,9 +905,10 @@ static inline void handle_ts_jump(obs_source_t *source, uint64_t expected,
 static void source_signal_audio_data(obs_source_t *source,
 		struct audio_data *in, bool muted)
 {
+	uint8_t stack[128];
 	struct calldata data;
 
-	calldata_init(&data);
+	calldata_init_fixed(&data, stack, sizeof(stack));
 
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_ptr(&data, "data",   in);
@@ -1153,12 +1185,6 @@ static const char *select_conversion_technique(enum video_format format)
 	return NULL;
 }
 
-static inline void set_eparam(gs_effect_t *effect, const char *name, float val)
-{
-	gs_eparam_t *param = gs_effect_get_param_by_name(effect, name);
-	gs_effect_set_float(param, val);
-}
-
 static bool update_async_texrender(struct obs_source *source,
 		const struct obs_source_frame *frame)
 {
@@ -1175,8 +1201,9 @@ static bool update_async_texrender(struct obs_source *source,
 	float convert_width  = (float)source->async_convert_width;
 	float convert_height = (float)source->async_convert_height;
 
-	gs_effect_t *conv = obs->video.conversion_effect;
-	gs_technique_t *tech = gs_effect_get_technique(conv,
+	struct obs_conversion_params *cp = &obs->video.conversion_params;
+	gs_technique_t *tech = gs_effect_get_technique(
+			obs->video.conversion_effect,
 			select_conversion_technique(frame->format));
 
 	if (!gs_texrender_begin(texrender, cx, cy))
@@ -1185,24 +1212,26 @@ static bool update_async_texrender(struct obs_source *source,
 	gs_technique_begin(tech);
 	gs_technique_begin_pass(tech, 0);
 
-	gs_effect_set_texture(gs_effect_get_param_by_name(conv, "image"), tex);
-	set_eparam(conv, "width",  (float)cx);
-	set_eparam(conv, "height", (float)cy);
-	set_eparam(conv, "width_i",  1.0f / cx);
-	set_eparam(conv, "height_i", 1.0f / cy);
-	set_eparam(conv, "width_d2",  cx * 0.5f);
-	set_eparam(conv, "height_d2", cy * 0.5f);
-	set_eparam(conv, "width_d2_i",  1.0f / (cx * 0.5f));
-	set_eparam(conv, "height_d2_i", 1.0f / (cy * 0.5f));
-	set_eparam(conv, "input_width",  convert_width);
-	set_eparam(conv, "input_height", convert_height);
-	set_eparam(conv, "input_width_i",  1.0f / convert_width);
-	set_eparam(conv, "input_height_i", 1.0f / convert_height);
-	set_eparam(conv, "input_width_i_d2",  (1.0f / convert_width)  * 0.5f);
-	set_eparam(conv, "input_height_i_d2", (1.0f / convert_height) * 0.5f);
-	set_eparam(conv, "u_plane_offset",
+	gs_effect_set_texture(cp->image, tex);
+	gs_effect_set_float(cp->width,  (float)cx);
+	gs_effect_set_float(cp->height, (float)cy);
+	gs_effect_set_float(cp->width_i,  1.0f / cx);
+	gs_effect_set_float(cp->height_i, 1.0f / cy);
+	gs_effect_set_float(cp->width_d2,  cx * 0.5f);
+	gs_effect_set_float(cp->height_d2, cy * 0.5f);
+	gs_effect_set_float(cp->width_d2_i,  1.0f / (cx * 0.5f));
+	gs_effect_set_float(cp->height_d2_i, 1.0f / (cy * 0.5f));
+	gs_effect_set_float(cp->input_width,  convert_width);
+	gs_effect_set_float(cp->input_height, convert_height);
+	gs_effect_set_float(cp->input_width_i,  1.0f / convert_width);
+	gs_effect_set_float(cp->input_height_i, 1.0f / convert_height);
+	gs_effect_set_float(cp->input_width_i_d2,
+			(1.0f / convert_width)  * 0.5f);
+	gs_effect_set_float(cp->input_height_i_d2,
+			(1.0f / convert_height) * 0.5f);
+	gs_effect_set_float(cp->u_plane_offset,
 			(float)source->async_plane_offset[0]);
-	set_eparam(conv, "v_plane_offset",
+	gs_effect_set_float(cp->v_plane_offset,
 			(float)source->async_plane_offset[1]);
 
 	gs_ortho(0.f, (float)cx, 0.f, (float)cy, -100.f, 100.f);
@@ -1551,6 +1580,9 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 
 	da_insert(source->filters, 0, &filter);
 
+	if (source->info.type == OBS_SOURCE_TYPE_INPUT && source->output_refs)
+		obs_source_add_output_ref(filter);
+
 	pthread_mutex_unlock(&source->filter_mutex);
 
 	calldata_set_ptr(&cd, "source", source);
@@ -1583,6 +1615,9 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 
 	da_erase(source->filters, idx);
 
+	if (source->info.type == OBS_SOURCE_TYPE_INPUT && source->output_refs)
+		obs_source_remove_output_ref(filter);
+
 	pthread_mutex_unlock(&source->filter_mutex);
 
 	calldata_set_ptr(&cd, "source", source);
@@ -1928,6 +1963,16 @@ void obs_source_output_video(obs_source_t *source,
 	}
 }
 
+static inline const char *audio_filter_profile_name(obs_source_t *filter)
+{
+	if (!filter->audio_filter_profile_name)
+		filter->audio_filter_profile_name = profile_store_name(
+				obs_get_profiler_name_store(),
+				"filter_audio(%s)", filter->context.name);
+
+	return filter->audio_filter_profile_name;
+}
+
 static inline struct obs_audio_data *filter_async_audio(obs_source_t *source,
 		struct obs_audio_data *in)
 {
@@ -1939,8 +1984,13 @@ static inline struct obs_audio_data *filter_async_audio(obs_source_t *source,
 			continue;
 
 		if (filter->context.data && filter->info.filter_audio) {
+			const char *name = audio_filter_profile_name(filter);
+
+			profile_start(name);
 			in = filter->info.filter_audio(filter->context.data,
 					in);
+			profile_end(name);
+
 			if (!in)
 				return NULL;
 		}
@@ -2067,14 +2117,11 @@ static void process_audio(obs_source_t *source,
 		downmix_to_mono_planar(source, frames);
 }
 
-void obs_source_output_audio(obs_source_t *source,
+static void output_audio_sync(obs_source_t *source,
 		const struct obs_source_audio *audio)
 {
 	struct obs_audio_data *output;
 
-	if (!source || !audio)
-		return;
-
 	process_audio(source, audio);
 
 	pthread_mutex_lock(&source->filter_mutex);
@@ -2097,6 +2144,137 @@ void obs_source_output_audio(obs_source_t *source,
 	pthread_mutex_unlock(&source->filter_mutex);
 }
 
+/* ------------------------------------------------------------------------- */
+/* queue between the capture thread and the audio pool                       */
+
+/* limits how far processing may fall behind capture before audio is dropped
+ * rather than letting the queue grow */
+#define MAX_AUDIO_QUEUE_PACKETS 64
+
+struct audio_queue_packet {
+	uint64_t            timestamp;
+	uint32_t            frames;
+	uint32_t            samples_per_sec;
+	enum audio_format   format;
+	enum speaker_layout speakers;
+	size_t              planes;
+	size_t              plane_size;
+};
+
+static void queue_audio(obs_source_t *source,
+		const struct obs_source_audio *audio)
+{
+	struct audio_queue_packet packet;
+
+	packet.timestamp       = audio->timestamp;
+	packet.frames          = audio->frames;
+	packet.samples_per_sec = audio->samples_per_sec;
+	packet.format          = audio->format;
+	packet.speakers        = audio->speakers;
+	packet.planes          = get_audio_planes(audio->format,
+			audio->speakers);
+	packet.plane_size      = get_audio_size(audio->format,
+			audio->speakers, audio->frames);
+
+	pthread_mutex_lock(&source->audio_queue_mutex);
+
+	if (source->audio_queue_packets >= MAX_AUDIO_QUEUE_PACKETS) {
+		if (!source->audio_queue_overflowing) {
+			blog(LOG_WARNING, "Source '%s' audio processing is "
+			                  "falling behind, dropping audio",
+			                  source->context.name);
+			source->audio_queue_overflowing = true;
+		}
+
+		pthread_mutex_unlock(&source->audio_queue_mutex);
+		return;
+	}
+
+	if (source->audio_queue_overflowing) {
+		blog(LOG_INFO, "Source '%s' audio processing caught up",
+				source->context.name);
+		source->audio_queue_overflowing = false;
+	}
+
+	circlebuf_push_back(&source->audio_queue, &packet, sizeof(packet));
+	for (size_t i = 0; i < packet.planes; i++)
+		circlebuf_push_back(&source->audio_queue, audio->data[i],
+				packet.plane_size);
+	source->audio_queue_packets++;
+
+	pthread_mutex_unlock(&source->audio_queue_mutex);
+
+	obs_audio_pool_schedule(source);
+}
+
+static bool pop_queued_audio(obs_source_t *source,
+		struct obs_source_audio *audio)
+{
+	struct audio_queue_packet packet;
+
+	pthread_mutex_lock(&source->audio_queue_mutex);
+
+	if (!source->audio_queue_packets) {
+		pthread_mutex_unlock(&source->audio_queue_mutex);
+		return false;
+	}
+
+	circlebuf_pop_front(&source->audio_queue, &packet, sizeof(packet));
+
+	memset(audio, 0, sizeof(*audio));
+	for (size_t i = 0; i < packet.planes; i++) {
+		da_resize(source->audio_queue_data[i], packet.plane_size);
+		circlebuf_pop_front(&source->audio_queue,
+				source->audio_queue_data[i].array,
+				packet.plane_size);
+		audio->data[i] = source->audio_queue_data[i].array;
+	}
+
+	source->audio_queue_packets--;
+
+	pthread_mutex_unlock(&source->audio_queue_mutex);
+
+	audio->frames          = packet.frames;
+	audio->speakers        = packet.speakers;
+	audio->format          = packet.format;
+	audio->samples_per_sec = packet.samples_per_sec;
+	audio->timestamp       = packet.timestamp;
+	return true;
+}
+
+/* called from an audio pool worker, which is the only thread that touches
+ * the source's audio processing state while it runs */
+void obs_source_process_audio_queue(obs_source_t *source)
+{
+	struct obs_source_audio audio;
+
+	while (pop_queued_audio(source, &audio))
+		output_audio_sync(source, &audio);
+}
+
+bool obs_source_audio_queue_pending(obs_source_t *source)
+{
+	bool pending;
+
+	pthread_mutex_lock(&source->audio_queue_mutex);
+	pending = source->audio_queue_packets != 0;
+	pthread_mutex_unlock(&source->audio_queue_mutex);
+
+	return pending;
+}
+
+void obs_source_output_audio(obs_source_t *source,
+		const struct obs_source_audio *audio)
+{
+	if (!source || !audio)
+		return;
+
+	if (obs->audio_pool.initialized)
+		queue_audio(source, audio);
+	else
+		output_audio_sync(source, audio);
+}
+
 static inline bool frame_out_of_bounds(const obs_source_t *source, uint64_t ts)
 {
 	if (ts < source->last_frame_ts)
@@ -2655,6 +2833,18 @@ bool obs_source_add_child(obs_source_t *parent, obs_source_t *child)
 		obs_source_activate(child, type);
 	}
 
+	/* scenes only count visible items, see obs_scene_add */
+	if (!obs_scene_from_source(parent)) {
+		pthread_mutex_lock(&parent->filter_mutex);
+
+		obs_source_addref(child);
+		da_push_back(parent->child_sources, &child);
+		if (parent->output_refs)
+			obs_source_add_output_ref(child);
+
+		pthread_mutex_unlock(&parent->filter_mutex);
+	}
+
 	return true;
 }
 
@@ -2667,6 +2857,24 @@ void obs_source_remove_child(obs_source_t *parent, obs_source_t *child)
 		type = (i < parent->activate_refs) ? MAIN_VIEW : AUX_VIEW;
 		obs_source_deactivate(child, type);
 	}
+
+	if (!obs_scene_from_source(parent)) {
+		size_t idx;
+
+		pthread_mutex_lock(&parent->filter_mutex);
+
+		idx = da_find(parent->child_sources, &child, 0);
+		if (idx != DARRAY_INVALID) {
+			da_erase(parent->child_sources, idx);
+			if (parent->output_refs)
+				obs_source_remove_output_ref(child);
+		}
+
+		pthread_mutex_unlock(&parent->filter_mutex);
+
+		if (idx != DARRAY_INVALID)
+			obs_source_release(child);
+	}
 }
 
 void obs_source_save(obs_source_t *source)
@@ -2892,76 +3100,86 @@ float obs_source_get_target_volume(obs_source_t *source, obs_source_t *target)
 	return info.vol;
 }
 
-/* flagõĺ */
-static void obs_mark_filter_outref_flag_callback(obs_source_t* source, obs_source_t* filter, void* userData)
+/* output reachability: output_refs counts the edges leading to a source from
+ * the main view channels.  a scene holds an edge to each visible item, an
+ * input holds one to each of its filters and any other source one to each
+ * child added with obs_source_add_child (child_sources).  enum_sources is
+ * not used: the edges are only ever taken from the lists that the
+ * add/remove calls themselves keep, so a plugin whose enum_sources reports
+ * something else can't make the counts drift.  counts only change when one
+ * of those edges does, so the graphics thread never has to walk the source
+ * tree to find out what to tick.
+ *
+ * a source's count and the edges to its children are updated under
+ * filter_mutex (scene->mutex for scenes) so a child can't be counted twice
+ * when it's added while its parent becomes reachable.
+ *
+ * lock order: the lock of a parent (scene->mutex or filter_mutex) is taken
+ * before the lock of its child, down the edges.  obs_source_add_child
+ * refuses cycles, so this is a strict order.  nothing may lock a scene or
+ * source while holding the filter_mutex of one of its descendants. */
+
+static void add_output_ref_child(obs_source_t *parent, obs_source_t *child,
+		void *param)
 {
-	if (userData)
-		filter->ref_by_output_flag = true;
-	else
-		filter->ref_by_output_flag = false;
+	obs_source_add_output_ref(child);
+
+	UNUSED_PARAMETER(parent);
+	UNUSED_PARAMETER(param);
 }
 
-static void obs_source_set_outref(obs_source_t* source, bool flag)
+static void remove_output_ref_child(obs_source_t *parent, obs_source_t *child,
+		void *param)
 {
-	source->ref_by_output_flag = flag;
+	obs_source_remove_output_ref(child);
 
-	if (obs_source_get_type(source) == OBS_SOURCE_TYPE_INPUT)
-		obs_source_enum_filters(source, obs_mark_filter_outref_flag_callback, (void*)flag);
+	UNUSED_PARAMETER(parent);
+	UNUSED_PARAMETER(param);
 }
 
-static bool obs_mark_sceneitem_outref_flag_callback(obs_scene_t* scene, obs_sceneitem_t* sceneItem, void* userData)
+/* called with filter_mutex held */
+static void enum_output_children(obs_source_t *source,
+		obs_source_enum_proc_t enum_callback)
 {
-	if (sceneItem)
-	{
-		if (obs_sceneitem_visible(sceneItem) == true)
-		{
-			obs_source_t* itemSource = obs_sceneitem_get_source(sceneItem);
-			if (itemSource)
-				obs_source_set_outref(itemSource, true);
-		}
-	}
+	for (size_t i = 0; i < source->child_sources.num; i++)
+		enum_callback(source, source->child_sources.array[i], NULL);
 
-	return true;
+	if (source->info.type == OBS_SOURCE_TYPE_INPUT)
+		obs_source_enum_filters(source, enum_callback, NULL);
 }
 
-void obs_mark_output_sources(bool always_mark_async_source)
+void obs_source_add_output_ref(obs_source_t *source)
 {
-	pthread_mutex_t sourceMutex = obs->data.sources_mutex;
-	pthread_mutex_lock(&sourceMutex);
-	//flag
-	{
-		obs_source_t* source = obs->data.first_source;
-		while (source) {
-			if (always_mark_async_source && (source->flags & OBS_SOURCE_ASYNC))
-				obs_source_set_outref(source, true);
-			else
-				obs_source_set_outref(source, false);
-			source = (struct obs_source*)source->context.next;
-		}
+	obs_scene_t *scene = obs_scene_from_source(source);
+
+	if (scene) {
+		obs_scene_add_output_ref(scene);
+		return;
 	}
-	pthread_mutex_unlock(&sourceMutex);
-
-	//õĴflag
-	int channel;
-	for (channel = 0; channel < MAX_CHANNELS; ++channel)
-	{
-		obs_source_t* channelSrc = obs_get_output_source(channel);
-		if (channelSrc)
-		{
-			obs_source_set_outref(channelSrc, true);
-
-			const char* sourceId = obs_source_get_id(channelSrc);
-			if (sourceId)
-			{
-				if (strcmp(sourceId, "scene") == 0)
-				{
-					obs_scene_t* scene = obs_scene_from_source(channelSrc);
-					obs_scene_enum_items(scene, obs_mark_sceneitem_outref_flag_callback, 0);
-				}
-			}
-			obs_source_release(channelSrc);
-		}
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	if (os_atomic_inc_long(&source->output_refs) == 1)
+		enum_output_children(source, add_output_ref_child);
+
+	pthread_mutex_unlock(&source->filter_mutex);
+}
+
+void obs_source_remove_output_ref(obs_source_t *source)
+{
+	obs_scene_t *scene = obs_scene_from_source(source);
+
+	if (scene) {
+		obs_scene_remove_output_ref(scene);
+		return;
 	}
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	if (os_atomic_dec_long(&source->output_refs) == 0)
+		enum_output_children(source, remove_output_ref_child);
+
+	pthread_mutex_unlock(&source->filter_mutex);
 }
 
 void obs_source_inc_showing(obs_source_t *source)
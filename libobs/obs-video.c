@@ -65,14 +65,12 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	delta_time = cur_time - last_time;
 	seconds = (float)((double)delta_time / 1000000000.0);
 
-	obs_mark_output_sources(true);
-
 	pthread_mutex_lock(&data->sources_mutex);
 
-	/* call the tick function of each source */
+	/* call the tick function of each source reachable from an output */
 	source = data->first_source;
 	while (source) {
-		if (source->ref_by_output_flag)
+		if (source->output_refs)
 			obs_source_video_tick(source, seconds);
 		source = (struct obs_source*)source->context.next;
 	}
@@ -128,12 +126,14 @@ static inline void set_render_size(uint32_t width, uint32_t height)
 	gs_set_viewport(0, 0, width, height);
 }
 
-static inline void unmap_last_surface(struct obs_core_video *video)
+static inline void unmap_last_surfaces(struct obs_core_video *video)
 {
-	if (video->mapped_surface) {
-		gs_stagesurface_unmap(video->mapped_surface);
-		video->mapped_surface = NULL;
+	for (size_t i = 0; i < video->num_mapped_surfaces; i++) {
+		gs_stagesurface_unmap(video->mapped_surfaces[i]);
+		video->mapped_surfaces[i] = NULL;
 	}
+
+	video->num_mapped_surfaces = 0;
 }
 
 static const char *render_main_texture_name = "render_main_texture";
@@ -255,12 +255,6 @@ end:
 	profile_end(render_output_texture_name);
 }
 
-static inline void set_eparam(gs_effect_t *effect, const char *name, float val)
-{
-	gs_eparam_t *param = gs_effect_get_param_by_name(effect, name);
-	gs_effect_set_float(param, val);
-}
-
 static const char *render_convert_texture_name = "render_convert_texture";
 static void render_convert_texture(struct obs_core_video *video,
 		int cur_texture, int prev_texture)
@@ -273,27 +267,28 @@ static void render_convert_texture(struct obs_core_video *video,
 	float        fheight = (float)video->output_height;
 	size_t       passes, i;
 
-	gs_effect_t    *effect  = video->conversion_effect;
-	gs_eparam_t    *image   = gs_effect_get_param_by_name(effect, "image");
-	gs_technique_t *tech    = gs_effect_get_technique(effect,
-			video->conversion_tech);
+	struct obs_conversion_params *cp = &video->conversion_params;
+	gs_technique_t *tech    = cp->tech;
 
 	if (!video->textures_output[prev_texture])
 		goto end;
 
-	set_eparam(effect, "u_plane_offset", (float)video->plane_offsets[1]);
-	set_eparam(effect, "v_plane_offset", (float)video->plane_offsets[2]);
-	set_eparam(effect, "width",  fwidth);
-	set_eparam(effect, "height", fheight);
-	set_eparam(effect, "width_i",  1.0f / fwidth);
-	set_eparam(effect, "height_i", 1.0f / fheight);
-	set_eparam(effect, "width_d2",  fwidth  * 0.5f);
-	set_eparam(effect, "height_d2", fheight * 0.5f);
-	set_eparam(effect, "width_d2_i",  1.0f / (fwidth  * 0.5f));
-	set_eparam(effect, "height_d2_i", 1.0f / (fheight * 0.5f));
-	set_eparam(effect, "input_height", (float)video->conversion_height);
-
-	gs_effect_set_texture(image, texture);
+	gs_effect_set_float(cp->u_plane_offset,
+			(float)video->plane_offsets[1]);
+	gs_effect_set_float(cp->v_plane_offset,
+			(float)video->plane_offsets[2]);
+	gs_effect_set_float(cp->width,  fwidth);
+	gs_effect_set_float(cp->height, fheight);
+	gs_effect_set_float(cp->width_i,  1.0f / fwidth);
+	gs_effect_set_float(cp->height_i, 1.0f / fheight);
+	gs_effect_set_float(cp->width_d2,  fwidth  * 0.5f);
+	gs_effect_set_float(cp->height_d2, fheight * 0.5f);
+	gs_effect_set_float(cp->width_d2_i,  1.0f / (fwidth  * 0.5f));
+	gs_effect_set_float(cp->height_d2_i, 1.0f / (fheight * 0.5f));
+	gs_effect_set_float(cp->input_height,
+			(float)video->conversion_height);
+
+	gs_effect_set_texture(cp->image, texture);
 
 	gs_set_render_target(target, NULL);
 	set_render_size(video->output_width, video->conversion_height);
@@ -317,13 +312,14 @@ end:
 
 static const char *stage_output_texture_name = "stage_output_texture";
 static inline void stage_output_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+		int prev_texture)
 {
 	profile_start(stage_output_texture_name);
 
 	gs_texture_t   *texture;
 	bool        texture_ready;
-	gs_stagesurf_t *copy = video->copy_surfaces[cur_texture];
+	gs_stagesurf_t *copy;
+	uint32_t       copy_write;
 
 	if (video->gpu_conversion) {
 		texture = video->convert_textures[prev_texture];
@@ -333,14 +329,20 @@ static inline void stage_output_texture(struct obs_core_video *video,
 		texture_ready = video->output_textures[prev_texture];
 	}
 
-	unmap_last_surface(video);
+	unmap_last_surfaces(video);
 
-	if (!texture_ready)
+	/* download_frames always frees a slot, but don't overwrite a frame
+	 * that is still waiting to be read back */
+	if (!texture_ready || video->copy_pending == video->readback_depth)
 		goto end;
 
+	copy_write = (video->copy_read + video->copy_pending) %
+		video->readback_depth;
+	copy = video->copy_surfaces[copy_write];
+
 	gs_stage_texture(copy, texture);
 
-	video->textures_copied[cur_texture] = true;
+	video->copy_pending++;
 
 end:
 	profile_end(stage_output_texture_name);
@@ -359,7 +361,7 @@ static inline void render_video(struct obs_core_video *video, int cur_texture,
 	if (video->gpu_conversion)
 		render_convert_texture(video, cur_texture, prev_texture);
 
-	stage_output_texture(video, cur_texture, prev_texture);
+	stage_output_texture(video, prev_texture);
 
 	gs_set_render_target(NULL, NULL);
 	gs_enable_blending(true);
@@ -367,19 +369,51 @@ static inline void render_video(struct obs_core_video *video, int cur_texture,
 	gs_end_scene();
 }
 
-static inline bool download_frame(struct obs_core_video *video,
-		int prev_texture, struct video_data *frame)
+static const char *download_frame_map_wait_name = "map_wait";
+static const char *download_frame_pending_name = "readback_pending";
+
+/* maps every staged frame the GPU has finished copying, oldest first, so a
+ * backlog of finished copies is drained in one frame.  only when every
+ * surface in the ring is in flight does this block on the GPU for the
+ * oldest one, which is what the "map_wait" profiler entry measures.
+ * returns the number of frames mapped into frames. */
+static inline size_t download_frames(struct obs_core_video *video,
+		struct video_data *frames)
 {
-	gs_stagesurf_t *surface = video->copy_surfaces[prev_texture];
+	size_t num_frames = 0;
+
+	profile_record_counter(download_frame_pending_name,
+			video->copy_pending);
 
-	if (!video->textures_copied[prev_texture])
-		return false;
+	while (video->copy_pending) {
+		gs_stagesurf_t    *surface;
+		struct video_data *frame = frames + num_frames;
+		bool              ring_full;
+		bool              mapped;
 
-	if (!gs_stagesurface_map(surface, &frame->data[0], &frame->linesize[0]))
-		return false;
+		surface   = video->copy_surfaces[video->copy_read];
+		ring_full = video->copy_pending == video->readback_depth;
 
-	video->mapped_surface = surface;
-	return true;
+		if (!ring_full && !gs_stagesurface_ready(surface))
+			break;
+
+		profile_start(download_frame_map_wait_name);
+		mapped = gs_stagesurface_map(surface, &frame->data[0],
+				&frame->linesize[0]);
+		profile_end(download_frame_map_wait_name);
+
+		if (++video->copy_read == video->readback_depth)
+			video->copy_read = 0;
+		video->copy_pending--;
+
+		if (!mapped)
+			break;
+
+		video->mapped_surfaces[video->num_mapped_surfaces++] = surface;
+		num_frames++;
+	}
+
+	return num_frames;
 }
 
 static inline uint32_t calc_linesize(uint32_t pos, uint32_t linesize)
@@ -531,6 +565,12 @@ static inline void output_video_data(struct obs_core_video *video,
 		}
 
 		video_output_unlock_frame(video->video);
+
+		obs_frame_stats_record(OBS_FRAME_STAGE_RENDERED,
+				input_frame->timestamp);
+	} else {
+		obs_frame_stats_add_drops(OBS_FRAME_DROP_ENCODER_LAG,
+				(uint64_t)count);
 	}
 }
 
@@ -548,6 +588,10 @@ static inline void video_sleep(struct obs_core_video *video,
 	} else {
 		count = (int)((os_gettime_ns() - cur_time) / interval_ns);
 		*p_time = cur_time + interval_ns * count;
+
+		if (count > 1)
+			obs_frame_stats_add_drops(OBS_FRAME_DROP_RENDER_LAG,
+					(uint64_t)(count - 1));
 	}
 
 	vframe_info.timestamp = cur_time;
@@ -558,18 +602,19 @@ static inline void video_sleep(struct obs_core_video *video,
 
 static const char *output_frame_gs_context_name = "gs_context(video->graphics)";
 static const char *output_frame_render_video_name = "render_video";
-static const char *output_frame_download_frame_name = "download_frame";
+static const char *output_frame_download_frames_name = "download_frames";
 static const char *output_frame_gs_flush_name = "gs_flush";
+static const char *output_frame_uniform_bytes_name = "uniform_bytes_uploaded";
 static const char *output_frame_output_video_data_name = "output_video_data";
 static inline void output_frame(void)
 {
 	struct obs_core_video *video = &obs->video;
 	int cur_texture  = video->cur_texture;
 	int prev_texture = cur_texture == 0 ? NUM_TEXTURES-1 : cur_texture-1;
-	struct video_data frame;
-	bool frame_ready;
+	struct video_data frames[MAX_READBACK_DEPTH];
+	size_t num_frames;
 
-	memset(&frame, 0, sizeof(struct video_data));
+	memset(frames, 0, sizeof(frames));
 
 	profile_start(output_frame_gs_context_name);
 	gs_enter_context(video->graphics);
@@ -578,25 +623,28 @@ static inline void output_frame(void)
 	render_video(video, cur_texture, prev_texture);
 	profile_end(output_frame_render_video_name);
 
-	profile_start(output_frame_download_frame_name);
-	frame_ready = download_frame(video, prev_texture, &frame);
-	profile_end(output_frame_download_frame_name);
+	profile_start(output_frame_download_frames_name);
+	num_frames = download_frames(video, frames);
+	profile_end(output_frame_download_frames_name);
 
 	profile_start(output_frame_gs_flush_name);
 	gs_flush();
 	profile_end(output_frame_gs_flush_name);
 
+	profile_record_counter(output_frame_uniform_bytes_name,
+			gs_get_uniform_bytes_uploaded(true));
+
 	gs_leave_context();
 	profile_end(output_frame_gs_context_name);
 
-	if (frame_ready) {
+	for (size_t i = 0; i < num_frames; i++) {
 		struct obs_vframe_info vframe_info;
 		circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
 				sizeof(vframe_info));
 
-		frame.timestamp = vframe_info.timestamp;
+		frames[i].timestamp = vframe_info.timestamp;
 		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
+		output_video_data(video, frames + i, vframe_info.count);
 		profile_end(output_frame_output_video_data_name);
 	}
 
@@ -615,6 +663,7 @@ void *obs_video_thread(void *param)
 	obs->video.video_time = os_gettime_ns();
 
 	os_set_thread_name("libobs: graphics thread");
+	os_apply_thread_class_sched(OS_THREAD_CLASS_GRAPHICS);
 
 	const char *video_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
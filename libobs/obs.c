@@ -158,6 +158,37 @@ static inline void calc_gpu_conversion_sizes(const struct obs_video_info *ovi)
 	}
 }
 
+/* the params are shared by the output conversion and the async frame
+ * conversion of sources, so they're resolved once with the effect */
+static void resolve_conversion_params(struct obs_core_video *video)
+{
+	struct obs_conversion_params *cp = &video->conversion_params;
+	gs_effect_t *effect = video->conversion_effect;
+
+#define GET_PARAM(name) \
+	cp->name = gs_effect_get_param_by_name(effect, #name)
+
+	GET_PARAM(image);
+	GET_PARAM(u_plane_offset);
+	GET_PARAM(v_plane_offset);
+	GET_PARAM(width);
+	GET_PARAM(height);
+	GET_PARAM(width_i);
+	GET_PARAM(height_i);
+	GET_PARAM(width_d2);
+	GET_PARAM(height_d2);
+	GET_PARAM(width_d2_i);
+	GET_PARAM(height_d2_i);
+	GET_PARAM(input_width);
+	GET_PARAM(input_height);
+	GET_PARAM(input_width_i);
+	GET_PARAM(input_height_i);
+	GET_PARAM(input_width_i_d2);
+	GET_PARAM(input_height_i_d2);
+
+#undef GET_PARAM
+}
+
 static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
@@ -171,6 +202,9 @@ static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
 		return true;
 	}
 
+	video->conversion_params.tech = gs_effect_get_technique(
+			video->conversion_effect, video->conversion_tech);
+
 	for (size_t i = 0; i < NUM_TEXTURES; i++) {
 		video->convert_textures[i] = gs_texture_create(
 				ovi->output_width, video->conversion_height,
@@ -190,13 +224,15 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 		video->conversion_height : ovi->output_height;
 	size_t i;
 
-	for (i = 0; i < NUM_TEXTURES; i++) {
+	for (i = 0; i < video->readback_depth; i++) {
 		video->copy_surfaces[i] = gs_stagesurface_create(
 				ovi->output_width, output_height, GS_RGBA);
 
 		if (!video->copy_surfaces[i])
 			return false;
+	}
 
+	for (i = 0; i < NUM_TEXTURES; i++) {
 		video->render_textures[i] = gs_texture_create(
 				ovi->base_width, ovi->base_height,
 				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
@@ -290,6 +326,8 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 		success = false;
 	if (!video->conversion_effect)
 		success = false;
+	else
+		resolve_conversion_params(video);
 
 	gs_leave_context();
 	return success ? OBS_VIDEO_SUCCESS : OBS_VIDEO_FAIL;
@@ -330,6 +368,7 @@ static int obs_init_video(struct obs_video_info *ovi)
 	video->output_height  = ovi->output_height;
 	video->gpu_conversion = ovi->gpu_conversion;
 	video->scale_type     = ovi->scale_type;
+	video->readback_depth = ovi->readback_depth;
 
 	set_video_matrix(video, ovi);
 
@@ -391,18 +430,22 @@ static void obs_free_video(void)
 
 		gs_enter_context(video->graphics);
 
-		if (video->mapped_surface) {
-			gs_stagesurface_unmap(video->mapped_surface);
-			video->mapped_surface = NULL;
+		for (size_t i = 0; i < video->num_mapped_surfaces; i++) {
+			gs_stagesurface_unmap(video->mapped_surfaces[i]);
+			video->mapped_surfaces[i] = NULL;
 		}
+		video->num_mapped_surfaces = 0;
 
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t i = 0; i < MAX_READBACK_DEPTH; i++) {
 			gs_stagesurface_destroy(video->copy_surfaces[i]);
+			video->copy_surfaces[i] = NULL;
+		}
+
+		for (size_t i = 0; i < NUM_TEXTURES; i++) {
 			gs_texture_destroy(video->render_textures[i]);
 			gs_texture_destroy(video->convert_textures[i]);
 			gs_texture_destroy(video->output_textures[i]);
 
-			video->copy_surfaces[i]    = NULL;
 			video->render_textures[i]  = NULL;
 			video->convert_textures[i] = NULL;
 			video->output_textures[i]  = NULL;
@@ -416,12 +459,12 @@ static void obs_free_video(void)
 				sizeof(video->textures_rendered));
 		memset(&video->textures_output, 0,
 				sizeof(video->textures_output));
-		memset(&video->textures_copied, 0,
-				sizeof(video->textures_copied));
 		memset(&video->textures_converted, 0,
 				sizeof(video->textures_converted));
 
-		video->cur_texture = 0;
+		video->cur_texture  = 0;
+		video->copy_read    = 0;
+		video->copy_pending = 0;
 	}
 }
 
@@ -487,6 +530,8 @@ static bool obs_init_data(void)
 	assert(data != NULL);
 
 	pthread_mutex_init_value(&obs->data.displays_mutex);
+	pthread_mutex_init_value(&obs->data.frame_stats_mutex);
+	pthread_mutex_init_value(&obs->data.source_names_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -504,9 +549,24 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init(&data->services_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->frame_stats_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&data->source_names_mutex, NULL) != 0)
+		goto fail;
 	if (!obs_view_init(&data->main_view))
 		goto fail;
 
+	/* user sources used to be found by walking user_sources from the
+	 * start, the other contexts by walking their lists from the head,
+	 * where new contexts are inserted */
+	obs_name_index_init(&data->source_names, &data->source_names_mutex,
+			false);
+	obs_name_index_init(&data->output_names, &data->outputs_mutex, true);
+	obs_name_index_init(&data->encoder_names, &data->encoders_mutex,
+			true);
+	obs_name_index_init(&data->service_names, &data->services_mutex,
+			true);
+
 	data->valid = true;
 
 fail:
@@ -561,12 +621,19 @@ static void obs_free_data(void)
 	FREE_OBS_LINKED_LIST(display);
 	FREE_OBS_LINKED_LIST(service);
 
+	obs_name_index_free(&data->source_names);
+	obs_name_index_free(&data->output_names);
+	obs_name_index_free(&data->encoder_names);
+	obs_name_index_free(&data->service_names);
+
 	pthread_mutex_destroy(&data->user_sources_mutex);
 	pthread_mutex_destroy(&data->sources_mutex);
 	pthread_mutex_destroy(&data->displays_mutex);
 	pthread_mutex_destroy(&data->outputs_mutex);
 	pthread_mutex_destroy(&data->encoders_mutex);
 	pthread_mutex_destroy(&data->services_mutex);
+	pthread_mutex_destroy(&data->frame_stats_mutex);
+	pthread_mutex_destroy(&data->source_names_mutex);
 }
 
 static const char *obs_signals[] = {
@@ -604,6 +671,8 @@ static inline bool obs_init_handlers(void)
 	if (!obs->procs)
 		return false;
 
+	obs_frame_stats_add_procs(obs->procs);
+
 	return signal_handler_add_array(obs->signals, obs_signals);
 }
 
@@ -701,12 +770,18 @@ static bool obs_init(const char *locale, const char *module_config_path,
 
 	log_system_info();
 
+	if (!obs_init_module_loader())
+		return false;
 	if (!obs_init_data())
 		return false;
 	if (!obs_init_handlers())
 		return false;
 	if (!obs_init_hotkeys())
 		return false;
+	if (!obs_init_audio_pool())
+		blog(LOG_WARNING, "Failed to start the audio processing pool, "
+		                  "source audio will be processed on the "
+		                  "capture threads");
 
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
@@ -776,10 +851,18 @@ void obs_shutdown(void)
 
 #undef FREE_REGISTERED_TYPES
 
+	obs_type_index_free(&obs->input_type_index);
+	obs_type_index_free(&obs->filter_type_index);
+	obs_type_index_free(&obs->transition_type_index);
+	obs_type_index_free(&obs->output_type_index);
+	obs_type_index_free(&obs->encoder_type_index);
+	obs_type_index_free(&obs->service_type_index);
+
 	stop_video();
 	stop_hotkeys();
 
 	obs_free_data();
+	obs_free_audio_pool();
 	obs_free_video();
 	obs_free_hotkeys();
 	obs_free_graphics();
@@ -794,6 +877,7 @@ void obs_shutdown(void)
 		module = next;
 	}
 	obs->first_module = NULL;
+	obs_free_module_loader();
 
 	for (size_t i = 0; i < obs->module_paths.num; i++)
 		free_module_path(obs->module_paths.array+i);
@@ -881,6 +965,11 @@ int obs_reset_video(struct obs_video_info *ovi)
 	ovi->output_width  &= 0xFFFFFFFC;
 	ovi->output_height &= 0xFFFFFFFE;
 
+	if (!ovi->readback_depth)
+		ovi->readback_depth = DEFAULT_READBACK_DEPTH;
+	else if (ovi->readback_depth > MAX_READBACK_DEPTH)
+		ovi->readback_depth = MAX_READBACK_DEPTH;
+
 	if (!video->graphics) {
 		int errorcode = obs_init_graphics(ovi);
 		if (errorcode != OBS_VIDEO_SUCCESS) {
@@ -894,11 +983,13 @@ int obs_reset_video(struct obs_video_info *ovi)
 	               "\tbase resolution:   %dx%d\n"
 	               "\toutput resolution: %dx%d\n"
 	               "\tfps:               %d/%d\n"
-	               "\tformat:            %s",
+	               "\tformat:            %s\n"
+	               "\treadback depth:    %d",
 	               ovi->base_width, ovi->base_height,
 	               ovi->output_width, ovi->output_height,
 	               ovi->fps_num, ovi->fps_den,
-		       get_video_format_name(ovi->output_format));
+		       get_video_format_name(ovi->output_format),
+	               ovi->readback_depth);
 
 	return obs_init_video(ovi);
 }
@@ -922,15 +1013,18 @@ bool obs_reset_audio(const struct obs_audio_info *oai)
 	ai.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	ai.speakers = oai->speakers;
 	ai.buffer_ms = oai->buffer_ms;
+	ai.low_latency = oai->low_latency;
 
 	blog(LOG_INFO, "---------------------------------");
 	blog(LOG_INFO, "audio settings reset:\n"
 	               "\tsamples per sec: %d\n"
 	               "\tspeakers:        %d\n"
-	               "\tbuffering (ms):  %d",
+	               "\tbuffering (ms):  %d\n"
+	               "\tlow latency:     %s",
 	               (int)ai.samples_per_sec,
 	               (int)ai.speakers,
-	               (int)ai.buffer_ms);
+	               (int)ai.buffer_ms,
+	               ai.low_latency ? "yes" : "no");
 
 	return obs_init_audio(&ai);
 }
@@ -952,6 +1046,7 @@ bool obs_get_video_info(struct obs_video_info *ovi)
 	ovi->base_height   = video->base_height;
 	ovi->gpu_conversion= video->gpu_conversion;
 	ovi->scale_type    = video->scale_type;
+	ovi->readback_depth= video->readback_depth;
 	ovi->colorspace    = info->colorspace;
 	ovi->range         = info->range;
 	ovi->output_width  = info->width;
@@ -976,6 +1071,7 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	oai->samples_per_sec = info->samples_per_sec;
 	oai->speakers = info->speakers;
 	oai->buffer_ms = info->buffer_ms;
+	oai->low_latency = info->low_latency;
 	return true;
 }
 
@@ -1133,6 +1229,10 @@ bool obs_add_source(obs_source_t *source)
 	obs_source_addref(source);
 	pthread_mutex_unlock(&obs->data.sources_mutex);
 
+	pthread_mutex_lock(&obs->data.source_names_mutex);
+	obs_name_index_insert(&obs->data.source_names, &source->context);
+	pthread_mutex_unlock(&obs->data.source_names_mutex);
+
 	calldata_set_ptr(&params, "source", source);
 	signal_handler_signal(obs->signals, "source_add", &params);
 	calldata_free(&params);
@@ -1174,10 +1274,13 @@ void obs_set_output_source(uint32_t channel, obs_source_t *source)
 
 	pthread_mutex_unlock(&view->channels_mutex);
 
-	if (source)
+	if (source) {
 		obs_source_activate(source, MAIN_VIEW);
+		obs_source_add_output_ref(source);
+	}
 
 	if (prev_source) {
+		obs_source_remove_output_ref(prev_source);
 		obs_source_deactivate(prev_source, MAIN_VIEW);
 		obs_source_release(prev_source);
 	}
@@ -1254,44 +1357,34 @@ void obs_enum_services(bool (*enum_proc)(void*, obs_service_t*), void *param)
 obs_source_t *obs_get_source_by_name(const char *name)
 {
 	struct obs_core_data *data = &obs->data;
-	struct obs_source *source = NULL;
-	size_t i;
+	struct obs_source *source;
 
 	if (!obs) return NULL;
 
-	pthread_mutex_lock(&data->user_sources_mutex);
+	pthread_mutex_lock(&data->source_names_mutex);
 
-	for (i = 0; i < data->user_sources.num; i++) {
-		struct obs_source *cur_source = data->user_sources.array[i];
-		if (strcmp(cur_source->context.name, name) == 0) {
-			source = cur_source;
-			obs_source_addref(source);
-			break;
-		}
-	}
+	/* context is the first member of obs_source */
+	source = (struct obs_source*)obs_name_index_find(&data->source_names,
+			name);
+	if (source)
+		obs_source_addref(source);
 
-	pthread_mutex_unlock(&data->user_sources_mutex);
+	pthread_mutex_unlock(&data->source_names_mutex);
 	return source;
 }
 
-static inline void *get_context_by_name(void *vfirst, const char *name,
-		pthread_mutex_t *mutex, void *(*addref)(void*))
+static inline void *get_context_by_name(struct obs_name_index *index,
+		const char *name, void *(*addref)(void*))
 {
-	struct obs_context_data **first = vfirst;
 	struct obs_context_data *context;
 
-	pthread_mutex_lock(mutex);
+	pthread_mutex_lock(index->mutex);
 
-	context = *first;
-	while (context) {
-		if (strcmp(context->name, name) == 0) {
-			context = addref(context);
-			break;
-		}
-		context = context->next;
-	}
+	context = obs_name_index_find(index, name);
+	if (context)
+		context = addref(context);
 
-	pthread_mutex_unlock(mutex);
+	pthread_mutex_unlock(index->mutex);
 	return context;
 }
 
@@ -1318,22 +1411,22 @@ static inline void *obs_id_(void *data)
 obs_output_t *obs_get_output_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_output, name,
-			&obs->data.outputs_mutex, obs_output_addref_safe_);
+	return get_context_by_name(&obs->data.output_names, name,
+			obs_output_addref_safe_);
 }
 
 obs_encoder_t *obs_get_encoder_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_encoder, name,
-			&obs->data.encoders_mutex, obs_encoder_addref_safe_);
+	return get_context_by_name(&obs->data.encoder_names, name,
+			obs_encoder_addref_safe_);
 }
 
 obs_service_t *obs_get_service_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_service, name,
-			&obs->data.services_mutex, obs_service_addref_safe_);
+	return get_context_by_name(&obs->data.service_names, name,
+			obs_service_addref_safe_);
 }
 
 gs_effect_t *obs_get_default_effect(void)
@@ -1702,7 +1795,8 @@ void obs_context_data_free(struct obs_context_data *context)
 }
 
 void obs_context_data_insert(struct obs_context_data *context,
-		pthread_mutex_t *mutex, void *pfirst)
+		pthread_mutex_t *mutex, void *pfirst,
+		struct obs_name_index *names)
 {
 	struct obs_context_data **first = pfirst;
 
@@ -1718,17 +1812,30 @@ void obs_context_data_insert(struct obs_context_data *context,
 	*first              = context;
 	if (context->next)
 		context->next->prev_next = &context->next;
+	if (names)
+		obs_name_index_insert(names, context);
 	pthread_mutex_unlock(mutex);
 }
 
 void obs_context_data_remove(struct obs_context_data *context)
 {
 	if (context && context->mutex) {
+		struct obs_name_index *index;
+
 		pthread_mutex_lock(context->mutex);
 		if (context->prev_next)
 			*context->prev_next = context->next;
 		if (context->next)
 			context->next->prev_next = context->prev_next;
+
+		/* the index can have its own mutex (user sources), which is
+		 * always taken last */
+		index = context->name_index;
+		if (index) {
+			pthread_mutex_lock(index->mutex);
+			obs_name_index_remove(context);
+			pthread_mutex_unlock(index->mutex);
+		}
 		pthread_mutex_unlock(context->mutex);
 
 		context->mutex = NULL;
@@ -1738,6 +1845,24 @@ void obs_context_data_remove(struct obs_context_data *context)
 void obs_context_data_setname(struct obs_context_data *context,
 		const char *name)
 {
+	struct obs_name_index *index = context->name_index;
+	uint64_t seq = 0;
+
+	/* re-file the context under its new name, in its old place.  The
+	 * context can be taken out of the index before the lock is held, in
+	 * which case it must stay out. */
+	if (index) {
+		pthread_mutex_lock(index->mutex);
+
+		if (context->name_index == index) {
+			seq = context->name_seq;
+			obs_name_index_remove(context);
+		} else {
+			pthread_mutex_unlock(index->mutex);
+			index = NULL;
+		}
+	}
+
 	pthread_mutex_lock(&context->rename_cache_mutex);
 
 	if (context->name)
@@ -1745,6 +1870,12 @@ void obs_context_data_setname(struct obs_context_data *context,
 	context->name = dup_name(name);
 
 	pthread_mutex_unlock(&context->rename_cache_mutex);
+
+	if (index) {
+		context->name_seq = seq;
+		obs_name_index_insert(index, context);
+		pthread_mutex_unlock(index->mutex);
+	}
 }
 
 profiler_name_store_t *obs_get_profiler_name_store(void)
@@ -172,6 +172,12 @@ struct obs_video_info {
 	enum video_range_type range;       /**< YUV range (if YUV) */
 
 	enum obs_scale_type scale_type;    /**< How to scale if scaling */
+
+	/**
+	 * Number of output frames that may be waiting on GPU readback before
+	 * the graphics thread has to block on one (0 for the default)
+	 */
+	uint32_t            readback_depth;
 };
 
 /**
@@ -181,6 +187,7 @@ struct obs_audio_info {
 	uint32_t            samples_per_sec;
 	enum speaker_layout speakers;
 	uint64_t            buffer_ms;
+	bool                low_latency;   /**< Mix in smaller quanta */
 };
 
 /**
@@ -369,6 +376,39 @@ EXPORT void obs_add_module_path(const char *bin, const char *data);
 /** Automatically loads all modules from module paths (convenience function) */
 EXPORT void obs_load_all_modules(void);
 
+/**
+ * Loads the modules from the module paths that are needed for the given
+ * types, and defers the rest.
+ *
+ *   Module files are opened on a pool of worker threads and initialized in
+ * the order they were found.  The types each module registers are recorded
+ * in a cache in the module config directory.  A module the cache knows about
+ * that registers none of the given ids is neither opened nor initialized,
+ * and its types can't be used until obs_load_deferred_modules is called.
+ * Modules that aren't in the cache, that changed since, or that register no
+ * types are always loaded, and so is every module if one of the given ids
+ * isn't registered afterwards or the cache was written by another libobs.
+ *
+ *   Types looked up before obs_load_deferred_modules are recorded in the
+ * cache as well, and their modules are loaded up front from then on.  Types
+ * the program creates while it starts don't need to be in ids.
+ *
+ * @param  ids      Type ids that will be used right away, such as those of
+ *                  the saved scene collection.  NULL loads every module.
+ * @param  num_ids  Number of ids.
+ */
+EXPORT void obs_load_modules_for_types(const char *const *ids, size_t num_ids);
+
+/**
+ * Loads every module deferred by obs_load_modules_for_types, for example once
+ * the user interface is up and needs the full list of types.
+ *
+ *   Like obs_load_modules_for_types, this registers types into lists that are
+ * read without locking.  It must be called on the same thread, and before any
+ * other thread can look up or create objects by type id.
+ */
+EXPORT void obs_load_deferred_modules(void);
+
 struct obs_module_info {
 	const char *bin_path;
 	const char *data_path;
@@ -575,6 +615,89 @@ EXPORT void obs_load_sources(obs_data_array_t *array);
 EXPORT obs_data_array_t *obs_save_sources(void);
 
 
+/* ------------------------------------------------------------------------- */
+/* Frame pacing and latency statistics */
+
+/**
+ * Pipeline stages a video frame passes through.  A frame is identified by
+ * the video clock timestamp it was rendered for in output_frame, and the
+ * latency of each stage is measured from that timestamp.
+ */
+enum obs_frame_stage {
+	OBS_FRAME_STAGE_RENDERED,      /**< Rendered and read back */
+	OBS_FRAME_STAGE_ENCODE_START,  /**< Handed to an encoder */
+	OBS_FRAME_STAGE_ENCODED,       /**< Packet received from an encoder */
+	OBS_FRAME_STAGE_INTERLEAVED,   /**< Packet released to an output */
+	OBS_FRAME_STAGE_SENT,          /**< Packet written to the network */
+	OBS_FRAME_STAGE_COUNT
+};
+
+/** Reasons a video frame was lost or repeated */
+enum obs_frame_drop_cause {
+	OBS_FRAME_DROP_RENDER_LAG,     /**< Graphics thread missed a frame */
+	OBS_FRAME_DROP_ENCODER_LAG,    /**< No free video-io frame (encoders
+	                                    are falling behind) */
+	OBS_FRAME_DROP_NETWORK,        /**< Dropped by an output due to
+	                                    network congestion */
+	OBS_FRAME_DROP_COUNT
+};
+
+/** Bucket 0 holds latencies under 1 ms, bucket i holds latencies in
+ * [2^(i-1), 2^i) ms, and the last bucket holds everything above */
+#define OBS_LATENCY_BUCKETS 14
+
+struct obs_latency_histogram {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[OBS_LATENCY_BUCKETS];
+};
+
+struct obs_frame_stats {
+	uint64_t                     rendered_frames;
+	uint64_t                     drops[OBS_FRAME_DROP_COUNT];
+	struct obs_latency_histogram latency[OBS_FRAME_STAGE_COUNT];
+
+	/** Encoded video bytes copied between the encoder and the network */
+	uint64_t                     video_bytes_copied;
+};
+
+/** Copies the current frame statistics */
+EXPORT void obs_get_frame_stats(struct obs_frame_stats *stats);
+
+/** Resets all frame statistics */
+EXPORT void obs_reset_frame_stats(void);
+
+/**
+ * Records a frame reaching a pipeline stage.  frame_ts is the video clock
+ * timestamp of the frame (encoder_packet::frame_ts for packets).
+ */
+EXPORT void obs_frame_stats_record(enum obs_frame_stage stage,
+		uint64_t frame_ts);
+
+/** Records frames that were dropped or repeated */
+EXPORT void obs_frame_stats_add_drops(enum obs_frame_drop_cause cause,
+		uint64_t count);
+
+/** Records encoded video data being copied on its way to an output */
+EXPORT void obs_frame_stats_add_copied_bytes(uint64_t bytes);
+
+/**
+ * Adds a sample to a latency histogram.  Not thread safe, callers that share
+ * a histogram between threads need to lock it themselves.
+ */
+EXPORT void obs_latency_histogram_add(struct obs_latency_histogram *histogram,
+		uint64_t latency_ns);
+
+/**
+ * Returns the upper bound (in nanoseconds) of the histogram bucket that
+ * contains the given percentile (0.0-1.0), or 0 if the histogram is empty.
+ */
+EXPORT uint64_t obs_latency_histogram_percentile(
+		const struct obs_latency_histogram *histogram,
+		double percentile);
+
+
 /* ------------------------------------------------------------------------- */
 /* View context */
 
@@ -1251,6 +1374,13 @@ EXPORT size_t obs_output_get_mixer(const obs_output_t *output);
 EXPORT void obs_output_set_video_encoder(obs_output_t *output,
 		obs_encoder_t *encoder);
 
+/**
+ * Sets whether the output may use another output's active video encoder
+ * with identical settings instead of starting its own (enabled by default)
+ */
+EXPORT void obs_output_set_video_encoder_sharing(obs_output_t *output,
+		bool enable);
+
 /**
  * Sets the current audio encoder associated with this output,
  * required for encoded outputs.
@@ -1262,7 +1392,10 @@ EXPORT void obs_output_set_video_encoder(obs_output_t *output,
 EXPORT void obs_output_set_audio_encoder(obs_output_t *output,
 		obs_encoder_t *encoder, size_t idx);
 
-/** Returns the current video encoder associated with this output */
+/**
+ * Returns the current video encoder associated with this output.  While the
+ * output is active this can be another output's encoder that it shares.
+ */
 EXPORT obs_encoder_t *obs_output_get_video_encoder(const obs_output_t *output);
 
 /**
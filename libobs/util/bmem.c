@@ -86,6 +86,7 @@ static void a_free(void *ptr)
 
 static struct base_allocator alloc = {a_malloc, a_realloc, a_free};
 static long num_allocs = 0;
+static long total_allocs = 0;
 
 void base_set_allocator(struct base_allocator *defs)
 {
@@ -102,6 +103,7 @@ void *bmalloc(size_t size)
 				(unsigned long)size);
 
 	os_atomic_inc_long(&num_allocs);
+	os_atomic_inc_long(&total_allocs);
 	return ptr;
 }
 
@@ -109,6 +111,7 @@ void *brealloc(void *ptr, size_t size)
 {
 	if (!ptr)
 		os_atomic_inc_long(&num_allocs);
+	os_atomic_inc_long(&total_allocs);
 
 	ptr = alloc.realloc(ptr, size);
 	if (!ptr && !size)
@@ -132,6 +135,11 @@ long bnum_allocs(void)
 	return num_allocs;
 }
 
+long bnum_total_allocs(void)
+{
+	return os_atomic_load_long(&total_allocs);
+}
+
 int base_get_alignment(void)
 {
 	return ALIGNMENT;
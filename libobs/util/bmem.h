@@ -41,6 +41,9 @@ EXPORT int base_get_alignment(void);
 
 EXPORT long bnum_allocs(void);
 
+/** Number of bmalloc and brealloc calls so far, to measure allocation rates */
+EXPORT long bnum_total_allocs(void);
+
 EXPORT void *bmemdup(const void *ptr, size_t size);
 
 static inline void *bzalloc(size_t size)
@@ -38,6 +38,20 @@ extern "C" {
 
 #define DARRAY_INVALID ((size_t)-1)
 
+/* the first allocation of an array has room for at least this many bytes,
+ * so arrays of small items don't reallocate for each of their first pushes */
+#define DARRAY_MIN_BYTES 64
+
+/* darray_shrink gives back half of an array that has at least this many
+ * bytes allocated once it is down to a quarter full.  Growing doubles and
+ * shrinking halves, so an array has to grow or shrink by 2x again after a
+ * resize before it resizes a second time. */
+#define DARRAY_SHRINK_MIN_BYTES 65536
+
+/* set in the capacity of arrays that still use the small buffer given to
+ * darray_init_small, which isn't theirs to free */
+#define DARRAY_SMALL_BUFFER ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
 struct darray {
 	void *array;
 	size_t num;
@@ -51,9 +65,36 @@ static inline void darray_init(struct darray *dst)
 	dst->capacity = 0;
 }
 
+/*
+ * Starts the array out in a buffer provided by the caller (usually on the
+ * stack), so it only allocates once it grows past 'capacity' items.
+ *
+ * NOTE: The array must not be moved with a plain struct copy while it uses
+ *       the buffer, and its storage can't be taken over by anything else
+ *       (e.g. handed out as a packet), it has to be freed with darray_free.
+ */
+static inline void darray_init_small(struct darray *dst, void *buffer,
+		const size_t capacity)
+{
+	dst->array    = buffer;
+	dst->num      = 0;
+	dst->capacity = capacity | DARRAY_SMALL_BUFFER;
+}
+
+static inline bool darray_is_small(const struct darray *da)
+{
+	return (da->capacity & DARRAY_SMALL_BUFFER) != 0;
+}
+
+static inline size_t darray_capacity(const struct darray *da)
+{
+	return da->capacity & ~DARRAY_SMALL_BUFFER;
+}
+
 static inline void darray_free(struct darray *dst)
 {
-	bfree(dst->array);
+	if (!darray_is_small(dst))
+		bfree(dst->array);
 	dst->array    = NULL;
 	dst->num      = 0;
 	dst->capacity = 0;
@@ -80,40 +121,70 @@ static inline void *darray_end(const size_t element_size,
 	return darray_item(element_size, da, da->num-1);
 }
 
-static inline void darray_reserve(const size_t element_size,
+/* moves the items to a new allocation of 'capacity' items.  A new block is
+ * allocated rather than reallocated to keep the bmalloc alignment. */
+static inline void darray_realloc(const size_t element_size,
 		struct darray *dst, const size_t capacity)
 {
+	size_t old_cap = darray_capacity(dst);
+	size_t count = dst->num < old_cap ? dst->num : old_cap;
 	void *ptr;
-	if (capacity == 0 || capacity <= dst->num)
-		return;
+
+	if (count > capacity)
+		count = capacity;
 
 	ptr = bmalloc(element_size*capacity);
-	if (dst->num)
-		memcpy(ptr, dst->array, element_size*dst->num);
-	if (dst->array)
+	if (count)
+		memcpy(ptr, dst->array, element_size*count);
+	if (dst->array && !darray_is_small(dst))
 		bfree(dst->array);
 	dst->array = ptr;
 	dst->capacity = capacity;
 }
 
+/* allocates exactly 'capacity' items up front, so an array whose final size
+ * is known (or can be estimated) never has to grow */
+static inline void darray_reserve(const size_t element_size,
+		struct darray *dst, const size_t capacity)
+{
+	if (capacity == 0 || capacity <= dst->num ||
+	    capacity <= darray_capacity(dst))
+		return;
+
+	darray_realloc(element_size, dst, capacity);
+}
+
 static inline void darray_ensure_capacity(const size_t element_size,
 		struct darray *dst, const size_t new_size)
 {
+	size_t capacity = darray_capacity(dst);
 	size_t new_cap;
-	void *ptr;
-	if (new_size <= dst->capacity)
+
+	if (new_size <= capacity)
 		return;
 
-	new_cap = (!dst->capacity) ? new_size : dst->capacity*2;
+	new_cap = capacity ? capacity*2 : DARRAY_MIN_BYTES / element_size;
 	if (new_size > new_cap)
 		new_cap = new_size;
-	ptr = bmalloc(element_size*new_cap);
-	if (dst->capacity)
-		memcpy(ptr, dst->array, element_size*dst->capacity);
-	if (dst->array)
-		bfree(dst->array);
-	dst->array = ptr;
-	dst->capacity = new_cap;
+
+	darray_realloc(element_size, dst, new_cap);
+}
+
+/* NOTE: This can move the items, so it is never done implicitly: erasing
+ * keeps pointers to the items before the erased ones valid.  Containers
+ * that see large spikes call it when they hold no item pointers. */
+static inline void darray_shrink(const size_t element_size,
+		struct darray *dst)
+{
+	size_t capacity = dst->capacity;
+
+	if (darray_is_small(dst) ||
+	    capacity * element_size < DARRAY_SHRINK_MIN_BYTES)
+		return;
+	if (!dst->num || dst->num > capacity / 4)
+		return;
+
+	darray_realloc(element_size, dst, capacity / 2);
 }
 
 static inline void darray_resize(const size_t element_size,
@@ -160,6 +231,9 @@ static inline void darray_copy_array(const size_t element_size,
 
 static inline void darray_move(struct darray *dst, struct darray *src)
 {
+	/* the small buffer belongs to the source, it can't be moved */
+	assert(!darray_is_small(src));
+
 	darray_free(dst);
 	memcpy(dst, src, sizeof(struct darray));
 	src->array    = NULL;
@@ -388,12 +462,14 @@ static inline void darray_split(const size_t element_size, struct darray *dst1,
 static inline void darray_move_item(const size_t element_size,
 		struct darray *dst, const size_t from, const size_t to)
 {
+	uint8_t small_temp[64];
 	void *temp, *p_from, *p_to;
 
 	if (from == to)
 		return;
 
-	temp   = bmalloc(element_size);
+	temp   = element_size <= sizeof(small_temp) ?
+		small_temp : bmalloc(element_size);
 	p_from = darray_item(element_size, dst, from);
 	p_to   = darray_item(element_size, dst, to);
 
@@ -407,12 +483,14 @@ static inline void darray_move_item(const size_t element_size,
 				element_size*(to-from));
 
 	memcpy(p_to, temp, element_size);
-	bfree(temp);
+	if (temp != small_temp)
+		bfree(temp);
 }
 
 static inline void darray_swap(const size_t element_size,
 		struct darray *dst, const size_t a, const size_t b)
 {
+	uint8_t small_temp[64];
 	void *temp, *a_ptr, *b_ptr;
 
 	assert(a < dst->num);
@@ -421,7 +499,8 @@ static inline void darray_swap(const size_t element_size,
 	if (a == b)
 		return;
 
-	temp  = bmalloc(element_size);
+	temp  = element_size <= sizeof(small_temp) ?
+		small_temp : bmalloc(element_size);
 	a_ptr = darray_item(element_size, dst, a);
 	b_ptr = darray_item(element_size, dst, b);
 
@@ -429,7 +508,8 @@ static inline void darray_swap(const size_t element_size,
 	memcpy(a_ptr, b_ptr, element_size);
 	memcpy(b_ptr, temp,  element_size);
 
-	bfree(temp);
+	if (temp != small_temp)
+		bfree(temp);
 }
 
 /*
@@ -453,6 +533,9 @@ static inline void darray_swap(const size_t element_size,
 
 #define da_init(v) darray_init(&v.da)
 
+#define da_init_small(v, buffer) \
+	darray_init_small(&v.da, buffer, sizeof(buffer) / sizeof(*v.array))
+
 #define da_free(v) darray_free(&v.da)
 
 #define da_alloc_size(v) (sizeof(*v.array)*v.num)
@@ -462,6 +545,8 @@ static inline void darray_swap(const size_t element_size,
 #define da_reserve(v, capacity) \
 	darray_reserve(sizeof(*v.array), &v.da, capacity)
 
+#define da_shrink(v) darray_shrink(sizeof(*v.array), &v.da)
+
 #define da_resize(v, size) darray_resize(sizeof(*v.array), &v.da, size)
 
 #define da_copy(dst, src)  \
@@ -33,6 +33,13 @@ extern "C" {
 
 struct strref;
 
+/* the first allocation of a string has room for at least this many bytes */
+#define DSTR_MIN_CAPACITY 32
+
+/* set in the capacity of strings that still use the small buffer given to
+ * dstr_init_small, which isn't theirs to free */
+#define DSTR_SMALL_BUFFER ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
 struct dstr {
 	char *array;
 	size_t len; /* number of characters, excluding null terminator */
@@ -62,6 +69,8 @@ EXPORT char **strlist_split(const char *str, char split_ch, bool include_empty);
 EXPORT void strlist_free(char **strlist);
 
 static inline void dstr_init(struct dstr *dst);
+static inline void dstr_init_small(struct dstr *dst, char *buffer,
+		size_t size);
 static inline void dstr_init_move(struct dstr *dst, struct dstr *src);
 static inline void dstr_init_move_array(struct dstr *dst, char *str);
 static inline void dstr_init_copy(struct dstr *dst, const char *src);
@@ -165,6 +174,32 @@ static inline void dstr_init(struct dstr *dst)
 	dst->capacity = 0;
 }
 
+/*
+ * Starts the string out in a buffer provided by the caller (usually on the
+ * stack), so it only allocates once it grows past 'size' bytes.
+ *
+ * NOTE: The string must be freed with dstr_free, its array can't be handed
+ *       out or freed with bfree while it still uses the buffer.
+ */
+static inline void dstr_init_small(struct dstr *dst, char *buffer,
+		size_t size)
+{
+	buffer[0]     = 0;
+	dst->array    = buffer;
+	dst->len      = 0;
+	dst->capacity = size | DSTR_SMALL_BUFFER;
+}
+
+static inline bool dstr_is_small(const struct dstr *str)
+{
+	return (str->capacity & DSTR_SMALL_BUFFER) != 0;
+}
+
+static inline size_t dstr_capacity(const struct dstr *str)
+{
+	return str->capacity & ~DSTR_SMALL_BUFFER;
+}
+
 static inline void dstr_init_move_array(struct dstr *dst, char *str)
 {
 	dst->array    = str;
@@ -174,6 +209,14 @@ static inline void dstr_init_move_array(struct dstr *dst, char *str)
 
 static inline void dstr_init_move(struct dstr *dst, struct dstr *src)
 {
+	/* the small buffer belongs to the source, so it gets copied */
+	if (dstr_is_small(src)) {
+		dstr_init(dst);
+		dstr_ncopy(dst, src->array, src->len);
+		dstr_free(src);
+		return;
+	}
+
 	*dst = *src;
 	dstr_init(src);
 }
@@ -192,7 +235,8 @@ static inline void dstr_init_copy_dstr(struct dstr *dst, const struct dstr *src)
 
 static inline void dstr_free(struct dstr *dst)
 {
-	bfree(dst->array);
+	if (!dstr_is_small(dst))
+		bfree(dst->array);
 	dst->array    = NULL;
 	dst->len      = 0;
 	dst->capacity = 0;
@@ -219,17 +263,33 @@ static inline void dstr_move(struct dstr *dst, struct dstr *src)
 	dstr_init_move(dst, src);
 }
 
+static inline void dstr_realloc(struct dstr *dst, const size_t capacity)
+{
+	if (dstr_is_small(dst)) {
+		char *array = (char*)bmalloc(capacity);
+		size_t old_cap = dstr_capacity(dst);
+
+		memcpy(array, dst->array,
+				old_cap < capacity ? old_cap : capacity);
+		dst->array = array;
+	} else {
+		dst->array = (char*)brealloc(dst->array, capacity);
+	}
+
+	dst->capacity = capacity;
+}
+
 static inline void dstr_ensure_capacity(struct dstr *dst, const size_t new_size)
 {
+	size_t capacity = dstr_capacity(dst);
 	size_t new_cap;
-	if (new_size <= dst->capacity)
+	if (new_size <= capacity)
 		return;
 
-	new_cap = (!dst->capacity) ? new_size : dst->capacity*2;
+	new_cap = capacity ? capacity*2 : DSTR_MIN_CAPACITY;
 	if (new_size > new_cap)
 		new_cap = new_size;
-	dst->array = (char*)brealloc(dst->array, new_cap);
-	dst->capacity = new_cap;
+	dstr_realloc(dst, new_cap);
 }
 
 static inline void dstr_copy_dstr(struct dstr *dst, const struct dstr *src)
@@ -247,8 +307,7 @@ static inline void dstr_reserve(struct dstr *dst, const size_t capacity)
 	if (capacity == 0 || capacity <= dst->len)
 		return;
 
-	dst->array = (char*)brealloc(dst->array, capacity);
-	dst->capacity = capacity;
+	dstr_realloc(dst, capacity);
 }
 
 static inline void dstr_resize(struct dstr *dst, const size_t num)
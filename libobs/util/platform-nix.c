@@ -129,25 +129,43 @@ bool os_sleepto_ns(uint64_t time_target)
 	if (time_target < current)
 		return false;
 
-	time_target -= current;
-
-	struct timespec req, remain;
-	memset(&req, 0, sizeof(req));
-	memset(&remain, 0, sizeof(remain));
-	req.tv_sec = time_target/1000000000;
-	req.tv_nsec = time_target%1000000000;
-
-	while (nanosleep(&req, &remain)) {
-		req = remain;
-		memset(&remain, 0, sizeof(remain));
+#if defined(__APPLE__)
+	/* os_gettime_ns isn't based on a clock nanosleep knows about here,
+	 * so sleep relative to it, measuring again after an interruption */
+	while (current < time_target) {
+		struct timespec req;
+		uint64_t remain = time_target - current;
+
+		req.tv_sec  = (time_t)(remain / 1000000000);
+		req.tv_nsec = (long)(remain % 1000000000);
+		nanosleep(&req, NULL);
+
+		current = os_gettime_ns();
 	}
+#else
+	/* os_gettime_ns is CLOCK_MONOTONIC, so the target can be used as an
+	 * absolute deadline: interrupted sleeps resume toward the same point
+	 * in time instead of drifting by the time spent getting back in */
+	struct timespec req;
+	req.tv_sec  = (time_t)(time_target / 1000000000);
+	req.tv_nsec = (long)(time_target % 1000000000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL) ==
+			EINTR);
+#endif
 
 	return true;
 }
 
 void os_sleep_ms(uint32_t duration)
 {
-	usleep(duration*1000);
+	struct timespec req, remain;
+	req.tv_sec  = (time_t)(duration / 1000);
+	req.tv_nsec = (long)(duration % 1000) * 1000000;
+
+	/* usleep isn't required to accept a second or more */
+	while (nanosleep(&req, &remain) != 0 && errno == EINTR)
+		req = remain;
 }
 
 #if !defined(__APPLE__)
@@ -21,6 +21,7 @@
 #include <locale.h>
 #include "c99defs.h"
 #include "platform.h"
+#include "threading.h"
 #include "bmem.h"
 #include "utf8.h"
 #include "dstr.h"
@@ -622,3 +623,44 @@ int os_mkdirs(const char *dir)
 	dstr_free(&dir_str);
 	return ret;
 }
+
+static struct os_thread_sched thread_class_sched[OS_THREAD_CLASS_COUNT];
+
+void os_set_thread_class_sched(enum os_thread_class thread_class,
+		const struct os_thread_sched *sched)
+{
+	if (thread_class < 0 || thread_class >= OS_THREAD_CLASS_COUNT)
+		return;
+
+	if (sched)
+		thread_class_sched[thread_class] = *sched;
+	else
+		memset(&thread_class_sched[thread_class], 0,
+				sizeof(struct os_thread_sched));
+}
+
+void os_get_thread_class_sched(enum os_thread_class thread_class,
+		struct os_thread_sched *sched)
+{
+	if (thread_class < 0 || thread_class >= OS_THREAD_CLASS_COUNT) {
+		memset(sched, 0, sizeof(*sched));
+		return;
+	}
+
+	*sched = thread_class_sched[thread_class];
+}
+
+bool os_apply_thread_class_sched(enum os_thread_class thread_class)
+{
+	const struct os_thread_sched *sched;
+
+	if (thread_class < 0 || thread_class >= OS_THREAD_CLASS_COUNT)
+		return false;
+
+	sched = &thread_class_sched[thread_class];
+	if (sched->policy == OS_SCHED_DEFAULT && !sched->timer_slack_ns &&
+	    !sched->cpu_mask)
+		return true;
+
+	return os_set_thread_sched(sched);
+}
@@ -18,10 +18,14 @@ struct profiler_snapshot {
 
 struct profiler_snapshot_entry {
 	const char *name;
+	bool is_counter;
 	profiler_time_entries_t times;
 	uint64_t min_time;
 	uint64_t max_time;
 	uint64_t overall_count;
+	profiler_value_entries_t values;
+	uint64_t min_value;
+	uint64_t max_value;
 	profiler_time_entries_t times_between_calls;
 	uint64_t expected_time_between_calls;
 	uint64_t min_time_between_calls;
@@ -44,6 +48,8 @@ struct profile_call {
 	uint64_t overhead_end;
 #endif
 	uint64_t expected_time_between_calls;
+	bool is_counter;
+	uint64_t value;
 	DARRAY(profile_call) children;
 	profile_call *parent;
 };
@@ -69,7 +75,10 @@ struct profile_times_table {
 typedef struct profile_entry profile_entry;
 struct profile_entry {
 	const char *name;
+	bool is_counter;
 	profile_times_table times;
+	/* same table, keyed by the recorded value instead of the duration */
+	profile_times_table values;
 #ifdef TRACK_OVERHEAD
 	profile_times_table overhead;
 #endif
@@ -208,6 +217,7 @@ static profile_entry *init_entry(profile_entry *entry, const char *name)
 {
 	entry->name = name;
 	init_hashmap(&entry->times, 1);
+	init_hashmap(&entry->values, 1);
 #ifdef TRACK_OVERHEAD
 	init_hashmap(&entry->overhead, 1);
 #endif
@@ -231,6 +241,13 @@ static profile_entry *get_child(profile_entry *parent, const char *name)
 static void merge_call(profile_entry *entry, profile_call *call,
 		profile_call *prev_call)
 {
+	if (call->is_counter) {
+		entry->is_counter = true;
+		migrate_old_entries(&entry->values, true);
+		add_hashmap_entry(&entry->values, call->value, 1);
+		return;
+	}
+
 	const size_t num = call->children.num;
 	for (size_t i = 0; i < num; i++) {
 		profile_call *child = &call->children.array[i];
@@ -260,14 +277,99 @@ static bool enabled = false;
 static pthread_mutex_t root_mutex = PTHREAD_MUTEX_INITIALIZER;
 static DARRAY(profile_root_entry) root_entries;
 
+typedef struct profile_event profile_event;
+struct profile_event {
+	const char *name;
+	uint64_t time;
+	uint64_t value;
+	char phase;
+};
+
+/* single producer ring, the owning thread overwrites the oldest events.
+ * readers copy events out and discard any that may have been overwritten
+ * while copying by re-checking head afterwards. */
+typedef struct profile_event_ring profile_event_ring;
+struct profile_event_ring {
+	long tid;
+	const char *thread_name;
+	unsigned long mask;
+	volatile long head;
+	profile_event *events;
+};
+
+static volatile bool timeline_enabled = false;
+static volatile long timeline_generation = 0;
+static unsigned long timeline_ring_size = 0;
+static DARRAY(profile_event_ring*) timeline_rings;
+static DARRAY(profile_event_ring*) timeline_retired_rings;
+
 #ifdef _MSC_VER
 static __declspec(thread) profile_call *thread_context = NULL;
 static __declspec(thread) bool thread_enabled = true;
+static __declspec(thread) profile_event_ring *thread_ring = NULL;
+static __declspec(thread) long thread_ring_generation = 0;
 #else
 static __thread profile_call *thread_context = NULL;
 static __thread bool thread_enabled = true;
+static __thread profile_event_ring *thread_ring = NULL;
+static __thread long thread_ring_generation = 0;
 #endif
 
+static profile_event_ring *create_thread_ring(void)
+{
+	profile_event_ring *ring = NULL;
+	profile_call *root = thread_context;
+
+	while (root && root->parent)
+		root = root->parent;
+
+	pthread_mutex_lock(&root_mutex);
+	if (!timeline_ring_size)
+		goto unlock;
+
+	ring = bzalloc(sizeof(profile_event_ring));
+	ring->tid         = (long)timeline_rings.num + 1;
+	ring->thread_name = root ? root->name : NULL;
+	ring->mask        = timeline_ring_size - 1;
+	ring->events      = bzalloc(sizeof(profile_event) *
+			timeline_ring_size);
+	da_push_back(timeline_rings, &ring);
+
+	thread_ring            = ring;
+	thread_ring_generation = timeline_generation;
+
+unlock:
+	pthread_mutex_unlock(&root_mutex);
+	return ring;
+}
+
+static inline void timeline_record(const char *name, char phase,
+		uint64_t time, uint64_t value)
+{
+	profile_event_ring *ring = thread_ring;
+	profile_event *event;
+	long head;
+
+	if (!timeline_enabled)
+		return;
+
+	if (!ring || thread_ring_generation !=
+			os_atomic_load_long(&timeline_generation)) {
+		ring = create_thread_ring();
+		if (!ring)
+			return;
+	}
+
+	head  = ring->head;
+	event = &ring->events[(unsigned long)head & ring->mask];
+	event->name  = name;
+	event->time  = time;
+	event->value = value;
+	event->phase = phase;
+
+	os_atomic_set_long(&ring->head, head + 1);
+}
+
 void profiler_start(void)
 {
 	pthread_mutex_lock(&root_mutex);
@@ -395,6 +497,8 @@ void profile_start(const char *name)
 
 	thread_context = call;
 	call->start_time = os_gettime_ns();
+
+	timeline_record(name, 'B', call->start_time, 0);
 }
 
 void profile_end(const char *name)
@@ -432,6 +536,8 @@ void profile_end(const char *name)
 
 	thread_context = call->parent;
 
+	timeline_record(call->name, 'E', end, 0);
+
 	call->end_time = end;
 #ifdef TRACK_OVERHEAD
 	call->overhead_end = os_gettime_ns();
@@ -443,6 +549,27 @@ void profile_end(const char *name)
 	merge_context(call);
 }
 
+void profile_record_counter(const char *name, uint64_t value)
+{
+	if (!thread_enabled)
+		return;
+
+	profile_call *parent = thread_context;
+	if (!parent) {
+		blog(LOG_ERROR, "Called profile record counter with no active "
+				"profile");
+		return;
+	}
+
+	profile_call *call = da_push_back_new(parent->children);
+	call->name = name;
+	call->is_counter = true;
+	call->value = value;
+	call->parent = parent;
+
+	timeline_record(name, 'C', os_gettime_ns(), value);
+}
+
 static int profiler_time_entry_compare(const void *first, const void *second)
 {
 	int64_t diff = ((profiler_time_entry*)second)->time_delta -
@@ -450,6 +577,46 @@ static int profiler_time_entry_compare(const void *first, const void *second)
 	return diff < 0 ? -1 : (diff > 0 ? 1 : 0);
 }
 
+static int profiler_value_entry_compare(const void *first, const void *second)
+{
+	uint64_t a = ((const profiler_value_entry_t*)first)->value;
+	uint64_t b = ((const profiler_value_entry_t*)second)->value;
+	return (a < b) - (a > b);
+}
+
+static uint64_t copy_map_to_values(profile_times_table *map,
+		profiler_value_entries_t *value_buffer,
+		uint64_t *min_, uint64_t *max_)
+{
+	uint64_t min__ = ~(uint64_t)0;
+	uint64_t max__ = 0;
+	uint64_t calls = 0;
+
+	migrate_old_entries(map, false);
+
+	da_reserve((*value_buffer), map->occupied);
+	da_resize((*value_buffer), 0);
+
+	for (size_t i = 0; i < map->size; i++) {
+		profiler_value_entry_t value;
+
+		if (!map->entries[i].probes)
+			continue;
+
+		value.value = map->entries[i].entry.time_delta;
+		value.count = map->entries[i].entry.count;
+		da_push_back((*value_buffer), &value);
+
+		calls += value.count;
+		min__ = (min__ < value.value) ? min__ : value.value;
+		max__ = (max__ > value.value) ? max__ : value.value;
+	}
+
+	*min_ = min__;
+	*max_ = max__;
+	return calls;
+}
+
 static uint64_t copy_map_to_array(profile_times_table *map,
 		profiler_time_entries_t *entry_buffer,
 		uint64_t *min_, uint64_t *max_)
@@ -561,6 +728,29 @@ static void gather_stats(uint64_t expected_time_between_calls,
 	*percent_within_bounds = (1. - (double)accu / calls) * 100;
 }
 
+static void gather_value_stats(profiler_value_entries_t *values,
+		uint64_t calls, uint64_t *percentile99, uint64_t *median)
+{
+	uint64_t accu = 0;
+
+	*percentile99 = 0;
+	*median = 0;
+
+	for (size_t i = 0; i < values->num; i++) {
+		uint64_t old_accu = accu;
+		accu += values->array[i].count;
+
+		/* counters often repeat a value, so one entry can hold both
+		 * the 99th percentile and the median */
+		if (old_accu < calls * 0.01 && accu >= calls * 0.01)
+			*percentile99 = values->array[i].value;
+		if (old_accu < calls * 0.5 && accu >= calls * 0.5) {
+			*median = values->array[i].value;
+			break;
+		}
+	}
+}
+
 static void profile_print_entry(profiler_snapshot_entry_t *entry,
 		struct dstr *indent_buffer, struct dstr *output_buffer,
 		unsigned indent, uint64_t active, uint64_t parent_calls)
@@ -571,13 +761,26 @@ static void profile_print_entry(profiler_snapshot_entry_t *entry,
 	uint64_t percentile99 = 0;
 	uint64_t median = 0;
 	double percent_within_bounds = 0.;
-	gather_stats(entry->expected_time_between_calls,
-			&entry->times, calls,
-			&percentile99, &median, &percent_within_bounds);
+
+	if (entry->is_counter)
+		gather_value_stats(&entry->values, calls,
+				&percentile99, &median);
+	else
+		gather_stats(entry->expected_time_between_calls,
+				&entry->times, calls,
+				&percentile99, &median, &percent_within_bounds);
 
 	make_indent_string(indent_buffer, indent, active);
 
-	if (min_ == max_) {
+	if (entry->is_counter) {
+		dstr_printf(output_buffer, "%s%s: min=%"PRIu64", "
+				"median=%"PRIu64", max=%"PRIu64", "
+				"99th percentile=%"PRIu64,
+				indent_buffer->array, entry->name,
+				entry->min_value, median, entry->max_value,
+				percentile99);
+
+	} else if (min_ == max_) {
 		dstr_printf(output_buffer, "%s%s: %g ms",
 				indent_buffer->array, entry->name,
 				min_ / 1000.);
@@ -793,6 +996,7 @@ static void free_profile_entry(profile_entry *entry)
 		free_profile_entry(&entry->children.array[i]);
 
 	free_hashmap(&entry->times);
+	free_hashmap(&entry->values);
 #ifdef TRACK_OVERHEAD
 	free_hashmap(&entry->overhead);
 #endif
@@ -800,15 +1004,36 @@ static void free_profile_entry(profile_entry *entry)
 	da_free(entry->children);
 }
 
+static void free_event_rings(profile_event_ring **rings, size_t num)
+{
+	for (size_t i = 0; i < num; i++) {
+		bfree(rings[i]->events);
+		bfree(rings[i]);
+	}
+}
+
 void profiler_free(void)
 {
 	DARRAY(profile_root_entry) old_root_entries = {0};
+	DARRAY(profile_event_ring*) old_rings = {0};
+	DARRAY(profile_event_ring*) old_retired_rings = {0};
 
 	pthread_mutex_lock(&root_mutex);
 	enabled = false;
 	da_move(old_root_entries, root_entries);
+
+	timeline_enabled = false;
+	timeline_ring_size = 0;
+	os_atomic_inc_long(&timeline_generation);
+	da_move(old_rings, timeline_rings);
+	da_move(old_retired_rings, timeline_retired_rings);
 	pthread_mutex_unlock(&root_mutex);
 
+	free_event_rings(old_rings.array, old_rings.num);
+	free_event_rings(old_retired_rings.array, old_retired_rings.num);
+	da_free(old_rings);
+	da_free(old_retired_rings);
+
 	for (size_t i = 0; i < old_root_entries.num; i++) {
 		profile_root_entry *entry = &old_root_entries.array[i];
 
@@ -892,10 +1117,16 @@ static void add_entry_to_snapshot(profile_entry *entry,
 		profiler_snapshot_entry_t *s_entry)
 {
 	s_entry->name = entry->name;
+	s_entry->is_counter = entry->is_counter;
 
-	s_entry->overall_count = copy_map_to_array(&entry->times,
-			&s_entry->times,
-			&s_entry->min_time, &s_entry->max_time);
+	if (entry->is_counter)
+		s_entry->overall_count = copy_map_to_values(&entry->values,
+				&s_entry->values,
+				&s_entry->min_value, &s_entry->max_value);
+	else
+		s_entry->overall_count = copy_map_to_array(&entry->times,
+				&s_entry->times,
+				&s_entry->min_time, &s_entry->max_time);
 
 	if ((s_entry->expected_time_between_calls = 
 				entry->expected_time_between_calls))
@@ -917,6 +1148,10 @@ static void sort_snapshot_entry(profiler_snapshot_entry_t *entry)
 			sizeof(profiler_time_entry),
 			profiler_time_entry_compare);
 
+	qsort(entry->values.array, entry->values.num,
+			sizeof(profiler_value_entry_t),
+			profiler_value_entry_compare);
+
 	if (entry->expected_time_between_calls)
 		qsort(entry->times_between_calls.array,
 				entry->times_between_calls.num,
@@ -955,6 +1190,7 @@ static void free_snapshot_entry(profiler_snapshot_entry_t *entry)
 	da_free(entry->children);
 	da_free(entry->times_between_calls);
 	da_free(entry->times);
+	da_free(entry->values);
 }
 
 void profile_snapshot_free(profiler_snapshot_t *snap)
@@ -979,16 +1215,26 @@ static void entry_dump_csv(struct dstr *buffer,
 
 	for (size_t i = 0; i < entry->times.num; i++) {
 		dstr_printf(buffer, "%p,%p,%p,%p,%s,0,"
-				"%"PRIu64",%"PRIu64"\n", entry,
+				"%"PRIu64",%"PRIu64",\n", entry,
 				parent, entry->name, parent_name, entry->name,
 				entry->times.array[i].time_delta,
 				entry->times.array[i].count);
 		func(data, buffer);
 	}
 
+	/* counter entries have a value instead of a time */
+	for (size_t i = 0; i < entry->values.num; i++) {
+		dstr_printf(buffer, "%p,%p,%p,%p,%s,0,,"
+				"%"PRIu64",%"PRIu64"\n", entry,
+				parent, entry->name, parent_name, entry->name,
+				entry->values.array[i].count,
+				entry->values.array[i].value);
+		func(data, buffer);
+	}
+
 	for (size_t i = 0; i < entry->times_between_calls.num; i++) {
 		dstr_printf(buffer,"%p,%p,%p,%p,%s,"
-				"%"PRIu64",%"PRIu64",%"PRIu64"\n", entry,
+				"%"PRIu64",%"PRIu64",%"PRIu64",\n", entry,
 				parent, entry->name, parent_name, entry->name,
 				entry->expected_time_between_calls,
 				entry->times_between_calls.array[i].time_delta,
@@ -1007,7 +1253,7 @@ static void profiler_snapshot_dump(const profiler_snapshot_t *snap,
 	struct dstr buffer = {0};
 
 	dstr_init_copy(&buffer, "id,parent_id,name_id,parent_name_id,name,"
-			"time_between_calls,time_delta_µs,count\n");
+			"time_between_calls,time_delta_µs,count,value\n");
 	func(data, &buffer);
 
 	for (size_t i = 0; i < snap->roots.num; i++)
@@ -1122,6 +1368,11 @@ const char *profiler_snapshot_entry_name(profiler_snapshot_entry_t *entry)
 	return entry ? entry->name : NULL;
 }
 
+bool profiler_snapshot_entry_is_counter(profiler_snapshot_entry_t *entry)
+{
+	return entry ? entry->is_counter : false;
+}
+
 profiler_time_entries_t *profiler_snapshot_entry_times(
 		profiler_snapshot_entry_t *entry)
 {
@@ -1144,6 +1395,22 @@ uint64_t profiler_snapshot_entry_max_time(profiler_snapshot_entry_t *entry)
 	return entry ? entry->max_time : 0;
 }
 
+profiler_value_entries_t *profiler_snapshot_entry_values(
+		profiler_snapshot_entry_t *entry)
+{
+	return entry ? &entry->values : NULL;
+}
+
+uint64_t profiler_snapshot_entry_min_value(profiler_snapshot_entry_t *entry)
+{
+	return entry ? entry->min_value : 0;
+}
+
+uint64_t profiler_snapshot_entry_max_value(profiler_snapshot_entry_t *entry)
+{
+	return entry ? entry->max_value : 0;
+}
+
 profiler_time_entries_t *profiler_snapshot_entry_times_between_calls(
 		profiler_snapshot_entry_t *entry)
 {
@@ -1173,3 +1440,219 @@ uint64_t profiler_snapshot_entry_overall_between_calls_count(
 {
 	return entry ? entry->overall_between_calls_count : 0;
 }
+
+
+/* ------------------------------------------------------------------------- */
+/* Timeline */
+
+#define MAX_TIMELINE_EVENTS (1 << 20)
+
+struct profiler_timeline_thread {
+	long tid;
+	const char *name;
+	DARRAY(profile_event) events;
+};
+
+struct profiler_timeline {
+	DARRAY(struct profiler_timeline_thread) threads;
+};
+
+static unsigned long round_up_pow2(size_t val)
+{
+	unsigned long size = 16;
+	while (size < val && size < MAX_TIMELINE_EVENTS)
+		size <<= 1;
+	return size;
+}
+
+void profiler_timeline_enable(size_t events_per_thread)
+{
+	pthread_mutex_lock(&root_mutex);
+
+	/* rings can still be written to by threads that have not yet seen
+	 * the new generation, so they are only freed in profiler_free */
+	if (timeline_rings.num) {
+		da_push_back_array(timeline_retired_rings,
+				timeline_rings.array, timeline_rings.num);
+		da_resize(timeline_rings, 0);
+	}
+
+	timeline_ring_size = round_up_pow2(events_per_thread);
+	os_atomic_inc_long(&timeline_generation);
+	timeline_enabled = true;
+
+	pthread_mutex_unlock(&root_mutex);
+}
+
+void profiler_timeline_disable(void)
+{
+	pthread_mutex_lock(&root_mutex);
+	timeline_enabled = false;
+	pthread_mutex_unlock(&root_mutex);
+}
+
+static void copy_ring_events(profile_event_ring *ring,
+		struct profiler_timeline_thread *thread)
+{
+	unsigned long size = ring->mask + 1;
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+	unsigned long num  = head < size ? head : size;
+	unsigned long first = head - num;
+	unsigned long valid_first;
+
+	da_resize(thread->events, num);
+	for (unsigned long i = 0; i < num; i++)
+		thread->events.array[i] =
+			ring->events[(first + i) & ring->mask];
+
+	/* the producer may have lapped the copy; the slot at new_head - size
+	 * may also be mid-write, so drop everything up to and including it */
+	head = (unsigned long)os_atomic_load_long(&ring->head);
+	valid_first = head >= size ? head - size + 1 : 0;
+	if (valid_first > first) {
+		size_t drop = valid_first - first;
+		if (drop > thread->events.num)
+			drop = thread->events.num;
+		da_erase_range(thread->events, 0, drop);
+	}
+}
+
+profiler_timeline_t *profiler_timeline_snapshot_create(void)
+{
+	profiler_timeline_t *timeline = bzalloc(sizeof(profiler_timeline_t));
+	DARRAY(profile_event_ring*) rings = {0};
+
+	pthread_mutex_lock(&root_mutex);
+	da_copy(rings, timeline_rings);
+	pthread_mutex_unlock(&root_mutex);
+
+	da_reserve(timeline->threads, rings.num);
+	for (size_t i = 0; i < rings.num; i++) {
+		profile_event_ring *ring = rings.array[i];
+		struct profiler_timeline_thread *thread =
+			da_push_back_new(timeline->threads);
+
+		thread->tid  = ring->tid;
+		thread->name = ring->thread_name;
+		copy_ring_events(ring, thread);
+	}
+
+	da_free(rings);
+	return timeline;
+}
+
+void profiler_timeline_snapshot_free(profiler_timeline_t *timeline)
+{
+	if (!timeline)
+		return;
+
+	for (size_t i = 0; i < timeline->threads.num; i++)
+		da_free(timeline->threads.array[i].events);
+
+	da_free(timeline->threads);
+	bfree(timeline);
+}
+
+size_t profiler_timeline_num_events(const profiler_timeline_t *timeline)
+{
+	size_t num = 0;
+
+	if (!timeline)
+		return 0;
+
+	for (size_t i = 0; i < timeline->threads.num; i++)
+		num += timeline->threads.array[i].events.num;
+	return num;
+}
+
+static void json_cat_escaped(struct dstr *str, const char *in)
+{
+	if (!in) {
+		dstr_cat(str, "(null)");
+		return;
+	}
+
+	for (; *in; in++) {
+		unsigned char ch = (unsigned char)*in;
+
+		if (ch == '"' || ch == '\\') {
+			dstr_cat_ch(str, '\\');
+			dstr_cat_ch(str, (char)ch);
+		} else if (ch < 0x20) {
+			dstr_catf(str, "\\u%04x", ch);
+		} else {
+			dstr_cat_ch(str, (char)ch);
+		}
+	}
+}
+
+static void dump_trace_event(struct dstr *buffer, long tid,
+		const profile_event *event, bool first)
+{
+	dstr_printf(buffer, "%s{\"name\":\"", first ? "" : ",\n");
+	json_cat_escaped(buffer, event->name);
+	dstr_catf(buffer, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,"
+			"\"tid\":%ld", event->phase, event->time / 1000.0, tid);
+
+	if (event->phase == 'C')
+		dstr_catf(buffer, ",\"args\":{\"value\":%"PRIu64"}",
+				event->value);
+
+	dstr_cat(buffer, "}");
+}
+
+static void dump_trace_thread(struct dstr *buffer, FILE *f,
+		const struct profiler_timeline_thread *thread, bool *first)
+{
+	size_t depth = 0;
+
+	dstr_printf(buffer, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+			"\"pid\":1,\"tid\":%ld,\"args\":{\"name\":\"",
+			*first ? "" : ",\n", thread->tid);
+	json_cat_escaped(buffer, thread->name);
+	dstr_cat(buffer, "\"}}");
+	fwrite(buffer->array, 1, buffer->len, f);
+	*first = false;
+
+	for (size_t i = 0; i < thread->events.num; i++) {
+		const profile_event *event = &thread->events.array[i];
+
+		/* the oldest events may end scopes that began before the
+		 * ring's window; leave those out so the trace stays nested */
+		if (event->phase == 'B') {
+			depth++;
+		} else if (event->phase == 'E') {
+			if (!depth)
+				continue;
+			depth--;
+		}
+
+		dump_trace_event(buffer, thread->tid, event, false);
+		fwrite(buffer->array, 1, buffer->len, f);
+	}
+}
+
+bool profiler_timeline_dump_chrome_trace(const profiler_timeline_t *timeline,
+		const char *filename)
+{
+	struct dstr buffer = {0};
+	bool first = true;
+	FILE *f;
+
+	if (!timeline)
+		return false;
+
+	f = os_fopen(filename, "wb+");
+	if (!f)
+		return false;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+	for (size_t i = 0; i < timeline->threads.num; i++)
+		dump_trace_thread(&buffer, f, &timeline->threads.array[i],
+				&first);
+	fputs("\n]}\n", f);
+
+	dstr_free(&buffer);
+	fclose(f);
+	return true;
+}
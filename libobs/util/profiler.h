@@ -10,6 +10,7 @@ extern "C" {
 typedef struct profiler_snapshot profiler_snapshot_t;
 typedef struct profiler_snapshot_entry profiler_snapshot_entry_t;
 typedef struct profiler_time_entry profiler_time_entry_t;
+typedef struct profiler_timeline profiler_timeline_t;
 
 /* ------------------------------------------------------------------------- */
 /* Profiling */
@@ -20,6 +21,10 @@ EXPORT void profile_register_root(const char *name,
 EXPORT void profile_start(const char *name);
 EXPORT void profile_end(const char *name);
 
+/* records a value (instead of a duration) as a child of the active profile
+ * scope; the entry is a counter entry, see profiler_snapshot_entry_values */
+EXPORT void profile_record_counter(const char *name, uint64_t value);
+
 EXPORT void profile_reenable_thread(void);
 
 /* ------------------------------------------------------------------------- */
@@ -63,6 +68,14 @@ struct profiler_time_entry {
 
 typedef DARRAY(profiler_time_entry_t) profiler_time_entries_t;
 
+struct profiler_value_entry {
+	uint64_t value;
+	uint64_t count;
+};
+
+typedef struct profiler_value_entry profiler_value_entry_t;
+typedef DARRAY(profiler_value_entry_t) profiler_value_entries_t;
+
 typedef bool (*profiler_entry_enum_func)(void *context,
 		profiler_snapshot_entry_t *entry);
 
@@ -90,6 +103,8 @@ EXPORT void profiler_snapshot_enumerate_children(
 
 EXPORT const char *profiler_snapshot_entry_name(
 		profiler_snapshot_entry_t *entry);
+EXPORT bool profiler_snapshot_entry_is_counter(
+		profiler_snapshot_entry_t *entry);
 
 EXPORT profiler_time_entries_t *profiler_snapshot_entry_times(
 		profiler_snapshot_entry_t *entry);
@@ -100,6 +115,14 @@ EXPORT uint64_t profiler_snapshot_entry_max_time(
 EXPORT uint64_t profiler_snapshot_entry_overall_count(
 		profiler_snapshot_entry_t *entry);
 
+/* values recorded by profile_record_counter, counter entries have no times */
+EXPORT profiler_value_entries_t *profiler_snapshot_entry_values(
+		profiler_snapshot_entry_t *entry);
+EXPORT uint64_t profiler_snapshot_entry_min_value(
+		profiler_snapshot_entry_t *entry);
+EXPORT uint64_t profiler_snapshot_entry_max_value(
+		profiler_snapshot_entry_t *entry);
+
 EXPORT profiler_time_entries_t *profiler_snapshot_entry_times_between_calls(
 		profiler_snapshot_entry_t *entry);
 EXPORT uint64_t profiler_snapshot_entry_expected_time_between_calls(
@@ -111,6 +134,27 @@ EXPORT uint64_t profiler_snapshot_entry_max_time_between_calls(
 EXPORT uint64_t profiler_snapshot_entry_overall_between_calls_count(
 		profiler_snapshot_entry_t *entry);
 
+/* ------------------------------------------------------------------------- */
+/* Timeline
+ *
+ *   When enabled, each profiled thread also records the begin/end of its
+ * profile scopes (and counter values) with timestamps into a fixed size
+ * ring that keeps the most recent events_per_thread events.  Snapshots can
+ * be taken at any time and written in the Chrome trace event format
+ * (viewable in chrome://tracing).
+ */
+
+EXPORT void profiler_timeline_enable(size_t events_per_thread);
+EXPORT void profiler_timeline_disable(void);
+
+EXPORT profiler_timeline_t *profiler_timeline_snapshot_create(void);
+EXPORT void profiler_timeline_snapshot_free(profiler_timeline_t *timeline);
+EXPORT size_t profiler_timeline_num_events(
+		const profiler_timeline_t *timeline);
+
+EXPORT bool profiler_timeline_dump_chrome_trace(
+		const profiler_timeline_t *timeline, const char *filename);
+
 #ifdef __cplusplus
 }
 #endif
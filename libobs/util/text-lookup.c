@@ -14,82 +14,106 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/stat.h>
+
 #include "dstr.h"
+#include "darray.h"
 #include "text-lookup.h"
 #include "lexer.h"
 #include "platform.h"
 
 /* ------------------------------------------------------------------------- */
 
-struct text_leaf {
-	char *lookup, *value;
-};
-
-static inline void text_leaf_destroy(struct text_leaf *leaf)
-{
-	if (leaf) {
-		bfree(leaf->lookup);
-		bfree(leaf->value);
-		bfree(leaf);
-	}
-}
-
-/* ------------------------------------------------------------------------- */
+/*
+ * Each locale file is turned into one block of memory: a header, an open
+ * addressed table of entry indices, the entries, and the key and value
+ * strings they point into by offset.  The block doesn't contain any
+ * pointers, so it's written as-is next to the ini file and read back in a
+ * single allocation the next time, as long as the ini file hasn't changed.
+ */
 
-struct text_node {
-	struct dstr str;
-	struct text_node *first_subnode;
-	struct text_leaf *leaf;
+#define LOCALE_TABLE_MAGIC   0x3154544C /* "LTT1" */
+#define LOCALE_TABLE_EXT     ".table"
+#define LOCALE_TABLE_MIN_BUCKETS 16
+
+struct locale_table {
+	uint32_t magic;
+	uint32_t header_size;
+	uint64_t total_size;
+	int64_t  source_size;
+	int64_t  source_mtime;
+	uint32_t num_buckets;
+	uint32_t num_entries;
+	uint32_t strings_size;
+	uint32_t reserved;
+};
 
-	struct text_node *next;
+struct locale_entry {
+	uint32_t hash;
+	uint32_t key;
+	uint32_t value;
 };
 
-static void text_node_destroy(struct text_node *node)
+static inline uint32_t *table_buckets(const struct locale_table *table)
 {
-	struct text_node *subnode;
-
-	if (!node)
-		return;
+	return (uint32_t*)(table + 1);
+}
 
-	subnode = node->first_subnode;
-	while (subnode) {
-		struct text_node *destroy_node = subnode;
+static inline struct locale_entry *table_entries(
+		const struct locale_table *table)
+{
+	return (struct locale_entry*)(table_buckets(table) +
+			table->num_buckets);
+}
 
-		subnode = subnode->next;
-		text_node_destroy(destroy_node);
-	}
+static inline char *table_strings(const struct locale_table *table)
+{
+	return (char*)(table_entries(table) + table->num_entries);
+}
 
-	dstr_free(&node->str);
-	if (node->leaf)
-		text_leaf_destroy(node->leaf);
-	bfree(node);
+static inline uint64_t table_size(uint64_t num_buckets, uint64_t num_entries,
+		uint64_t strings_size)
+{
+	return sizeof(struct locale_table) +
+		num_buckets * sizeof(uint32_t) +
+		num_entries * sizeof(struct locale_entry) +
+		strings_size;
 }
 
-static struct text_node *text_node_bychar(struct text_node *node, char ch)
+/* lookups ignore ASCII case, so the hash does too */
+static inline uint32_t lookup_hash(const char *str, size_t len)
 {
-	struct text_node *subnode = node->first_subnode;
+	uint32_t hash = 2166136261U;
 
-	while (subnode) {
-		if (!dstr_is_empty(&subnode->str) &&
-		    subnode->str.array[0] == ch)
-			return subnode;
+	for (size_t i = 0; i < len; i++) {
+		char ch = str[i];
+		if (ch >= 'A' && ch <= 'Z')
+			ch += 0x20;
 
-		subnode = subnode->next;
+		hash ^= (uint8_t)ch;
+		hash *= 16777619U;
 	}
 
-	return NULL;
+	return hash;
 }
 
-static struct text_node *text_node_byname(struct text_node *node,
-		const char *name)
+static const char *table_find(const struct locale_table *table,
+		const char *name, uint32_t hash)
 {
-	struct text_node *subnode = node->first_subnode;
+	const uint32_t *buckets = table_buckets(table);
+	const struct locale_entry *entries = table_entries(table);
+	const char *strings = table_strings(table);
+	uint32_t mask = table->num_buckets - 1;
+	uint32_t slot = hash & mask;
+
+	while (buckets[slot]) {
+		const struct locale_entry *entry = entries + buckets[slot] - 1;
 
-	while (subnode) {
-		if (astrcmpi_n(subnode->str.array, name, subnode->str.len) == 0)
-			return subnode;
+		if (entry->hash == hash &&
+		    astrcmpi(strings + entry->key, name) == 0)
+			return strings + entry->value;
 
-		subnode = subnode->next;
+		slot = (slot + 1) & mask;
 	}
 
 	return NULL;
@@ -97,88 +121,204 @@ static struct text_node *text_node_byname(struct text_node *node,
 
 /* ------------------------------------------------------------------------- */
 
-struct text_lookup {
-	struct dstr language;
-	struct text_node *top;
+struct table_builder {
+	DARRAY(struct locale_entry) entries;
+	DARRAY(char)                strings;
 };
 
-static void lookup_createsubnode(const char *lookup_val,
-		struct text_leaf *leaf, struct text_node *node)
+static inline uint32_t builder_add_string(struct table_builder *builder,
+		const char *str, size_t len)
 {
-	struct text_node *new = bzalloc(sizeof(struct text_node));
-	new->leaf = leaf;
-	new->next = node->first_subnode;
-	dstr_copy(&new->str, lookup_val);
+	uint32_t offset = (uint32_t)builder->strings.num;
+	char nul = 0;
 
-	node->first_subnode = new;
+	da_push_back_array(builder->strings, str, len);
+	da_push_back(builder->strings, &nul);
+	return offset;
 }
 
-static void lookup_splitnode(const char *lookup_val, size_t len,
-		struct text_leaf *leaf, struct text_node *node)
+static void builder_add(struct table_builder *builder,
+		const struct strref *name, const char *value)
 {
-	struct text_node *split = bzalloc(sizeof(struct text_node));
+	struct locale_entry entry;
 
-	dstr_copy(&split->str, node->str.array+len);
-	split->leaf = node->leaf;
-	split->first_subnode = node->first_subnode;
-	node->first_subnode = split;
+	entry.hash  = lookup_hash(name->array, name->len);
+	entry.key   = builder_add_string(builder, name->array, name->len);
+	entry.value = builder_add_string(builder, value, strlen(value));
 
-	dstr_resize(&node->str, len);
-
-	if (lookup_val[len] != 0) {
-		node->leaf = NULL;
-		lookup_createsubnode(lookup_val+len, leaf, node);
-	} else {
-		node->leaf = leaf;
-	}
+	da_push_back(builder->entries, &entry);
 }
 
-static inline void lookup_replaceleaf(struct text_node *node,
-		struct text_leaf *leaf)
+static struct locale_table *builder_finish(struct table_builder *builder,
+		const struct stat *st)
 {
-	text_leaf_destroy(node->leaf);
-	node->leaf = leaf;
+	struct locale_table *table;
+	struct locale_entry *entries;
+	uint32_t *buckets;
+	uint32_t num_buckets = LOCALE_TABLE_MIN_BUCKETS;
+	uint32_t num_entries = 0;
+	uint64_t total_size;
+
+	while (num_buckets < builder->entries.num * 2)
+		num_buckets *= 2;
+
+	total_size = table_size(num_buckets, builder->entries.num,
+			builder->strings.num);
+
+	table = bzalloc((size_t)total_size);
+	table->magic        = LOCALE_TABLE_MAGIC;
+	table->header_size  = sizeof(struct locale_table);
+	table->num_buckets  = num_buckets;
+	table->num_entries  = (uint32_t)builder->entries.num;
+	table->strings_size = (uint32_t)builder->strings.num;
+	table->source_size  = st ? (int64_t)st->st_size  : 0;
+	table->source_mtime = st ? (int64_t)st->st_mtime : 0;
+
+	buckets = table_buckets(table);
+	entries = table_entries(table);
+	if (builder->strings.num)
+		memcpy(table_strings(table), builder->strings.array,
+				builder->strings.num);
+
+	/* a name that appears twice keeps the later value, like the trie
+	 * this replaced did */
+	for (size_t i = 0; i < builder->entries.num; i++) {
+		struct locale_entry *entry = builder->entries.array + i;
+		const char *key = builder->strings.array + entry->key;
+		uint32_t slot = entry->hash & (num_buckets - 1);
+
+		while (buckets[slot]) {
+			struct locale_entry *existing =
+				entries + buckets[slot] - 1;
+
+			if (existing->hash == entry->hash &&
+			    astrcmpi(table_strings(table) + existing->key,
+				    key) == 0)
+				break;
+
+			slot = (slot + 1) & (num_buckets - 1);
+		}
+
+		if (buckets[slot]) {
+			entries[buckets[slot] - 1].value = entry->value;
+		} else {
+			entries[num_entries] = *entry;
+			buckets[slot] = ++num_entries;
+		}
+	}
+
+	/* duplicates leave unused entries at the end, which are left in the
+	 * block rather than moving the strings */
+	table->total_size = total_size;
+
+	da_free(builder->entries);
+	da_free(builder->strings);
+	return table;
 }
 
-static void lookup_addstring(const char *lookup_val, struct text_leaf *leaf,
-		struct text_node *node)
+/* ------------------------------------------------------------------------- */
+
+static bool table_valid(const struct locale_table *table, uint64_t size,
+		const struct stat *st)
 {
-	struct text_node *child;
+	const uint32_t *buckets;
+	const struct locale_entry *entries;
+	const char *strings;
+	uint32_t used = 0;
+
+	if (size < sizeof(struct locale_table) ||
+	    table->magic != LOCALE_TABLE_MAGIC ||
+	    table->header_size != sizeof(struct locale_table) ||
+	    table->total_size != size ||
+	    table->source_size != (int64_t)st->st_size ||
+	    table->source_mtime != (int64_t)st->st_mtime)
+		return false;
 
-	/* value already exists, so replace */
-	if (!lookup_val || !*lookup_val) {
-		lookup_replaceleaf(node, leaf);
-		return;
+	if (!table->num_buckets ||
+	    (table->num_buckets & (table->num_buckets - 1)) != 0 ||
+	    table_size(table->num_buckets, table->num_entries,
+		    table->strings_size) != size)
+		return false;
+
+	buckets = table_buckets(table);
+	entries = table_entries(table);
+	strings = table_strings(table);
+
+	if (table->strings_size && strings[table->strings_size - 1] != 0)
+		return false;
+
+	for (uint32_t i = 0; i < table->num_entries; i++) {
+		if (entries[i].key   >= table->strings_size ||
+		    entries[i].value >= table->strings_size)
+			return false;
 	}
 
-	child = text_node_bychar(node, *lookup_val);
-	if (child) {
-		size_t len;
+	/* a probe has to reach an empty bucket to terminate */
+	for (uint32_t i = 0; i < table->num_buckets; i++) {
+		if (buckets[i] > table->num_entries)
+			return false;
+		if (buckets[i])
+			used++;
+	}
 
-		for (len = 0; len < child->str.len; len++) {
-			char val1 = child->str.array[len],
-			        val2 = lookup_val[len];
+	return used < table->num_buckets;
+}
 
-			if (val1 >= 'A' && val1 <= 'Z')
-				val1 += 0x20;
-			if (val2 >= 'A' && val2 <= 'Z')
-				val2 += 0x20;
+static struct locale_table *table_load(const char *path,
+		const struct stat *st)
+{
+	struct locale_table *table = NULL;
+	int64_t size;
+	FILE *file;
 
-			if (val1 != val2)
-				break;
-		}
+	file = os_fopen(path, "rb");
+	if (!file)
+		return NULL;
 
-		if (len == child->str.len) {
-			lookup_addstring(lookup_val+len, leaf, child);
-			return;
-		} else {
-			lookup_splitnode(lookup_val, len, leaf, child);
+	size = os_fgetsize(file);
+	if (size >= (int64_t)sizeof(struct locale_table) &&
+	    size <= 0x7FFFFFFF) {
+		table = bmalloc((size_t)size);
+
+		if (fread(table, 1, (size_t)size, file) != (size_t)size ||
+		    !table_valid(table, (uint64_t)size, st)) {
+			bfree(table);
+			table = NULL;
 		}
-	} else {
-		lookup_createsubnode(lookup_val, leaf, node);
 	}
+
+	fclose(file);
+	return table;
 }
 
+/* the ini files may well be in a read-only location, in which case the table
+ * is simply rebuilt every time */
+static void table_save(const char *path, const struct locale_table *table)
+{
+	FILE *file = os_fopen(path, "wb");
+	size_t size = (size_t)table->total_size;
+
+	if (!file)
+		return;
+
+	if (fwrite(table, 1, size, file) != size) {
+		fclose(file);
+		os_unlink(path);
+		return;
+	}
+
+	fclose(file);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct text_lookup {
+	struct dstr language;
+
+	/* one table per added file, later files take precedence */
+	DARRAY(struct locale_table*) tables;
+};
+
 static void lookup_getstringtoken(struct lexer *lex, struct strref *token)
 {
 	const char *temp = lex->offset;
@@ -291,7 +431,7 @@ static char *convert_string(const char *str, size_t len)
 	return out.array;
 }
 
-static void lookup_addfiledata(struct text_lookup *lookup,
+static void lookup_addfiledata(struct table_builder *builder,
 		const char *file_data)
 {
 	struct lexer lex;
@@ -303,7 +443,7 @@ static void lookup_addfiledata(struct text_lookup *lookup,
 	strref_clear(&value);
 
 	while (lookup_gettoken(&lex, &name)) {
-		struct text_leaf *leaf;
+		char *converted;
 		bool got_eq = false;
 
 		if (*name.array == '\n')
@@ -318,11 +458,9 @@ getval:
 			goto getval;
 		}
 
-		leaf = bmalloc(sizeof(struct text_leaf));
-		leaf->lookup = bstrdup_n(name.array,  name.len);
-		leaf->value  = convert_string(value.array, value.len);
-
-		lookup_addstring(leaf->lookup, leaf, lookup->top);
+		converted = convert_string(value.array, value.len);
+		builder_add(builder, &name, converted);
+		bfree(converted);
 
 		if (!lookup_goto_nextline(&lex))
 			break;
@@ -331,29 +469,30 @@ getval:
 	lexer_free(&lex);
 }
 
-static inline bool lookup_getstring(const char *lookup_val,
-		const char **out, struct text_node *node)
+static struct locale_table *table_create(const char *path,
+		const struct stat *st)
 {
-	struct text_node *child;
-	char ch;
+	struct table_builder builder = {0};
+	struct dstr file_str;
+	char *temp = NULL;
+	FILE *file;
 
-	if (!node)
-		return false;
+	file = os_fopen(path, "rb");
+	if (!file)
+		return NULL;
 
-	child = text_node_byname(node, lookup_val);
-	if (!child)
-		return false;
+	os_fread_utf8(file, &temp);
+	dstr_init_move_array(&file_str, temp);
+	fclose(file);
 
-	lookup_val += child->str.len;
-	ch = *lookup_val;
-	if (ch)
-		return lookup_getstring(lookup_val, out, child);
+	if (!file_str.array)
+		return NULL;
 
-	if (!child->leaf)
-		return false;
+	dstr_replace(&file_str, "\r", " ");
+	lookup_addfiledata(&builder, file_str.array);
+	dstr_free(&file_str);
 
-	*out = child->leaf->value;
-	return true;
+	return builder_finish(&builder, st);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -372,28 +511,29 @@ lookup_t *text_lookup_create(const char *path)
 
 bool text_lookup_add(lookup_t *lookup, const char *path)
 {
-	struct dstr file_str;
-	char *temp = NULL;
-	FILE *file;
+	struct locale_table *table;
+	struct dstr table_path = {0};
+	struct stat st;
 
-	file = os_fopen(path, "rb");
-	if (!file)
+	if (!path || os_stat(path, &st) != 0)
 		return false;
 
-	os_fread_utf8(file, &temp);
-	dstr_init_move_array(&file_str, temp);
-	fclose(file);
+	dstr_copy(&table_path, path);
+	dstr_cat(&table_path, LOCALE_TABLE_EXT);
 
-	if (!file_str.array)
-		return false;
+	table = table_load(table_path.array, &st);
+	if (!table) {
+		table = table_create(path, &st);
+		if (table)
+			table_save(table_path.array, table);
+	}
 
-	if (!lookup->top)
-		lookup->top = bzalloc(sizeof(struct text_node));
+	dstr_free(&table_path);
 
-	dstr_replace(&file_str, "\r", " ");
-	lookup_addfiledata(lookup, file_str.array);
-	dstr_free(&file_str);
+	if (!table)
+		return false;
 
+	da_push_back(lookup->tables, &table);
 	return true;
 }
 
@@ -401,7 +541,10 @@ void text_lookup_destroy(lookup_t *lookup)
 {
 	if (lookup) {
 		dstr_free(&lookup->language);
-		text_node_destroy(lookup->top);
+
+		for (size_t i = 0; i < lookup->tables.num; i++)
+			bfree(lookup->tables.array[i]);
+		da_free(lookup->tables);
 
 		bfree(lookup);
 	}
@@ -410,7 +553,22 @@ void text_lookup_destroy(lookup_t *lookup)
 bool text_lookup_getstr(lookup_t *lookup, const char *lookup_val,
 		const char **out)
 {
-	if (lookup)
-		return lookup_getstring(lookup_val, out, lookup->top);
+	uint32_t hash;
+
+	if (!lookup || !lookup_val)
+		return false;
+
+	hash = lookup_hash(lookup_val, strlen(lookup_val));
+
+	for (size_t i = lookup->tables.num; i > 0; i--) {
+		const char *value = table_find(lookup->tables.array[i - 1],
+				lookup_val, hash);
+
+		if (value) {
+			*out = value;
+			return true;
+		}
+	}
+
 	return false;
 }
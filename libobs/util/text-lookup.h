@@ -19,9 +19,11 @@
 /*
  * Text Lookup interface
  *
- *   Used for storing and looking up localized strings.  Stores locazation
- * strings in a radix/trie tree to efficiently look up associated strings via a
- * unique string identifier name.
+ *   Used for storing and looking up localized strings.  Each locale file is
+ * stored as a single hash table block, which is cached next to the file
+ * (<file>.table) so that it doesn't have to be parsed again as long as the
+ * file stays the same.  Names are matched case-insensitively, and strings from
+ * files added later take precedence.
  */
 
 #include "c99defs.h"
@@ -30,9 +30,253 @@
 #include <pthread_np.h>
 #endif
 
+#include <sched.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <time.h>
+#endif
+
 #include "bmem.h"
 #include "threading.h"
 
+#if defined(__linux__)
+
+/* ------------------------------------------------------------------------- */
+/* futex based events and semaphores
+ *
+ * The fast paths are a single atomic operation; the kernel is only entered
+ * to sleep when there's nothing to take, and to wake when someone sleeps. */
+
+static inline int futex_wait(volatile int *addr, int val,
+		const struct timespec *timeout)
+{
+	return (int)syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout,
+			NULL, 0);
+}
+
+static inline void futex_wake(volatile int *addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static inline uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+struct os_event_data {
+	volatile int signalled;
+	volatile int waiters;
+	bool         manual;
+};
+
+int os_event_init(os_event_t **event, enum os_event_type type)
+{
+	struct os_event_data *data = bzalloc(sizeof(struct os_event_data));
+
+	data->manual = (type == OS_EVENT_TYPE_MANUAL);
+	*event = data;
+	return 0;
+}
+
+void os_event_destroy(os_event_t *event)
+{
+	bfree(event);
+}
+
+static inline bool event_consume(os_event_t *event)
+{
+	int expected = 1;
+
+	if (event->manual)
+		return __atomic_load_n(&event->signalled, __ATOMIC_SEQ_CST);
+
+	return __atomic_compare_exchange_n(&event->signalled, &expected, 0,
+			false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+int os_event_wait(os_event_t *event)
+{
+	while (!event_consume(event)) {
+		__atomic_add_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+		futex_wait(&event->signalled, 0, NULL);
+		__atomic_sub_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+
+	return 0;
+}
+
+int os_event_timedwait(os_event_t *event, unsigned long milliseconds)
+{
+	uint64_t end = monotonic_ns() + (uint64_t)milliseconds * 1000000ULL;
+
+	while (!event_consume(event)) {
+		uint64_t now = monotonic_ns();
+		struct timespec ts;
+
+		if (now >= end)
+			return ETIMEDOUT;
+
+		ts.tv_sec  = (time_t)((end - now) / 1000000000ULL);
+		ts.tv_nsec = (long)((end - now) % 1000000000ULL);
+
+		__atomic_add_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+		futex_wait(&event->signalled, 0, &ts);
+		__atomic_sub_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+
+	return 0;
+}
+
+int os_event_try(os_event_t *event)
+{
+	return event_consume(event) ? 0 : EAGAIN;
+}
+
+int os_event_signal(os_event_t *event)
+{
+	__atomic_store_n(&event->signalled, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&event->waiters, __ATOMIC_SEQ_CST))
+		futex_wake(&event->signalled, event->manual ? INT_MAX : 1);
+	return 0;
+}
+
+void os_event_reset(os_event_t *event)
+{
+	__atomic_store_n(&event->signalled, 0, __ATOMIC_SEQ_CST);
+}
+
+struct os_sem_data {
+	volatile int  count;
+	volatile int  waiters;
+
+	/* current spin, adapted between max_spin_ns / 16 and max_spin_ns */
+	volatile long spin_ns;
+	long          max_spin_ns;
+};
+
+int  os_sem_init(os_sem_t **sem, int value)
+{
+	if (value < 0)
+		return -1;
+
+	*sem = bzalloc(sizeof(struct os_sem_data));
+	(*sem)->count = value;
+	return 0;
+}
+
+void os_sem_destroy(os_sem_t *sem)
+{
+	bfree(sem);
+}
+
+void os_sem_set_spin(os_sem_t *sem, unsigned long max_spin_ns)
+{
+	if (!sem)
+		return;
+
+	/* spinning only makes sense if the poster can run at the same time */
+	if (sysconf(_SC_NPROCESSORS_ONLN) <= 1)
+		max_spin_ns = 0;
+
+	sem->max_spin_ns = (long)max_spin_ns;
+	__atomic_store_n(&sem->spin_ns, (long)max_spin_ns, __ATOMIC_RELAXED);
+}
+
+static inline bool sem_try(os_sem_t *sem)
+{
+	int count = __atomic_load_n(&sem->count, __ATOMIC_RELAXED);
+
+	while (count > 0) {
+		if (__atomic_compare_exchange_n(&sem->count, &count, count - 1,
+					true, __ATOMIC_SEQ_CST,
+					__ATOMIC_RELAXED))
+			return true;
+	}
+
+	return false;
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+static bool sem_spin(os_sem_t *sem)
+{
+	long spin_ns = __atomic_load_n(&sem->spin_ns, __ATOMIC_RELAXED);
+	uint64_t end;
+	bool success = false;
+
+	if (!spin_ns)
+		return false;
+
+	end = monotonic_ns() + (uint64_t)spin_ns;
+	do {
+		for (int i = 0; i < 64; i++) {
+			cpu_relax();
+			if (__atomic_load_n(&sem->count, __ATOMIC_RELAXED) > 0 &&
+			    sem_try(sem)) {
+				success = true;
+				goto adapt;
+			}
+		}
+	} while (monotonic_ns() < end);
+
+adapt:
+	if (success)
+		spin_ns = spin_ns * 2;
+	else
+		spin_ns = spin_ns / 2;
+
+	if (spin_ns > sem->max_spin_ns)
+		spin_ns = sem->max_spin_ns;
+	else if (spin_ns < sem->max_spin_ns / 16)
+		spin_ns = sem->max_spin_ns / 16;
+
+	__atomic_store_n(&sem->spin_ns, spin_ns, __ATOMIC_RELAXED);
+	return success;
+}
+
+int  os_sem_post(os_sem_t *sem)
+{
+	if (!sem) return -1;
+
+	__atomic_add_fetch(&sem->count, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&sem->waiters, __ATOMIC_SEQ_CST))
+		futex_wake(&sem->count, 1);
+	return 0;
+}
+
+int  os_sem_wait(os_sem_t *sem)
+{
+	if (!sem) return -1;
+
+	if (sem_try(sem) || sem_spin(sem))
+		return 0;
+
+	__atomic_add_fetch(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+	while (!sem_try(sem))
+		futex_wait(&sem->count, 0, NULL);
+	__atomic_sub_fetch(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+#else
+
 struct os_event_data {
 	pthread_mutex_t mutex;
 	pthread_cond_t  cond;
@@ -206,6 +450,12 @@ int  os_sem_wait(os_sem_t *sem)
 	return (semaphore_wait(sem->sem) == KERN_SUCCESS) ? 0 : -1;
 }
 
+void os_sem_set_spin(os_sem_t *sem, unsigned long max_spin_ns)
+{
+	UNUSED_PARAMETER(sem);
+	UNUSED_PARAMETER(max_spin_ns);
+}
+
 #else
 
 struct os_sem_data {
@@ -244,8 +494,16 @@ int  os_sem_wait(os_sem_t *sem)
 	return sem_wait(&sem->sem);
 }
 
+void os_sem_set_spin(os_sem_t *sem, unsigned long max_spin_ns)
+{
+	UNUSED_PARAMETER(sem);
+	UNUSED_PARAMETER(max_spin_ns);
+}
+
 #endif
 
+#endif /* __linux__ */
+
 long os_atomic_inc_long(volatile long *val)
 {
 	return __sync_add_and_fetch(val, 1);
@@ -261,6 +519,16 @@ bool os_atomic_compare_swap_long(volatile long *val, long old_val, long new_val)
 	return __sync_bool_compare_and_swap(val, old_val, new_val);
 }
 
+long os_atomic_set_long(volatile long *ptr, long val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+long os_atomic_load_long(const volatile long *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
 void os_set_thread_name(const char *name)
 {
 #if defined(__APPLE__)
@@ -271,3 +539,112 @@ void os_set_thread_name(const char *name)
 	pthread_setname_np(pthread_self(), name);
 #endif
 }
+
+static inline int clamp_priority(int policy, int priority)
+{
+	int min = sched_get_priority_min(policy);
+	int max = sched_get_priority_max(policy);
+
+	if (priority < min)
+		return min;
+	if (priority > max)
+		return max;
+	return priority;
+}
+
+static bool set_realtime_policy(enum os_sched_policy sched_policy,
+		int priority)
+{
+	int policy = (sched_policy == OS_SCHED_FIFO) ? SCHED_FIFO : SCHED_RR;
+	struct sched_param param = {0};
+	int ret;
+
+	param.sched_priority = clamp_priority(policy, priority);
+
+	ret = pthread_setschedparam(pthread_self(), policy, &param);
+	if (ret != 0) {
+		blog(LOG_WARNING, "os_set_thread_sched: Failed to set %s "
+		                  "priority %d (%d), this needs CAP_SYS_NICE "
+		                  "or a high enough RLIMIT_RTPRIO",
+		                  policy == SCHED_FIFO ? "SCHED_FIFO" :
+		                                         "SCHED_RR",
+		                  param.sched_priority, ret);
+		return false;
+	}
+
+	return true;
+}
+
+static bool set_nice(int priority)
+{
+#if defined(__linux__)
+	/* nice values are per thread on linux */
+	if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid),
+				priority) != 0) {
+		blog(LOG_WARNING, "os_set_thread_sched: Failed to set nice "
+		                  "value %d (%d)", priority, errno);
+		return false;
+	}
+
+	return true;
+#else
+	blog(LOG_WARNING, "os_set_thread_sched: Per-thread nice values are "
+	                  "not supported on this platform");
+	UNUSED_PARAMETER(priority);
+	return false;
+#endif
+}
+
+bool os_set_thread_sched(const struct os_thread_sched *sched)
+{
+	bool success = true;
+
+	if (!sched)
+		return false;
+
+#if defined(__linux__)
+	if (sched->timer_slack_ns &&
+	    prctl(PR_SET_TIMERSLACK, (unsigned long)sched->timer_slack_ns,
+		    0, 0, 0) != 0) {
+		blog(LOG_WARNING, "os_set_thread_sched: Failed to set timer "
+		                  "slack (%d)", errno);
+		success = false;
+	}
+
+	if (sched->cpu_mask) {
+		cpu_set_t set;
+		int ret;
+
+		CPU_ZERO(&set);
+		for (int i = 0; i < 64 && i < CPU_SETSIZE; i++) {
+			if (sched->cpu_mask & (1ULL << i))
+				CPU_SET(i, &set);
+		}
+
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(set),
+				&set);
+		if (ret != 0) {
+			blog(LOG_WARNING, "os_set_thread_sched: Failed to set "
+			                  "cpu affinity 0x%llx (%d)",
+			                  (unsigned long long)sched->cpu_mask,
+			                  ret);
+			success = false;
+		}
+	}
+#endif
+
+	switch (sched->policy) {
+	case OS_SCHED_DEFAULT:
+		break;
+	case OS_SCHED_NICE:
+		success = set_nice(sched->priority) && success;
+		break;
+	case OS_SCHED_FIFO:
+	case OS_SCHED_RR:
+		success = set_realtime_policy(sched->policy,
+				sched->priority) && success;
+		break;
+	}
+
+	return success;
+}
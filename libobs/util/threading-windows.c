@@ -15,6 +15,7 @@
  */
 
 #include "bmem.h"
+#include "platform.h"
 #include "threading.h"
 
 #define WIN32_LEAN_AND_MEAN
@@ -40,7 +41,14 @@ struct os_event_data {
 };
 
 struct os_sem_data {
-	HANDLE handle;
+	HANDLE        handle;
+
+	/* available count, or minus the number of sleeping waiters */
+	volatile long count;
+
+	/* current spin, adapted between max_spin_ns / 16 and max_spin_ns */
+	volatile long spin_ns;
+	long          max_spin_ns;
 };
 
 int os_event_init(os_event_t **event, enum os_event_type type)
@@ -134,12 +142,20 @@ void os_event_reset(os_event_t *event)
 
 int  os_sem_init(os_sem_t **sem, int value)
 {
-	HANDLE handle = CreateSemaphore(NULL, (LONG)value, 0x7FFFFFFF, NULL);
+	HANDLE handle;
+
+	if (value < 0)
+		return -1;
+
+	/* the kernel semaphore only counts the waiters that went to sleep,
+	 * the count itself is kept in user space */
+	handle = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
 	if (!handle)
 		return -1;
 
 	*sem = bzalloc(sizeof(struct os_sem_data));
 	(*sem)->handle = handle;
+	(*sem)->count  = value;
 	return 0;
 }
 
@@ -151,10 +167,98 @@ void os_sem_destroy(os_sem_t *sem)
 	}
 }
 
+void os_sem_set_spin(os_sem_t *sem, unsigned long max_spin_ns)
+{
+	SYSTEM_INFO info;
+
+	if (!sem)
+		return;
+
+	/* spinning only makes sense if the poster can run at the same time */
+	GetSystemInfo(&info);
+	if (info.dwNumberOfProcessors <= 1)
+		max_spin_ns = 0;
+
+	sem->max_spin_ns = (long)max_spin_ns;
+	InterlockedExchange(&sem->spin_ns, (long)max_spin_ns);
+}
+
+static inline bool sem_try(os_sem_t *sem)
+{
+	long count = sem->count;
+
+	while (count > 0) {
+		long prev = InterlockedCompareExchange(&sem->count, count - 1,
+				count);
+		if (prev == count)
+			return true;
+		count = prev;
+	}
+
+	return false;
+}
+
+static bool sem_spin(os_sem_t *sem)
+{
+	long spin_ns = sem->spin_ns;
+	uint64_t end;
+	bool success = false;
+
+	if (!spin_ns)
+		return false;
+
+	end = os_gettime_ns() + (uint64_t)spin_ns;
+	do {
+		for (int i = 0; i < 64; i++) {
+			YieldProcessor();
+			if (sem->count > 0 && sem_try(sem)) {
+				success = true;
+				goto adapt;
+			}
+		}
+	} while (os_gettime_ns() < end);
+
+adapt:
+	if (success)
+		spin_ns = spin_ns * 2;
+	else
+		spin_ns = spin_ns / 2;
+
+	if (spin_ns > sem->max_spin_ns)
+		spin_ns = sem->max_spin_ns;
+	else if (spin_ns < sem->max_spin_ns / 16)
+		spin_ns = sem->max_spin_ns / 16;
+
+	sem->spin_ns = spin_ns;
+	return success;
+}
+
 int  os_sem_post(os_sem_t *sem)
 {
 	if (!sem) return -1;
-	return ReleaseSemaphore(sem->handle, 1, NULL) ? 0 : -1;
+
+	/* a count that was negative means someone is asleep on the handle */
+	if (InterlockedIncrement(&sem->count) <= 0)
+		return ReleaseSemaphore(sem->handle, 1, NULL) ? 0 : -1;
+	return 0;
+}
+
+/* takes a failed waiter back out of the count.  if a post already counted
+ * this waiter as woken, its release is on the handle and is consumed here
+ * instead, so it can't wake a later waiter without a post of its own */
+static int sem_cancel_wait(os_sem_t *sem)
+{
+	long count = sem->count;
+
+	while (count < 0) {
+		long prev = InterlockedCompareExchange(&sem->count, count + 1,
+				count);
+		if (prev == count)
+			return -1;
+		count = prev;
+	}
+
+	return (WaitForSingleObject(sem->handle, 0) == WAIT_OBJECT_0) ? 0 : -1;
 }
 
 int  os_sem_wait(os_sem_t *sem)
@@ -162,8 +266,18 @@ int  os_sem_wait(os_sem_t *sem)
 	DWORD ret;
 
 	if (!sem) return -1;
+
+	if (sem_try(sem) || sem_spin(sem))
+		return 0;
+
+	if (InterlockedDecrement(&sem->count) >= 0)
+		return 0;
+
 	ret = WaitForSingleObject(sem->handle, INFINITE);
-	return (ret == WAIT_OBJECT_0) ? 0 : -1;
+	if (ret == WAIT_OBJECT_0)
+		return 0;
+
+	return sem_cancel_wait(sem);
 }
 
 long os_atomic_inc_long(volatile long *val)
@@ -181,6 +295,16 @@ bool os_atomic_compare_swap_long(volatile long *val, long old_val, long new_val)
 	return InterlockedCompareExchange(val, new_val, old_val) == old_val;
 }
 
+long os_atomic_set_long(volatile long *ptr, long val)
+{
+	return InterlockedExchange(ptr, val);
+}
+
+long os_atomic_load_long(const volatile long *ptr)
+{
+	return InterlockedOr((volatile long*)ptr, 0);
+}
+
 #define VC_EXCEPTION 0x406D1388
 
 #pragma pack(push,8)
@@ -221,3 +345,48 @@ void os_set_thread_name(const char *name)
 	}
 #endif
 }
+
+static int get_windows_priority(const struct os_thread_sched *sched)
+{
+	if (sched->policy == OS_SCHED_FIFO || sched->policy == OS_SCHED_RR)
+		return THREAD_PRIORITY_HIGHEST;
+
+	if (sched->priority < -10)
+		return THREAD_PRIORITY_HIGHEST;
+	else if (sched->priority < 0)
+		return THREAD_PRIORITY_ABOVE_NORMAL;
+	else if (sched->priority == 0)
+		return THREAD_PRIORITY_NORMAL;
+	else if (sched->priority <= 10)
+		return THREAD_PRIORITY_BELOW_NORMAL;
+	return THREAD_PRIORITY_LOWEST;
+}
+
+/* real-time policies map to THREAD_PRIORITY_HIGHEST rather than
+ * TIME_CRITICAL, and there is no per-thread timer slack on windows */
+bool os_set_thread_sched(const struct os_thread_sched *sched)
+{
+	HANDLE thread = GetCurrentThread();
+	bool success = true;
+
+	if (!sched)
+		return false;
+
+	if (sched->cpu_mask &&
+	    !SetThreadAffinityMask(thread, (DWORD_PTR)sched->cpu_mask)) {
+		blog(LOG_WARNING, "os_set_thread_sched: Failed to set cpu "
+		                  "affinity 0x%llx (%lu)",
+		                  (unsigned long long)sched->cpu_mask,
+		                  GetLastError());
+		success = false;
+	}
+
+	if (sched->policy != OS_SCHED_DEFAULT &&
+	    !SetThreadPriority(thread, get_windows_priority(sched))) {
+		blog(LOG_WARNING, "os_set_thread_sched: Failed to set thread "
+		                  "priority (%lu)", GetLastError());
+		success = false;
+	}
+
+	return success;
+}
@@ -70,14 +70,77 @@ EXPORT void os_sem_destroy(os_sem_t *sem);
 EXPORT int  os_sem_post(os_sem_t *sem);
 EXPORT int  os_sem_wait(os_sem_t *sem);
 
+/**
+ * Lets os_sem_wait spin for up to max_spin_ns before it goes to sleep in the
+ * kernel, for hand-offs where the post usually follows the wait closely.
+ * The spin adapts: it shrinks while it keeps missing and grows back when it
+ * catches posts.  Nothing is spun on single cpu systems.  0 (the default)
+ * disables spinning.
+ */
+EXPORT void os_sem_set_spin(os_sem_t *sem, unsigned long max_spin_ns);
+
 EXPORT long os_atomic_inc_long(volatile long *val);
 EXPORT long os_atomic_dec_long(volatile long *val);
 
 EXPORT bool os_atomic_compare_swap_long(volatile long *val,
 		long old_val, long new_val);
 
+EXPORT long os_atomic_set_long(volatile long *ptr, long val);
+EXPORT long os_atomic_load_long(const volatile long *ptr);
+
 EXPORT void os_set_thread_name(const char *name);
 
+/* ------------------------------------------------------------------------- */
+/* media thread scheduling */
+
+enum os_thread_class {
+	OS_THREAD_CLASS_GRAPHICS, /* libobs graphics/render thread */
+	OS_THREAD_CLASS_VIDEO,    /* video-io thread, runs the video encoders */
+	OS_THREAD_CLASS_AUDIO,    /* audio-io thread, runs the audio encoders,
+	                           * and the source audio workers */
+	OS_THREAD_CLASS_COUNT
+};
+
+enum os_sched_policy {
+	OS_SCHED_DEFAULT,         /* leave the thread as it was created */
+	OS_SCHED_NICE,            /* normal scheduling with a nice value */
+	OS_SCHED_FIFO,            /* real-time, first in first out */
+	OS_SCHED_RR               /* real-time, round robin */
+};
+
+struct os_thread_sched {
+	enum os_sched_policy policy;
+
+	/* nice value (-20 to 19) for OS_SCHED_NICE, real-time priority
+	 * (1 to 99 on linux) for OS_SCHED_FIFO and OS_SCHED_RR */
+	int                  priority;
+
+	/* how late the kernel may wake the thread to batch timer expiries,
+	 * 0 leaves the default (50 us on linux) */
+	uint64_t             timer_slack_ns;
+
+	/* bit n allows the thread on cpu n, 0 leaves it unrestricted */
+	uint64_t             cpu_mask;
+};
+
+/**
+ * Sets the scheduling a class of media threads applies when it starts.  Has
+ * to be called before the threads are created (obs_reset_video and
+ * obs_reset_audio) to take effect.  Real-time policies need the right
+ * privileges (CAP_SYS_NICE or an rtprio limit on linux); if they can't be
+ * set, a warning is logged and the thread keeps running as it was.
+ */
+EXPORT void os_set_thread_class_sched(enum os_thread_class thread_class,
+		const struct os_thread_sched *sched);
+EXPORT void os_get_thread_class_sched(enum os_thread_class thread_class,
+		struct os_thread_sched *sched);
+
+/** Applies the scheduling set for a class to the calling thread */
+EXPORT bool os_apply_thread_class_sched(enum os_thread_class thread_class);
+
+/** Applies the given scheduling to the calling thread */
+EXPORT bool os_set_thread_sched(const struct os_thread_sched *sched);
+
 
 #ifdef __cplusplus
 }
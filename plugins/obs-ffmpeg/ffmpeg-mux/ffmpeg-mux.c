@@ -24,9 +24,11 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ffmpeg-mux.h"
 
 #include <libavformat/avformat.h>
+#include <libavutil/opt.h>
 
 /* ------------------------------------------------------------------------- */
 
@@ -73,6 +75,7 @@ struct main_params {
 	int fps_num;
 	int fps_den;
 	char *acodec;
+	int fragmented;
 };
 
 struct audio_params {
@@ -250,6 +253,17 @@ static bool init_params(int *argc, char ***argv, struct main_params *params,
 	return true;
 }
 
+/* flags that can follow the track parameters */
+static void init_flags(int argc, char **argv, struct main_params *params)
+{
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--fragmented") == 0)
+			params->fragmented = 1;
+		else
+			printf("Unknown option '%s'\n", argv[i]);
+	}
+}
+
 static bool new_stream(struct ffmpeg_mux *ffm, AVStream **stream,
 		const char *name, enum AVCodecID *id)
 {
@@ -438,9 +452,39 @@ static inline bool ffmpeg_mux_get_extra_data(struct ffmpeg_mux *ffm)
 	return true;
 }
 
+/* MP4/MOV normally keep the index (moov) for the end of the file, so a file
+ * that is cut off can't be played.  Fragmented files start with an empty
+ * index and add a moof/mdat pair per GOP, so everything up to the last
+ * complete fragment stays playable. */
+static void set_fragmented_options(struct ffmpeg_mux *ffm,
+		AVDictionary **opts)
+{
+	AVOutputFormat *format = ffm->output->oformat;
+
+	if (!format->priv_class || !av_opt_find(&format->priv_class,
+				"movflags", NULL, 0, AV_OPT_SEARCH_FAKE_OBJ)) {
+		printf("Fragmented output isn't supported by the '%s' muxer, "
+		       "writing a normal file\n", format->name);
+		ffm->params.fragmented = 0;
+		return;
+	}
+
+	/* every audio packet can be a keyframe, so without video the
+	 * fragments are cut by time instead */
+	if (ffm->video_stream) {
+		av_dict_set(opts, "movflags",
+				"frag_keyframe+empty_moov+default_base_moof", 0);
+	} else {
+		av_dict_set(opts, "movflags",
+				"empty_moov+default_base_moof", 0);
+		av_dict_set(opts, "frag_duration", "2000000", 0);
+	}
+}
+
 static inline int open_output_file(struct ffmpeg_mux *ffm)
 {
 	AVOutputFormat *format = ffm->output->oformat;
+	AVDictionary *opts = NULL;
 	int ret;
 
 	if ((format->flags & AVFMT_NOFILE) == 0) {
@@ -453,7 +497,11 @@ static inline int open_output_file(struct ffmpeg_mux *ffm)
 		}
 	}
 
-	ret = avformat_write_header(ffm->output, NULL);
+	if (ffm->params.fragmented)
+		set_fragmented_options(ffm, &opts);
+
+	ret = avformat_write_header(ffm->output, &opts);
+	av_dict_free(&opts);
 	if (ret < 0) {
 		printf("Error opening '%s': %s",
 				ffm->params.file, av_err2str(ret));
@@ -508,6 +556,8 @@ static int ffmpeg_mux_init_internal(struct ffmpeg_mux *ffm, int argc,
 	if (!init_params(&argc, &argv, &ffm->params, &ffm->audio))
 		return FFM_ERROR;
 
+	init_flags(argc, argv, &ffm->params);
+
 	if (ffm->params.tracks) {
 		ffm->audio_header =
 			calloc(1, sizeof(struct header) * ffm->params.tracks);
@@ -570,6 +620,7 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
 {
 	int idx = get_index(ffm, info);
 	AVPacket packet = {0};
+	int ret;
 
 	/* The muxer might not support video/audio, or multiple audio tracks */
 	if (idx == -1) {
@@ -587,7 +638,24 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
 	if (info->keyframe)
 		packet.flags = AV_PKT_FLAG_KEY;
 
-	return av_interleaved_write_frame(ffm->output, &packet) >= 0;
+	/* the packets already come interleaved from the output.  in fragmented
+	 * mode they go to the muxer directly, because the interleaving queue
+	 * can hold a keyframe back, and the keyframe is what makes the muxer
+	 * write out the fragment it closes */
+	if (ffm->params.fragmented)
+		ret = av_write_frame(ffm->output, &packet);
+	else
+		ret = av_interleaved_write_frame(ffm->output, &packet);
+
+	if (ret < 0)
+		return false;
+
+	/* pass the fragment the keyframe closed on to the file right away
+	 * instead of leaving it in the avio buffer */
+	if (ffm->params.fragmented && (info->keyframe || !ffm->video_stream))
+		avio_flush(ffm->output->pb);
+
+	return true;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -17,6 +17,7 @@
 
 #include <obs-module.h>
 #include <obs-avc.h>
+#include <util/darray.h>
 #include <util/dstr.h>
 #include <util/pipe.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
@@ -32,6 +33,8 @@ struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
 	struct dstr       path;
+	DARRAY(uint8_t)   annexb;
+	bool              fragmented;
 	bool              sent_headers;
 	bool              active;
 	bool              capturing;
@@ -48,6 +51,7 @@ static void ffmpeg_mux_destroy(void *data)
 	struct ffmpeg_muxer *stream = data;
 	os_process_pipe_destroy(stream->pipe);
 	dstr_free(&stream->path);
+	da_free(stream->annexb);
 	bfree(stream);
 }
 
@@ -144,6 +148,9 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd)
 			add_audio_encoder_params(cmd, aencoders[i]);
 		}
 	}
+
+	if (stream->fragmented)
+		dstr_cat(cmd, "--fragmented ");
 }
 
 static bool ffmpeg_mux_start(void *data)
@@ -162,6 +169,7 @@ static bool ffmpeg_mux_start(void *data)
 	path = obs_data_get_string(settings, "path");
 	dstr_copy(&stream->path, path);
 	dstr_replace(&stream->path, "\"", "\"\"");
+	stream->fragmented = obs_data_get_bool(settings, "fragmented");
 	obs_data_release(settings);
 
 	build_command_line(stream, &cmd);
@@ -178,7 +186,8 @@ static bool ffmpeg_mux_start(void *data)
 	stream->capturing = true;
 	obs_output_begin_data_capture(stream->output, 0);
 
-	info("Writing file '%s'...", stream->path.array);
+	info("Writing %sfile '%s'...", stream->fragmented ? "fragmented " : "",
+			stream->path.array);
 	return true;
 }
 
@@ -305,6 +314,40 @@ static bool send_headers(struct ffmpeg_muxer *stream)
 	return true;
 }
 
+/* ffmpeg-mux expects annex-b video.  the four byte NAL lengths are replaced
+ * by four byte start codes, so the packet keeps its size */
+static void convert_to_annexb(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	uint8_t *data, *end;
+
+	da_resize(stream->annexb, packet->size);
+	memcpy(stream->annexb.array, packet->data, packet->size);
+	obs_frame_stats_add_copied_bytes(packet->size);
+
+	data = stream->annexb.array;
+	end  = data + packet->size;
+
+	while (end - data > 4) {
+		size_t nal_size = ((size_t)data[0] << 24) |
+		                  ((size_t)data[1] << 16) |
+		                  ((size_t)data[2] << 8)  |
+		                   (size_t)data[3];
+
+		data[0] = 0;
+		data[1] = 0;
+		data[2] = 0;
+		data[3] = 1;
+
+		if (nal_size > (size_t)(end - data) - 4)
+			break;
+		data += 4 + nal_size;
+	}
+
+	packet->data = stream->annexb.array;
+	packet->avcc = false;
+}
+
 static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -319,6 +362,14 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 		stream->sent_headers = true;
 	}
 
+	if (packet->type == OBS_ENCODER_VIDEO && packet->avcc) {
+		struct encoder_packet annexb_packet = *packet;
+
+		convert_to_annexb(stream, &annexb_packet);
+		write_packet(stream, &annexb_packet);
+		return;
+	}
+
 	write_packet(stream, packet);
 }
 
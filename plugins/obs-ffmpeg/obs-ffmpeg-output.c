@@ -30,6 +30,9 @@
 #include "closest-pixel-format.h"
 #include "obs-ffmpeg-compat.h"
 
+/* raw frames are written as soon as they are encoded */
+#define WRITE_SPIN_NS 20000
+
 struct ffmpeg_cfg {
 	const char         *url;
 	const char         *format_name;
@@ -575,6 +578,7 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 		goto fail;
 	if (os_sem_init(&data->write_sem, 0) != 0)
 		goto fail;
+	os_sem_set_spin(data->write_sem, WRITE_SPIN_NS);
 
 	av_log_set_callback(ffmpeg_log_callback);
 
@@ -22,8 +22,6 @@
 
 #include <libff/ff-demuxer.h>
 
-#include <libswscale/swscale.h>
-
 #define FF_LOG(level, format, ...) \
 	blog(level, "[Media Source]: " format, ##__VA_ARGS__)
 #define FF_LOG_S(source, level, format, ...) \
@@ -35,14 +33,21 @@
 static bool video_frame(struct ff_frame *frame, void *opaque);
 static bool video_format(AVCodecContext *codec_context, void *opaque);
 
+/* formats that can be output without conversion, anything else is converted
+ * to BGRA on the decoder thread */
+static const enum AVPixelFormat passthrough_formats[] = {
+	AV_PIX_FMT_YUV444P,
+	AV_PIX_FMT_YUV420P,
+	AV_PIX_FMT_NV12,
+	AV_PIX_FMT_YUYV422,
+	AV_PIX_FMT_UYVY422,
+	AV_PIX_FMT_RGBA,
+	AV_PIX_FMT_BGRA,
+	AV_PIX_FMT_NONE
+};
+
 struct ffmpeg_source {
 	struct ff_demuxer *demuxer;
-	struct SwsContext *sws_ctx;
-	int sws_width;
-	int sws_height;
-	enum AVPixelFormat sws_format;
-	uint8_t *sws_data;
-	int sws_linesize;
 	obs_source_t *source;
 	bool is_forcing_scale;
 	bool is_hw_decoding;
@@ -86,103 +91,6 @@ static bool set_obs_frame_colorprops(struct ff_frame *frame,
 	return true;
 }
 
-bool update_sws_context(struct ffmpeg_source *s, AVFrame *frame)
-{
-	if (frame->width != s->sws_width
-			|| frame->height != s->sws_height
-			|| frame->format != s->sws_format) {
-		if (s->sws_ctx != NULL)
-			sws_freeContext(s->sws_ctx);
-
-		if (frame->width <= 0 || frame->height <= 0) {
-			FF_BLOG(LOG_ERROR, "unable to create a sws "
-					"context that has a width(%d) or "
-					"height(%d) of zero.", frame->width,
-					frame->height);
-			goto fail;
-		}
-
-		s->sws_ctx = sws_getContext(
-			frame->width,
-			frame->height,
-			frame->format,
-			frame->width,
-			frame->height,
-			AV_PIX_FMT_BGRA,
-			SWS_BILINEAR,
-			NULL, NULL, NULL);
-
-		if (s->sws_ctx == NULL) {
-			FF_BLOG(LOG_ERROR, "unable to create sws "
-					"context with src{w:%d,h:%d,f:%d}->"
-					"dst{w:%d,h:%d,f:%d}",
-					frame->width, frame->height,
-					frame->format, frame->width,
-					frame->height, AV_PIX_FMT_BGRA);
-			goto fail;
-
-		}
-
-		if (s->sws_data != NULL)
-			bfree(s->sws_data);
-		s->sws_data = bzalloc(frame->width * frame->height * 4);
-		if (s->sws_data == NULL) {
-			FF_BLOG(LOG_ERROR, "unable to allocate sws "
-					"pixel data with size %d",
-					frame->width * frame->height * 4);
-			goto fail;
-		}
-
-		s->sws_linesize = frame->width * 4;
-		s->sws_width = frame->width;
-		s->sws_height = frame->height;
-		s->sws_format = frame->format;
-	}
-
-	return true;
-
-fail:
-	if (s->sws_ctx != NULL)
-		sws_freeContext(s->sws_ctx);
-	s->sws_ctx = NULL;
-
-	if (s->sws_data)
-		bfree(s->sws_data);
-	s->sws_data = NULL;
-
-	s->sws_linesize = 0;
-	s->sws_width = 0;
-	s->sws_height = 0;
-	s->sws_format = 0;
-
-	return false;
-}
-
-static bool video_frame_scale(struct ff_frame *frame,
-		struct ffmpeg_source *s, struct obs_source_frame *obs_frame)
-{
-	if (!update_sws_context(s, frame->frame))
-		return false;
-
-	sws_scale(
-		s->sws_ctx,
-		(uint8_t const *const *)frame->frame->data,
-		frame->frame->linesize,
-		0,
-		frame->frame->height,
-		&s->sws_data,
-		&s->sws_linesize
-	);
-
-	obs_frame->data[0]     = s->sws_data;
-	obs_frame->linesize[0] = s->sws_linesize;
-	obs_frame->format      = VIDEO_FORMAT_BGRA;
-
-	obs_source_output_video(s->source, obs_frame);
-
-	return true;
-}
-
 static bool video_frame_hwaccel(struct ff_frame *frame,
 		struct ffmpeg_source *s, struct obs_source_frame *obs_frame)
 {
@@ -238,9 +146,10 @@ static bool video_frame(struct ff_frame *frame, void *opaque)
 	enum video_format format =
 			ffmpeg_to_obs_video_format(frame->frame->format);
 
-	if (s->is_forcing_scale || format == VIDEO_FORMAT_NONE)
-		return video_frame_scale(frame, s, &obs_frame);
-	else if (s->is_hw_decoding)
+	if (format == VIDEO_FORMAT_NONE) {
+		/* only reached if conversion on the decoder thread failed */
+		return false;
+	} else if (s->is_hw_decoding)
 		return video_frame_hwaccel(frame, s, &obs_frame);
 	else
 		return video_frame_direct(frame, s, &obs_frame);
@@ -305,13 +214,23 @@ static bool is_advanced_modified(obs_properties_t *props,
 	obs_property_t *abuf = obs_properties_get(props, "audio_buffer_size");
 	obs_property_t *vbuf = obs_properties_get(props, "video_buffer_size");
 	obs_property_t *frame_drop = obs_properties_get(props, "frame_drop");
+	obs_property_t *threads = obs_properties_get(props, "decoder_threads");
+	obs_property_t *frame_threading = obs_properties_get(props,
+			"frame_threading");
 	obs_property_set_visible(abuf, enabled);
 	obs_property_set_visible(vbuf, enabled);
 	obs_property_set_visible(frame_drop, enabled);
+	obs_property_set_visible(threads, enabled);
+	obs_property_set_visible(frame_threading, enabled);
 
 	return true;
 }
 
+static void ffmpeg_source_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_bool(settings, "frame_threading", true);
+}
+
 static obs_properties_t *ffmpeg_source_getproperties(void *data)
 {
 	UNUSED_PARAMETER(data);
@@ -386,6 +305,16 @@ static obs_properties_t *ffmpeg_source_getproperties(void *data)
 
 	obs_property_set_visible(prop, false);
 
+	prop = obs_properties_add_int(props, "decoder_threads",
+			obs_module_text("DecoderThreads"), 0, 64, 1);
+
+	obs_property_set_visible(prop, false);
+
+	prop = obs_properties_add_bool(props, "frame_threading",
+			obs_module_text("FrameThreading"));
+
+	obs_property_set_visible(prop, false);
+
 	return props;
 }
 
@@ -433,10 +362,15 @@ static void dump_source_info(struct ffmpeg_source *s, const char *input,
 			"advanced settings:\n"
 			"\taudio_buffer_size:       %d\n"
 			"\tvideo_buffer_size:       %d\n"
-			"\tframe_drop:              %s",
+			"\tframe_drop:              %s\n"
+			"\tdecoder_threads:         %d\n"
+			"\tframe_threading:         %s",
 			s->demuxer->options.audio_frame_queue_size,
 			s->demuxer->options.video_frame_queue_size,
-			frame_drop_to_str(s->demuxer->options.frame_drop));
+			frame_drop_to_str(s->demuxer->options.frame_drop),
+			s->demuxer->options.decoder_threads,
+			(s->demuxer->options.decoder_thread_type &
+			 FF_THREAD_FRAME) ? "yes" : "no");
 }
 
 static void ffmpeg_source_update(void *data, obs_data_t *settings)
@@ -472,6 +406,9 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 	s->demuxer = ff_demuxer_init();
 	s->demuxer->options.is_hw_decoding = s->is_hw_decoding;
 	s->demuxer->options.is_looping = is_looping;
+	s->demuxer->options.convert_format = AV_PIX_FMT_BGRA;
+	s->demuxer->options.passthrough_formats = passthrough_formats;
+	s->demuxer->options.is_forcing_conversion = s->is_forcing_scale;
 
 	if (is_advanced) {
 		int audio_buffer_size = (int)obs_data_get_int(settings,
@@ -501,6 +438,19 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 					frame_drop);
 		}
 		s->demuxer->options.frame_drop = frame_drop;
+
+		int decoder_threads = (int)obs_data_get_int(settings,
+				"decoder_threads");
+		if (decoder_threads < 0) {
+			FF_BLOG(LOG_WARNING, "invalid decoder_threads %d",
+					decoder_threads);
+			decoder_threads = 0;
+		}
+		s->demuxer->options.decoder_threads = decoder_threads;
+
+		if (!obs_data_get_bool(settings, "frame_threading"))
+			s->demuxer->options.decoder_thread_type =
+					FF_THREAD_SLICE;
 	}
 
 	ff_demuxer_set_callbacks(&s->demuxer->video_callbacks,
@@ -539,12 +489,6 @@ static void ffmpeg_source_destroy(void *data)
 	struct ffmpeg_source *s = data;
 
 	ff_demuxer_free(s->demuxer);
-
-	if (s->sws_ctx != NULL)
-		sws_freeContext(s->sws_ctx);
-	if (s->sws_data != NULL)
-		bfree(s->sws_data);
-
 	bfree(s);
 }
 
@@ -556,5 +500,6 @@ struct obs_source_info ffmpeg_source = {
 	.create         = ffmpeg_source_create,
 	.destroy        = ffmpeg_source_destroy,
 	.get_properties = ffmpeg_source_getproperties,
+	.get_defaults   = ffmpeg_source_defaults,
 	.update         = ffmpeg_source_update
 };
@@ -1,5 +1,7 @@
 #include <obs-module.h>
 #include <util/circlebuf.h>
+#include <util/threading.h>
+#include <util/darray.h>
 
 #ifndef SEC_TO_NSEC
 #define SEC_TO_NSEC 1000000000ULL
@@ -10,8 +12,46 @@
 #endif
 
 #define SETTING_DELAY_MS               "delay_ms"
+#define SETTING_COMPACT                "compact_storage"
+#define SETTING_MEMORY_LIMIT_MB        "memory_limit_mb"
 
 #define TEXT_DELAY_MS                  obs_module_text("DelayMs")
+#define TEXT_COMPACT                   obs_module_text("AsyncDelayFilter.CompactStorage")
+#define TEXT_MEMORY_LIMIT_MB           obs_module_text("AsyncDelayFilter.MemoryLimitMB")
+
+#define DEFAULT_MEMORY_LIMIT_MB        512
+
+/* frames the ring holds beyond the delay when it's first sized, for frame
+ * rates that vary or are above the canvas rate */
+#define RING_EXTRA_FRAMES              4
+
+#define do_log(level, format, ...) \
+	blog(level, "[async delay filter: '%s'] " format, \
+			obs_source_get_name(filter->context), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+/* A frame held in the compact ring.  YUV formats are stored as tightly packed
+ * I420 (4:2:2 and 4:4:4 input is subsampled to 4:2:0), packed RGB formats are
+ * stored as-is without line padding. */
+struct compact_frame {
+	size_t                         offset;
+	size_t                         size;
+
+	uint32_t                       width;
+	uint32_t                       height;
+	uint32_t                       linesize[MAX_AV_PLANES];
+	uint32_t                       lines[MAX_AV_PLANES];
+	uint64_t                       timestamp;
+
+	enum video_format              format;
+	float                          color_matrix[16];
+	bool                           full_range;
+	float                          color_range_min[3];
+	float                          color_range_max[3];
+	bool                           flip;
+};
 
 struct async_delay_data {
 	obs_source_t                   *context;
@@ -19,6 +59,28 @@ struct async_delay_data {
 	/* contains struct obs_source_frame* */
 	struct circlebuf               video_frames;
 
+	/* compact storage: frame data lives in a byte ring sized for the
+	 * delay, which grows up to memory_limit bytes when more frames have
+	 * to be held.  the circlebuf only holds the frame headers
+	 * (struct compact_frame).  the mutex guards the ring state and the
+	 * usage statistics against the settings/proc handler threads. */
+	bool                           compact;
+	pthread_mutex_t                compact_mutex;
+	struct circlebuf               compact_frames;
+	uint8_t                        *ring;
+	size_t                         ring_size;
+	size_t                         ring_head;
+	size_t                         memory_limit;
+	size_t                         stored_bytes;
+	size_t                         peak_bytes;
+	long long                      dropped_frames;
+	bool                           limit_warned;
+
+	/* output frames handed back to libobs.  each frame holds one reference
+	 * owned by the filter, and a frame is only reused once every other
+	 * reference has been released */
+	DARRAY(struct obs_source_frame*) output_frames;
+
 	/* stores the audio data */
 	struct circlebuf               audio_frames;
 	struct obs_audio_data          audio_output;
@@ -69,15 +131,571 @@ static void free_audio_data(struct async_delay_data *filter)
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+/* Compact frame storage */
+
+static bool get_compact_layout(const struct obs_source_frame *frame,
+		struct compact_frame *cf)
+{
+	uint32_t width  = frame->width;
+	uint32_t height = frame->height;
+
+	memset(cf->linesize, 0, sizeof(cf->linesize));
+	memset(cf->lines, 0, sizeof(cf->lines));
+
+	switch (frame->format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_I444:
+		cf->format      = VIDEO_FORMAT_I420;
+		cf->linesize[0] = width;
+		cf->linesize[1] = width / 2;
+		cf->linesize[2] = width / 2;
+		cf->lines[0]    = height;
+		cf->lines[1]    = height / 2;
+		cf->lines[2]    = height / 2;
+		break;
+
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		cf->format      = frame->format;
+		cf->linesize[0] = width * 4;
+		cf->lines[0]    = height;
+		break;
+
+	case VIDEO_FORMAT_NONE:
+	default:
+		return false;
+	}
+
+	cf->size = 0;
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		cf->size += (size_t)cf->linesize[i] * cf->lines[i];
+
+	cf->width     = width;
+	cf->height    = height;
+	cf->timestamp = frame->timestamp;
+	cf->full_range = frame->full_range;
+	cf->flip      = frame->flip;
+	memcpy(cf->color_matrix, frame->color_matrix,
+			sizeof(cf->color_matrix));
+	memcpy(cf->color_range_min, frame->color_range_min,
+			sizeof(cf->color_range_min));
+	memcpy(cf->color_range_max, frame->color_range_max,
+			sizeof(cf->color_range_max));
+	return cf->size != 0;
+}
+
+static inline void compact_planes(uint8_t *base, const struct compact_frame *cf,
+		uint8_t *planes[MAX_AV_PLANES])
+{
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		planes[i] = base;
+		base += (size_t)cf->linesize[i] * cf->lines[i];
+	}
+}
+
+static void copy_planes(uint8_t *const dst[MAX_AV_PLANES],
+		const uint32_t dst_linesize[MAX_AV_PLANES],
+		uint8_t *const src[MAX_AV_PLANES],
+		const uint32_t src_linesize[MAX_AV_PLANES],
+		const struct compact_frame *cf)
+{
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		uint32_t line_bytes = cf->linesize[i];
+
+		if (!line_bytes)
+			break;
+
+		if (dst_linesize[i] == line_bytes &&
+		    src_linesize[i] == line_bytes) {
+			memcpy(dst[i], src[i], (size_t)line_bytes *
+					cf->lines[i]);
+			continue;
+		}
+
+		for (uint32_t y = 0; y < cf->lines[i]; y++)
+			memcpy(dst[i] + (size_t)y * dst_linesize[i],
+			       src[i] + (size_t)y * src_linesize[i],
+			       line_bytes);
+	}
+}
+
+static void store_nv12(const struct obs_source_frame *frame,
+		const struct compact_frame *cf, uint8_t *planes[MAX_AV_PLANES])
+{
+	uint32_t cw = cf->linesize[1];
+
+	for (uint32_t y = 0; y < cf->lines[0]; y++)
+		memcpy(planes[0] + (size_t)y * cf->linesize[0],
+		       frame->data[0] + (size_t)y * frame->linesize[0],
+		       cf->linesize[0]);
+
+	for (uint32_t y = 0; y < cf->lines[1]; y++) {
+		const uint8_t *uv = frame->data[1] +
+			(size_t)y * frame->linesize[1];
+		uint8_t *u = planes[1] + (size_t)y * cw;
+		uint8_t *v = planes[2] + (size_t)y * cw;
+
+		for (uint32_t x = 0; x < cw; x++) {
+			u[x] = uv[x * 2];
+			v[x] = uv[x * 2 + 1];
+		}
+	}
+}
+
+/* packed 4:2:2 to I420, chroma of each pair of lines is averaged */
+static void store_packed422(const struct obs_source_frame *frame,
+		const struct compact_frame *cf, uint8_t *planes[MAX_AV_PLANES])
+{
+	uint32_t cw = cf->linesize[1];
+	int y_pos, u_pos, v_pos;
+
+	if (frame->format == VIDEO_FORMAT_UYVY) {
+		y_pos = 1; u_pos = 0; v_pos = 2;
+	} else if (frame->format == VIDEO_FORMAT_YVYU) {
+		y_pos = 0; u_pos = 3; v_pos = 1;
+	} else {
+		y_pos = 0; u_pos = 1; v_pos = 3;
+	}
+
+	for (uint32_t y = 0; y < cf->lines[0]; y++) {
+		const uint8_t *src = frame->data[0] +
+			(size_t)y * frame->linesize[0];
+		uint8_t *luma = planes[0] + (size_t)y * cf->linesize[0];
+
+		for (uint32_t x = 0; x < cf->width; x++)
+			luma[x] = src[x * 2 + y_pos];
+	}
+
+	for (uint32_t y = 0; y < cf->lines[1]; y++) {
+		const uint8_t *src0 = frame->data[0] +
+			(size_t)(y * 2) * frame->linesize[0];
+		const uint8_t *src1 = src0 + frame->linesize[0];
+		uint8_t *u = planes[1] + (size_t)y * cw;
+		uint8_t *v = planes[2] + (size_t)y * cw;
+
+		for (uint32_t x = 0; x < cw; x++) {
+			const uint8_t *p0 = src0 + x * 4;
+			const uint8_t *p1 = src1 + x * 4;
+
+			u[x] = (uint8_t)((p0[u_pos] + p1[u_pos] + 1) >> 1);
+			v[x] = (uint8_t)((p0[v_pos] + p1[v_pos] + 1) >> 1);
+		}
+	}
+}
+
+/* planar 4:4:4 to I420, chroma is averaged over 2x2 blocks */
+static void store_i444(const struct obs_source_frame *frame,
+		const struct compact_frame *cf, uint8_t *planes[MAX_AV_PLANES])
+{
+	uint32_t cw = cf->linesize[1];
+
+	for (uint32_t y = 0; y < cf->lines[0]; y++)
+		memcpy(planes[0] + (size_t)y * cf->linesize[0],
+		       frame->data[0] + (size_t)y * frame->linesize[0],
+		       cf->linesize[0]);
+
+	for (size_t plane = 1; plane < 3; plane++) {
+		uint32_t src_linesize = frame->linesize[plane];
+
+		for (uint32_t y = 0; y < cf->lines[plane]; y++) {
+			const uint8_t *src0 = frame->data[plane] +
+				(size_t)(y * 2) * src_linesize;
+			const uint8_t *src1 = src0 + src_linesize;
+			uint8_t *dst = planes[plane] + (size_t)y * cw;
+
+			for (uint32_t x = 0; x < cw; x++)
+				dst[x] = (uint8_t)((src0[x * 2] +
+						src0[x * 2 + 1] +
+						src1[x * 2] +
+						src1[x * 2 + 1] + 2) >> 2);
+		}
+	}
+}
+
+static void store_compact_frame(const struct obs_source_frame *frame,
+		const struct compact_frame *cf, uint8_t *base)
+{
+	uint8_t *planes[MAX_AV_PLANES];
+
+	compact_planes(base, cf, planes);
+
+	switch (frame->format) {
+	case VIDEO_FORMAT_NV12:
+		store_nv12(frame, cf, planes);
+		break;
+
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+		store_packed422(frame, cf, planes);
+		break;
+
+	case VIDEO_FORMAT_I444:
+		store_i444(frame, cf, planes);
+		break;
+
+	default:
+		copy_planes(planes, cf->linesize, frame->data,
+				frame->linesize, cf);
+	}
+}
+
+/* finds a contiguous region for a frame in the ring.  frames are stored in
+ * order, so the free space is the region between the write head and the
+ * oldest stored frame */
+static bool ring_alloc(struct async_delay_data *filter, size_t size,
+		size_t *offset)
+{
+	struct compact_frame oldest;
+
+	if (!filter->compact_frames.size) {
+		if (size > filter->ring_size)
+			return false;
+
+		*offset = 0;
+		filter->ring_head = size;
+		return true;
+	}
+
+	circlebuf_peek_front(&filter->compact_frames, &oldest,
+			sizeof(oldest));
+
+	if (filter->ring_head > oldest.offset) {
+		if (filter->ring_size - filter->ring_head >= size) {
+			*offset = filter->ring_head;
+			filter->ring_head += size;
+			return true;
+		}
+
+		if (oldest.offset >= size) {
+			*offset = 0;
+			filter->ring_head = size;
+			return true;
+		}
+
+	} else if (oldest.offset - filter->ring_head >= size) {
+		*offset = filter->ring_head;
+		filter->ring_head += size;
+		return true;
+	}
+
+	return false;
+}
+
+/* enough for the delay at the canvas frame rate, the ring grows if the
+ * source delivers more than that */
+static size_t initial_ring_size(struct async_delay_data *filter,
+		size_t frame_size)
+{
+	struct obs_video_info ovi;
+	uint64_t fps_num = 30;
+	uint64_t fps_den = 1;
+	uint64_t frames;
+	uint64_t size;
+
+	if (obs_get_video_info(&ovi) && ovi.fps_num && ovi.fps_den) {
+		fps_num = ovi.fps_num;
+		fps_den = ovi.fps_den;
+	}
+
+	frames = filter->interval * fps_num / (fps_den * SEC_TO_NSEC) +
+		RING_EXTRA_FRAMES;
+	size = frames * frame_size;
+
+	return size < filter->memory_limit ? (size_t)size :
+		filter->memory_limit;
+}
+
+/* moves the stored frames, in order, to the start of a bigger ring */
+static bool ring_grow(struct async_delay_data *filter, size_t needed)
+{
+	size_t count = filter->compact_frames.size /
+		sizeof(struct compact_frame);
+	size_t new_size = filter->ring_size * 2;
+	size_t offset = 0;
+	uint8_t *ring;
+
+	if (filter->ring_size >= filter->memory_limit)
+		return false;
+
+	if (new_size < filter->stored_bytes + needed)
+		new_size = filter->stored_bytes + needed;
+	if (new_size > filter->memory_limit)
+		new_size = filter->memory_limit;
+
+	ring = bmalloc(new_size);
+
+	for (size_t i = 0; i < count; i++) {
+		struct compact_frame cf;
+
+		circlebuf_pop_front(&filter->compact_frames, &cf, sizeof(cf));
+		memcpy(ring + offset, filter->ring + cf.offset, cf.size);
+		cf.offset = offset;
+		offset += cf.size;
+		circlebuf_push_back(&filter->compact_frames, &cf, sizeof(cf));
+	}
+
+	bfree(filter->ring);
+	filter->ring      = ring;
+	filter->ring_size = new_size;
+	filter->ring_head = offset;
+	return true;
+}
+
+static void free_compact_data(struct async_delay_data *filter)
+{
+	pthread_mutex_lock(&filter->compact_mutex);
+	circlebuf_free(&filter->compact_frames);
+	filter->ring_head    = 0;
+	filter->stored_bytes = 0;
+	filter->limit_warned = false;
+	pthread_mutex_unlock(&filter->compact_mutex);
+}
+
+static void free_compact_ring(struct async_delay_data *filter)
+{
+	free_compact_data(filter);
+
+	pthread_mutex_lock(&filter->compact_mutex);
+	bfree(filter->ring);
+	filter->ring      = NULL;
+	filter->ring_size = 0;
+	pthread_mutex_unlock(&filter->compact_mutex);
+}
+
+/* returns false if the frame had to be dropped */
+static bool push_compact_frame(struct async_delay_data *filter,
+		const struct obs_source_frame *frame)
+{
+	struct compact_frame cf;
+	bool success = false;
+
+	if (!get_compact_layout(frame, &cf))
+		return false;
+
+	pthread_mutex_lock(&filter->compact_mutex);
+
+	if (!filter->ring && filter->memory_limit) {
+		filter->ring_size = initial_ring_size(filter, cf.size);
+		filter->ring      = bmalloc(filter->ring_size);
+		filter->ring_head = 0;
+	}
+
+	if (ring_alloc(filter, cf.size, &cf.offset) ||
+	    (ring_grow(filter, cf.size) &&
+	     ring_alloc(filter, cf.size, &cf.offset))) {
+		store_compact_frame(frame, &cf, filter->ring + cf.offset);
+		circlebuf_push_back(&filter->compact_frames, &cf, sizeof(cf));
+
+		filter->stored_bytes += cf.size;
+		if (filter->stored_bytes > filter->peak_bytes)
+			filter->peak_bytes = filter->stored_bytes;
+		success = true;
+
+	} else {
+		filter->dropped_frames++;
+
+		if (!filter->limit_warned) {
+			warn("memory limit of %d MB reached with %d frames "
+			     "stored, dropping frames to maintain the delay",
+			     (int)(filter->ring_size / (1024 * 1024)),
+			     (int)(filter->compact_frames.size / sizeof(cf)));
+			filter->limit_warned = true;
+		}
+	}
+
+	pthread_mutex_unlock(&filter->compact_mutex);
+	return success;
+}
+
+static struct obs_source_frame *get_output_frame(
+		struct async_delay_data *filter, const struct compact_frame *cf)
+{
+	struct obs_source_frame *frame = NULL;
+	size_t idx = DARRAY_INVALID;
+
+	for (size_t i = 0; i < filter->output_frames.num; i++) {
+		struct obs_source_frame *cur = filter->output_frames.array[i];
+
+		if (os_atomic_load_long(&cur->refs) != 1)
+			continue;
+
+		if (cur->format == cf->format &&
+		    cur->width  == cf->width &&
+		    cur->height == cf->height) {
+			frame = cur;
+			break;
+		}
+
+		if (idx == DARRAY_INVALID)
+			idx = i;
+	}
+
+	if (!frame) {
+		frame = obs_source_frame_create(cf->format, cf->width,
+				cf->height);
+		frame->refs = 1;
+
+		if (idx != DARRAY_INVALID) {
+			obs_source_frame_destroy(filter->output_frames.array[idx]);
+			filter->output_frames.array[idx] = frame;
+		} else {
+			da_push_back(filter->output_frames, &frame);
+		}
+	}
+
+	/* reference for the caller, released by obs_source_release_frame */
+	os_atomic_inc_long(&frame->refs);
+	return frame;
+}
+
+static void free_output_frames(struct async_delay_data *filter)
+{
+	for (size_t i = 0; i < filter->output_frames.num; i++) {
+		struct obs_source_frame *frame = filter->output_frames.array[i];
+
+		if (os_atomic_dec_long(&frame->refs) == 0)
+			obs_source_frame_destroy(frame);
+	}
+
+	da_free(filter->output_frames);
+}
+
+static struct obs_source_frame *pop_compact_frame(
+		struct async_delay_data *filter)
+{
+	struct obs_source_frame *output;
+	uint8_t *planes[MAX_AV_PLANES];
+	struct compact_frame cf;
+
+	circlebuf_pop_front(&filter->compact_frames, &cf, sizeof(cf));
+	filter->stored_bytes -= cf.size;
+
+	output = get_output_frame(filter, &cf);
+	compact_planes(filter->ring + cf.offset, &cf, planes);
+	copy_planes(output->data, output->linesize, planes, cf.linesize, &cf);
+
+	output->timestamp  = cf.timestamp;
+	output->full_range = cf.full_range;
+	output->flip       = cf.flip;
+	memcpy(output->color_matrix, cf.color_matrix,
+			sizeof(cf.color_matrix));
+	memcpy(output->color_range_min, cf.color_range_min,
+			sizeof(cf.color_range_min));
+	memcpy(output->color_range_max, cf.color_range_max,
+			sizeof(cf.color_range_max));
+	return output;
+}
+
+static struct obs_source_frame *async_delay_filter_video_compact(
+		struct async_delay_data *filter,
+		struct obs_source_frame *frame)
+{
+	obs_source_t *parent = obs_filter_get_parent(filter->context);
+	struct obs_source_frame *output = NULL;
+	struct compact_frame oldest;
+	uint64_t ts = frame->timestamp;
+
+	/* the source frame is copied out right away, so the source's async
+	 * frame cache never has to hold frames for the duration of the delay */
+	push_compact_frame(filter, frame);
+	obs_source_release_frame(parent, frame);
+
+	pthread_mutex_lock(&filter->compact_mutex);
+
+	/* skip stored frames that are superseded by a newer frame which is
+	 * also due, which keeps the delay exact if frames were dropped or
+	 * rendering fell behind */
+	while (filter->compact_frames.size >= sizeof(oldest) * 2) {
+		struct compact_frame front[2];
+
+		circlebuf_peek_front(&filter->compact_frames, front,
+				sizeof(front));
+		if (ts - front[1].timestamp < filter->interval)
+			break;
+
+		circlebuf_pop_front(&filter->compact_frames, &oldest,
+				sizeof(oldest));
+		filter->stored_bytes -= oldest.size;
+	}
+
+	if (!filter->compact_frames.size)
+		goto unlock;
+
+	circlebuf_peek_front(&filter->compact_frames, &oldest, sizeof(oldest));
+	if (ts - oldest.timestamp < filter->interval)
+		goto unlock;
+
+	output = pop_compact_frame(filter);
+	filter->video_delay_reached = true;
+
+unlock:
+	pthread_mutex_unlock(&filter->compact_mutex);
+	return output;
+}
+
+/* void get_memory_usage(out int used, out int peak, out int capacity,
+ *                       out int frames, out int dropped) */
+static void proc_get_memory_usage(void *data, calldata_t *cd)
+{
+	struct async_delay_data *filter = data;
+
+	pthread_mutex_lock(&filter->compact_mutex);
+	calldata_set_int(cd, "used", (long long)filter->stored_bytes);
+	calldata_set_int(cd, "peak", (long long)filter->peak_bytes);
+	calldata_set_int(cd, "capacity", (long long)filter->ring_size);
+	calldata_set_int(cd, "frames", (long long)(
+			filter->compact_frames.size /
+			sizeof(struct compact_frame)));
+	calldata_set_int(cd, "dropped", filter->dropped_frames);
+	pthread_mutex_unlock(&filter->compact_mutex);
+}
+
+static void log_memory_usage(struct async_delay_data *filter)
+{
+	if (!filter->peak_bytes)
+		return;
+
+	info("compact storage peak usage %.1f MB of %.1f MB, "
+	     "%lld frames dropped",
+	     (double)filter->peak_bytes / (1024.0 * 1024.0),
+	     (double)filter->memory_limit / (1024.0 * 1024.0),
+	     filter->dropped_frames);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static void async_delay_filter_update(void *data, obs_data_t *settings)
 {
 	struct async_delay_data *filter = data;
 	uint64_t new_interval = (uint64_t)obs_data_get_int(settings,
 			SETTING_DELAY_MS) * MSEC_TO_NSEC;
+	bool compact = obs_data_get_bool(settings, SETTING_COMPACT);
+	size_t memory_limit = (size_t)obs_data_get_int(settings,
+			SETTING_MEMORY_LIMIT_MB) * 1024 * 1024;
 
-	if (new_interval < filter->interval)
+	if (new_interval < filter->interval || compact != filter->compact)
 		free_video_data(filter, obs_filter_get_parent(filter->context));
 
+	if (!compact || memory_limit != filter->memory_limit) {
+		log_memory_usage(filter);
+		free_compact_ring(filter);
+		filter->peak_bytes     = 0;
+		filter->dropped_frames = 0;
+
+	} else if (new_interval < filter->interval) {
+		free_compact_data(filter);
+	}
+
+	filter->compact = compact;
+	filter->memory_limit = memory_limit;
+
 	filter->reset_audio = true;
 	filter->reset_video = true;
 	filter->interval = new_interval;
@@ -89,11 +707,21 @@ static void *async_delay_filter_create(obs_data_t *settings,
 		obs_source_t *context)
 {
 	struct async_delay_data *filter = bzalloc(sizeof(*filter));
+	proc_handler_t *ph = obs_source_get_proc_handler(context);
 	struct obs_audio_info oai;
 
+	if (pthread_mutex_init(&filter->compact_mutex, NULL) != 0) {
+		bfree(filter);
+		return NULL;
+	}
+
 	filter->context = context;
 	async_delay_filter_update(filter, settings);
 
+	proc_handler_add(ph, "void get_memory_usage(out int used, out int peak, "
+			"out int capacity, out int frames, out int dropped)",
+			proc_get_memory_usage, filter);
+
 	obs_get_audio_info(&oai);
 	filter->samplerate = oai.samples_per_sec;
 
@@ -104,6 +732,11 @@ static void async_delay_filter_destroy(void *data)
 {
 	struct async_delay_data *filter = data;
 
+	log_memory_usage(filter);
+	free_compact_ring(filter);
+	free_output_frames(filter);
+	pthread_mutex_destroy(&filter->compact_mutex);
+
 	free_audio_packet(&filter->audio_output);
 	circlebuf_free(&filter->video_frames);
 	circlebuf_free(&filter->audio_frames);
@@ -116,16 +749,26 @@ static obs_properties_t *async_delay_filter_properties(void *data)
 
 	obs_properties_add_int(props, SETTING_DELAY_MS, TEXT_DELAY_MS,
 			0, 6000, 1);
+	obs_properties_add_bool(props, SETTING_COMPACT, TEXT_COMPACT);
+	obs_properties_add_int(props, SETTING_MEMORY_LIMIT_MB,
+			TEXT_MEMORY_LIMIT_MB, 16, 4096, 16);
 
 	UNUSED_PARAMETER(data);
 	return props;
 }
 
+static void async_delay_filter_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, SETTING_MEMORY_LIMIT_MB,
+			DEFAULT_MEMORY_LIMIT_MB);
+}
+
 static void async_delay_filter_remove(void *data, obs_source_t *parent)
 {
 	struct async_delay_data *filter = data;
 
 	free_video_data(filter, parent);
+	free_compact_data(filter);
 	free_audio_data(filter);
 }
 
@@ -149,12 +792,16 @@ static struct obs_source_frame *async_delay_filter_video(void *data,
 	if (filter->reset_video ||
 	    is_timestamp_jump(frame->timestamp, filter->last_video_ts)) {
 		free_video_data(filter, parent);
+		free_compact_data(filter);
 		filter->video_delay_reached = false;
 		filter->reset_video = false;
 	}
 
 	filter->last_video_ts = frame->timestamp;
 
+	if (filter->compact)
+		return async_delay_filter_video_compact(filter, frame);
+
 	circlebuf_push_back(&filter->video_frames, &frame,
 			sizeof(struct obs_source_frame*));
 	circlebuf_peek_front(&filter->video_frames, &output,
@@ -236,6 +883,7 @@ struct obs_source_info async_delay_filter = {
 	.destroy                       = async_delay_filter_destroy,
 	.update                        = async_delay_filter_update,
 	.get_properties                = async_delay_filter_properties,
+	.get_defaults                  = async_delay_filter_defaults,
 	.filter_video                  = async_delay_filter_video,
 #ifdef DELAY_AUDIO
 	.filter_audio                  = async_delay_filter_audio,
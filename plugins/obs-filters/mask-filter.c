@@ -17,6 +17,8 @@
 struct mask_filter_data {
 	obs_source_t                   *context;
 	gs_effect_t                    *effect;
+	gs_eparam_t                    *param_target;
+	gs_eparam_t                    *param_color;
 
 	gs_texture_t                   *target;
 	struct vec4                    color;
@@ -52,6 +54,11 @@ static void mask_filter_update(void *data, obs_data_t *settings)
 	filter->effect = gs_effect_create_from_file(effect_path, NULL);
 	bfree(effect_path);
 
+	filter->param_target = gs_effect_get_param_by_name(filter->effect,
+			"target");
+	filter->param_color  = gs_effect_get_param_by_name(filter->effect,
+			"color");
+
 	obs_leave_graphics();
 }
 
@@ -132,7 +139,6 @@ static void mask_filter_destroy(void *data)
 static void mask_filter_render(void *data, gs_effect_t *effect)
 {
 	struct mask_filter_data *filter = data;
-	gs_eparam_t *param;
 
 	if (!filter->target || !filter->effect) {
 		obs_source_skip_video_filter(filter->context);
@@ -142,11 +148,8 @@ static void mask_filter_render(void *data, gs_effect_t *effect)
 	obs_source_process_filter_begin(filter->context, GS_RGBA,
 			OBS_ALLOW_DIRECT_RENDERING);
 
-	param = gs_effect_get_param_by_name(filter->effect, "target");
-	gs_effect_set_texture(param, filter->target);
-
-	param = gs_effect_get_param_by_name(filter->effect, "color");
-	gs_effect_set_vec4(param, &filter->color);
+	gs_effect_set_texture(filter->param_target, filter->target);
+	gs_effect_set_vec4(filter->param_color, &filter->color);
 
 	obs_source_process_filter_end(filter->context, filter->effect, 0, 0);
 
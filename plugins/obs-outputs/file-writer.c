@@ -0,0 +1,510 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <obs-module.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "file-writer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+#define do_log(level, format, ...) \
+	blog(level, "[file writer: '%s'] " format, \
+			fw->path.array, ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+
+struct file_writer {
+	struct dstr              path;
+
+#ifdef _WIN32
+	HANDLE                   handle;
+#else
+	int                      fd;
+#endif
+
+	bool                     direct_io;
+	uint64_t                 prealloc_size;
+	uint64_t                 prealloc_end;
+	enum file_sync_mode      sync_mode;
+	uint64_t                 sync_interval_ns;
+	uint64_t                 last_sync_ts;
+
+	/* the caller fills the front buffer while the writer thread writes
+	 * the back buffer out */
+	uint8_t                  *buffers[2];
+	size_t                   buffer_size;
+	uint8_t                  *front;
+	size_t                   front_used;
+	uint8_t                  *back;
+	size_t                   back_used;
+	uint64_t                 back_offset;
+
+	uint64_t                 total_size;
+	uint64_t                 next_offset;
+
+	pthread_t                thread;
+	os_sem_t                 *ready_sem;
+	os_sem_t                 *free_sem;
+	volatile long            stop;
+	volatile long            failed;
+
+	pthread_mutex_t          stats_mutex;
+	struct file_writer_stats stats;
+};
+
+/* ------------------------------------------------------------------------- */
+/* platform file functions */
+
+#ifdef _WIN32
+
+static inline void *aligned_buffer_alloc(size_t size)
+{
+	return _aligned_malloc(size, FILE_WRITER_ALIGN);
+}
+
+static inline void aligned_buffer_free(void *ptr)
+{
+	_aligned_free(ptr);
+}
+
+static bool file_open(struct file_writer *fw, bool direct_io)
+{
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+	wchar_t *wpath = NULL;
+
+	if (direct_io)
+		flags |= FILE_FLAG_NO_BUFFERING;
+
+	if (!os_utf8_to_wcs_ptr(fw->path.array, 0, &wpath))
+		return false;
+
+	fw->handle = CreateFileW(wpath, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+			CREATE_ALWAYS, flags, NULL);
+	bfree(wpath);
+
+	return fw->handle != INVALID_HANDLE_VALUE;
+}
+
+static bool file_pwrite(struct file_writer *fw, const uint8_t *data,
+		size_t size, uint64_t offset)
+{
+	while (size) {
+		OVERLAPPED ol = {0};
+		DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+		DWORD written = 0;
+
+		ol.Offset     = (DWORD)offset;
+		ol.OffsetHigh = (DWORD)(offset >> 32);
+
+		if (!WriteFile(fw->handle, data, chunk, &written, &ol) ||
+		    !written)
+			return false;
+
+		data   += written;
+		size   -= written;
+		offset += written;
+	}
+
+	return true;
+}
+
+static void file_reserve(struct file_writer *fw, uint64_t size)
+{
+	FILE_ALLOCATION_INFO info;
+	info.AllocationSize.QuadPart = (LONGLONG)size;
+
+	SetFileInformationByHandle(fw->handle, FileAllocationInfo,
+			&info, sizeof(info));
+}
+
+static bool file_sync(struct file_writer *fw)
+{
+	return !!FlushFileBuffers(fw->handle);
+}
+
+static bool file_truncate(struct file_writer *fw, uint64_t size)
+{
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)size;
+
+	return SetFilePointerEx(fw->handle, pos, NULL, FILE_BEGIN) &&
+		SetEndOfFile(fw->handle);
+}
+
+static void file_close(struct file_writer *fw)
+{
+	CloseHandle(fw->handle);
+	fw->handle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+static inline void *aligned_buffer_alloc(size_t size)
+{
+	void *ptr;
+	return posix_memalign(&ptr, FILE_WRITER_ALIGN, size) == 0 ? ptr : NULL;
+}
+
+static inline void aligned_buffer_free(void *ptr)
+{
+	free(ptr);
+}
+
+static bool file_open(struct file_writer *fw, bool direct_io)
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+#if defined(O_DIRECT)
+	if (direct_io)
+		flags |= O_DIRECT;
+#endif
+
+	fw->fd = open(fw->path.array, flags, 0644);
+	if (fw->fd == -1)
+		return false;
+
+#if defined(__APPLE__)
+	if (direct_io)
+		fcntl(fw->fd, F_NOCACHE, 1);
+#endif
+	return true;
+}
+
+static bool file_pwrite(struct file_writer *fw, const uint8_t *data,
+		size_t size, uint64_t offset)
+{
+	while (size) {
+		ssize_t written = pwrite(fw->fd, data, size, (off_t)offset);
+
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+
+		data   += written;
+		size   -= (size_t)written;
+		offset += (uint64_t)written;
+	}
+
+	return true;
+}
+
+/* reserves space past the end of the file without changing its size, so a
+ * recording cut short doesn't end in zeros */
+static void file_reserve(struct file_writer *fw, uint64_t size)
+{
+#if defined(__linux__)
+	fallocate(fw->fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+#else
+	UNUSED_PARAMETER(fw);
+	UNUSED_PARAMETER(size);
+#endif
+}
+
+static bool file_sync(struct file_writer *fw)
+{
+#if defined(__linux__)
+	return fdatasync(fw->fd) == 0;
+#else
+	return fsync(fw->fd) == 0;
+#endif
+}
+
+/* also drops whatever was reserved past the end */
+static bool file_truncate(struct file_writer *fw, uint64_t size)
+{
+	return ftruncate(fw->fd, (off_t)size) == 0;
+}
+
+static void file_close(struct file_writer *fw)
+{
+	close(fw->fd);
+	fw->fd = -1;
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static void sync_file(struct file_writer *fw)
+{
+	uint64_t start = os_gettime_ns();
+	bool success = file_sync(fw);
+	uint64_t end = os_gettime_ns();
+
+	if (!success)
+		warn("Failed to sync file");
+
+	pthread_mutex_lock(&fw->stats_mutex);
+	fw->stats.syncs++;
+	obs_latency_histogram_add(&fw->stats.sync_latency, end - start);
+	pthread_mutex_unlock(&fw->stats_mutex);
+
+	fw->last_sync_ts = end;
+}
+
+static void write_back_buffer(struct file_writer *fw)
+{
+	uint64_t end_offset = fw->back_offset + fw->back_used;
+	uint64_t start, end;
+	bool success;
+
+	if (fw->prealloc_size && end_offset > fw->prealloc_end) {
+		fw->prealloc_end = end_offset + fw->prealloc_size;
+		file_reserve(fw, fw->prealloc_end);
+	}
+
+	start = os_gettime_ns();
+	success = file_pwrite(fw, fw->back, fw->back_used, fw->back_offset);
+	end = os_gettime_ns();
+
+	if (!success) {
+		if (!os_atomic_set_long(&fw->failed, 1))
+			warn("Failed to write %llu bytes at offset %llu",
+					(unsigned long long)fw->back_used,
+					(unsigned long long)fw->back_offset);
+		return;
+	}
+
+	pthread_mutex_lock(&fw->stats_mutex);
+	fw->stats.bytes_written += fw->back_used;
+	obs_latency_histogram_add(&fw->stats.write_latency, end - start);
+	pthread_mutex_unlock(&fw->stats_mutex);
+
+	if (fw->sync_mode == FILE_SYNC_INTERVAL &&
+	    end - fw->last_sync_ts >= fw->sync_interval_ns)
+		sync_file(fw);
+}
+
+static void *writer_thread(void *data)
+{
+	struct file_writer *fw = data;
+
+	os_set_thread_name("file writer");
+
+	while (os_sem_wait(fw->ready_sem) == 0) {
+		if (os_atomic_load_long(&fw->stop))
+			break;
+
+		write_back_buffer(fw);
+		os_sem_post(fw->free_sem);
+	}
+
+	return NULL;
+}
+
+/* hands the front buffer to the writer thread once it's done with the back
+ * buffer, this is the only place the caller can be held up by the disk */
+static void submit_front(struct file_writer *fw, size_t size)
+{
+	uint64_t start = os_gettime_ns();
+	uint8_t *buffer;
+
+	os_sem_wait(fw->free_sem);
+
+	pthread_mutex_lock(&fw->stats_mutex);
+	obs_latency_histogram_add(&fw->stats.stalls,
+			os_gettime_ns() - start);
+	pthread_mutex_unlock(&fw->stats_mutex);
+
+	buffer      = fw->back;
+	fw->back    = fw->front;
+	fw->front   = buffer;
+
+	fw->back_used   = size;
+	fw->back_offset = fw->next_offset;
+	fw->next_offset += size;
+	fw->front_used  = 0;
+
+	os_sem_post(fw->ready_sem);
+}
+
+static void file_writer_free(struct file_writer *fw)
+{
+	aligned_buffer_free(fw->buffers[0]);
+	aligned_buffer_free(fw->buffers[1]);
+	os_sem_destroy(fw->ready_sem);
+	os_sem_destroy(fw->free_sem);
+	pthread_mutex_destroy(&fw->stats_mutex);
+	dstr_free(&fw->path);
+	bfree(fw);
+}
+
+struct file_writer *file_writer_open(const char *path,
+		const struct file_writer_config *config)
+{
+	struct file_writer *fw = bzalloc(sizeof(struct file_writer));
+	size_t size = config->buffer_size ?
+		config->buffer_size : FILE_WRITER_DEFAULT_SIZE;
+
+	size = (size + FILE_WRITER_ALIGN - 1) & ~(size_t)(FILE_WRITER_ALIGN - 1);
+
+	fw->buffer_size      = size;
+	fw->direct_io        = config->direct_io;
+	fw->prealloc_size    = config->prealloc_size;
+	fw->sync_mode        = config->sync_mode;
+	fw->sync_interval_ns = (uint64_t)config->sync_interval_ms * 1000000;
+
+	if (pthread_mutex_init(&fw->stats_mutex, NULL) != 0) {
+		bfree(fw);
+		return NULL;
+	}
+
+	dstr_copy(&fw->path, path);
+
+	fw->buffers[0] = aligned_buffer_alloc(size);
+	fw->buffers[1] = aligned_buffer_alloc(size);
+	if (!fw->buffers[0] || !fw->buffers[1])
+		goto fail;
+
+	fw->front = fw->buffers[0];
+	fw->back  = fw->buffers[1];
+
+	if (os_sem_init(&fw->ready_sem, 0) != 0)
+		goto fail;
+	if (os_sem_init(&fw->free_sem, 1) != 0)
+		goto fail;
+
+	if (!file_open(fw, fw->direct_io)) {
+		if (!fw->direct_io || !file_open(fw, false))
+			goto fail;
+
+		warn("Direct I/O is not supported here, using buffered writes");
+		fw->direct_io = false;
+	}
+
+	fw->last_sync_ts = os_gettime_ns();
+
+	if (pthread_create(&fw->thread, NULL, writer_thread, fw) != 0) {
+		file_close(fw);
+		goto fail;
+	}
+
+	return fw;
+
+fail:
+	file_writer_free(fw);
+	return NULL;
+}
+
+bool file_writer_write(struct file_writer *fw, const void *data, size_t size)
+{
+	const uint8_t *in = data;
+
+	while (size) {
+		size_t space = fw->buffer_size - fw->front_used;
+		size_t copy  = size < space ? size : space;
+
+		memcpy(fw->front + fw->front_used, in, copy);
+		fw->front_used += copy;
+		fw->total_size += copy;
+		in   += copy;
+		size -= copy;
+
+		if (fw->front_used == fw->buffer_size)
+			submit_front(fw, fw->buffer_size);
+	}
+
+	return !os_atomic_load_long(&fw->failed);
+}
+
+bool file_writer_failed(struct file_writer *fw)
+{
+	return os_atomic_load_long(&fw->failed) != 0;
+}
+
+uint64_t file_writer_size(struct file_writer *fw)
+{
+	return fw->total_size;
+}
+
+void file_writer_get_stats(struct file_writer *fw,
+		struct file_writer_stats *stats)
+{
+	pthread_mutex_lock(&fw->stats_mutex);
+	*stats = fw->stats;
+	pthread_mutex_unlock(&fw->stats_mutex);
+}
+
+bool file_writer_close(struct file_writer *fw,
+		struct file_writer_stats *stats)
+{
+	bool success;
+
+	if (!fw)
+		return false;
+
+	/* direct writes have to be whole blocks, the padding is cut off again
+	 * by the truncate below */
+	if (fw->front_used) {
+		size_t size = fw->front_used;
+
+		if (fw->direct_io) {
+			size_t aligned = (size + FILE_WRITER_ALIGN - 1) &
+				~(size_t)(FILE_WRITER_ALIGN - 1);
+			memset(fw->front + size, 0, aligned - size);
+			size = aligned;
+		}
+
+		submit_front(fw, size);
+	}
+
+	os_sem_wait(fw->free_sem);
+	os_atomic_set_long(&fw->stop, 1);
+	os_sem_post(fw->ready_sem);
+	pthread_join(fw->thread, NULL);
+
+	if ((fw->direct_io || fw->prealloc_size) &&
+	    !file_truncate(fw, fw->total_size)) {
+		warn("Failed to trim file to %llu bytes",
+				(unsigned long long)fw->total_size);
+		os_atomic_set_long(&fw->failed, 1);
+	}
+
+	if (fw->sync_mode != FILE_SYNC_NONE)
+		sync_file(fw);
+
+	file_close(fw);
+
+	success = !os_atomic_load_long(&fw->failed);
+	if (stats)
+		*stats = fw->stats;
+
+	file_writer_free(fw);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+/* serializer */
+
+static size_t file_writer_serializer_write(void *param, const void *data,
+		size_t size)
+{
+	return file_writer_write(param, data, size) ? size : 0;
+}
+
+static uint64_t file_writer_serializer_get_pos(void *param)
+{
+	return file_writer_size(param);
+}
+
+void file_writer_serializer_init(struct serializer *s, struct file_writer *fw)
+{
+	memset(s, 0, sizeof(struct serializer));
+	s->data    = fw;
+	s->write   = file_writer_serializer_write;
+	s->get_pos = file_writer_serializer_get_pos;
+}
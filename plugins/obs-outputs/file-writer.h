@@ -0,0 +1,77 @@
+#pragma once
+
+#include <obs.h>
+#include <util/serializer.h>
+
+/*
+ * Buffered file writer for recording outputs.  Data is copied into one of
+ * two large buffers, and full buffers are handed to a writer thread, so a
+ * slow disk only holds up the caller once both buffers are in use.
+ */
+
+/* buffers and direct writes are aligned to this */
+#define FILE_WRITER_ALIGN        4096
+#define FILE_WRITER_DEFAULT_SIZE (4 * 1024 * 1024)
+
+enum file_sync_mode {
+	FILE_SYNC_NONE,     /* leave it to the OS */
+	FILE_SYNC_CLOSE,    /* sync once when the file is closed */
+	FILE_SYNC_INTERVAL  /* also sync every sync_interval_ms */
+};
+
+struct file_writer_config {
+	/* size of each of the two buffers, rounded up to FILE_WRITER_ALIGN */
+	size_t              buffer_size;
+
+	/* bypass the OS page cache (O_DIRECT / FILE_FLAG_NO_BUFFERING) */
+	bool                direct_io;
+
+	/* disk space to reserve ahead of the data, 0 to not reserve any */
+	uint64_t            prealloc_size;
+
+	enum file_sync_mode sync_mode;
+	uint32_t            sync_interval_ms;
+};
+
+struct file_writer_stats {
+	uint64_t                     bytes_written;
+	uint64_t                     syncs;
+
+	/* how long each buffer took to write out */
+	struct obs_latency_histogram write_latency;
+
+	/* how long each sync took */
+	struct obs_latency_histogram sync_latency;
+
+	/* how long file_writer_write waited for the writer thread */
+	struct obs_latency_histogram stalls;
+};
+
+struct file_writer;
+
+extern struct file_writer *file_writer_open(const char *path,
+		const struct file_writer_config *config);
+
+/* returns false once a write to the file has failed */
+extern bool file_writer_write(struct file_writer *fw, const void *data,
+		size_t size);
+
+/* whether a write to the file has failed */
+extern bool file_writer_failed(struct file_writer *fw);
+
+/* bytes given to the writer so far */
+extern uint64_t file_writer_size(struct file_writer *fw);
+
+extern void file_writer_get_stats(struct file_writer *fw,
+		struct file_writer_stats *stats);
+
+/*
+ * Writes out what is left, trims the file to its size and closes it.  stats
+ * can be NULL.  Returns false if anything failed to be written.
+ */
+extern bool file_writer_close(struct file_writer *fw,
+		struct file_writer_stats *stats);
+
+/* serializer that writes through the file writer, its position is the size */
+extern void file_writer_serializer_init(struct serializer *s,
+		struct file_writer *fw);
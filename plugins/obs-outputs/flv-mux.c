@@ -31,6 +31,9 @@
 
 #define VIDEO_HEADER_SIZE 5
 
+/* tag header, codec header and trailing tag size around each packet */
+#define PACKET_TAG_OVERHEAD (11 + VIDEO_HEADER_SIZE + 4)
+
 static inline double encoder_bitrate(obs_encoder_t *encoder)
 {
 	obs_data_t *settings = obs_encoder_get_settings(encoder);
@@ -182,6 +185,7 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 {
 	int64_t offset  = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts);
+	uint64_t start  = serializer_get_pos(s);
 
 	if (!packet->data || !packet->size)
 		return;
@@ -209,13 +213,14 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesnt count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) + 4 - 1);
+	s_wb32(s, (uint32_t)(serializer_get_pos(s) - start) + 4 - 1);
 }
 
 static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 		bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts);
+	uint64_t start  = serializer_get_pos(s);
 
 	if (!packet->data || !packet->size)
 		return;
@@ -242,7 +247,19 @@ static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesnt count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) + 4 - 1);
+	s_wb32(s, (uint32_t)(serializer_get_pos(s) - start) + 4 - 1);
+}
+
+void flv_packet_serialize(struct serializer *s, struct encoder_packet *packet,
+		bool is_header)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		flv_video(s, packet, is_header);
+	else
+		flv_audio(s, packet, is_header);
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_frame_stats_add_copied_bytes(packet->size);
 }
 
 void flv_packet_mux(struct encoder_packet *packet,
@@ -252,11 +269,9 @@ void flv_packet_mux(struct encoder_packet *packet,
 	struct serializer s;
 
 	array_output_serializer_init(&s, &data);
+	da_reserve(data.bytes, packet->size + PACKET_TAG_OVERHEAD);
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		flv_video(&s, packet, is_header);
-	else
-		flv_audio(&s, packet, is_header);
+	flv_packet_serialize(&s, packet, is_header);
 
 	*output = data.bytes.array;
 	*size   = data.bytes.num;
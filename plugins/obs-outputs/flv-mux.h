@@ -18,6 +18,7 @@
 #pragma once
 
 #include <obs.h>
+#include <util/serializer.h>
 
 #define MILLISECOND_DEN   1000
 
@@ -30,5 +31,10 @@ extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
 
 extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
+
+/* writes the tag for a packet to any serializer, the tag starts at the
+ * serializer's current position */
+extern void flv_packet_serialize(struct serializer *s,
+		struct encoder_packet *packet, bool is_header);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
@@ -23,6 +23,14 @@
 #include <util/threading.h>
 #include <inttypes.h>
 #include "flv-mux.h"
+#include "file-writer.h"
+
+#define OPT_PATH          "path"
+#define OPT_BUFFER_SIZE   "buffer_size_mb"
+#define OPT_DIRECT_IO     "direct_io"
+#define OPT_PREALLOC      "prealloc_mb"
+#define OPT_SYNC_MODE     "sync_mode"
+#define OPT_SYNC_INTERVAL "sync_interval_ms"
 
 #define do_log(level, format, ...) \
 	blog(level, "[flv output: '%s'] " format, \
@@ -32,12 +40,18 @@
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
 struct flv_output {
-	obs_output_t *output;
-	struct dstr  path;
-	FILE         *file;
-	bool         active;
-	bool         sent_headers;
-	int64_t      last_packet_ts;
+	obs_output_t             *output;
+	struct dstr              path;
+	struct file_writer       *writer;
+	struct serializer        s;
+	bool                     active;
+	bool                     sent_headers;
+	int64_t                  last_packet_ts;
+
+	/* the writer stats are kept once the file is closed, the mutex guards
+	 * them and the writer against get_write_stats calls */
+	pthread_mutex_t          stats_mutex;
+	struct file_writer_stats stats;
 };
 
 static const char *flv_output_getname(void *unused)
@@ -55,29 +69,127 @@ static void flv_output_destroy(void *data)
 	if (stream->active)
 		flv_output_stop(data);
 
+	pthread_mutex_destroy(&stream->stats_mutex);
 	dstr_free(&stream->path);
 	bfree(stream);
 }
 
+static inline double ns_to_ms(uint64_t ns)
+{
+	return (double)ns / 1000000.0;
+}
+
+static void proc_get_write_stats(void *data, calldata_t *cd)
+{
+	struct flv_output        *stream = data;
+	struct file_writer_stats stats;
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	if (stream->writer)
+		file_writer_get_stats(stream->writer, &stats);
+	else
+		stats = stream->stats;
+	pthread_mutex_unlock(&stream->stats_mutex);
+
+	calldata_set_int(cd, "bytes_written", (long long)stats.bytes_written);
+	calldata_set_int(cd, "writes", (long long)stats.write_latency.count);
+	calldata_set_float(cd, "write_p50_ms", ns_to_ms(
+			obs_latency_histogram_percentile(
+				&stats.write_latency, 0.5)));
+	calldata_set_float(cd, "write_p99_ms", ns_to_ms(
+			obs_latency_histogram_percentile(
+				&stats.write_latency, 0.99)));
+	calldata_set_float(cd, "write_max_ms",
+			ns_to_ms(stats.write_latency.max_ns));
+	calldata_set_int(cd, "syncs", (long long)stats.syncs);
+	calldata_set_float(cd, "sync_max_ms",
+			ns_to_ms(stats.sync_latency.max_ns));
+	calldata_set_float(cd, "stall_p99_ms", ns_to_ms(
+			obs_latency_histogram_percentile(&stats.stalls, 0.99)));
+	calldata_set_float(cd, "stall_max_ms",
+			ns_to_ms(stats.stalls.max_ns));
+}
+
 static void *flv_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct flv_output *stream = bzalloc(sizeof(struct flv_output));
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+
 	stream->output = output;
 
+	if (pthread_mutex_init(&stream->stats_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
+	proc_handler_add(ph, "void get_write_stats(out int bytes_written, "
+			"out int writes, out float write_p50_ms, "
+			"out float write_p99_ms, out float write_max_ms, "
+			"out int syncs, out float sync_max_ms, "
+			"out float stall_p99_ms, out float stall_max_ms)",
+			proc_get_write_stats, stream);
+
 	UNUSED_PARAMETER(settings);
 	return stream;
 }
 
+static void log_write_stats(struct flv_output *stream)
+{
+	struct file_writer_stats *stats = &stream->stats;
+
+	info("Wrote %"PRIu64" bytes in %"PRIu64" writes, "
+	     "write p50/p99/max: %.2f/%.2f/%.2f ms, "
+	     "%"PRIu64" syncs (max %.2f ms), "
+	     "waited over 1 ms for the disk %"PRIu64" times (max %.2f ms)",
+			stats->bytes_written, stats->write_latency.count,
+			ns_to_ms(obs_latency_histogram_percentile(
+					&stats->write_latency, 0.5)),
+			ns_to_ms(obs_latency_histogram_percentile(
+					&stats->write_latency, 0.99)),
+			ns_to_ms(stats->write_latency.max_ns),
+			stats->syncs, ns_to_ms(stats->sync_latency.max_ns),
+			stats->stalls.count -
+				stats->stalls.buckets[0],
+			ns_to_ms(stats->stalls.max_ns));
+}
+
+/* the duration and size in the header are filled in once everything else is
+ * on disk, through a normal handle since direct writes have to be aligned */
+static bool close_file(struct flv_output *stream)
+{
+	struct file_writer *writer = stream->writer;
+	int64_t size = (int64_t)file_writer_size(writer);
+	bool success;
+	FILE *file;
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	success = file_writer_close(writer, &stream->stats);
+	stream->writer = NULL;
+	pthread_mutex_unlock(&stream->stats_mutex);
+
+	log_write_stats(stream);
+
+	if (!success)
+		return false;
+
+	file = os_fopen(stream->path.array, "r+b");
+	if (!file) {
+		warn("Unable to reopen FLV file '%s' to write its duration",
+				stream->path.array);
+		return false;
+	}
+
+	write_file_info(file, stream->last_packet_ts, size);
+	fclose(file);
+	return true;
+}
+
 static void flv_output_stop(void *data)
 {
 	struct flv_output *stream = data;
 
 	if (stream->active) {
-		if (stream->file)
-			write_file_info(stream->file, stream->last_packet_ts,
-					os_ftelli64(stream->file));
-
-		fclose(stream->file);
+		close_file(stream);
 		obs_output_end_data_capture(stream->output);
 		stream->active = false;
 		stream->sent_headers = false;
@@ -86,18 +198,26 @@ static void flv_output_stop(void *data)
 	}
 }
 
+static void signal_failure(struct flv_output *stream)
+{
+	warn("Failed to write to FLV file '%s'", stream->path.array);
+
+	close_file(stream);
+	stream->active = false;
+	stream->sent_headers = false;
+
+	obs_output_signal_stop(stream->output, OBS_OUTPUT_ERROR);
+}
+
 static int write_packet(struct flv_output *stream,
 		struct encoder_packet *packet, bool is_header)
 {
-	uint8_t *data;
-	size_t  size;
-	int     ret = 0;
+	int ret = 0;
 
 	stream->last_packet_ts = get_ms_time(packet, packet->dts);
 
-	flv_packet_mux(packet, &data, &size, is_header);
-	fwrite(data, 1, size, stream->file);
-	bfree(data);
+	/* the tag goes straight into the writer's buffer */
+	flv_packet_serialize(&stream->s, packet, is_header);
 	obs_free_encoder_packet(packet);
 
 	return ret;
@@ -109,7 +229,7 @@ static void write_meta_data(struct flv_output *stream)
 	size_t  meta_data_size;
 
 	flv_meta_data(stream->output, &meta_data, &meta_data_size, true, 0);
-	fwrite(meta_data, 1, meta_data_size, stream->file);
+	file_writer_write(stream->writer, meta_data, meta_data_size);
 	bfree(meta_data);
 }
 
@@ -154,9 +274,25 @@ static void write_headers(struct flv_output *stream)
 	write_video_header(stream);
 }
 
+static void get_writer_config(obs_data_t *settings,
+		struct file_writer_config *config)
+{
+	config->buffer_size = (size_t)obs_data_get_int(settings,
+			OPT_BUFFER_SIZE) * 1024 * 1024;
+	config->direct_io = obs_data_get_bool(settings, OPT_DIRECT_IO);
+	config->prealloc_size = (uint64_t)obs_data_get_int(settings,
+			OPT_PREALLOC) * 1024 * 1024;
+	config->sync_mode = (enum file_sync_mode)obs_data_get_int(settings,
+			OPT_SYNC_MODE);
+	config->sync_interval_ms = (uint32_t)obs_data_get_int(settings,
+			OPT_SYNC_INTERVAL);
+}
+
 static bool flv_output_start(void *data)
 {
 	struct flv_output *stream = data;
+	struct file_writer_config config;
+	struct file_writer *writer;
 	obs_data_t *settings;
 	const char *path;
 
@@ -167,16 +303,24 @@ static bool flv_output_start(void *data)
 
 	/* get path */
 	settings = obs_output_get_settings(stream->output);
-	path = obs_data_get_string(settings, "path");
+	path = obs_data_get_string(settings, OPT_PATH);
 	dstr_copy(&stream->path, path);
+	get_writer_config(settings, &config);
 	obs_data_release(settings);
 
-	stream->file = os_fopen(stream->path.array, "wb");
-	if (!stream->file) {
+	writer = file_writer_open(stream->path.array, &config);
+	if (!writer) {
 		warn("Unable to open FLV file '%s'", stream->path.array);
 		return false;
 	}
 
+	pthread_mutex_lock(&stream->stats_mutex);
+	stream->writer = writer;
+	memset(&stream->stats, 0, sizeof(stream->stats));
+	pthread_mutex_unlock(&stream->stats_mutex);
+
+	file_writer_serializer_init(&stream->s, writer);
+
 	/* write headers and start capture */
 	stream->active = true;
 	obs_output_begin_data_capture(stream->output, 0);
@@ -190,18 +334,36 @@ static void flv_output_data(void *data, struct encoder_packet *packet)
 	struct flv_output     *stream = data;
 	struct encoder_packet parsed_packet;
 
+	if (!stream->active)
+		return;
+
 	if (!stream->sent_headers) {
 		write_headers(stream);
 		stream->sent_headers = true;
 	}
 
-	if (packet->type == OBS_ENCODER_VIDEO) {
+	/* length prefixed packets are written straight out of the encoder's
+	 * buffer, only annex-b packets need to be converted first */
+	if (packet->type == OBS_ENCODER_VIDEO && !packet->avcc) {
 		obs_parse_avc_packet(&parsed_packet, packet);
 		write_packet(stream, &parsed_packet, false);
 		obs_free_encoder_packet(&parsed_packet);
 	} else {
 		write_packet(stream, packet, false);
 	}
+
+	if (file_writer_failed(stream->writer))
+		signal_failure(stream);
+}
+
+static void flv_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_BUFFER_SIZE,
+			FILE_WRITER_DEFAULT_SIZE / (1024 * 1024));
+	obs_data_set_default_bool(defaults, OPT_DIRECT_IO, false);
+	obs_data_set_default_int(defaults, OPT_PREALLOC, 0);
+	obs_data_set_default_int(defaults, OPT_SYNC_MODE, FILE_SYNC_NONE);
+	obs_data_set_default_int(defaults, OPT_SYNC_INTERVAL, 1000);
 }
 
 static obs_properties_t *flv_output_properties(void *unused)
@@ -209,10 +371,34 @@ static obs_properties_t *flv_output_properties(void *unused)
 	UNUSED_PARAMETER(unused);
 
 	obs_properties_t *props = obs_properties_create();
+	obs_property_t   *p;
 
-	obs_properties_add_text(props, "path",
+	obs_properties_add_text(props, OPT_PATH,
 			obs_module_text("FLVOutput.FilePath"),
 			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, OPT_BUFFER_SIZE,
+			obs_module_text("FLVOutput.BufferSize"), 1, 64, 1);
+	obs_properties_add_bool(props, OPT_DIRECT_IO,
+			obs_module_text("FLVOutput.DirectIO"));
+	obs_properties_add_int(props, OPT_PREALLOC,
+			obs_module_text("FLVOutput.Preallocate"), 0, 4096, 64);
+
+	p = obs_properties_add_list(props, OPT_SYNC_MODE,
+			obs_module_text("FLVOutput.SyncMode"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p,
+			obs_module_text("FLVOutput.SyncMode.None"),
+			FILE_SYNC_NONE);
+	obs_property_list_add_int(p,
+			obs_module_text("FLVOutput.SyncMode.Close"),
+			FILE_SYNC_CLOSE);
+	obs_property_list_add_int(p,
+			obs_module_text("FLVOutput.SyncMode.Interval"),
+			FILE_SYNC_INTERVAL);
+
+	obs_properties_add_int(props, OPT_SYNC_INTERVAL,
+			obs_module_text("FLVOutput.SyncInterval"),
+			100, 60000, 100);
 	return props;
 }
 
@@ -225,5 +411,6 @@ struct obs_output_info flv_output_info = {
 	.start          = flv_output_start,
 	.stop           = flv_output_stop,
 	.encoded_packet = flv_output_data,
+	.get_defaults   = flv_output_defaults,
 	.get_properties = flv_output_properties
 };
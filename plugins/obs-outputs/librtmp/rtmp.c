@@ -117,6 +117,7 @@ static int HandShake(RTMP *r, int FP9HandShake);
 static int SocksNegotiate(RTMP *r);
 
 static int SendConnectPacket(RTMP *r, RTMPPacket *cp);
+static int SendChunkSize(RTMP *r, int size);
 static int SendCheckBW(RTMP *r);
 static int SendCheckBWResult(RTMP *r, double txn);
 static int SendDeleteStream(RTMP *r, double dStreamId);
@@ -1468,19 +1469,7 @@ SendConnectPacket(RTMP *r, RTMPPacket *cp)
 
     if((r->Link.protocol & RTMP_FEATURE_WRITE) && r->m_bSendChunkSizeInfo)
     {
-        packet.m_nChannel = 0x02;
-        packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
-        packet.m_packetType = RTMP_PACKET_TYPE_CHUNK_SIZE;
-        packet.m_nTimeStamp = 0;
-        packet.m_nInfoField2 = 0;
-        packet.m_hasAbsTimestamp = 0;
-        packet.m_body = pbuf + RTMP_MAX_HEADER_SIZE;
-        packet.m_nBodySize = 4;
-
-        enc = packet.m_body;
-        AMF_EncodeInt32(enc, pend, r->m_outChunkSize);
-
-        if(!RTMP_SendPacket(r, &packet, FALSE))
+        if (!SendChunkSize(r, r->m_outChunkSize))
             return 0;
     }
 
@@ -3908,6 +3897,51 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
+static int
+SendChunkSize(RTMP *r, int size)
+{
+    RTMPPacket packet;
+    char pbuf[RTMP_MAX_HEADER_SIZE + 4], *pend = pbuf + sizeof(pbuf);
+
+    packet.m_nChannel = 0x02;
+    packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    packet.m_packetType = RTMP_PACKET_TYPE_CHUNK_SIZE;
+    packet.m_nTimeStamp = 0;
+    packet.m_nInfoField2 = 0;
+    packet.m_hasAbsTimestamp = 0;
+    packet.m_body = pbuf + RTMP_MAX_HEADER_SIZE;
+    packet.m_nBodySize = 4;
+
+    AMF_EncodeInt32(packet.m_body, pend, size);
+
+    return RTMP_SendPacket(r, &packet, FALSE);
+}
+
+/* raise the outgoing chunk size so that a message of the given size fits
+ * in as few chunks as possible, never exceeding m_maxOutChunkSize */
+static int
+GrowOutChunkSize(RTMP *r, int size)
+{
+    int newSize = r->m_outChunkSize;
+
+    if (!r->m_bSendChunkSizeInfo || r->m_maxOutChunkSize <= newSize ||
+            size <= newSize)
+        return TRUE;
+
+    while (newSize < size && newSize < r->m_maxOutChunkSize)
+        newSize *= 2;
+    if (newSize > r->m_maxOutChunkSize)
+        newSize = r->m_maxOutChunkSize;
+
+    if (!SendChunkSize(r, newSize))
+        return FALSE;
+
+    RTMP_Log(RTMP_LOGDEBUG, "%s, outgoing chunk size changed to %d",
+             __FUNCTION__, newSize);
+    r->m_outChunkSize = newSize;
+    return TRUE;
+}
+
 int
 RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
 {
@@ -3916,6 +3950,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     int nSize;
     int hSize, cSize;
     char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char cheader[3];
     uint32_t t;
     char *buffer, *tbuf = NULL, *toff = NULL;
     int nChunkSize;
@@ -4036,18 +4071,32 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
 
     RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%d", __FUNCTION__, (int)r->m_sb.sb_socket,
              nSize);
-    /* send all chunks in one HTTP request */
-    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+
+    /* the type 3 header is identical for every continuation chunk */
+    cheader[0] = (0xc0 | c);
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        cheader[1] = tmp & 0xff;
+        if (cSize == 2)
+            cheader[2] = tmp >> 8;
+    }
+
+    /* coalesce all chunks into one write (one HTTP request for RTMPT) */
+    if (nSize > nChunkSize)
     {
         int chunks = (nSize+nChunkSize-1) / nChunkSize;
-        if (chunks > 1)
+        tlen = (chunks - 1) * (cSize + 1) + nSize + hSize;
+        if (tlen > r->m_outBufSize)
         {
-            tlen = chunks * (cSize + 1) + nSize + hSize;
-            tbuf = malloc(tlen);
-            if (!tbuf)
+            char *outBuf = realloc(r->m_outBuf, tlen);
+            if (!outBuf)
                 return FALSE;
-            toff = tbuf;
+            r->m_outBuf = outBuf;
+            r->m_outBufSize = tlen;
         }
+        tbuf = r->m_outBuf;
+        toff = tbuf;
     }
     while (nSize + hSize)
     {
@@ -4060,8 +4109,10 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
         RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)buffer, nChunkSize);
         if (tbuf)
         {
-            memcpy(toff, header, nChunkSize + hSize);
-            toff += nChunkSize + hSize;
+            memcpy(toff, header, hSize);
+            toff += hSize;
+            memcpy(toff, buffer, nChunkSize);
+            toff += nChunkSize;
         }
         else
         {
@@ -4075,28 +4126,13 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
 
         if (nSize > 0)
         {
-            header = buffer - 1;
-            hSize = 1;
-            if (cSize)
-            {
-                header -= cSize;
-                hSize += cSize;
-            }
-            *header = (0xc0 | c);
-            if (cSize)
-            {
-                int tmp = packet->m_nChannel - 64;
-                header[1] = tmp & 0xff;
-                if (cSize == 2)
-                    header[2] = tmp >> 8;
-            }
+            header = cheader;
+            hSize = 1 + cSize;
         }
     }
     if (tbuf)
     {
         int wrote = WriteN(r, tbuf, toff-tbuf);
-        free(tbuf);
-        tbuf = NULL;
         if (!wrote)
             return FALSE;
     }
@@ -4181,7 +4217,13 @@ RTMP_Close(RTMP *r)
     r->m_read.nIgnoredFlvFrameCounter = 0;
 
     r->m_write.m_nBytesRead = 0;
-    RTMPPacket_Free(&r->m_write);
+    r->m_write.m_body = NULL;
+    free(r->m_writeBuf);
+    r->m_writeBuf = NULL;
+    r->m_writeBufSize = 0;
+    free(r->m_outBuf);
+    r->m_outBuf = NULL;
+    r->m_outBufSize = 0;
 
     for (i = 0; i < r->m_channelsAllocatedIn; i++)
     {
@@ -5204,11 +5246,23 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
                 pkt->m_headerType = RTMP_PACKET_SIZE_MEDIUM;
             }
 
-            if (!RTMPPacket_Alloc(pkt, pkt->m_nBodySize))
+            if (!GrowOutChunkSize(r, pkt->m_nBodySize))
+                return -1;
+
+            /* keep the body buffer around, tags arrive at frame rate */
+            if (pkt->m_nBodySize + RTMP_MAX_HEADER_SIZE > (uint32_t)r->m_writeBufSize)
             {
-                RTMP_Log(RTMP_LOGDEBUG, "%s, failed to allocate packet", __FUNCTION__);
-                return FALSE;
+                int bufSize = pkt->m_nBodySize + RTMP_MAX_HEADER_SIZE;
+                char *writeBuf = realloc(r->m_writeBuf, bufSize);
+                if (!writeBuf)
+                {
+                    RTMP_Log(RTMP_LOGDEBUG, "%s, failed to allocate packet", __FUNCTION__);
+                    return FALSE;
+                }
+                r->m_writeBuf = writeBuf;
+                r->m_writeBufSize = bufSize;
             }
+            pkt->m_body = r->m_writeBuf + RTMP_MAX_HEADER_SIZE;
             enc = pkt->m_body;
             pend = enc + pkt->m_nBodySize;
             if (pkt->m_packetType == RTMP_PACKET_TYPE_INFO)
@@ -5231,7 +5285,7 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
         if (pkt->m_nBytesRead == pkt->m_nBodySize)
         {
             ret = RTMP_SendPacket(r, pkt, FALSE);
-            RTMPPacket_Free(pkt);
+            pkt->m_body = NULL;
             pkt->m_nBytesRead = 0;
             if (!ret)
                 return -1;
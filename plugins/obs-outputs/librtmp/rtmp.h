@@ -299,6 +299,7 @@ extern "C"
         RTMP_BINDINFO m_bindIP;
 
         uint8_t m_bSendChunkSizeInfo;
+        int m_maxOutChunkSize;	/* grow m_outChunkSize up to this, 0 = fixed */
 
         int m_numInvokes;
         int m_numCalls;
@@ -324,6 +325,10 @@ extern "C"
 
         RTMP_READ m_read;
         RTMPPacket m_write;
+        char *m_writeBuf;		/* reused body storage for m_write */
+        int m_writeBufSize;
+        char *m_outBuf;		/* reused buffer for coalesced chunks */
+        int m_outBufSize;
         RTMPSockBuf m_sb;
         RTMP_LNK Link;
     } RTMP;
@@ -0,0 +1,962 @@
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <inttypes.h>
+#include "librtmp/rtmp.h"
+#include "librtmp/log.h"
+#include "flv-mux.h"
+
+#define do_log(level, format, ...) \
+	blog(level, "[rtmp multi stream: '%s'] " format, \
+			obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+#define debug(format, ...) do_log(LOG_DEBUG,   format, ##__VA_ARGS__)
+
+#define OPT_DROP_THRESHOLD  "drop_threshold_ms"
+#define OPT_RECONNECT_DELAY "reconnect_delay_sec"
+#define OPT_MAX_RETRIES     "max_retries"
+
+/* array of objects with "url", "key" and optionally "username" and
+ * "password".  these destinations are added after the one of the output's
+ * service, if any */
+#define OPT_DESTINATIONS    "destinations"
+
+#define MIN_SENDBUF_SIZE    65535
+
+/* audio and video packets tend to arrive in bursts */
+#define SEND_SPIN_NS        20000
+
+/* An FLV tag muxed once and shared by every destination queue.  The packet
+ * properties needed for frame dropping are kept next to it. */
+struct shared_packet {
+	volatile long         refs;
+
+	enum obs_encoder_type type;
+	bool                  keyframe;
+	int                   priority;
+	int                   drop_priority;
+	int64_t               dts_usec;
+	uint64_t              frame_ts;
+
+	uint8_t               *data;
+	size_t                size;
+};
+
+struct rtmp_multi_stream;
+
+struct rtmp_destination {
+	struct rtmp_multi_stream *stream;
+	size_t                   index;
+
+	struct dstr              path, key;
+	struct dstr              username, password;
+
+	pthread_t                thread;
+	bool                     thread_created;
+
+	/* contains struct shared_packet* */
+	pthread_mutex_t          packets_mutex;
+	struct circlebuf         packets;
+	os_sem_t                 *send_sem;
+
+	/* set once connected and the metadata has been sent, packets are only
+	 * queued for the destination while this is set.  the first packet
+	 * queued after (re)connecting is always a video keyframe.  accepting,
+	 * wait_keyframe and min_priority are guarded by packets_mutex. */
+	bool                     accepting;
+	bool                     wait_keyframe;
+	bool                     sent_headers;
+
+	/* frame drop variables */
+	int                      min_priority;
+	int64_t                  last_dts_usec;
+
+	/* statistics */
+	volatile bool            connected;
+	uint64_t                 total_bytes_sent;
+	int                      dropped_frames;
+	int                      reconnects;
+	int                      last_error;
+
+	RTMP                     rtmp;
+};
+
+struct rtmp_multi_stream {
+	obs_output_t             *output;
+
+	os_event_t               *stop_event;
+
+	/* guards thread creation/detaching against rtmp_multi_stream_stop */
+	pthread_mutex_t          threads_mutex;
+	int                      running_threads;
+
+	pthread_mutex_t          capture_mutex;
+	bool                     capturing;
+
+	int64_t                  drop_threshold_usec;
+	int                      reconnect_delay_ms;
+	int                      max_retries;
+
+	struct dstr              encoder_name;
+
+	DARRAY(struct rtmp_destination*) destinations;
+};
+
+static const char *rtmp_multi_stream_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("RTMPMultiStream");
+}
+
+static void log_rtmp(int level, const char *format, va_list args)
+{
+	if (level > RTMP_LOGWARNING)
+		return;
+
+	blogva(LOG_INFO, format, args);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Shared packets */
+
+static struct shared_packet *shared_packet_create(
+		struct encoder_packet *packet)
+{
+	struct shared_packet *shared = bzalloc(sizeof(struct shared_packet));
+
+	shared->refs          = 1;
+	shared->type          = packet->type;
+	shared->keyframe      = packet->keyframe;
+	shared->priority      = packet->priority;
+	shared->drop_priority = packet->drop_priority;
+	shared->dts_usec      = packet->dts_usec;
+	shared->frame_ts      = packet->frame_ts;
+
+	flv_packet_mux(packet, &shared->data, &shared->size, false);
+	return shared;
+}
+
+static inline void shared_packet_addref(struct shared_packet *shared)
+{
+	os_atomic_inc_long(&shared->refs);
+}
+
+static inline void shared_packet_release(struct shared_packet *shared)
+{
+	if (shared && os_atomic_dec_long(&shared->refs) == 0) {
+		bfree(shared->data);
+		bfree(shared);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* Destinations */
+
+static inline void free_packets(struct rtmp_destination *dest)
+{
+	pthread_mutex_lock(&dest->packets_mutex);
+
+	while (dest->packets.size) {
+		struct shared_packet *shared;
+		circlebuf_pop_front(&dest->packets, &shared, sizeof(shared));
+		shared_packet_release(shared);
+	}
+
+	pthread_mutex_unlock(&dest->packets_mutex);
+}
+
+static void destination_destroy(struct rtmp_destination *dest)
+{
+	if (!dest)
+		return;
+
+	free_packets(dest);
+	circlebuf_free(&dest->packets);
+	dstr_free(&dest->path);
+	dstr_free(&dest->key);
+	dstr_free(&dest->username);
+	dstr_free(&dest->password);
+	os_sem_destroy(dest->send_sem);
+	pthread_mutex_destroy(&dest->packets_mutex);
+	bfree(dest);
+}
+
+static struct rtmp_destination *destination_create(
+		struct rtmp_multi_stream *stream, const char *url,
+		const char *key, const char *username, const char *password)
+{
+	struct rtmp_destination *dest = bzalloc(sizeof(*dest));
+	pthread_mutex_init_value(&dest->packets_mutex);
+
+	dest->stream = stream;
+	dest->index  = stream->destinations.num;
+
+	if (pthread_mutex_init(&dest->packets_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&dest->send_sem, 0) != 0)
+		goto fail;
+	os_sem_set_spin(dest->send_sem, SEND_SPIN_NS);
+
+	dstr_copy(&dest->path,     url);
+	dstr_copy(&dest->key,      key);
+	dstr_copy(&dest->username, username);
+	dstr_copy(&dest->password, password);
+
+	RTMP_Init(&dest->rtmp);
+	return dest;
+
+fail:
+	destination_destroy(dest);
+	return NULL;
+}
+
+static void free_destinations(struct rtmp_multi_stream *stream)
+{
+	for (size_t i = 0; i < stream->destinations.num; i++)
+		destination_destroy(stream->destinations.array[i]);
+
+	da_free(stream->destinations);
+}
+
+static inline bool stopping(struct rtmp_multi_stream *stream)
+{
+	return os_event_try(stream->stop_event) != EAGAIN;
+}
+
+static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
+{
+	bool valid  = !dstr_is_empty(str);
+	val->av_val = valid ? str->array    : NULL;
+	val->av_len = valid ? (int)str->len : 0;
+}
+
+static int write_tag(struct rtmp_destination *dest, const uint8_t *data,
+		size_t size)
+{
+	int ret = RTMP_Write(&dest->rtmp, (const char*)data, (int)size, 0);
+	if (ret >= 0)
+		dest->total_bytes_sent += size;
+	return ret;
+}
+
+static int send_header_packet(struct rtmp_destination *dest,
+		struct encoder_packet *packet)
+{
+	uint8_t *data;
+	size_t  size;
+	int     ret;
+
+	flv_packet_mux(packet, &data, &size, true);
+	ret = write_tag(dest, data, size);
+	bfree(data);
+
+	obs_free_encoder_packet(packet);
+	return ret;
+}
+
+static int send_headers(struct rtmp_destination *dest)
+{
+	obs_output_t  *context  = dest->stream->output;
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, 0);
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
+	uint8_t       *header;
+	size_t        size;
+
+	struct encoder_packet audio = {
+		.type         = OBS_ENCODER_AUDIO,
+		.timebase_den = 1
+	};
+	struct encoder_packet video = {
+		.type         = OBS_ENCODER_VIDEO,
+		.timebase_den = 1,
+		.keyframe     = true
+	};
+
+	dest->sent_headers = true;
+
+	if (aencoder) {
+		obs_encoder_get_extra_data(aencoder, &header, &audio.size);
+		audio.data = bmemdup(header, audio.size);
+		if (send_header_packet(dest, &audio) < 0)
+			return -1;
+	}
+
+	obs_encoder_get_extra_data(vencoder, &header, &size);
+	video.size = obs_parse_avc_header(&video.data, header, size);
+	return send_header_packet(dest, &video);
+}
+
+static bool send_meta_data(struct rtmp_destination *dest)
+{
+	uint8_t *meta_data;
+	size_t  meta_data_size;
+	bool success = flv_meta_data(dest->stream->output, &meta_data,
+			&meta_data_size, false, 0);
+
+	if (success) {
+		success = write_tag(dest, meta_data, meta_data_size) >= 0;
+		bfree(meta_data);
+	}
+
+	return success;
+}
+
+#ifdef _WIN32
+#define socklen_t int
+#endif
+
+static void adjust_sndbuf_size(struct rtmp_destination *dest, int new_size)
+{
+	int cur_sendbuf_size = new_size;
+	socklen_t int_size = sizeof(int);
+
+	getsockopt(dest->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+			(char*)&cur_sendbuf_size, &int_size);
+
+	if (cur_sendbuf_size < new_size) {
+		cur_sendbuf_size = new_size;
+		setsockopt(dest->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+				(const char*)&cur_sendbuf_size, int_size);
+	}
+}
+
+static int connect_destination(struct rtmp_destination *dest)
+{
+	struct rtmp_multi_stream *stream = dest->stream;
+
+	if (dstr_is_empty(&dest->path)) {
+		warn("URL of destination %d is empty", (int)dest->index);
+		return OBS_OUTPUT_BAD_PATH;
+	}
+
+	info("Connecting destination %d to RTMP URL %s...",
+			(int)dest->index, dest->path.array);
+
+	RTMP_Init(&dest->rtmp);
+	if (!RTMP_SetupURL(&dest->rtmp, dest->path.array))
+		return OBS_OUTPUT_BAD_PATH;
+
+	RTMP_EnableWrite(&dest->rtmp);
+
+	set_rtmp_dstr(&dest->rtmp.Link.pubUser,   &dest->username);
+	set_rtmp_dstr(&dest->rtmp.Link.pubPasswd, &dest->password);
+	set_rtmp_dstr(&dest->rtmp.Link.flashVer,  &stream->encoder_name);
+	dest->rtmp.Link.swfUrl = dest->rtmp.Link.tcUrl;
+
+	RTMP_AddStream(&dest->rtmp, dest->key.array);
+
+	dest->rtmp.m_outChunkSize       = 4096;
+	dest->rtmp.m_bSendChunkSizeInfo = true;
+	dest->rtmp.m_maxOutChunkSize    = 64 * 1024;
+	dest->rtmp.m_bUseNagle          = true;
+
+	if (!RTMP_Connect(&dest->rtmp, NULL))
+		return OBS_OUTPUT_CONNECT_FAILED;
+	if (!RTMP_ConnectStream(&dest->rtmp, 0)) {
+		RTMP_Close(&dest->rtmp);
+		return OBS_OUTPUT_INVALID_STREAM;
+	}
+
+#if defined(_WIN32)
+	adjust_sndbuf_size(dest, MIN_SENDBUF_SIZE);
+#endif
+
+	if (!send_meta_data(dest)) {
+		RTMP_Close(&dest->rtmp);
+		return OBS_OUTPUT_DISCONNECTED;
+	}
+
+	info("Destination %d connected to %s", (int)dest->index,
+			dest->path.array);
+	return OBS_OUTPUT_SUCCESS;
+}
+
+static void begin_capture(struct rtmp_multi_stream *stream)
+{
+	pthread_mutex_lock(&stream->capture_mutex);
+	if (!stream->capturing && !stopping(stream))
+		stream->capturing = obs_output_begin_data_capture(
+				stream->output, 0);
+	pthread_mutex_unlock(&stream->capture_mutex);
+}
+
+static inline bool get_next_packet(struct rtmp_destination *dest,
+		struct shared_packet **shared)
+{
+	bool new_packet = false;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+	if (dest->packets.size) {
+		circlebuf_pop_front(&dest->packets, shared, sizeof(*shared));
+		new_packet = true;
+	}
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	return new_packet;
+}
+
+/* returns false if the connection was lost */
+static bool send_loop(struct rtmp_destination *dest)
+{
+	struct rtmp_multi_stream *stream = dest->stream;
+
+	while (os_sem_wait(dest->send_sem) == 0) {
+		struct shared_packet *shared;
+		int ret;
+
+		if (stopping(stream))
+			return true;
+		if (!get_next_packet(dest, &shared))
+			continue;
+
+		if (!dest->sent_headers && send_headers(dest) < 0) {
+			shared_packet_release(shared);
+			return false;
+		}
+
+		ret = write_tag(dest, shared->data, shared->size);
+
+		if (ret >= 0 && dest->index == 0 &&
+		    shared->type == OBS_ENCODER_VIDEO)
+			obs_frame_stats_record(OBS_FRAME_STAGE_SENT,
+					shared->frame_ts);
+
+		shared_packet_release(shared);
+
+		if (ret < 0)
+			return false;
+	}
+
+	return true;
+}
+
+static inline bool can_retry(int code)
+{
+	return code != OBS_OUTPUT_BAD_PATH;
+}
+
+static void destination_finished(struct rtmp_destination *dest)
+{
+	struct rtmp_multi_stream *stream = dest->stream;
+	bool user_stop;
+	bool was_capturing;
+	bool last;
+
+	pthread_mutex_lock(&stream->threads_mutex);
+	user_stop = stopping(stream);
+	if (!user_stop) {
+		pthread_detach(dest->thread);
+		dest->thread_created = false;
+	}
+	last = --stream->running_threads == 0;
+	pthread_mutex_unlock(&stream->threads_mutex);
+
+	if (user_stop || !last)
+		return;
+
+	/* every destination gave up, let libobs handle the reconnect of the
+	 * whole output */
+	pthread_mutex_lock(&stream->capture_mutex);
+	was_capturing = stream->capturing;
+	stream->capturing = false;
+	pthread_mutex_unlock(&stream->capture_mutex);
+
+	obs_output_signal_stop(stream->output, was_capturing ?
+			OBS_OUTPUT_DISCONNECTED : dest->last_error);
+}
+
+static void *destination_thread(void *data)
+{
+	struct rtmp_destination  *dest   = data;
+	struct rtmp_multi_stream *stream = dest->stream;
+	int retries = 0;
+
+	while (!stopping(stream)) {
+		int ret = connect_destination(dest);
+
+		if (ret == OBS_OUTPUT_SUCCESS) {
+			retries = 0;
+
+			dest->sent_headers = false;
+			dest->connected    = true;
+
+			pthread_mutex_lock(&dest->packets_mutex);
+			dest->wait_keyframe = true;
+			dest->min_priority  = 0;
+			dest->accepting     = true;
+			pthread_mutex_unlock(&dest->packets_mutex);
+
+			begin_capture(stream);
+
+			if (send_loop(dest))
+				ret = OBS_OUTPUT_SUCCESS;
+			else
+				ret = OBS_OUTPUT_DISCONNECTED;
+
+			pthread_mutex_lock(&dest->packets_mutex);
+			dest->accepting = false;
+			pthread_mutex_unlock(&dest->packets_mutex);
+
+			dest->connected = false;
+			free_packets(dest);
+			RTMP_Close(&dest->rtmp);
+
+			if (stopping(stream))
+				break;
+
+			info("Destination %d disconnected from %s",
+					(int)dest->index, dest->path.array);
+		} else {
+			info("Connection of destination %d to %s failed: %d",
+					(int)dest->index, dest->path.array,
+					ret);
+		}
+
+		dest->last_error = ret;
+
+		if (!can_retry(ret) || retries++ >= stream->max_retries) {
+			warn("Giving up on destination %d (%s)",
+					(int)dest->index, dest->path.array);
+			break;
+		}
+
+		dest->reconnects++;
+		info("Reconnecting destination %d in %d seconds..",
+				(int)dest->index,
+				stream->reconnect_delay_ms / 1000);
+
+		if (os_event_timedwait(stream->stop_event,
+					(unsigned long)stream->reconnect_delay_ms)
+				!= ETIMEDOUT)
+			break;
+	}
+
+	destination_finished(dest);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Output callbacks */
+
+static void rtmp_multi_stream_stop(void *data);
+
+static void rtmp_multi_stream_destroy(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+
+	if (!stream)
+		return;
+
+	if (stream->stop_event)
+		rtmp_multi_stream_stop(stream);
+
+	free_destinations(stream);
+	dstr_free(&stream->encoder_name);
+	os_event_destroy(stream->stop_event);
+	pthread_mutex_destroy(&stream->threads_mutex);
+	pthread_mutex_destroy(&stream->capture_mutex);
+	bfree(stream);
+}
+
+static void proc_get_destination_count(void *data, calldata_t *cd)
+{
+	struct rtmp_multi_stream *stream = data;
+	calldata_set_int(cd, "count", (long long)stream->destinations.num);
+}
+
+static void proc_get_destination_stats(void *data, calldata_t *cd)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct rtmp_destination  *dest;
+	long long idx = calldata_int(cd, "index");
+
+	if (idx < 0 || (size_t)idx >= stream->destinations.num)
+		return;
+
+	dest = stream->destinations.array[idx];
+	calldata_set_string(cd, "url", dest->path.array);
+	calldata_set_bool(cd, "connected", dest->connected);
+	calldata_set_int(cd, "bytes_sent", (long long)dest->total_bytes_sent);
+	calldata_set_int(cd, "dropped_frames", dest->dropped_frames);
+	calldata_set_int(cd, "reconnects", dest->reconnects);
+}
+
+static void *rtmp_multi_stream_create(obs_data_t *settings,
+		obs_output_t *output)
+{
+	struct rtmp_multi_stream *stream = bzalloc(sizeof(*stream));
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+
+	stream->output = output;
+	pthread_mutex_init_value(&stream->threads_mutex);
+	pthread_mutex_init_value(&stream->capture_mutex);
+
+	RTMP_LogSetCallback(log_rtmp);
+	RTMP_LogSetLevel(RTMP_LOGWARNING);
+
+	if (pthread_mutex_init(&stream->threads_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&stream->capture_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+
+	proc_handler_add(ph, "void get_destination_count(out int count)",
+			proc_get_destination_count, stream);
+	proc_handler_add(ph, "void get_destination_stats(in int index, "
+			"out string url, out bool connected, "
+			"out int bytes_sent, out int dropped_frames, "
+			"out int reconnects)",
+			proc_get_destination_stats, stream);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+
+fail:
+	rtmp_multi_stream_destroy(stream);
+	return NULL;
+}
+
+static void rtmp_multi_stream_stop(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	void *ret;
+
+	pthread_mutex_lock(&stream->threads_mutex);
+	os_event_signal(stream->stop_event);
+	pthread_mutex_unlock(&stream->threads_mutex);
+
+	for (size_t i = 0; i < stream->destinations.num; i++) {
+		struct rtmp_destination *dest = stream->destinations.array[i];
+
+		if (dest->thread_created) {
+			os_sem_post(dest->send_sem);
+			pthread_join(dest->thread, &ret);
+			dest->thread_created = false;
+		}
+	}
+
+	pthread_mutex_lock(&stream->capture_mutex);
+	if (stream->capturing) {
+		stream->capturing = false;
+		obs_output_end_data_capture(stream->output);
+	}
+	pthread_mutex_unlock(&stream->capture_mutex);
+
+	os_event_reset(stream->stop_event);
+}
+
+static void set_encoder_name(struct rtmp_multi_stream *stream)
+{
+	dstr_copy(&stream->encoder_name, "FMLE/3.0 (compatible; obs-studio/");
+
+#ifdef HAVE_OBSCONFIG_H
+	dstr_cat(&stream->encoder_name, OBS_VERSION);
+#else
+	dstr_catf(&stream->encoder_name, "%d.%d.%d",
+			LIBOBS_API_MAJOR_VER,
+			LIBOBS_API_MINOR_VER,
+			LIBOBS_API_PATCH_VER);
+#endif
+
+	dstr_cat(&stream->encoder_name, "; FMSc/1.0)");
+}
+
+static void add_destination(struct rtmp_multi_stream *stream,
+		const char *url, const char *key, const char *username,
+		const char *password)
+{
+	struct rtmp_destination *dest = destination_create(stream, url, key,
+			username, password);
+	if (dest)
+		da_push_back(stream->destinations, &dest);
+}
+
+static void load_destinations(struct rtmp_multi_stream *stream,
+		obs_data_t *settings)
+{
+	obs_service_t    *service = obs_output_get_service(stream->output);
+	obs_data_array_t *array   = obs_data_get_array(settings,
+			OPT_DESTINATIONS);
+	size_t           count    = obs_data_array_count(array);
+
+	free_destinations(stream);
+
+	if (service)
+		add_destination(stream,
+				obs_service_get_url(service),
+				obs_service_get_key(service),
+				obs_service_get_username(service),
+				obs_service_get_password(service));
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(array, i);
+
+		add_destination(stream,
+				obs_data_get_string(item, "url"),
+				obs_data_get_string(item, "key"),
+				obs_data_get_string(item, "username"),
+				obs_data_get_string(item, "password"));
+
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(array);
+}
+
+static bool rtmp_multi_stream_start(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	obs_data_t *settings;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(stream->output);
+	stream->drop_threshold_usec =
+		(int64_t)obs_data_get_int(settings, OPT_DROP_THRESHOLD) * 1000;
+	stream->reconnect_delay_ms =
+		(int)obs_data_get_int(settings, OPT_RECONNECT_DELAY) * 1000;
+	stream->max_retries =
+		(int)obs_data_get_int(settings, OPT_MAX_RETRIES);
+	load_destinations(stream, settings);
+	obs_data_release(settings);
+
+	if (!stream->destinations.num) {
+		warn("No destinations");
+		return false;
+	}
+
+	set_encoder_name(stream);
+
+	pthread_mutex_lock(&stream->threads_mutex);
+
+	for (size_t i = 0; i < stream->destinations.num; i++) {
+		struct rtmp_destination *dest = stream->destinations.array[i];
+
+		if (pthread_create(&dest->thread, NULL, destination_thread,
+					dest) != 0) {
+			warn("Failed to create thread for destination %d",
+					(int)i);
+			continue;
+		}
+
+		dest->thread_created = true;
+		stream->running_threads++;
+	}
+
+	pthread_mutex_unlock(&stream->threads_mutex);
+
+	return stream->running_threads > 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Per-destination queueing and frame dropping */
+
+static inline size_t num_buffered_packets(struct rtmp_destination *dest)
+{
+	return dest->packets.size / sizeof(struct shared_packet*);
+}
+
+static void drop_frames(struct rtmp_destination *dest)
+{
+	struct circlebuf new_buf            = {0};
+	int              drop_priority      = 0;
+	int              num_frames_dropped = 0;
+
+	circlebuf_reserve(&new_buf, sizeof(struct shared_packet*) * 8);
+
+	while (dest->packets.size) {
+		struct shared_packet *shared;
+		circlebuf_pop_front(&dest->packets, &shared, sizeof(shared));
+
+		/* do not drop audio data or video keyframes */
+		if (shared->type          == OBS_ENCODER_AUDIO ||
+		    shared->drop_priority == OBS_NAL_PRIORITY_HIGHEST) {
+			circlebuf_push_back(&new_buf, &shared, sizeof(shared));
+		} else {
+			if (drop_priority < shared->drop_priority)
+				drop_priority = shared->drop_priority;
+
+			num_frames_dropped++;
+			shared_packet_release(shared);
+		}
+	}
+
+	circlebuf_free(&dest->packets);
+	dest->packets      = new_buf;
+	dest->min_priority = drop_priority;
+
+	dest->dropped_frames += num_frames_dropped;
+	if (dest->index == 0)
+		obs_frame_stats_add_drops(OBS_FRAME_DROP_NETWORK,
+				(uint64_t)num_frames_dropped);
+}
+
+static void check_to_drop_frames(struct rtmp_destination *dest)
+{
+	struct rtmp_multi_stream *stream = dest->stream;
+	struct shared_packet *first;
+	int64_t buffer_duration_usec;
+
+	if (num_buffered_packets(dest) < 5)
+		return;
+
+	circlebuf_peek_front(&dest->packets, &first, sizeof(first));
+
+	/* if the amount of time stored in the buffered packets waiting to be
+	 * sent is higher than threshold, drop frames */
+	buffer_duration_usec = dest->last_dts_usec - first->dts_usec;
+
+	if (buffer_duration_usec > stream->drop_threshold_usec) {
+		drop_frames(dest);
+		debug("destination %d: dropping %" PRId64 " worth of frames",
+				(int)dest->index, buffer_duration_usec);
+	}
+}
+
+static bool add_video_packet(struct rtmp_destination *dest,
+		struct shared_packet *shared)
+{
+	check_to_drop_frames(dest);
+
+	/* if currently dropping frames, drop packets until it reaches the
+	 * desired priority */
+	if (shared->priority < dest->min_priority) {
+		dest->dropped_frames++;
+		if (dest->index == 0)
+			obs_frame_stats_add_drops(OBS_FRAME_DROP_NETWORK, 1);
+		return false;
+	} else {
+		dest->min_priority = 0;
+	}
+
+	return true;
+}
+
+static void queue_packet(struct rtmp_destination *dest,
+		struct shared_packet *shared)
+{
+	bool add;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+
+	if (!dest->accepting) {
+		add = false;
+	} else if (dest->wait_keyframe) {
+		add = shared->type == OBS_ENCODER_VIDEO && shared->keyframe;
+		if (add)
+			dest->wait_keyframe = false;
+	} else {
+		add = (shared->type == OBS_ENCODER_VIDEO) ?
+			add_video_packet(dest, shared) : true;
+	}
+
+	if (add) {
+		shared_packet_addref(shared);
+		circlebuf_push_back(&dest->packets, &shared, sizeof(shared));
+		dest->last_dts_usec = shared->dts_usec;
+	}
+
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	if (add)
+		os_sem_post(dest->send_sem);
+}
+
+static void rtmp_multi_stream_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct encoder_packet    new_packet;
+	struct shared_packet     *shared;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_parse_avc_packet(&new_packet, packet);
+	else
+		obs_duplicate_encoder_packet(&new_packet, packet);
+
+	/* mux once, every destination only takes a reference */
+	shared = shared_packet_create(&new_packet);
+	obs_free_encoder_packet(&new_packet);
+
+	for (size_t i = 0; i < stream->destinations.num; i++)
+		queue_packet(stream->destinations.array[i], shared);
+
+	shared_packet_release(shared);
+}
+
+static void rtmp_multi_stream_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 600);
+	obs_data_set_default_int(defaults, OPT_RECONNECT_DELAY, 10);
+	obs_data_set_default_int(defaults, OPT_MAX_RETRIES, 20);
+}
+
+static obs_properties_t *rtmp_multi_stream_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
+			obs_module_text("RTMPStream.DropThreshold"),
+			200, 10000, 100);
+	obs_properties_add_int(props, OPT_RECONNECT_DELAY,
+			obs_module_text("RTMPMultiStream.ReconnectDelay"),
+			1, 60, 1);
+	obs_properties_add_int(props, OPT_MAX_RETRIES,
+			obs_module_text("RTMPMultiStream.MaxRetries"),
+			0, 10000, 1);
+	return props;
+}
+
+static uint64_t rtmp_multi_stream_total_bytes_sent(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	uint64_t total = 0;
+
+	for (size_t i = 0; i < stream->destinations.num; i++)
+		total += stream->destinations.array[i]->total_bytes_sent;
+
+	return total;
+}
+
+/* reports the destination that dropped the most */
+static int rtmp_multi_stream_dropped_frames(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	int dropped = 0;
+
+	for (size_t i = 0; i < stream->destinations.num; i++) {
+		int cur = stream->destinations.array[i]->dropped_frames;
+		if (cur > dropped)
+			dropped = cur;
+	}
+
+	return dropped;
+}
+
+struct obs_output_info rtmp_multi_output_info = {
+	.id                 = "rtmp_multi_output",
+	.flags              = OBS_OUTPUT_AV |
+	                      OBS_OUTPUT_ENCODED |
+	                      OBS_OUTPUT_SERVICE,
+	.get_name           = rtmp_multi_stream_getname,
+	.create             = rtmp_multi_stream_create,
+	.destroy            = rtmp_multi_stream_destroy,
+	.start              = rtmp_multi_stream_start,
+	.stop               = rtmp_multi_stream_stop,
+	.encoded_packet     = rtmp_multi_stream_data,
+	.get_defaults       = rtmp_multi_stream_defaults,
+	.get_properties     = rtmp_multi_stream_properties,
+	.get_total_bytes    = rtmp_multi_stream_total_bytes_sent,
+	.get_dropped_frames = rtmp_multi_stream_dropped_frames
+};
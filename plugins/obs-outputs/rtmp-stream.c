@@ -36,6 +36,9 @@
 
 #define OPT_DROP_THRESHOLD "drop_threshold_ms"
 
+/* audio and video packets tend to arrive in bursts */
+#define SEND_SPIN_NS 20000
+
 //#define TEST_FRAMEDROPS
 
 struct rtmp_stream {
@@ -207,6 +210,9 @@ static int send_packet(struct rtmp_stream *stream,
 	ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size, (int)idx);
 	bfree(data);
 
+	if (ret >= 0 && !is_header && packet->type == OBS_ENCODER_VIDEO)
+		obs_frame_stats_record(OBS_FRAME_STAGE_SENT, packet->frame_ts);
+
 	obs_free_encoder_packet(packet);
 
 	stream->total_bytes_sent += size;
@@ -355,7 +361,11 @@ static inline void send_headers(struct rtmp_stream *stream)
 static inline bool reset_semaphore(struct rtmp_stream *stream)
 {
 	os_sem_destroy(stream->send_sem);
-	return os_sem_init(&stream->send_sem, 0) == 0;
+	if (os_sem_init(&stream->send_sem, 0) != 0)
+		return false;
+
+	os_sem_set_spin(stream->send_sem, SEND_SPIN_NS);
+	return true;
 }
 
 #ifdef _WIN32
@@ -453,6 +463,7 @@ static int try_connect(struct rtmp_stream *stream)
 
 	stream->rtmp.m_outChunkSize       = 4096;
 	stream->rtmp.m_bSendChunkSizeInfo = true;
+	stream->rtmp.m_maxOutChunkSize    = 64 * 1024;
 	stream->rtmp.m_bUseNagle          = true;
 
 	if (!RTMP_Connect(&stream->rtmp, NULL))
@@ -590,6 +601,8 @@ static void drop_frames(struct rtmp_stream *stream)
 	stream->min_drop_dts_usec = last_drop_dts_usec;
 
 	stream->dropped_frames += num_frames_dropped;
+	obs_frame_stats_add_drops(OBS_FRAME_DROP_NETWORK,
+			(uint64_t)num_frames_dropped);
 	debug("New packet count: %d", (int)num_buffered_packets(stream));
 }
 
@@ -627,6 +640,7 @@ static bool add_video_packet(struct rtmp_stream *stream,
 	 * desired priority */
 	if (packet->priority < stream->min_priority) {
 		stream->dropped_frames++;
+		obs_frame_stats_add_drops(OBS_FRAME_DROP_NETWORK, 1);
 		return false;
 	} else {
 		stream->min_priority = 0;
@@ -43,8 +43,6 @@ struct obs_x264 {
 	x264_param_t           params;
 	x264_t                 *context;
 
-	DARRAY(uint8_t)        packet_data;
-
 	uint8_t                *extra_data;
 	uint8_t                *sei;
 
@@ -84,7 +82,6 @@ static void obs_x264_destroy(void *data)
 	if (obsx264) {
 		os_end_high_performance(obsx264->performance_token);
 		clear_data(obsx264);
-		da_free(obsx264->packet_data);
 		bfree(obsx264);
 	}
 }
@@ -491,6 +488,10 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings)
 
 	obsx264->params.b_repeat_headers = false;
 
+	/* have x264 write length prefixed NALs so that packets can be handed
+	 * to the outputs as they are, without scanning for start codes */
+	obsx264->params.b_annexb = 0;
+
 	strlist_free(paramlist);
 	bfree(preset);
 	bfree(profile);
@@ -515,6 +516,8 @@ static bool obs_x264_update(void *data, obs_data_t *settings)
 	return false;
 }
 
+static const uint8_t start_code[4] = {0, 0, 0, 1};
+
 static void load_headers(struct obs_x264 *obsx264)
 {
 	x264_nal_t      *nals;
@@ -527,14 +530,20 @@ static void load_headers(struct obs_x264 *obsx264)
 
 	x264_encoder_headers(obsx264->context, &nals, &nal_count);
 
+	/* headers and SEI are still expected in annex-b form, so swap the
+	 * four byte length of each NAL for a start code */
 	for (int i = 0; i < nal_count; i++) {
 		x264_nal_t *nal = nals+i;
 
-		if (nal->i_type == NAL_SEI)
-			da_push_back_array(sei, nal->p_payload, nal->i_payload);
-		else
-			da_push_back_array(header, nal->p_payload,
-					nal->i_payload);
+		if (nal->i_type == NAL_SEI) {
+			da_push_back_array(sei, start_code, 4);
+			da_push_back_array(sei, nal->p_payload + 4,
+					nal->i_payload - 4);
+		} else {
+			da_push_back_array(header, start_code, 4);
+			da_push_back_array(header, nal->p_payload + 4,
+					nal->i_payload - 4);
+		}
 	}
 
 	obsx264->extra_data      = header.array;
@@ -570,26 +579,32 @@ static void *obs_x264_create(obs_data_t *settings, obs_encoder_t *encoder)
 	return obsx264;
 }
 
-static void parse_packet(struct obs_x264 *obsx264,
-		struct encoder_packet *packet, x264_nal_t *nals,
+static void parse_packet(struct encoder_packet *packet, x264_nal_t *nals,
 		int nal_count, x264_picture_t *pic_out)
 {
-	if (!nal_count) return;
+	x264_nal_t *last = nals + nal_count - 1;
+	int priority = 0;
 
-	da_resize(obsx264->packet_data, 0);
+	if (!nal_count) return;
 
+	/* x264 writes the NALs of a frame back to back in its own buffer,
+	 * which stays valid until the next call to x264_encoder_encode */
 	for (int i = 0; i < nal_count; i++) {
 		x264_nal_t *nal = nals+i;
-		da_push_back_array(obsx264->packet_data, nal->p_payload,
-				nal->i_payload);
+
+		if (nal->i_type == NAL_SLICE || nal->i_type == NAL_SLICE_IDR)
+			priority = nal->i_ref_idc;
 	}
 
-	packet->data          = obsx264->packet_data.array;
-	packet->size          = obsx264->packet_data.num;
+	packet->data          = nals[0].p_payload;
+	packet->size          = (size_t)(last->p_payload + last->i_payload -
+	                                 nals[0].p_payload);
 	packet->type          = OBS_ENCODER_VIDEO;
 	packet->pts           = pic_out->i_pts;
 	packet->dts           = pic_out->i_dts;
 	packet->keyframe      = pic_out->b_keyframe != 0;
+	packet->priority      = priority;
+	packet->avcc          = true;
 }
 
 static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
@@ -636,7 +651,7 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	}
 
 	*received_packet = (nal_count != 0);
-	parse_packet(obsx264, packet, nals, nal_count, &pic_out);
+	parse_packet(packet, nals, nal_count, &pic_out);
 
 	return true;
 }
@@ -17,6 +17,7 @@
 #include "ff-decoder.h"
 
 #include <libavutil/time.h>
+#include <libswscale/swscale.h>
 #include <assert.h>
 
 typedef void *(*ff_decoder_thread_t)(void *opaque_decoder);
@@ -53,6 +54,7 @@ struct ff_decoder *ff_decoder_init(AVCodecContext *codec_context,
 	decoder->start_pts = 0;
 	decoder->predicted_pts = 0;
 	decoder->first_frame = true;
+	decoder->convert_format = AV_PIX_FMT_NONE;
 
 	success = ff_timer_init(&decoder->refresh_timer, ff_decoder_refresh,
 			decoder);
@@ -131,6 +133,9 @@ void ff_decoder_free(struct ff_decoder *decoder)
 	packet_queue_free(&decoder->packet_queue);
 	ff_circular_queue_free(&decoder->frame_queue);
 
+	if (decoder->sws_ctx != NULL)
+		sws_freeContext(decoder->sws_ctx);
+
 	avcodec_close(decoder->codec);
 
 	av_free(decoder);
@@ -28,6 +28,8 @@
 extern "C" {
 #endif
 
+struct SwsContext;
+
 struct ff_decoder {
 	AVCodecContext *codec;
 	AVStream *stream;
@@ -50,6 +52,16 @@ struct ff_decoder {
 
 	bool hwaccel_decoder;
 	enum AVDiscard frame_drop;
+
+	// colour conversion is done on the decoder thread into the frame
+	// queue slots, so the frame callback only has to hand frames on
+	enum AVPixelFormat convert_format;
+	const enum AVPixelFormat *passthrough_formats;
+	bool force_convert;
+	struct SwsContext *sws_ctx;
+	int sws_width;
+	int sws_height;
+	int sws_format;
 	struct ff_clock *clock;
 	enum ff_av_sync_type natural_sync_clock;
 
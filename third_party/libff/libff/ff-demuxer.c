@@ -52,6 +52,10 @@ struct ff_demuxer *ff_demuxer_init()
 	demuxer->options.audio_packet_queue_size = AUDIO_PACKET_QUEUE_SIZE;
 	demuxer->options.video_packet_queue_size = VIDEO_PACKET_QUEUE_SIZE;
 	demuxer->options.is_hw_decoding = false;
+	demuxer->options.decoder_threads = 0;
+	demuxer->options.decoder_thread_type = FF_THREAD_FRAME |
+			FF_THREAD_SLICE;
+	demuxer->options.convert_format = AV_PIX_FMT_NONE;
 
 	return demuxer;
 }
@@ -224,6 +228,13 @@ static bool initialize_decoder(struct ff_demuxer *demuxer,
 				AV_SYNC_VIDEO_MASTER;
 		demuxer->video_decoder->callbacks = &demuxer->video_callbacks;
 
+		demuxer->video_decoder->convert_format =
+				demuxer->options.convert_format;
+		demuxer->video_decoder->passthrough_formats =
+				demuxer->options.passthrough_formats;
+		demuxer->video_decoder->force_convert =
+				demuxer->options.is_forcing_conversion;
+
 		if (!ff_callbacks_format(&demuxer->video_callbacks,
 				codec_context)) {
 			ff_decoder_free(demuxer->video_decoder);
@@ -248,6 +259,7 @@ static bool find_decoder(struct ff_demuxer *demuxer, AVStream *stream)
 	int ret;
 
 	bool hwaccel_decoder = false;
+	bool single_thread = false;
 	codec_context = stream->codec;
 
 	// enable reference counted frames since we may have a buffer size
@@ -258,8 +270,10 @@ static bool find_decoder(struct ff_demuxer *demuxer, AVStream *stream)
 	if (codec_context->codec_id == AV_CODEC_ID_PNG
 			|| codec_context->codec_id == AV_CODEC_ID_TIFF
 			|| codec_context->codec_id == AV_CODEC_ID_JPEG2000
-			|| codec_context->codec_id == AV_CODEC_ID_WEBP)
+			|| codec_context->codec_id == AV_CODEC_ID_WEBP) {
 		codec_context->thread_count = 1;
+		single_thread = true;
+	}
 
 	if (demuxer->options.is_hw_decoding) {
 		AVHWAccel *hwaccel = find_hwaccel_codec(codec_context);
@@ -301,6 +315,19 @@ static bool find_decoder(struct ff_demuxer *demuxer, AVStream *stream)
                                                      codec_context->codec_id);
 			return false;
 		}
+
+		// frame and slice threading for software decoding only, the
+		// hwaccel decoders of this FFmpeg don't work with frame
+		// threads.  The stream's codec context defaults to a single
+		// thread.
+		if (codec_context->codec_type == AVMEDIA_TYPE_VIDEO &&
+		    !single_thread) {
+			codec_context->thread_count =
+					demuxer->options.decoder_threads;
+			codec_context->thread_type =
+					demuxer->options.decoder_thread_type;
+		}
+
 		if (avcodec_open2(codec_context, codec, &options_dict) < 0) {
 			av_log(NULL, AV_LOG_WARNING, "unable to open decoder"
                                                      " with codec id %d",
@@ -40,6 +40,18 @@ struct ff_demuxer_options
 	bool is_hw_decoding;
 	bool is_looping;
 	enum AVDiscard frame_drop;
+
+	// 0 lets the decoder pick the thread count from the cpu count
+	int decoder_threads;
+	// FF_THREAD_FRAME and/or FF_THREAD_SLICE
+	int decoder_thread_type;
+
+	// video frames are converted to convert_format on the decoder thread
+	// when forced or when their format is not in passthrough_formats
+	// (terminated by AV_PIX_FMT_NONE).  AV_PIX_FMT_NONE disables it.
+	enum AVPixelFormat convert_format;
+	const enum AVPixelFormat *passthrough_formats;
+	bool is_forcing_conversion;
 };
 
 typedef struct ff_demuxer_options ff_demuxer_options_t;
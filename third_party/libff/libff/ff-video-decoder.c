@@ -31,11 +31,108 @@
 //ʱ״̬Ƿ޷ݶ
 #define CACHE_WHOLE_FILE_SIZE_THREADHOLD 10485760
 
+static bool needs_conversion(struct ff_decoder *decoder, AVFrame *frame)
+{
+	const enum AVPixelFormat *format = decoder->passthrough_formats;
+
+	if (decoder->convert_format == AV_PIX_FMT_NONE)
+		return false;
+	if (frame->format == decoder->convert_format)
+		return false;
+	if (decoder->force_convert || format == NULL)
+		return true;
+
+	for (; *format != AV_PIX_FMT_NONE; format++) {
+		if (*format == frame->format)
+			return false;
+	}
+
+	return true;
+}
+
+static bool update_sws_context(struct ff_decoder *decoder, AVFrame *frame)
+{
+	if (decoder->sws_ctx != NULL
+			&& frame->width == decoder->sws_width
+			&& frame->height == decoder->sws_height
+			&& frame->format == decoder->sws_format)
+		return true;
+
+	if (decoder->sws_ctx != NULL)
+		sws_freeContext(decoder->sws_ctx);
+
+	decoder->sws_ctx = sws_getContext(
+			frame->width, frame->height, frame->format,
+			frame->width, frame->height, decoder->convert_format,
+			SWS_BILINEAR, NULL, NULL, NULL);
+
+	if (decoder->sws_ctx == NULL) {
+		av_log(NULL, AV_LOG_ERROR, "unable to create sws context "
+				"with src{w:%d,h:%d,f:%d}->dst{f:%d}",
+				frame->width, frame->height, frame->format,
+				decoder->convert_format);
+		decoder->sws_width = 0;
+		decoder->sws_height = 0;
+		decoder->sws_format = AV_PIX_FMT_NONE;
+		return false;
+	}
+
+	decoder->sws_width = frame->width;
+	decoder->sws_height = frame->height;
+	decoder->sws_format = frame->format;
+	return true;
+}
+
+// Converts the decoded frame into the queue slot.  The converted frame of the
+// slot is reused while its size and format stay the same, so the frame queue
+// acts as a pool of conversion buffers and conversion of the next frame can
+// overlap with the callback consuming the previous one.
+static AVFrame *convert_frame(struct ff_decoder *decoder,
+		AVFrame *slot_frame, AVFrame *frame)
+{
+	AVFrame *converted = slot_frame;
+
+	if (!update_sws_context(decoder, frame)) {
+		av_frame_free(&converted);
+		return NULL;
+	}
+
+	if (converted != NULL && (converted->width != frame->width
+			|| converted->height != frame->height
+			|| converted->format != decoder->convert_format
+			|| !av_frame_is_writable(converted)))
+		av_frame_free(&converted);
+
+	if (converted == NULL) {
+		converted = av_frame_alloc();
+		if (converted == NULL)
+			return NULL;
+
+		converted->width = frame->width;
+		converted->height = frame->height;
+		converted->format = decoder->convert_format;
+
+		if (av_frame_get_buffer(converted, 32) < 0) {
+			av_frame_free(&converted);
+			return NULL;
+		}
+	}
+
+	sws_scale(decoder->sws_ctx,
+			(const uint8_t *const *)frame->data, frame->linesize,
+			0, frame->height,
+			converted->data, converted->linesize);
+
+	av_frame_copy_props(converted, frame);
+	return converted;
+}
+
 static bool queue_frame(struct ff_decoder *decoder, AVFrame *frame,
 		double best_effort_pts)
 {
 	struct ff_frame *queue_frame;
 	bool call_initialize;
+	bool convert;
 
 	ff_circular_queue_wait_write(&decoder->frame_queue);
 
@@ -44,19 +141,28 @@ static bool queue_frame(struct ff_decoder *decoder, AVFrame *frame,
 	}
 
 	queue_frame = ff_circular_queue_peek_write(&decoder->frame_queue);
+	convert = needs_conversion(decoder, frame);
 
 	// Check if we need to communicate a different format has been received
 	// to any callbacks
-	AVCodecContext *codec = decoder->codec;
 	call_initialize = (queue_frame->frame == NULL
-			|| queue_frame->frame->width != codec->width
-			|| queue_frame->frame->height != codec->height
-			|| queue_frame->frame->format != codec->pix_fmt);
-
-	if (queue_frame->frame != NULL)
-		av_frame_free(&queue_frame->frame);
+			|| queue_frame->frame->width != frame->width
+			|| queue_frame->frame->height != frame->height
+			|| queue_frame->frame->format != (convert ?
+				decoder->convert_format : frame->format));
+
+	if (convert) {
+		queue_frame->frame = convert_frame(decoder,
+				queue_frame->frame, frame);
+		if (queue_frame->frame == NULL)
+			return true;
+	} else {
+		if (queue_frame->frame != NULL)
+			av_frame_free(&queue_frame->frame);
+
+		queue_frame->frame = av_frame_clone(frame);
+	}
 
-	queue_frame->frame = av_frame_clone(frame);
 	queue_frame->clock = ff_clock_retain(decoder->clock);
 
 	if (call_initialize)
@@ -0,0 +1,279 @@
+/*
+ * alloc-bench: counts the bmalloc/brealloc calls made by the darray, dstr
+ * and calldata call sequences of the hot callers, and checks the small
+ * buffer, explicit shrink and fixed calldata paths while doing so.
+ *
+ * Built from libobs/util (base.c, bmem.c, dstr.c, array-serializer.c,
+ * platform.c and the platform-* and threading-* files for the OS, utf8.c)
+ * and libobs/callback/calldata.c.  Running it under ASan also checks the
+ * small buffers for overruns.
+ *
+ * usage: alloc-bench [--iterations <n>]   (default 1000)
+ *
+ * One "key=value" line is printed per case, e.g.
+ *   case=flv_packet allocs_per_call=1.00
+ * then "leaks=0 failed_checks=0".  The exit code is 0 only when every
+ * check passed and nothing leaked.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/array-serializer.h>
+#include <callback/calldata.h>
+
+static int failed_checks = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "check failed (line %d): %s\n", \
+					__LINE__, #cond); \
+			failed_checks++; \
+		} \
+	} while (false)
+
+/* ------------------------------------------------------------------------- */
+/* the call sequences of the hot callers */
+
+static uint8_t payload[100000];
+
+/* the serializer writes flv_packet_mux makes for a video packet, with its
+ * size reserved up front */
+static void flv_packet(size_t size)
+{
+	struct array_output_data data;
+	struct serializer s;
+
+	array_output_serializer_init(&s, &data);
+	da_reserve(data.bytes, size + 20);
+
+	s_w8(&s, 9);
+	s_wb24(&s, (uint32_t)size + 5);
+	s_wb24(&s, 0);
+	s_w8(&s, 0);
+	s_wb24(&s, 0);
+	s_w8(&s, 0x17);
+	s_w8(&s, 1);
+	s_wb24(&s, 0);
+	s_write(&s, payload, size);
+	s_wb32(&s, (uint32_t)size + 16);
+
+	CHECK(data.bytes.num == size + 20);
+	array_output_serializer_free(&data);
+}
+
+/* the volmeter "levels_updated" signal */
+static void levels_signal(void)
+{
+	uint8_t stack[256];
+	struct calldata data;
+	double peak = 0.0;
+
+	calldata_init_fixed(&data, stack, sizeof(stack));
+
+	calldata_set_ptr  (&data, "volmeter",  &data);
+	calldata_set_float(&data, "level",     1.0);
+	calldata_set_float(&data, "magnitude", 2.0);
+	calldata_set_float(&data, "peak",      3.0);
+	calldata_set_bool (&data, "muted",     true);
+
+	CHECK(calldata_get_float(&data, "peak", &peak) && peak == 3.0);
+	CHECK(calldata_ptr(&data, "volmeter") == &data);
+	CHECK(data.stack == stack);
+
+	calldata_free(&data);
+}
+
+static void pointer_pushes(void)
+{
+	DARRAY(void*) list;
+
+	da_init(list);
+	for (int i = 0; i < 10; i++) {
+		void *ptr = &list;
+		da_push_back(list, &ptr);
+	}
+	da_free(list);
+}
+
+/* the module binary search path in parse_binary_from_directory */
+static void module_path(void)
+{
+	char buffer[512];
+	struct dstr path;
+
+	dstr_init_small(&path, buffer, sizeof(buffer));
+	dstr_copy(&path, "C:/obs/plugins/%module%/bin/64bit");
+	dstr_replace(&path, "%module%", "obs-outputs");
+	dstr_cat_ch(&path, '/');
+	dstr_cat(&path, "obs-outputs.dll");
+
+	CHECK(path.array == buffer);
+	dstr_free(&path);
+}
+
+struct bench_case {
+	const char *name;
+	void       (*run)(int i);
+};
+
+static void run_flv_packet(int i)     {flv_packet(5000 + (size_t)i * 7);}
+static void run_levels_signal(int i)  {(void)i; levels_signal();}
+static void run_pointer_pushes(int i) {(void)i; pointer_pushes();}
+static void run_module_path(int i)    {(void)i; module_path();}
+
+static const struct bench_case cases[] = {
+	{"flv_packet",     run_flv_packet},
+	{"levels_signal",  run_levels_signal},
+	{"pointer_pushes", run_pointer_pushes},
+	{"module_path",    run_module_path},
+};
+
+/* ------------------------------------------------------------------------- */
+/* checks */
+
+static void check_small_darray(void)
+{
+	int buffer[4];
+	int item = 4;
+	DARRAY(int) list;
+
+	da_init_small(list, buffer);
+	for (int i = 0; i < 4; i++)
+		da_push_back(list, &i);
+	CHECK(list.array == buffer);
+
+	/* growing past the buffer moves the items to the heap */
+	da_insert(list, 0, &item);
+	CHECK(list.array != buffer);
+	CHECK(list.array[0] == 4 && list.array[4] == 3);
+	da_free(list);
+
+	da_init_small(list, buffer);
+	for (int i = 0; i < 100; i++)
+		da_push_back(list, &i);
+	for (int i = 0; i < 100; i++)
+		CHECK(list.array[i] == i);
+	da_free(list);
+}
+
+static void check_shrink(void)
+{
+	DARRAY(uint8_t) bytes;
+	uint8_t *array;
+	size_t capacity;
+
+	da_init(bytes);
+	da_resize(bytes, 200000);
+	array    = bytes.array;
+	capacity = bytes.capacity;
+
+	/* erasing never reallocates, so pointers before the erased items stay
+	 * valid */
+	da_erase_range(bytes, 10, 190000);
+	da_erase(bytes, 0);
+	CHECK(bytes.array == array && bytes.capacity == capacity);
+
+	/* shrinking is explicit and halves a quarter-full array */
+	da_shrink(bytes);
+	CHECK(bytes.capacity == capacity / 2);
+	CHECK(bytes.num == 200000 - 190000 + 10 - 1);
+
+	/* and stops once the allocation is under DARRAY_SHRINK_MIN_BYTES */
+	capacity = bytes.capacity;
+	da_resize(bytes, 1);
+	da_shrink(bytes);
+	da_shrink(bytes);
+	CHECK(bytes.capacity == capacity / 2);
+	CHECK(bytes.capacity < DARRAY_SHRINK_MIN_BYTES);
+	da_free(bytes);
+}
+
+static void check_small_dstr(void)
+{
+	char buffer[8];
+	struct dstr str, moved;
+
+	dstr_init_small(&str, buffer, sizeof(buffer));
+	dstr_copy(&str, "abc");
+	CHECK(str.array == buffer);
+
+	dstr_cat(&str, "defghijkl");
+	CHECK(str.array != buffer);
+	CHECK(strcmp(str.array, "abcdefghijkl") == 0);
+	dstr_free(&str);
+
+	/* moving out of a small buffer copies instead of aliasing it */
+	dstr_init_small(&str, buffer, sizeof(buffer));
+	dstr_printf(&str, "%d", 42);
+	CHECK(str.array == buffer);
+	dstr_init_move(&moved, &str);
+	CHECK(moved.array != buffer && strcmp(moved.array, "42") == 0);
+	CHECK(str.array == NULL);
+	dstr_free(&moved);
+}
+
+static void check_fixed_calldata(void)
+{
+	uint8_t stack[64];
+	struct calldata data;
+	const char *text = NULL;
+
+	/* parameters that outgrow the buffer move to an allocated stack */
+	calldata_init_fixed(&data, stack, sizeof(stack));
+	calldata_set_ptr(&data, "source", &data);
+	calldata_set_string(&data, "name",
+			"a name that is longer than the fixed stack buffer");
+	CHECK(data.stack != stack);
+	CHECK(calldata_ptr(&data, "source") == &data);
+	CHECK(calldata_get_string(&data, "name", &text) &&
+			strncmp(text, "a name", 6) == 0);
+	calldata_free(&data);
+
+	/* the first parameter alone can be too large as well */
+	calldata_init_fixed(&data, stack, 16);
+	calldata_set_string(&data, "name", "longer than sixteen bytes");
+	CHECK(data.stack != stack);
+	calldata_free(&data);
+}
+
+int main(int argc, char *argv[])
+{
+	long live = bnum_allocs();
+	int iterations = 1000;
+
+	if (argc == 3 && strcmp(argv[1], "--iterations") == 0) {
+		iterations = atoi(argv[2]);
+	} else if (argc != 1) {
+		fprintf(stderr, "usage: %s [--iterations n]\n", argv[0]);
+		return 1;
+	}
+
+	if (iterations <= 0)
+		iterations = 1;
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		long start = bnum_total_allocs();
+
+		for (int j = 0; j < iterations; j++)
+			cases[i].run(j);
+
+		printf("case=%s allocs_per_call=%.2f\n", cases[i].name,
+				(double)(bnum_total_allocs() - start) /
+				(double)iterations);
+	}
+
+	check_small_darray();
+	check_shrink();
+	check_small_dstr();
+	check_fixed_calldata();
+
+	live = bnum_allocs() - live;
+	printf("leaks=%ld failed_checks=%d\n", live, failed_checks);
+	return (live == 0 && failed_checks == 0) ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/*
+ * audio-convert-bench: measures audio_convert() (libobs media-io) against
+ * swr_convert() for the sample format/layout changes libobs does at a
+ * fixed sample rate.
+ *
+ * Built from libobs (media-io/audio-conversion.c, util/platform.c) and
+ * linked against libswresample/libavutil.
+ *
+ * usage: audio-convert-bench [options]
+ *   --frames <n>      frames per conversion (default 1024)
+ *   --seconds <sec>   time spent on each case (default 1)
+ *
+ * One "key=value" line is printed per case and channel layout, e.g.
+ *   fltp->s16.stereo native_per_sec=... swr_per_sec=... speedup=...
+ * where *_per_sec is the number of conversions per second and realtime is
+ * how many 48 kHz streams one core could convert.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/platform.h>
+#include <media-io/audio-conversion.h>
+
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+
+#define SAMPLE_RATE 48000
+
+struct bench_case {
+	const char         *name;
+	enum audio_format  out_format;
+	enum AVSampleFormat out_av_format;
+	enum audio_format  in_format;
+	enum AVSampleFormat in_av_format;
+};
+
+static const struct bench_case cases[] = {
+	{"fltp->flt",  AUDIO_FORMAT_FLOAT,        AV_SAMPLE_FMT_FLT,
+	               AUDIO_FORMAT_FLOAT_PLANAR, AV_SAMPLE_FMT_FLTP},
+	{"flt->fltp",  AUDIO_FORMAT_FLOAT_PLANAR, AV_SAMPLE_FMT_FLTP,
+	               AUDIO_FORMAT_FLOAT,        AV_SAMPLE_FMT_FLT},
+	{"fltp->s16",  AUDIO_FORMAT_16BIT,        AV_SAMPLE_FMT_S16,
+	               AUDIO_FORMAT_FLOAT_PLANAR, AV_SAMPLE_FMT_FLTP},
+	{"s16->fltp",  AUDIO_FORMAT_FLOAT_PLANAR, AV_SAMPLE_FMT_FLTP,
+	               AUDIO_FORMAT_16BIT,        AV_SAMPLE_FMT_S16},
+	{"flt->s16",   AUDIO_FORMAT_16BIT,        AV_SAMPLE_FMT_S16,
+	               AUDIO_FORMAT_FLOAT,        AV_SAMPLE_FMT_FLT},
+	{"s32->fltp",  AUDIO_FORMAT_FLOAT_PLANAR, AV_SAMPLE_FMT_FLTP,
+	               AUDIO_FORMAT_32BIT,        AV_SAMPLE_FMT_S32},
+};
+
+struct bench_layout {
+	const char *name;
+	size_t     channels;
+	uint64_t   av_layout;
+};
+
+static const struct bench_layout layouts[] = {
+	{"stereo", 2, AV_CH_LAYOUT_STEREO},
+	{"5.1",    6, AV_CH_LAYOUT_5POINT1},
+};
+
+struct bench_buffers {
+	uint8_t *in[MAX_AV_PLANES];
+	uint8_t *out[MAX_AV_PLANES];
+	uint8_t *temp;
+};
+
+static void alloc_planes(uint8_t *planes[], enum audio_format format,
+		size_t channels, uint32_t frames)
+{
+	size_t size   = get_audio_bytes_per_channel(format) * frames;
+	bool   planar = is_audio_planar(format);
+
+	if (planar) {
+		for (size_t i = 0; i < channels; i++)
+			planes[i] = calloc(1, size);
+	} else {
+		planes[0] = calloc(channels, size);
+	}
+}
+
+static void free_planes(uint8_t *planes[])
+{
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		free(planes[i]);
+		planes[i] = NULL;
+	}
+}
+
+static void fill_input(uint8_t *planes[], enum audio_format format,
+		size_t channels, uint32_t frames)
+{
+	size_t planes_num = is_audio_planar(format) ? channels : 1;
+	size_t size = get_audio_size(format, SPEAKERS_MONO, frames) *
+		(is_audio_planar(format) ? 1 : channels);
+
+	for (size_t i = 0; i < planes_num; i++)
+		for (size_t j = 0; j < size; j++)
+			planes[i][j] = (uint8_t)rand();
+
+	/* keep float input in range so it doesn't measure NaN handling */
+	if (format == AUDIO_FORMAT_FLOAT || format == AUDIO_FORMAT_FLOAT_PLANAR) {
+		for (size_t i = 0; i < planes_num; i++) {
+			float *samples = (float*)planes[i];
+			for (size_t j = 0; j < size / sizeof(float); j++)
+				samples[j] = (float)(rand() % 20001 - 10000) /
+					10000.0f;
+		}
+	}
+}
+
+static double run_native(const struct bench_case *bc, size_t channels,
+		struct bench_buffers *bufs, uint32_t frames, uint64_t run_ns)
+{
+	uint64_t start = os_gettime_ns();
+	uint64_t end   = start + run_ns;
+	uint64_t count = 0;
+	uint64_t now;
+
+	do {
+		for (int i = 0; i < 64; i++)
+			audio_convert(bufs->out, bc->out_format,
+					(const uint8_t *const*)bufs->in,
+					bc->in_format, channels, frames,
+					bufs->temp);
+		count += 64;
+		now = os_gettime_ns();
+	} while (now < end);
+
+	return (double)count * 1000000000.0 / (double)(now - start);
+}
+
+static double run_swr(const struct bench_case *bc,
+		const struct bench_layout *layout,
+		struct bench_buffers *bufs, uint32_t frames, uint64_t run_ns)
+{
+	struct SwrContext *swr;
+	uint64_t start, end, now;
+	uint64_t count = 0;
+
+	swr = swr_alloc_set_opts(NULL,
+			layout->av_layout, bc->out_av_format, SAMPLE_RATE,
+			layout->av_layout, bc->in_av_format,  SAMPLE_RATE,
+			0, NULL);
+	if (!swr || swr_init(swr) != 0) {
+		fprintf(stderr, "failed to create swresample context\n");
+		swr_free(&swr);
+		return 0.0;
+	}
+
+	start = os_gettime_ns();
+	end   = start + run_ns;
+
+	do {
+		for (int i = 0; i < 64; i++)
+			swr_convert(swr, bufs->out, (int)frames,
+					(const uint8_t**)bufs->in, (int)frames);
+		count += 64;
+		now = os_gettime_ns();
+	} while (now < end);
+
+	swr_free(&swr);
+	return (double)count * 1000000000.0 / (double)(now - start);
+}
+
+static void run_case(const struct bench_case *bc,
+		const struct bench_layout *layout, uint32_t frames,
+		uint64_t run_ns)
+{
+	struct bench_buffers bufs = {0};
+	size_t temp_size;
+	double native, swr;
+	double per_sec = (double)SAMPLE_RATE / (double)frames;
+
+	alloc_planes(bufs.in,  bc->in_format,  layout->channels, frames);
+	alloc_planes(bufs.out, bc->out_format, layout->channels, frames);
+	fill_input(bufs.in, bc->in_format, layout->channels, frames);
+
+	temp_size = audio_convert_temp_size(bc->out_format, bc->in_format,
+			layout->channels, frames);
+	bufs.temp = temp_size ? malloc(temp_size) : NULL;
+
+	native = run_native(bc, layout->channels, &bufs, frames, run_ns);
+	swr    = run_swr(bc, layout, &bufs, frames, run_ns);
+
+	printf("%s.%s native_per_sec=%.0f swr_per_sec=%.0f "
+	       "native_realtime=%.0f swr_realtime=%.0f speedup=%.2f\n",
+	       bc->name, layout->name, native, swr,
+	       native / per_sec, swr / per_sec,
+	       swr > 0.0 ? native / swr : 0.0);
+
+	free_planes(bufs.in);
+	free_planes(bufs.out);
+	free(bufs.temp);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t frames  = 1024;
+	double   seconds = 1.0;
+
+	for (int i = 1; i < argc; i++) {
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(argv[i], "--frames") == 0 && val) {
+			frames = (uint32_t)strtoul(val, NULL, 10);
+			i++;
+		} else if (strcmp(argv[i], "--seconds") == 0 && val) {
+			seconds = strtod(val, NULL);
+			i++;
+		} else {
+			fprintf(stderr, "usage: %s [--frames n] "
+					"[--seconds sec]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!frames || seconds <= 0.0) {
+		fprintf(stderr, "invalid frame count or duration\n");
+		return 1;
+	}
+
+	printf("frames=%u sample_rate=%d\n", frames, SAMPLE_RATE);
+
+	for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+		for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+			run_case(&cases[c], &layouts[l], frames,
+					(uint64_t)(seconds * 1000000000.0));
+
+	return 0;
+}
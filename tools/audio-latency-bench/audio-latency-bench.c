@@ -0,0 +1,236 @@
+/*
+ * audio-latency-bench: measures how late the audio thread wakes up for
+ * each quantum and how long captured audio takes to come out of the mix,
+ * in the default and the low latency mode of the audio clock.
+ *
+ * A capture thread writes 10 ms packets stamped with the time their first
+ * sample was captured, the way audio sources do.  The end-to-end latency
+ * of a mix is the time its callback runs minus the capture time of its
+ * first sample, so it includes buffer_ms, the quantum and the wakeup
+ * lateness.  Mixes that come out silent are counted as well, to show the
+ * captured audio actually made it into the mixes that were measured.
+ *
+ * Links against libobs.  libobs is started for its profiler name store
+ * only, the audio output is opened directly with media-io.
+ *
+ * usage: audio-latency-bench [options]
+ *   --low-latency        mix in the smaller low latency quanta
+ *   --buffer-ms <ms>     audio buffering (default 100)
+ *   --seconds <sec>      run time (default 10)
+ *   --load <n>           busy threads to run alongside (default 0)
+ *
+ * One "key=value" line is printed, e.g.
+ *   mode=low_latency quantum_frames=256 mixes=... late_wakeups=...
+ *   lateness_mean_us=... lateness_max_us=... latency_mean_ms=...
+ *   latency_p50_ms=... latency_p99_ms=... latency_max_ms=...
+ *   silent_mixes=0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/audio-io.h>
+
+#define SAMPLE_RATE    48000
+#define PACKET_FRAMES  480
+#define WARMUP_NS      1000000000ULL
+
+static audio_t *audio = NULL;
+static uint64_t measure_start = 0;
+static volatile long stopping = 0;
+
+/* written by the audio thread only, read once it has stopped */
+static DARRAY(uint64_t) latencies;
+static uint64_t silent_mixes = 0;
+
+static inline uint64_t frames_to_ns(uint64_t frames)
+{
+	return frames * 1000000000ULL / SAMPLE_RATE;
+}
+
+static void receive_audio(void *param, size_t mix_idx, struct audio_data *data)
+{
+	uint64_t now = os_gettime_ns();
+
+	if (data->timestamp >= measure_start && now > data->timestamp) {
+		uint64_t latency = now - data->timestamp;
+		da_push_back(latencies, &latency);
+
+		if (*(float*)data->data[0] == 0.0f)
+			silent_mixes++;
+	}
+
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(mix_idx);
+}
+
+static void *capture_thread(void *param)
+{
+	float samples[PACKET_FRAMES];
+	audio_line_t *line = audio_output_create_line(audio, "capture", 1);
+	uint64_t start = os_gettime_ns();
+	uint64_t packets = 0;
+
+	for (size_t i = 0; i < PACKET_FRAMES; i++)
+		samples[i] = 0.25f;
+
+	while (!os_atomic_load_long(&stopping)) {
+		struct audio_data data = {
+			.data   = {(uint8_t*)samples, (uint8_t*)samples},
+			.frames = PACKET_FRAMES,
+			.volume = 1.0f
+		};
+
+		/* a packet is delivered once its last sample is captured */
+		packets++;
+		os_sleepto_ns(start + frames_to_ns(packets * PACKET_FRAMES));
+
+		data.timestamp = os_gettime_ns() - frames_to_ns(PACKET_FRAMES);
+		audio_line_output(line, &data);
+	}
+
+	audio_line_destroy(line);
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+static void *load_thread(void *param)
+{
+	volatile uint64_t counter = 0;
+
+	while (!os_atomic_load_long(&stopping))
+		counter++;
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t*)a;
+	uint64_t val_b = *(const uint64_t*)b;
+	return (val_a > val_b) - (val_a < val_b);
+}
+
+int main(int argc, char *argv[])
+{
+	struct audio_output_info info = {
+		.name            = "audio-latency-bench",
+		.samples_per_sec = SAMPLE_RATE,
+		.format          = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers        = SPEAKERS_STEREO,
+		.buffer_ms       = 100
+	};
+	struct audio_output_stats stats;
+	pthread_t capture;
+	pthread_t *load_threads;
+	int num_load = 0;
+	int seconds = 10;
+	uint64_t total = 0;
+	size_t count;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--low-latency") == 0) {
+			info.low_latency = true;
+			continue;
+		}
+
+		if (!val) {
+			fprintf(stderr, "missing value for %s\n", arg);
+			return 1;
+		}
+		i++;
+
+		if (strcmp(arg, "--buffer-ms") == 0) {
+			info.buffer_ms = (uint64_t)atoi(val);
+		} else if (strcmp(arg, "--seconds") == 0) {
+			seconds = atoi(val);
+		} else if (strcmp(arg, "--load") == 0) {
+			num_load = atoi(val);
+		} else {
+			fprintf(stderr, "unknown option %s\n", arg);
+			return 1;
+		}
+	}
+
+	if (seconds < 2 || num_load < 0) {
+		fprintf(stderr, "invalid seconds or load\n");
+		return 1;
+	}
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "obs_startup failed\n");
+		return 1;
+	}
+
+	load_threads = bzalloc(sizeof(pthread_t) * (num_load ? num_load : 1));
+	for (int i = 0; i < num_load; i++)
+		pthread_create(&load_threads[i], NULL, load_thread, NULL);
+
+	if (audio_output_open(&audio, &info) != AUDIO_OUTPUT_SUCCESS) {
+		fprintf(stderr, "audio_output_open failed\n");
+		obs_shutdown();
+		return 1;
+	}
+
+	/* leave out the first mixes, the line only has data after buffer_ms */
+	measure_start = os_gettime_ns() + WARMUP_NS + info.buffer_ms * 1000000;
+
+	da_reserve(latencies, (size_t)seconds * SAMPLE_RATE / 256);
+	audio_output_connect(audio, 0, NULL, receive_audio, NULL);
+	pthread_create(&capture, NULL, capture_thread, NULL);
+
+	os_sleep_ms((uint32_t)seconds * 1000);
+	os_atomic_set_long(&stopping, 1);
+
+	pthread_join(capture, NULL);
+	for (int i = 0; i < num_load; i++)
+		pthread_join(load_threads[i], NULL);
+
+	audio_output_get_stats(audio, &stats);
+	audio_output_disconnect(audio, 0, receive_audio, NULL);
+	audio_output_close(audio);
+	obs_shutdown();
+
+	count = latencies.num;
+	if (!count) {
+		fprintf(stderr, "no mixes were measured\n");
+		da_free(latencies);
+		bfree(load_threads);
+		return 1;
+	}
+
+	qsort(latencies.array, count, sizeof(uint64_t), compare_u64);
+	for (size_t i = 0; i < count; i++)
+		total += latencies.array[i];
+
+	printf("mode=%s quantum_frames=%u mixes=%llu late_wakeups=%llu "
+	       "lateness_mean_us=%.1f lateness_max_us=%.1f "
+	       "latency_mean_ms=%.2f latency_p50_ms=%.2f "
+	       "latency_p99_ms=%.2f latency_max_ms=%.2f silent_mixes=%llu\n",
+			info.low_latency ? "low_latency" : "default",
+			stats.quantum_frames,
+			(unsigned long long)stats.mixes,
+			(unsigned long long)stats.late_wakeups,
+			stats.mixes ? (double)stats.total_lateness_ns /
+				(double)stats.mixes / 1000.0 : 0.0,
+			(double)stats.max_lateness_ns / 1000.0,
+			(double)total / (double)count / 1000000.0,
+			(double)latencies.array[count / 2] / 1000000.0,
+			(double)latencies.array[count * 99 / 100] / 1000000.0,
+			(double)latencies.array[count - 1] / 1000000.0,
+			(unsigned long long)silent_mixes);
+
+	da_free(latencies);
+	bfree(load_threads);
+	return silent_mixes ? 1 : 0;
+}
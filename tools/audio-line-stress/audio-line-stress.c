@@ -0,0 +1,261 @@
+/*
+ * audio-line-stress: many capture threads writing into the lock-free input
+ * rings of a live audio output at once, each with its own line and packet
+ * size, while other threads keep creating and destroying lines.  Checks
+ * that the mixed output is sample-exact and that nothing was dropped.
+ *
+ * Every producer writes 1.0 with a volume of 0.5 / lines, so each mixed
+ * sample in the checked window must be 0.5.  The short-lived lines write
+ * silence, they only exercise line creation and destruction while the
+ * audio thread is mixing.
+ *
+ * Links against libobs.  libobs is started for its profiler name store
+ * only, the audio output is opened directly with media-io.  Build libobs
+ * with -fsanitize=thread to check the rings for races as well.
+ *
+ * usage: audio-line-stress [options]
+ *   --lines <n>       producer threads, one line each (default 8)
+ *   --churn <n>       threads creating and destroying lines (default 2)
+ *   --seconds <sec>   run time (default 3)
+ *   --low-latency     mix in the smaller low latency quanta
+ *
+ * One "key=value" line is printed, e.g.
+ *   lines=8 churn=2 mixes=... checked_frames=... bad_frames=0 dropped=0
+ *   churned_lines=...
+ * and the exit code is 0 only when every checked frame was exact and no
+ * packet was dropped.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/audio-io.h>
+
+#define SAMPLE_RATE 48000
+#define MAX_LINES   32
+#define MAX_CHURN   8
+
+/* frames written per packet, different for every producer so packets
+ * straddle the mix boundaries differently */
+static const uint32_t packet_frames[] = {
+	480, 441, 1024, 256, 960, 128, 2048, 333
+};
+
+static audio_t *audio = NULL;
+static uint64_t start_ts = 0;
+static uint64_t check_start = 0;
+static uint64_t check_end = 0;
+static int num_lines = 8;
+static volatile long stopping = 0;
+
+static uint64_t mixes = 0;
+static uint64_t checked_frames = 0;
+static uint64_t bad_frames = 0;
+static volatile long churned_lines = 0;
+
+static inline uint64_t frames_to_ns(uint64_t frames)
+{
+	return frames * 1000000000ULL / SAMPLE_RATE;
+}
+
+/* called on the audio thread only */
+static void receive_audio(void *param, size_t mix_idx, struct audio_data *data)
+{
+	mixes++;
+
+	if (data->timestamp < check_start || data->timestamp >= check_end)
+		return;
+
+	for (size_t plane = 0; plane < 2; plane++) {
+		float *samples = (float*)data->data[plane];
+
+		for (uint32_t i = 0; i < data->frames; i++) {
+			if (fabsf(samples[i] - 0.5f) > 1e-4f)
+				bad_frames++;
+		}
+	}
+
+	checked_frames += data->frames;
+
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(mix_idx);
+}
+
+static void *producer_thread(void *param)
+{
+	int idx = (int)(intptr_t)param;
+	uint32_t frames = packet_frames[idx % (sizeof(packet_frames) /
+			sizeof(packet_frames[0]))];
+	float *samples = bmalloc(frames * sizeof(float));
+	audio_line_t *line;
+	uint64_t written = 0;
+	char name[32];
+
+	for (uint32_t i = 0; i < frames; i++)
+		samples[i] = 1.0f;
+
+	snprintf(name, sizeof(name), "producer %d", idx);
+	line = audio_output_create_line(audio, name, 1);
+
+	while (!os_atomic_load_long(&stopping)) {
+		struct audio_data data = {
+			.data      = {(uint8_t*)samples, (uint8_t*)samples},
+			.frames    = frames,
+			.timestamp = start_ts + frames_to_ns(written),
+			.volume    = 0.5f / (float)num_lines
+		};
+
+		audio_line_output(line, &data);
+		written += frames;
+
+		os_sleepto_ns(start_ts + frames_to_ns(written));
+	}
+
+	audio_line_destroy(line);
+	bfree(samples);
+	return NULL;
+}
+
+/* lines that write a few packets of silence and go away again */
+static void *churn_thread(void *param)
+{
+	float samples[256] = {0};
+	char name[32];
+	int idx = (int)(intptr_t)param;
+	uint32_t seed = (uint32_t)idx + 1;
+
+	snprintf(name, sizeof(name), "churn %d", idx);
+
+	while (!os_atomic_load_long(&stopping)) {
+		audio_line_t *line = audio_output_create_line(audio, name, 1);
+		uint64_t ts = os_gettime_ns();
+		int packets;
+
+		seed = seed * 1103515245 + 12345;
+		packets = 1 + (int)((seed >> 16) % 8);
+
+		for (int i = 0; i < packets; i++) {
+			struct audio_data data = {
+				.data      = {(uint8_t*)samples,
+				              (uint8_t*)samples},
+				.frames    = 256,
+				.timestamp = ts + frames_to_ns(256 * i),
+				.volume    = 1.0f
+			};
+
+			audio_line_output(line, &data);
+		}
+
+		audio_line_destroy(line);
+		os_atomic_inc_long(&churned_lines);
+		os_sleep_ms(1 + (seed >> 20) % 10);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct audio_output_info info = {
+		.name            = "audio-line-stress",
+		.samples_per_sec = SAMPLE_RATE,
+		.format          = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers        = SPEAKERS_STEREO,
+		.buffer_ms       = 100
+	};
+	struct audio_output_stats stats;
+	pthread_t producers[MAX_LINES];
+	pthread_t churners[MAX_CHURN];
+	int num_churn = 2;
+	int seconds = 3;
+	bool success;
+
+	for (int i = 1; i < argc; i++) {
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(argv[i], "--lines") == 0 && val) {
+			num_lines = atoi(val);
+			i++;
+		} else if (strcmp(argv[i], "--churn") == 0 && val) {
+			num_churn = atoi(val);
+			i++;
+		} else if (strcmp(argv[i], "--seconds") == 0 && val) {
+			seconds = atoi(val);
+			i++;
+		} else if (strcmp(argv[i], "--low-latency") == 0) {
+			info.low_latency = true;
+		} else {
+			fprintf(stderr, "usage: %s [--lines n] [--churn n] "
+					"[--seconds sec] [--low-latency]\n",
+					argv[0]);
+			return 1;
+		}
+	}
+
+	if (num_lines < 1 || num_lines > MAX_LINES ||
+	    num_churn < 0 || num_churn > MAX_CHURN || seconds < 2) {
+		fprintf(stderr, "lines must be 1-%d, churn 0-%d and seconds "
+				"at least 2\n", MAX_LINES, MAX_CHURN);
+		return 1;
+	}
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "obs_startup failed\n");
+		return 1;
+	}
+
+	if (audio_output_open(&audio, &info) != AUDIO_OUTPUT_SUCCESS) {
+		fprintf(stderr, "audio_output_open failed\n");
+		obs_shutdown();
+		return 1;
+	}
+
+	/* leave out the start, where lines are still being created, and the
+	 * end, where they're being destroyed */
+	start_ts    = os_gettime_ns();
+	check_start = start_ts + 400000000ULL;
+	check_end   = start_ts + (uint64_t)seconds * 1000000000ULL -
+		500000000ULL;
+
+	audio_output_connect(audio, 0, NULL, receive_audio, NULL);
+
+	for (int i = 0; i < num_lines; i++)
+		pthread_create(&producers[i], NULL, producer_thread,
+				(void*)(intptr_t)i);
+	for (int i = 0; i < num_churn; i++)
+		pthread_create(&churners[i], NULL, churn_thread,
+				(void*)(intptr_t)i);
+
+	os_sleepto_ns(start_ts + (uint64_t)seconds * 1000000000ULL);
+	os_atomic_set_long(&stopping, 1);
+
+	for (int i = 0; i < num_lines; i++)
+		pthread_join(producers[i], NULL);
+	for (int i = 0; i < num_churn; i++)
+		pthread_join(churners[i], NULL);
+
+	/* let the audio thread free the destroyed lines */
+	os_sleep_ms(500);
+
+	audio_output_get_stats(audio, &stats);
+	audio_output_disconnect(audio, 0, receive_audio, NULL);
+	audio_output_close(audio);
+	obs_shutdown();
+
+	printf("lines=%d churn=%d mixes=%llu checked_frames=%llu "
+			"bad_frames=%llu dropped=%llu churned_lines=%ld\n",
+			num_lines, num_churn,
+			(unsigned long long)mixes,
+			(unsigned long long)checked_frames,
+			(unsigned long long)bad_frames,
+			(unsigned long long)stats.dropped_packets,
+			churned_lines);
+
+	success = checked_frames && !bad_frames && !stats.dropped_packets;
+	return success ? 0 : 1;
+}
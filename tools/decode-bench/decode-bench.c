@@ -0,0 +1,287 @@
+/*
+ * decode-bench: measures how fast sample files decode with the threading the
+ * media source (libff find_decoder()) can use, with and without converting
+ * the frames to BGRA the way libff does for formats libobs can't take.
+ *
+ * Decoding runs as fast as possible, not paced to the file's frame rate.
+ *
+ * Built from libobs/util (platform.c and the platform-* file for the OS,
+ * bmem.c, dstr.c, utf8.c) and linked against libavformat, libavcodec,
+ * libswscale and libavutil.
+ *
+ * usage: decode-bench [options] <files...>
+ *   --frames <n>        frames decoded per case (default 600, 0 = all)
+ *   --threads <n>       decoder threads for the threaded cases
+ *                       (default 0 = automatic)
+ *
+ * Four cases are run per file: "single" is the one thread the stream's codec
+ * context used to default to, "slice", "frame" and "frame+slice" are the
+ * thread types libff can be set to.  One "key=value" line is printed per
+ * file and case, e.g.
+ *   file=4k.mp4 res=3840x2160 pix_fmt=yuv420p mode=frame+slice frames=600
+ *   decode_fps=... convert_fps=...
+ * where decode_fps only decodes and convert_fps also converts every frame
+ * to BGRA on the decoding thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/platform.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
+
+struct bench_mode {
+	const char *name;
+	int        thread_type;
+	bool       single;
+};
+
+static const struct bench_mode modes[] = {
+	{"single",      0,                                 true},
+	{"slice",       FF_THREAD_SLICE,                   false},
+	{"frame",       FF_THREAD_FRAME,                   false},
+	{"frame+slice", FF_THREAD_FRAME | FF_THREAD_SLICE, false},
+};
+
+/* the formats obs-ffmpeg-source hands to libobs without conversion */
+static bool is_passthrough(enum AVPixelFormat format)
+{
+	switch (format) {
+	case AV_PIX_FMT_YUV420P:
+	case AV_PIX_FMT_NV12:
+	case AV_PIX_FMT_YUYV422:
+	case AV_PIX_FMT_UYVY422:
+	case AV_PIX_FMT_RGBA:
+	case AV_PIX_FMT_BGRA:
+		return true;
+	default:
+		return false;
+	}
+}
+
+struct bench_state {
+	AVFormatContext     *format;
+	AVCodecContext      *codec;
+	int                 stream_idx;
+
+	bool                convert;
+	struct SwsContext   *sws;
+	uint8_t             *bgra[4];
+	int                 bgra_linesize[4];
+};
+
+static bool open_decoder(struct bench_state *bs, const char *file,
+		const struct bench_mode *mode, int threads)
+{
+	AVCodec *decoder;
+	int ret;
+
+	ret = avformat_open_input(&bs->format, file, NULL, NULL);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", file, av_err2str(ret));
+		return false;
+	}
+
+	if (avformat_find_stream_info(bs->format, NULL) < 0)
+		return false;
+
+	bs->stream_idx = av_find_best_stream(bs->format, AVMEDIA_TYPE_VIDEO,
+			-1, -1, &decoder, 0);
+	if (bs->stream_idx < 0) {
+		fprintf(stderr, "%s: no video stream\n", file);
+		return false;
+	}
+
+	bs->codec = avcodec_alloc_context3(decoder);
+	avcodec_copy_context(bs->codec,
+			bs->format->streams[bs->stream_idx]->codec);
+
+	bs->codec->refcounted_frames = 1;
+	bs->codec->thread_count      = mode->single ? 1 : threads;
+	bs->codec->thread_type       = mode->single ?
+		FF_THREAD_FRAME : mode->thread_type;
+
+	ret = avcodec_open2(bs->codec, decoder, NULL);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", file, av_err2str(ret));
+		return false;
+	}
+
+	return true;
+}
+
+static void close_decoder(struct bench_state *bs)
+{
+	if (bs->codec) {
+		avcodec_close(bs->codec);
+		avcodec_free_context(&bs->codec);
+	}
+
+	avformat_close_input(&bs->format);
+	sws_freeContext(bs->sws);
+	av_freep(&bs->bgra[0]);
+	memset(bs, 0, sizeof(*bs));
+}
+
+static void convert_frame(struct bench_state *bs, AVFrame *frame)
+{
+	if (!bs->sws) {
+		bs->sws = sws_getContext(frame->width, frame->height,
+				frame->format, frame->width, frame->height,
+				AV_PIX_FMT_BGRA, SWS_BILINEAR, NULL, NULL, NULL);
+		av_image_alloc(bs->bgra, bs->bgra_linesize, frame->width,
+				frame->height, AV_PIX_FMT_BGRA, 32);
+	}
+
+	sws_scale(bs->sws, (const uint8_t *const *)frame->data,
+			frame->linesize, 0, frame->height,
+			bs->bgra, bs->bgra_linesize);
+}
+
+static bool decode_packet(struct bench_state *bs, AVPacket *packet,
+		AVFrame *frame, int *decoded)
+{
+	int got_frame = 0;
+	int ret = avcodec_decode_video2(bs->codec, frame, &got_frame, packet);
+
+	if (ret < 0)
+		return false;
+
+	if (got_frame) {
+		if (bs->convert)
+			convert_frame(bs, frame);
+
+		(*decoded)++;
+		av_frame_unref(frame);
+	}
+
+	return true;
+}
+
+/* returns the frames per second, or a negative value on failure */
+static double run_case(const char *file, const struct bench_mode *mode,
+		int threads, bool convert, int max_frames)
+{
+	struct bench_state bs = {0};
+	AVFrame *frame = av_frame_alloc();
+	AVPacket packet;
+	uint64_t start, elapsed;
+	int decoded = 0;
+
+	bs.convert = convert;
+
+	if (!open_decoder(&bs, file, mode, threads)) {
+		close_decoder(&bs);
+		av_frame_free(&frame);
+		return -1.0;
+	}
+
+	start = os_gettime_ns();
+
+	while ((!max_frames || decoded < max_frames) &&
+	       av_read_frame(bs.format, &packet) >= 0) {
+		bool success = true;
+
+		if (packet.stream_index == bs.stream_idx)
+			success = decode_packet(&bs, &packet, frame, &decoded);
+
+		av_packet_unref(&packet);
+		if (!success)
+			break;
+	}
+
+	/* drain the frames held by frame threading */
+	av_init_packet(&packet);
+	packet.data = NULL;
+	packet.size = 0;
+	while (!max_frames || decoded < max_frames) {
+		int before = decoded;
+		if (!decode_packet(&bs, &packet, frame, &decoded) ||
+		    decoded == before)
+			break;
+	}
+
+	elapsed = os_gettime_ns() - start;
+
+	close_decoder(&bs);
+	av_frame_free(&frame);
+
+	return elapsed ? (double)decoded * 1000000000.0 / (double)elapsed :
+		0.0;
+}
+
+static void bench_file(const char *file, int threads, int max_frames)
+{
+	struct bench_state bs = {0};
+	enum AVPixelFormat pix_fmt;
+	int width, height;
+
+	if (!open_decoder(&bs, file, &modes[0], 1)) {
+		close_decoder(&bs);
+		return;
+	}
+
+	width   = bs.codec->width;
+	height  = bs.codec->height;
+	pix_fmt = bs.codec->pix_fmt;
+	close_decoder(&bs);
+
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		double decode_fps = run_case(file, &modes[i], threads, false,
+				max_frames);
+		double convert_fps = run_case(file, &modes[i], threads,
+				!is_passthrough(pix_fmt), max_frames);
+
+		if (decode_fps < 0.0 || convert_fps < 0.0)
+			return;
+
+		printf("file=%s res=%dx%d pix_fmt=%s mode=%s frames=%d "
+		       "decode_fps=%.1f convert_fps=%.1f\n",
+				file, width, height,
+				av_get_pix_fmt_name(pix_fmt),
+				modes[i].name, max_frames,
+				decode_fps, convert_fps);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int max_frames = 600;
+	int threads = 0;
+	int first_file = 1;
+
+	while (first_file + 1 < argc && strncmp(argv[first_file], "--", 2) == 0) {
+		const char *opt = argv[first_file];
+		const char *val = argv[first_file + 1];
+
+		if (strcmp(opt, "--frames") == 0) {
+			max_frames = atoi(val);
+		} else if (strcmp(opt, "--threads") == 0) {
+			threads = atoi(val);
+		} else {
+			fprintf(stderr, "unknown option %s\n", opt);
+			return 1;
+		}
+
+		first_file += 2;
+	}
+
+	if (first_file >= argc || max_frames < 0 || threads < 0) {
+		fprintf(stderr, "usage: %s [--frames n] [--threads n] "
+				"<files...>\n", argv[0]);
+		return 1;
+	}
+
+	av_register_all();
+	av_log_set_level(AV_LOG_ERROR);
+
+	for (int i = first_file; i < argc; i++)
+		bench_file(argv[i], threads, max_frames);
+
+	return 0;
+}
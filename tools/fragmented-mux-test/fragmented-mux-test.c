@@ -0,0 +1,508 @@
+/*
+ * fragmented-mux-test: checks that a fragmented MP4/MOV recording survives
+ * ffmpeg-mux being killed.  The video and first audio track of a sample
+ * file are fed to ffmpeg-mux --fragmented the way obs-ffmpeg-mux does, the
+ * process is killed without warning once N keyframes have been closed off,
+ * and the partial file is then read back with libavformat (and ffprobe when
+ * given).
+ *
+ * Built from libobs/util (platform.c and the platform-* file for the OS,
+ * bmem.c, dstr.c, utf8.c) and linked against libavformat, libavcodec and
+ * libavutil.  The sample should hold H.264 video, and optionally AAC audio,
+ * such as a recording made with obs_x264.
+ *
+ * usage: fragmented-mux-test [options] <ffmpeg-mux> <sample> <output>
+ *   --keyframes <n>      complete GOPs to write before the kill (default 3)
+ *   --settle-ms <ms>     time given to ffmpeg-mux to write the last
+ *                        fragment before it is killed (default 500)
+ *   --ffprobe <path>     also require ffprobe to read the file cleanly
+ *
+ * The output's extension picks the container (.mp4 or .mov).  One
+ * "key=value" line is printed, e.g.
+ *   result=pass keyframes_sent=4 frames_expected=180 frames_read=180
+ *   keyframes_read=3 audio_packets_read=259
+ * and the exit code is 0 only when every frame of the first N GOPs could
+ * be read back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+
+#include "../../plugins/obs-ffmpeg/ffmpeg-mux/ffmpeg-mux.h"
+
+struct test_config {
+	const char *mux_path;
+	const char *sample_path;
+	const char *output_path;
+	const char *ffprobe_path;
+	int        keyframes;
+	uint32_t   settle_ms;
+};
+
+/* ------------------------------------------------------------------------- */
+/* ffmpeg-mux process with its stdin as a pipe */
+
+struct mux_process {
+#ifdef _WIN32
+	HANDLE process;
+	HANDLE write_pipe;
+#else
+	pid_t  pid;
+	int    write_fd;
+#endif
+};
+
+#ifdef _WIN32
+static bool mux_start(struct mux_process *mp, const char *cmd_line)
+{
+	SECURITY_ATTRIBUTES sa = {sizeof(sa), NULL, true};
+	STARTUPINFOA si = {0};
+	PROCESS_INFORMATION pi = {0};
+	HANDLE read_pipe;
+	char *cmd = bstrdup(cmd_line);
+	bool success;
+
+	if (!CreatePipe(&read_pipe, &mp->write_pipe, &sa, 0)) {
+		bfree(cmd);
+		return false;
+	}
+
+	SetHandleInformation(mp->write_pipe, HANDLE_FLAG_INHERIT, 0);
+
+	si.cb         = sizeof(si);
+	si.dwFlags    = STARTF_USESTDHANDLES;
+	si.hStdInput  = read_pipe;
+	si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+	si.hStdError  = GetStdHandle(STD_ERROR_HANDLE);
+
+	success = !!CreateProcessA(NULL, cmd, NULL, NULL, true, 0, NULL, NULL,
+			&si, &pi);
+	CloseHandle(read_pipe);
+	bfree(cmd);
+
+	if (!success) {
+		CloseHandle(mp->write_pipe);
+		return false;
+	}
+
+	CloseHandle(pi.hThread);
+	mp->process = pi.hProcess;
+	return true;
+}
+
+static bool mux_write(struct mux_process *mp, const void *data, size_t size)
+{
+	DWORD written;
+	return WriteFile(mp->write_pipe, data, (DWORD)size, &written, NULL) &&
+		written == (DWORD)size;
+}
+
+static void mux_kill(struct mux_process *mp)
+{
+	TerminateProcess(mp->process, 1);
+	WaitForSingleObject(mp->process, INFINITE);
+	CloseHandle(mp->process);
+	CloseHandle(mp->write_pipe);
+}
+
+#else
+
+static bool mux_start(struct mux_process *mp, const char *cmd_line)
+{
+	int fds[2];
+
+	if (pipe(fds) != 0)
+		return false;
+
+	mp->pid = fork();
+	if (mp->pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	if (mp->pid == 0) {
+		dup2(fds[0], STDIN_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl("/bin/sh", "sh", "-c", cmd_line, (char*)NULL);
+		_exit(127);
+	}
+
+	close(fds[0]);
+	mp->write_fd = fds[1];
+	signal(SIGPIPE, SIG_IGN);
+	return true;
+}
+
+static bool mux_write(struct mux_process *mp, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+
+	while (size) {
+		ssize_t written = write(mp->write_fd, bytes, size);
+		if (written <= 0)
+			return false;
+
+		bytes += written;
+		size  -= (size_t)written;
+	}
+
+	return true;
+}
+
+static void mux_kill(struct mux_process *mp)
+{
+	/* the command line starts with "exec", so this is ffmpeg-mux itself */
+	kill(mp->pid, SIGKILL);
+	waitpid(mp->pid, NULL, 0);
+	close(mp->write_fd);
+}
+#endif
+
+static bool mux_send(struct mux_process *mp, struct ffm_packet_info *info,
+		const uint8_t *data)
+{
+	return mux_write(mp, info, sizeof(*info)) &&
+		mux_write(mp, data, info->size);
+}
+
+/* ------------------------------------------------------------------------- */
+/* feeding the sample */
+
+struct sample {
+	AVFormatContext *format;
+	AVStream        *video;
+	AVStream        *audio;
+	AVRational      fps;
+};
+
+static bool open_sample(struct sample *s, const char *path)
+{
+	int video_idx, audio_idx;
+
+	if (avformat_open_input(&s->format, path, NULL, NULL) < 0 ||
+	    avformat_find_stream_info(s->format, NULL) < 0) {
+		fprintf(stderr, "Could not open sample '%s'\n", path);
+		return false;
+	}
+
+	video_idx = av_find_best_stream(s->format, AVMEDIA_TYPE_VIDEO, -1, -1,
+			NULL, 0);
+	audio_idx = av_find_best_stream(s->format, AVMEDIA_TYPE_AUDIO, -1, -1,
+			NULL, 0);
+
+	if (video_idx < 0 ||
+	    s->format->streams[video_idx]->codec->codec_id != AV_CODEC_ID_H264) {
+		fprintf(stderr, "The sample needs an H.264 video stream\n");
+		return false;
+	}
+
+	s->video = s->format->streams[video_idx];
+	if (audio_idx >= 0 &&
+	    s->format->streams[audio_idx]->codec->codec_id == AV_CODEC_ID_AAC)
+		s->audio = s->format->streams[audio_idx];
+
+	s->fps = s->video->avg_frame_rate;
+	if (!s->fps.num || !s->fps.den)
+		s->fps = s->video->r_frame_rate;
+	if (!s->fps.num || !s->fps.den)
+		s->fps = (AVRational){30, 1};
+
+	return true;
+}
+
+/* the same arguments obs-ffmpeg-mux passes */
+static void build_command_line(struct dstr *cmd, const struct test_config *cfg,
+		const struct sample *s)
+{
+	AVCodecContext *video = s->video->codec;
+
+#ifndef _WIN32
+	dstr_copy(cmd, "exec ");
+#endif
+	dstr_catf(cmd, "\"%s\" \"%s\" 1 %d h264 %d %d %d %d %d ",
+			cfg->mux_path, cfg->output_path, s->audio ? 1 : 0,
+			(int)(video->bit_rate / 1000), video->width,
+			video->height, s->fps.num, s->fps.den);
+
+	if (s->audio) {
+		AVCodecContext *audio = s->audio->codec;
+
+		dstr_catf(cmd, "aac \"track1\" %d %d %d ",
+				(int)(audio->bit_rate / 1000),
+				audio->sample_rate, audio->channels);
+	}
+
+	dstr_cat(cmd, "--fragmented");
+}
+
+static bool send_headers(struct mux_process *mp, const struct sample *s)
+{
+	struct ffm_packet_info info = {0};
+	AVCodecContext *video = s->video->codec;
+
+	info.type = FFM_PACKET_VIDEO;
+	info.size = (uint32_t)video->extradata_size;
+	if (!mux_send(mp, &info, video->extradata))
+		return false;
+
+	if (s->audio) {
+		AVCodecContext *audio = s->audio->codec;
+
+		info.type = FFM_PACKET_AUDIO;
+		info.size = (uint32_t)audio->extradata_size;
+		if (!mux_send(mp, &info, audio->extradata))
+			return false;
+	}
+
+	return true;
+}
+
+/* timestamps go out in encoder time bases: video in frames times fps_den
+ * (libobs steps pts by the time base numerator), audio in samples */
+static int64_t to_encoder_ts(const struct sample *s, AVStream *stream,
+		int64_t ts)
+{
+	if (stream == s->video) {
+		AVRational tb = {s->fps.den, s->fps.num};
+		return av_rescale_q(ts, stream->time_base, tb) * s->fps.den;
+	}
+
+	return av_rescale_q(ts, stream->time_base,
+			(AVRational){1, stream->codec->sample_rate});
+}
+
+struct feed_result {
+	int keyframes_sent;
+	int frames_expected;
+};
+
+/* sends packets until the keyframe that closes GOP number cfg->keyframes */
+static bool feed_packets(struct mux_process *mp, const struct sample *s,
+		const struct test_config *cfg, struct feed_result *result)
+{
+	AVPacket packet;
+	int frames = 0;
+
+	while (av_read_frame(s->format, &packet) >= 0) {
+		AVStream *stream = s->format->streams[packet.stream_index];
+		struct ffm_packet_info info = {0};
+		bool keyframe = (packet.flags & AV_PKT_FLAG_KEY) != 0;
+		bool success;
+
+		if (stream != s->video && stream != s->audio) {
+			av_packet_unref(&packet);
+			continue;
+		}
+
+		if (stream == s->video && keyframe) {
+			if (result->keyframes_sent == cfg->keyframes)
+				result->frames_expected = frames;
+			result->keyframes_sent++;
+		}
+
+		info.type     = stream == s->video ?
+			FFM_PACKET_VIDEO : FFM_PACKET_AUDIO;
+		info.keyframe = keyframe;
+		info.size     = (uint32_t)packet.size;
+		info.pts      = to_encoder_ts(s, stream, packet.pts);
+		info.dts      = to_encoder_ts(s, stream, packet.dts);
+
+		success = mux_send(mp, &info, packet.data);
+		av_packet_unref(&packet);
+
+		if (!success) {
+			fprintf(stderr, "ffmpeg-mux stopped reading\n");
+			return false;
+		}
+
+		if (result->keyframes_sent > cfg->keyframes)
+			return true;
+
+		if (stream == s->video)
+			frames++;
+	}
+
+	fprintf(stderr, "The sample has fewer than %d keyframes\n",
+			cfg->keyframes + 1);
+	return false;
+}
+
+/* ------------------------------------------------------------------------- */
+/* validating the partial file */
+
+struct read_result {
+	int frames;
+	int keyframes;
+	int audio_packets;
+};
+
+static bool read_output(const char *path, struct read_result *result)
+{
+	AVFormatContext *format = NULL;
+	AVPacket packet;
+	int video_idx;
+	int ret;
+
+	if (avformat_open_input(&format, path, NULL, NULL) < 0 ||
+	    avformat_find_stream_info(format, NULL) < 0) {
+		fprintf(stderr, "libavformat could not open '%s'\n", path);
+		avformat_close_input(&format);
+		return false;
+	}
+
+	video_idx = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1,
+			NULL, 0);
+
+	while ((ret = av_read_frame(format, &packet)) >= 0) {
+		if (packet.stream_index == video_idx) {
+			result->frames++;
+			if (packet.flags & AV_PKT_FLAG_KEY)
+				result->keyframes++;
+		} else {
+			result->audio_packets++;
+		}
+
+		av_packet_unref(&packet);
+	}
+
+	avformat_close_input(&format);
+
+	if (ret != AVERROR_EOF) {
+		fprintf(stderr, "Reading '%s' failed: %s\n", path,
+				av_err2str(ret));
+		return false;
+	}
+
+	return true;
+}
+
+static bool run_ffprobe(const char *ffprobe, const char *path)
+{
+	struct dstr cmd = {0};
+	int ret;
+
+	dstr_printf(&cmd, "\"%s\" -v error -show_format -show_streams "
+			"\"%s\"", ffprobe, path);
+#ifdef _WIN32
+	/* cmd.exe strips the outer quotes of the whole line */
+	dstr_insert_ch(&cmd, 0, '"');
+	dstr_cat_ch(&cmd, '"');
+#endif
+
+	ret = system(cmd.array);
+	dstr_free(&cmd);
+
+	if (ret != 0)
+		fprintf(stderr, "ffprobe failed on '%s': %d\n", path, ret);
+	return ret == 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool parse_args(int argc, char *argv[], struct test_config *cfg)
+{
+	int i = 1;
+
+	cfg->keyframes = 3;
+	cfg->settle_ms = 500;
+
+	for (; i + 1 < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+		const char *opt = argv[i];
+		const char *val = argv[i + 1];
+
+		if (strcmp(opt, "--keyframes") == 0) {
+			cfg->keyframes = atoi(val);
+		} else if (strcmp(opt, "--settle-ms") == 0) {
+			cfg->settle_ms = (uint32_t)atoi(val);
+		} else if (strcmp(opt, "--ffprobe") == 0) {
+			cfg->ffprobe_path = val;
+		} else {
+			fprintf(stderr, "unknown option %s\n", opt);
+			return false;
+		}
+	}
+
+	if (argc - i != 3 || cfg->keyframes < 1)
+		return false;
+
+	cfg->mux_path    = argv[i];
+	cfg->sample_path = argv[i + 1];
+	cfg->output_path = argv[i + 2];
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	struct test_config cfg = {0};
+	struct sample sample = {0};
+	struct mux_process mp = {0};
+	struct feed_result fed = {0};
+	struct read_result readback = {0};
+	struct dstr cmd = {0};
+	bool pass = false;
+
+	if (!parse_args(argc, argv, &cfg)) {
+		fprintf(stderr, "usage: %s [--keyframes n] [--settle-ms ms] "
+				"[--ffprobe path] <ffmpeg-mux> <sample> "
+				"<output>\n", argv[0]);
+		return 1;
+	}
+
+	av_register_all();
+	av_log_set_level(AV_LOG_ERROR);
+
+	if (!open_sample(&sample, cfg.sample_path))
+		goto done;
+
+	os_unlink(cfg.output_path);
+	build_command_line(&cmd, &cfg, &sample);
+
+	if (!mux_start(&mp, cmd.array)) {
+		fprintf(stderr, "Could not start '%s'\n", cfg.mux_path);
+		goto done;
+	}
+
+	pass = send_headers(&mp, &sample) &&
+		feed_packets(&mp, &sample, &cfg, &fed);
+
+	/* the last keyframe sent closes the fragment before it, give the
+	 * muxer time to flush that one and then pull the plug */
+	os_sleep_ms(cfg.settle_ms);
+	mux_kill(&mp);
+
+	if (pass)
+		pass = read_output(cfg.output_path, &readback) &&
+			readback.frames >= fed.frames_expected &&
+			readback.keyframes >= cfg.keyframes;
+	if (pass && cfg.ffprobe_path)
+		pass = run_ffprobe(cfg.ffprobe_path, cfg.output_path);
+
+	printf("result=%s keyframes_sent=%d frames_expected=%d "
+	       "frames_read=%d keyframes_read=%d audio_packets_read=%d\n",
+			pass ? "pass" : "fail", fed.keyframes_sent,
+			fed.frames_expected, readback.frames,
+			readback.keyframes, readback.audio_packets);
+
+done:
+	avformat_close_input(&sample.format);
+	dstr_free(&cmd);
+	return pass ? 0 : 1;
+}
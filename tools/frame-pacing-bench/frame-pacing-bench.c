@@ -0,0 +1,208 @@
+/*
+ * frame-pacing-bench: measures how late a thread pacing itself to frame
+ * deadlines with os_sleepto_ns() wakes up, the way the libobs graphics and
+ * video-io threads do.
+ *
+ * Built from libobs/util (platform.c, platform-nix.c, threading-posix.c,
+ * bmem.c, dstr.c, utf8.c).
+ *
+ * usage: frame-pacing-bench [options]
+ *   --fps <n>           frame rate to pace to (default 60)
+ *   --seconds <sec>     run time (default 10)
+ *   --sleep abs|rel     abs uses os_sleepto_ns, rel the relative nanosleep
+ *                       loop it used to be (default abs)
+ *   --policy <p>        default, nice, fifo or rr (default default)
+ *   --priority <n>      nice value or real-time priority
+ *   --slack <ns>        timer slack of the pacing thread
+ *   --cpus <list>       comma separated cpus to pin the pacing thread to
+ *   --load <n>          busy threads to run alongside (default 0)
+ *
+ * One "key=value" line is printed, e.g.
+ *   sleep=abs policy=fifo frames=600 mean_us=... p50_us=... p99_us=...
+ *   max_us=... over_1ms=...
+ * where the values are how long after each deadline the thread woke up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+static volatile long stop_load = 0;
+
+static void *load_thread(void *param)
+{
+	volatile uint64_t counter = 0;
+
+	while (!os_atomic_load_long(&stop_load))
+		counter++;
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+/* what os_sleepto_ns did before it slept to an absolute deadline */
+static bool sleepto_relative(uint64_t time_target)
+{
+	uint64_t current = os_gettime_ns();
+	struct timespec req, remain;
+
+	if (time_target < current)
+		return false;
+
+	time_target -= current;
+	req.tv_sec  = (time_t)(time_target / 1000000000);
+	req.tv_nsec = (long)(time_target % 1000000000);
+
+	while (nanosleep(&req, &remain))
+		req = remain;
+
+	return true;
+}
+
+static enum os_sched_policy get_policy(const char *name)
+{
+	if (strcmp(name, "nice") == 0)
+		return OS_SCHED_NICE;
+	else if (strcmp(name, "fifo") == 0)
+		return OS_SCHED_FIFO;
+	else if (strcmp(name, "rr") == 0)
+		return OS_SCHED_RR;
+	return OS_SCHED_DEFAULT;
+}
+
+static uint64_t get_cpu_mask(const char *cpus)
+{
+	uint64_t mask = 0;
+
+	while (*cpus) {
+		char *end;
+		long num = strtol(cpus, &end, 10);
+
+		if (end == cpus)
+			break;
+		if (num >= 0 && num < 64)
+			mask |= 1ULL << num;
+
+		cpus = (*end == ',') ? end + 1 : end;
+	}
+
+	return mask;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t*)a;
+	uint64_t val_b = *(const uint64_t*)b;
+	return (val_a > val_b) - (val_a < val_b);
+}
+
+int main(int argc, char *argv[])
+{
+	struct os_thread_sched sched = {0};
+	const char *policy_name = "default";
+	const char *sleep_mode = "abs";
+	double seconds = 10.0;
+	int fps = 60;
+	int num_load = 0;
+	pthread_t *load_threads;
+	uint64_t *lateness;
+	uint64_t interval, next, total = 0;
+	size_t frames, over_1ms = 0;
+	bool relative;
+
+	for (int i = 1; i < argc; i++) {
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (!val) {
+			fprintf(stderr, "missing value for %s\n", argv[i]);
+			return 1;
+		}
+
+		if (strcmp(argv[i], "--fps") == 0)
+			fps = atoi(val);
+		else if (strcmp(argv[i], "--seconds") == 0)
+			seconds = atof(val);
+		else if (strcmp(argv[i], "--sleep") == 0)
+			sleep_mode = val;
+		else if (strcmp(argv[i], "--policy") == 0)
+			policy_name = val;
+		else if (strcmp(argv[i], "--priority") == 0)
+			sched.priority = atoi(val);
+		else if (strcmp(argv[i], "--slack") == 0)
+			sched.timer_slack_ns = strtoull(val, NULL, 10);
+		else if (strcmp(argv[i], "--cpus") == 0)
+			sched.cpu_mask = get_cpu_mask(val);
+		else if (strcmp(argv[i], "--load") == 0)
+			num_load = atoi(val);
+		else {
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+
+		i++;
+	}
+
+	if (fps <= 0 || seconds <= 0.0 || num_load < 0) {
+		fprintf(stderr, "invalid fps, seconds or load\n");
+		return 1;
+	}
+
+	/* the load is started first so it doesn't inherit the scheduling */
+	load_threads = bzalloc(sizeof(pthread_t) * (num_load ? num_load : 1));
+	for (int i = 0; i < num_load; i++)
+		pthread_create(&load_threads[i], NULL, load_thread, NULL);
+
+	relative     = strcmp(sleep_mode, "rel") == 0;
+	sched.policy = get_policy(policy_name);
+	if (!os_set_thread_sched(&sched))
+		fprintf(stderr, "could not apply all scheduling options\n");
+
+	frames   = (size_t)(seconds * fps);
+	interval = 1000000000ULL / (uint64_t)fps;
+	lateness = bzalloc(sizeof(uint64_t) * (frames ? frames : 1));
+
+	next = os_gettime_ns() + interval;
+	for (size_t i = 0; i < frames; i++) {
+		uint64_t now;
+
+		if (relative)
+			sleepto_relative(next);
+		else
+			os_sleepto_ns(next);
+
+		now = os_gettime_ns();
+		lateness[i] = now > next ? now - next : 0;
+		total += lateness[i];
+		if (lateness[i] > 1000000)
+			over_1ms++;
+
+		next += interval;
+	}
+
+	os_atomic_set_long(&stop_load, 1);
+	for (int i = 0; i < num_load; i++)
+		pthread_join(load_threads[i], NULL);
+
+	qsort(lateness, frames, sizeof(uint64_t), compare_u64);
+
+	if (frames) {
+		printf("sleep=%s policy=%s frames=%d mean_us=%.1f p50_us=%.1f "
+		       "p99_us=%.1f max_us=%.1f over_1ms=%d\n",
+				relative ? "rel" : "abs", policy_name,
+				(int)frames,
+				(double)total / (double)frames / 1000.0,
+				(double)lateness[frames / 2] / 1000.0,
+				(double)lateness[frames * 99 / 100] / 1000.0,
+				(double)lateness[frames - 1] / 1000.0,
+				(int)over_1ms);
+	}
+
+	bfree(lateness);
+	bfree(load_threads);
+	return 0;
+}
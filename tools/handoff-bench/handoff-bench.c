@@ -0,0 +1,224 @@
+/*
+ * handoff-bench: measures how long it takes from a semaphore post to the
+ * waiting thread running, the way frames and packets are handed from the
+ * graphics thread to video-io and from the encoders to the outputs.
+ *
+ * Built from libobs/util (threading-posix.c, platform.c, platform-nix.c,
+ * bmem.c, dstr.c, utf8.c).
+ *
+ * usage: handoff-bench [options]
+ *   --seconds <sec>     run time per case (default 5)
+ *   --burst <n>         posts per frame, like a video packet followed by
+ *                       audio packets (default 4)
+ *   --gap <us>          time between the posts of a burst (default 20)
+ *   --work <us>         time the consumer spends per item (default 5)
+ *   --spin <ns>         os_sem_set_spin for the spinning case (default 20000)
+ *
+ * Every case runs at 60 and 144 fps.  One "key=value" line is printed per
+ * case and rate, e.g.
+ *   os_sem_spin fps=144 posts=2880 mean_us=... p50_us=... p99_us=...
+ *   max_us=... cpu_ms=...
+ * where the times are from the post to the consumer returning from its wait,
+ * and cpu_ms is the cpu time the consumer used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <semaphore.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+enum sem_kind {
+	KIND_SEM_T,
+	KIND_OS_SEM,
+	KIND_OS_SEM_SPIN
+};
+
+static const char *kind_names[] = {"sem_t", "os_sem", "os_sem_spin"};
+
+struct handoff {
+	enum sem_kind kind;
+	sem_t         sem;
+	os_sem_t      *os_sem;
+
+	uint64_t      *post_times;
+	uint64_t      *latencies;
+	size_t        count;
+
+	uint64_t      work_ns;
+	uint64_t      cpu_ns;
+};
+
+static inline void handoff_post(struct handoff *h)
+{
+	if (h->kind == KIND_SEM_T)
+		sem_post(&h->sem);
+	else
+		os_sem_post(h->os_sem);
+}
+
+static inline void handoff_wait(struct handoff *h)
+{
+	if (h->kind == KIND_SEM_T)
+		sem_wait(&h->sem);
+	else
+		os_sem_wait(h->os_sem);
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void *consumer_thread(void *param)
+{
+	struct handoff *h = param;
+	uint64_t cpu_start = thread_cpu_ns();
+
+	for (size_t i = 0; i < h->count; i++) {
+		uint64_t end;
+
+		handoff_wait(h);
+		h->latencies[i] = os_gettime_ns() -
+			__atomic_load_n(&h->post_times[i], __ATOMIC_ACQUIRE);
+
+		end = os_gettime_ns() + h->work_ns;
+		while (os_gettime_ns() < end);
+	}
+
+	h->cpu_ns = thread_cpu_ns() - cpu_start;
+	return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t*)a;
+	uint64_t val_b = *(const uint64_t*)b;
+	return (val_a > val_b) - (val_a < val_b);
+}
+
+static void run_case(enum sem_kind kind, int fps, double seconds, int burst,
+		uint64_t gap_ns, uint64_t work_ns, unsigned long spin_ns)
+{
+	struct handoff h = {0};
+	uint64_t interval = 1000000000ULL / (uint64_t)fps;
+	uint64_t next, total = 0;
+	size_t frames = (size_t)(seconds * fps);
+	size_t idx = 0;
+	pthread_t thread;
+
+	h.kind       = kind;
+	h.count      = frames * (size_t)burst;
+	h.work_ns    = work_ns;
+	h.post_times = bzalloc(sizeof(uint64_t) * h.count);
+	h.latencies  = bzalloc(sizeof(uint64_t) * h.count);
+
+	if (kind == KIND_SEM_T) {
+		sem_init(&h.sem, 0, 0);
+	} else {
+		os_sem_init(&h.os_sem, 0);
+		if (kind == KIND_OS_SEM_SPIN)
+			os_sem_set_spin(h.os_sem, spin_ns);
+	}
+
+	pthread_create(&thread, NULL, consumer_thread, &h);
+
+	next = os_gettime_ns() + interval;
+	for (size_t i = 0; i < frames; i++) {
+		os_sleepto_ns(next);
+
+		for (int j = 0; j < burst; j++) {
+			if (j)
+				os_sleepto_ns(next + gap_ns * (uint64_t)j);
+
+			__atomic_store_n(&h.post_times[idx++], os_gettime_ns(),
+					__ATOMIC_RELEASE);
+			handoff_post(&h);
+		}
+
+		next += interval;
+	}
+
+	pthread_join(thread, NULL);
+
+	for (size_t i = 0; i < h.count; i++)
+		total += h.latencies[i];
+	qsort(h.latencies, h.count, sizeof(uint64_t), compare_u64);
+
+	if (h.count) {
+		printf("%s fps=%d posts=%d mean_us=%.1f p50_us=%.1f "
+		       "p99_us=%.1f max_us=%.1f cpu_ms=%.1f\n",
+				kind_names[kind], fps, (int)h.count,
+				(double)total / (double)h.count / 1000.0,
+				(double)h.latencies[h.count / 2] / 1000.0,
+				(double)h.latencies[h.count * 99 / 100] / 1000.0,
+				(double)h.latencies[h.count - 1] / 1000.0,
+				(double)h.cpu_ns / 1000000.0);
+	}
+
+	if (kind == KIND_SEM_T)
+		sem_destroy(&h.sem);
+	else
+		os_sem_destroy(h.os_sem);
+
+	bfree(h.post_times);
+	bfree(h.latencies);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int rates[] = {60, 144};
+	double seconds = 5.0;
+	int burst = 4;
+	uint64_t gap_ns = 20000;
+	uint64_t work_ns = 5000;
+	unsigned long spin_ns = 20000;
+
+	for (int i = 1; i < argc; i++) {
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (!val) {
+			fprintf(stderr, "missing value for %s\n", argv[i]);
+			return 1;
+		}
+
+		if (strcmp(argv[i], "--seconds") == 0)
+			seconds = atof(val);
+		else if (strcmp(argv[i], "--burst") == 0)
+			burst = atoi(val);
+		else if (strcmp(argv[i], "--gap") == 0)
+			gap_ns = strtoull(val, NULL, 10) * 1000;
+		else if (strcmp(argv[i], "--work") == 0)
+			work_ns = strtoull(val, NULL, 10) * 1000;
+		else if (strcmp(argv[i], "--spin") == 0)
+			spin_ns = strtoul(val, NULL, 10);
+		else {
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+
+		i++;
+	}
+
+	if (seconds <= 0.0 || burst <= 0) {
+		fprintf(stderr, "invalid seconds or burst\n");
+		return 1;
+	}
+
+	for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+		run_case(KIND_SEM_T, rates[r], seconds, burst, gap_ns,
+				work_ns, spin_ns);
+		run_case(KIND_OS_SEM, rates[r], seconds, burst, gap_ns,
+				work_ns, spin_ns);
+		run_case(KIND_OS_SEM_SPIN, rates[r], seconds, burst, gap_ns,
+				work_ns, spin_ns);
+	}
+
+	return 0;
+}
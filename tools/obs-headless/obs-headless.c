@@ -0,0 +1,890 @@
+/*
+ * obs-headless: runs libobs without the UI from a JSON scenario file and
+ * writes machine-readable results for performance comparisons.
+ *
+ * usage: obs-headless <scenario.json>
+ *
+ * Scenario keys (all optional except "sources"):
+ *
+ *   "graphics_module"  "libobs-opengl" (default) or "libobs-d3d11"
+ *   "module_paths"     [{"bin": "...", "data": "..."}], searched before the
+ *                      default plugin locations
+ *   "video"            {"base_width", "base_height", "output_width",
+ *                       "output_height", "fps_num", "fps_den", "format",
+ *                       "readback_depth"}
+ *   "audio"            {"samples_per_sec", "speakers", "buffer_ms",
+ *                       "low_latency"}
+ *   "thread_sched"     {"graphics", "video", "audio"}, each
+ *                      {"policy", "priority", "timer_slack_ns", "cpus"}
+ *                      where policy is default, nice, fifo or rr and cpus
+ *                      is a comma separated list of cpu numbers ("2,3")
+ *   "sources"          [{"id", "name", "settings", "count", "visible"}],
+ *                      added to one scene in order.  "count" creates that
+ *                      many copies named "<name>.<n>", "visible": false adds
+ *                      them hidden.  "synthetic_video" and "synthetic_audio"
+ *                      are always available.
+ *   "video_encoder"    {"id", "settings"}
+ *   "audio_encoder"    {"id", "settings"}
+ *   "outputs"          [{"id", "name", "settings", "autostart",
+ *                        "service": {"id", "settings"},
+ *                        "video_encoder": {"id", "settings"},
+ *                        "share_video_encoder"}], where "video_encoder"
+ *                      gives the output its own encoder instead of the
+ *                      scenario's, and "share_video_encoder": false stops
+ *                      it from using another output's identical encoder
+ *   "events"           [{"time", "action", "target", "settings"}], where
+ *                      action is one of start, stop, show, hide, update,
+ *                      reset_stats
+ *   "duration"         seconds to run (default 10)
+ *   "results"          results JSON path (default: stdout)
+ *   "profiler_csv"     profiler snapshot CSV path
+ *   "timeline"         chrome trace path; enables the profiler timeline
+ *   "timeline_events"  events kept per thread (default 65536)
+ *
+ * Point an rtmp_output at tools/rtmp-ingest to measure the full streaming
+ * path on one machine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <obs.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "obs-headless.h"
+
+#define DEFAULT_DURATION        10.0
+#define DEFAULT_TIMELINE_EVENTS 65536
+
+struct scenario_event {
+	double                  time;
+	const char              *action;
+	const char              *target;
+	obs_data_t              *settings;
+};
+
+struct scenario_output {
+	obs_output_t            *output;
+	obs_service_t           *service;
+	obs_encoder_t           *video_encoder;
+	bool                    autostart;
+};
+
+struct scenario {
+	obs_data_t              *data;
+
+	obs_scene_t             *scene;
+	DARRAY(obs_source_t*)   sources;
+	obs_encoder_t           *video_encoder;
+	obs_encoder_t           *audio_encoder;
+	DARRAY(struct scenario_output) outputs;
+	DARRAY(struct scenario_event) events;
+
+	double                  duration;
+	long                    alloc_base;
+	os_cpu_usage_info_t     *cpu_info;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static const char *thread_class_names[OS_THREAD_CLASS_COUNT] = {
+	"graphics",
+	"video",
+	"audio"
+};
+
+static enum os_sched_policy get_sched_policy(const char *name)
+{
+	if (astrcmpi(name, "nice") == 0)
+		return OS_SCHED_NICE;
+	else if (astrcmpi(name, "fifo") == 0)
+		return OS_SCHED_FIFO;
+	else if (astrcmpi(name, "rr") == 0)
+		return OS_SCHED_RR;
+	return OS_SCHED_DEFAULT;
+}
+
+static void set_thread_sched(obs_data_t *data)
+{
+	obs_data_t *thread_sched = obs_data_get_obj(data, "thread_sched");
+
+	if (!thread_sched)
+		return;
+
+	for (size_t i = 0; i < OS_THREAD_CLASS_COUNT; i++) {
+		obs_data_t *obj = obs_data_get_obj(thread_sched,
+				thread_class_names[i]);
+		struct os_thread_sched sched = {0};
+		const char *cpus;
+
+		if (!obj)
+			continue;
+
+		cpus = obs_data_get_string(obj, "cpus");
+		while (cpus && *cpus) {
+			char *end;
+			long num = strtol(cpus, &end, 10);
+
+			if (end == cpus)
+				break;
+			if (num >= 0 && num < 64)
+				sched.cpu_mask |= 1ULL << num;
+
+			cpus = (*end == ',') ? end + 1 : end;
+		}
+
+		sched.policy         = get_sched_policy(
+				obs_data_get_string(obj, "policy"));
+		sched.priority       = (int)obs_data_get_int(obj, "priority");
+		sched.timer_slack_ns = (uint64_t)obs_data_get_int(obj,
+				"timer_slack_ns");
+
+		os_set_thread_class_sched((enum os_thread_class)i, &sched);
+		obs_data_release(obj);
+	}
+
+	obs_data_release(thread_sched);
+}
+
+static bool reset_video(obs_data_t *data)
+{
+	obs_data_t *video = obs_data_get_obj(data, "video");
+	struct obs_video_info ovi = {0};
+	const char *format;
+	int ret;
+
+	if (!video)
+		video = obs_data_create();
+
+	obs_data_set_default_int(video, "base_width", 1280);
+	obs_data_set_default_int(video, "base_height", 720);
+	obs_data_set_default_int(video, "fps_num", 30);
+	obs_data_set_default_int(video, "fps_den", 1);
+	obs_data_set_default_string(video, "format", "NV12");
+
+	ovi.graphics_module = obs_data_get_string(data, "graphics_module");
+	if (!ovi.graphics_module || !*ovi.graphics_module)
+		ovi.graphics_module = "libobs-opengl";
+
+	ovi.fps_num        = (uint32_t)obs_data_get_int(video, "fps_num");
+	ovi.fps_den        = (uint32_t)obs_data_get_int(video, "fps_den");
+	ovi.base_width     = (uint32_t)obs_data_get_int(video, "base_width");
+	ovi.base_height    = (uint32_t)obs_data_get_int(video, "base_height");
+	ovi.output_width   = (uint32_t)obs_data_get_int(video, "output_width");
+	ovi.output_height  = (uint32_t)obs_data_get_int(video, "output_height");
+	ovi.gpu_conversion = true;
+	ovi.colorspace     = VIDEO_CS_601;
+	ovi.range          = VIDEO_RANGE_PARTIAL;
+	ovi.scale_type     = OBS_SCALE_BICUBIC;
+	ovi.readback_depth = (uint32_t)obs_data_get_int(video,
+			"readback_depth");
+
+	if (!ovi.output_width || !ovi.output_height) {
+		ovi.output_width  = ovi.base_width;
+		ovi.output_height = ovi.base_height;
+	}
+
+	format = obs_data_get_string(video, "format");
+	if (astrcmpi(format, "I420") == 0)
+		ovi.output_format = VIDEO_FORMAT_I420;
+	else if (astrcmpi(format, "I444") == 0)
+		ovi.output_format = VIDEO_FORMAT_I444;
+	else if (astrcmpi(format, "RGBA") == 0)
+		ovi.output_format = VIDEO_FORMAT_RGBA;
+	else
+		ovi.output_format = VIDEO_FORMAT_NV12;
+
+	ret = obs_reset_video(&ovi);
+	if (ret != OBS_VIDEO_SUCCESS)
+		blog(LOG_ERROR, "obs_reset_video failed with '%s' (%d)",
+				ovi.graphics_module, ret);
+
+	obs_data_release(video);
+	return ret == OBS_VIDEO_SUCCESS;
+}
+
+static bool reset_audio(obs_data_t *data)
+{
+	obs_data_t *audio = obs_data_get_obj(data, "audio");
+	struct obs_audio_info oai;
+	bool success;
+
+	if (!audio)
+		audio = obs_data_create();
+
+	obs_data_set_default_int(audio, "samples_per_sec", 44100);
+	obs_data_set_default_int(audio, "speakers", SPEAKERS_STEREO);
+	obs_data_set_default_int(audio, "buffer_ms", 1000);
+	obs_data_set_default_bool(audio, "low_latency", false);
+
+	oai.samples_per_sec = (uint32_t)obs_data_get_int(audio,
+			"samples_per_sec");
+	oai.speakers  = (enum speaker_layout)obs_data_get_int(audio,
+			"speakers");
+	oai.buffer_ms = (uint64_t)obs_data_get_int(audio, "buffer_ms");
+	oai.low_latency = obs_data_get_bool(audio, "low_latency");
+
+	success = obs_reset_audio(&oai);
+	if (!success)
+		blog(LOG_ERROR, "obs_reset_audio failed");
+
+	obs_data_release(audio);
+	return success;
+}
+
+static void load_modules(obs_data_t *data)
+{
+	obs_data_array_t *paths = obs_data_get_array(data, "module_paths");
+	size_t count = obs_data_array_count(paths);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *path = obs_data_array_item(paths, i);
+		obs_add_module_path(obs_data_get_string(path, "bin"),
+				obs_data_get_string(path, "data"));
+		obs_data_release(path);
+	}
+
+	obs_data_array_release(paths);
+
+	register_synthetic_sources();
+	obs_load_all_modules();
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool create_source(struct scenario *sc, const char *id,
+		const char *name, obs_data_t *settings, bool visible)
+{
+	obs_source_t *source;
+	obs_sceneitem_t *item;
+
+	source = obs_source_create(OBS_SOURCE_TYPE_INPUT, id, name, settings,
+			NULL);
+	if (!source) {
+		blog(LOG_ERROR, "Failed to create source '%s' (%s)", name, id);
+		return false;
+	}
+
+	item = obs_scene_add(sc->scene, source);
+	if (item && !visible)
+		obs_sceneitem_set_visible(item, false);
+
+	da_push_back(sc->sources, &source);
+	return true;
+}
+
+static bool create_sources(struct scenario *sc)
+{
+	obs_data_array_t *sources = obs_data_get_array(sc->data, "sources");
+	size_t count = obs_data_array_count(sources);
+	struct dstr name = {0};
+	bool success = true;
+
+	sc->scene = obs_scene_create("headless scene");
+	obs_set_output_source(0, obs_scene_get_source(sc->scene));
+
+	for (size_t i = 0; i < count && success; i++) {
+		obs_data_t *item = obs_data_array_item(sources, i);
+		obs_data_t *settings = obs_data_get_obj(item, "settings");
+		const char *id = obs_data_get_string(item, "id");
+		long long copies;
+		bool visible;
+
+		obs_data_set_default_int(item, "count", 1);
+		obs_data_set_default_bool(item, "visible", true);
+		copies  = obs_data_get_int(item, "count");
+		visible = obs_data_get_bool(item, "visible");
+
+		if (copies == 1) {
+			success = create_source(sc, id,
+					obs_data_get_string(item, "name"),
+					settings, visible);
+		}
+
+		for (long long j = 0; copies > 1 && j < copies && success; j++) {
+			dstr_printf(&name, "%s.%lld",
+					obs_data_get_string(item, "name"), j);
+			success = create_source(sc, id, name.array, settings,
+					visible);
+		}
+
+		obs_data_release(settings);
+		obs_data_release(item);
+	}
+
+	dstr_free(&name);
+
+	obs_data_array_release(sources);
+	return success;
+}
+
+static obs_encoder_t *create_encoder(obs_data_t *data, const char *key,
+		const char *name, bool video)
+{
+	obs_data_t *item = obs_data_get_obj(data, key);
+	obs_data_t *settings;
+	obs_encoder_t *encoder;
+	const char *id;
+
+	if (!item)
+		return NULL;
+
+	settings = obs_data_get_obj(item, "settings");
+	id = obs_data_get_string(item, "id");
+
+	if (video) {
+		encoder = obs_video_encoder_create(id, name, settings, NULL);
+		if (encoder)
+			obs_encoder_set_video(encoder, obs_get_video());
+	} else {
+		encoder = obs_audio_encoder_create(id, name, settings, 0,
+				NULL);
+		if (encoder)
+			obs_encoder_set_audio(encoder, obs_get_audio());
+	}
+
+	if (!encoder)
+		blog(LOG_ERROR, "Failed to create %s (%s)", key, id);
+
+	obs_data_release(settings);
+	obs_data_release(item);
+	return encoder;
+}
+
+static bool create_outputs(struct scenario *sc)
+{
+	obs_data_array_t *outputs = obs_data_get_array(sc->data, "outputs");
+	size_t count = obs_data_array_count(outputs);
+	bool success = true;
+
+	for (size_t i = 0; i < count && success; i++) {
+		obs_data_t *item = obs_data_array_item(outputs, i);
+		obs_data_t *settings = obs_data_get_obj(item, "settings");
+		obs_data_t *service = obs_data_get_obj(item, "service");
+		struct scenario_output out = {0};
+
+		obs_data_set_default_bool(item, "autostart", true);
+		out.autostart = obs_data_get_bool(item, "autostart");
+		out.output = obs_output_create(obs_data_get_string(item, "id"),
+				obs_data_get_string(item, "name"), settings,
+				NULL);
+
+		if (out.output) {
+			struct dstr name = {0};
+
+			dstr_printf(&name, "%s video",
+					obs_output_get_name(out.output));
+			out.video_encoder = create_encoder(item,
+					"video_encoder", name.array, true);
+			dstr_free(&name);
+
+			obs_output_set_video_encoder(out.output,
+					out.video_encoder ? out.video_encoder :
+					sc->video_encoder);
+
+			obs_data_set_default_bool(item,
+					"share_video_encoder", true);
+			obs_output_set_video_encoder_sharing(out.output,
+					obs_data_get_bool(item,
+						"share_video_encoder"));
+			obs_output_set_audio_encoder(out.output,
+					sc->audio_encoder, 0);
+		} else {
+			blog(LOG_ERROR, "Failed to create output '%s'",
+					obs_data_get_string(item, "name"));
+			success = false;
+		}
+
+		if (out.output && service) {
+			obs_data_t *service_settings =
+				obs_data_get_obj(service, "settings");
+
+			out.service = obs_service_create(
+					obs_data_get_string(service, "id"),
+					"headless service", service_settings,
+					NULL);
+			if (out.service)
+				obs_output_set_service(out.output,
+						out.service);
+
+			obs_data_release(service_settings);
+		}
+
+		if (out.output)
+			da_push_back(sc->outputs, &out);
+
+		obs_data_release(service);
+		obs_data_release(settings);
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(outputs);
+	return success;
+}
+
+static int event_compare(const void *a, const void *b)
+{
+	const struct scenario_event *ea = a;
+	const struct scenario_event *eb = b;
+
+	return (ea->time > eb->time) - (ea->time < eb->time);
+}
+
+static void load_events(struct scenario *sc)
+{
+	obs_data_array_t *events = obs_data_get_array(sc->data, "events");
+	size_t count = obs_data_array_count(events);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(events, i);
+		struct scenario_event event;
+
+		/* strings stay valid for as long as sc->data is alive */
+		event.time     = obs_data_get_double(item, "time");
+		event.action   = obs_data_get_string(item, "action");
+		event.target   = obs_data_get_string(item, "target");
+		event.settings = obs_data_get_obj(item, "settings");
+		da_push_back(sc->events, &event);
+
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(events);
+
+	if (sc->events.num)
+		qsort(sc->events.array, sc->events.num,
+				sizeof(struct scenario_event), event_compare);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static struct scenario_output *find_output(struct scenario *sc,
+		const char *name)
+{
+	for (size_t i = 0; i < sc->outputs.num; i++) {
+		struct scenario_output *out = sc->outputs.array + i;
+		if (strcmp(obs_output_get_name(out->output), name) == 0)
+			return out;
+	}
+
+	return NULL;
+}
+
+static void start_output(struct scenario_output *out)
+{
+	if (!obs_output_start(out->output))
+		blog(LOG_WARNING, "Output '%s' failed to start",
+				obs_output_get_name(out->output));
+}
+
+static void run_event(struct scenario *sc, struct scenario_event *event)
+{
+	const char *action = event->action;
+	const char *target = event->target;
+
+	blog(LOG_INFO, "[%.3f] %s %s", event->time, action,
+			target ? target : "");
+
+	if (strcmp(action, "start") == 0 || strcmp(action, "stop") == 0) {
+		struct scenario_output *out = find_output(sc, target);
+
+		if (!out)
+			blog(LOG_WARNING, "No output named '%s'", target);
+		else if (action[2] == 'a')
+			start_output(out);
+		else
+			obs_output_stop(out->output);
+
+	} else if (strcmp(action, "show") == 0 ||
+	           strcmp(action, "hide") == 0) {
+		obs_sceneitem_t *item = obs_scene_find_source(sc->scene,
+				target);
+
+		if (item)
+			obs_sceneitem_set_visible(item, action[0] == 's');
+		else
+			blog(LOG_WARNING, "No scene item named '%s'", target);
+
+	} else if (strcmp(action, "update") == 0) {
+		obs_source_t *source = obs_get_source_by_name(target);
+
+		if (source) {
+			obs_source_update(source, event->settings);
+			obs_source_release(source);
+		} else {
+			blog(LOG_WARNING, "No source named '%s'", target);
+		}
+
+	} else if (strcmp(action, "reset_stats") == 0) {
+		obs_reset_frame_stats();
+		sc->alloc_base = bnum_total_allocs();
+
+		os_cpu_usage_info_destroy(sc->cpu_info);
+		sc->cpu_info = os_cpu_usage_info_start();
+
+	} else {
+		blog(LOG_WARNING, "Unknown event action '%s'", action);
+	}
+}
+
+static void run_scenario(struct scenario *sc)
+{
+	uint64_t start = os_gettime_ns();
+	size_t next_event = 0;
+
+	sc->alloc_base = bnum_total_allocs();
+	sc->cpu_info = os_cpu_usage_info_start();
+
+	for (size_t i = 0; i < sc->outputs.num; i++) {
+		if (sc->outputs.array[i].autostart)
+			start_output(sc->outputs.array + i);
+	}
+
+	while (next_event < sc->events.num) {
+		struct scenario_event *event = sc->events.array + next_event;
+
+		if (event->time > sc->duration)
+			break;
+
+		os_sleepto_ns(start + (uint64_t)(event->time * 1000000000.0));
+		run_event(sc, event);
+		next_event++;
+	}
+
+	os_sleepto_ns(start + (uint64_t)(sc->duration * 1000000000.0));
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *stage_names[OBS_FRAME_STAGE_COUNT] = {
+	"rendered",
+	"encode_start",
+	"encoded",
+	"interleaved",
+	"sent"
+};
+
+static const char *drop_names[OBS_FRAME_DROP_COUNT] = {
+	"render_lag",
+	"encoder_lag",
+	"network"
+};
+
+static obs_data_t *histogram_results(const struct obs_latency_histogram *h)
+{
+	obs_data_t *obj = obs_data_create();
+
+	obs_data_set_int(obj, "count", (long long)h->count);
+	obs_data_set_double(obj, "avg_ms", h->count ?
+			(double)h->total_ns / (double)h->count / 1000000.0 :
+			0.0);
+	obs_data_set_double(obj, "max_ms", (double)h->max_ns / 1000000.0);
+	obs_data_set_double(obj, "p50_ms",
+			(double)obs_latency_histogram_percentile(h, 0.50) /
+			1000000.0);
+	obs_data_set_double(obj, "p95_ms",
+			(double)obs_latency_histogram_percentile(h, 0.95) /
+			1000000.0);
+	obs_data_set_double(obj, "p99_ms",
+			(double)obs_latency_histogram_percentile(h, 0.99) /
+			1000000.0);
+	return obj;
+}
+
+static bool count_active_video_encoder(void *param, obs_encoder_t *encoder)
+{
+	long long *count = param;
+
+	if (obs_encoder_get_type(encoder) == OBS_ENCODER_VIDEO &&
+	    obs_encoder_active(encoder))
+		(*count)++;
+	return true;
+}
+
+/* file outputs report their disk writes through get_write_stats */
+static obs_data_t *write_stats_results(obs_output_t *output)
+{
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	obs_data_t *obj = NULL;
+	calldata_t cd = {0};
+
+	if (proc_handler_call(ph, "get_write_stats", &cd)) {
+		obj = obs_data_create();
+		obs_data_set_int(obj, "bytes_written",
+				calldata_int(&cd, "bytes_written"));
+		obs_data_set_int(obj, "writes", calldata_int(&cd, "writes"));
+		obs_data_set_double(obj, "write_p50_ms",
+				calldata_float(&cd, "write_p50_ms"));
+		obs_data_set_double(obj, "write_p99_ms",
+				calldata_float(&cd, "write_p99_ms"));
+		obs_data_set_double(obj, "write_max_ms",
+				calldata_float(&cd, "write_max_ms"));
+		obs_data_set_int(obj, "syncs", calldata_int(&cd, "syncs"));
+		obs_data_set_double(obj, "sync_max_ms",
+				calldata_float(&cd, "sync_max_ms"));
+		obs_data_set_double(obj, "stall_p99_ms",
+				calldata_float(&cd, "stall_p99_ms"));
+		obs_data_set_double(obj, "stall_max_ms",
+				calldata_float(&cd, "stall_max_ms"));
+	}
+
+	calldata_free(&cd);
+	return obj;
+}
+
+static obs_data_t *collect_results(struct scenario *sc)
+{
+	obs_data_t *results = obs_data_create();
+	obs_data_t *video = obs_data_create();
+	obs_data_t *audio = obs_data_create();
+	obs_data_t *frames = obs_data_create();
+	obs_data_t *drops = obs_data_create();
+	obs_data_t *latency = obs_data_create();
+	obs_data_t *memory = obs_data_create();
+	obs_data_array_t *outputs = obs_data_array_create();
+	struct audio_output_stats audio_stats = {0};
+	struct obs_frame_stats stats;
+	long allocs = bnum_total_allocs() - sc->alloc_base;
+	long long video_encoders = 0;
+
+	obs_get_frame_stats(&stats);
+	obs_enum_encoders(count_active_video_encoder, &video_encoders);
+
+	obs_data_set_double(results, "duration", sc->duration);
+	obs_data_set_double(results, "cpu_usage",
+			os_cpu_usage_info_query(sc->cpu_info));
+	obs_data_set_int(results, "active_video_encoders", video_encoders);
+
+	obs_data_set_int(video, "total_frames",
+			video_output_get_total_frames(obs_get_video()));
+	obs_data_set_int(video, "skipped_frames",
+			video_output_get_skipped_frames(obs_get_video()));
+	obs_data_set_obj(results, "video", video);
+
+	audio_output_get_stats(obs_get_audio(), &audio_stats);
+	obs_data_set_int(audio, "quantum_frames", audio_stats.quantum_frames);
+	obs_data_set_int(audio, "mixes", (long long)audio_stats.mixes);
+	obs_data_set_int(audio, "late_wakeups",
+			(long long)audio_stats.late_wakeups);
+	obs_data_set_double(audio, "avg_lateness_ms", audio_stats.mixes ?
+			(double)audio_stats.total_lateness_ns /
+			(double)audio_stats.mixes / 1000000.0 : 0.0);
+	obs_data_set_double(audio, "max_lateness_ms",
+			(double)audio_stats.max_lateness_ns / 1000000.0);
+	obs_data_set_int(audio, "dropped_packets",
+			(long long)audio_stats.dropped_packets);
+	obs_data_set_obj(results, "audio", audio);
+
+	obs_data_set_int(frames, "rendered_frames",
+			(long long)stats.rendered_frames);
+	obs_data_set_int(frames, "video_bytes_copied",
+			(long long)stats.video_bytes_copied);
+	obs_data_set_double(frames, "video_bytes_copied_per_frame",
+			stats.rendered_frames ?
+			(double)stats.video_bytes_copied /
+			(double)stats.rendered_frames : 0.0);
+	for (size_t i = 0; i < OBS_FRAME_DROP_COUNT; i++)
+		obs_data_set_int(drops, drop_names[i],
+				(long long)stats.drops[i]);
+	for (size_t i = 0; i < OBS_FRAME_STAGE_COUNT; i++) {
+		obs_data_t *obj = histogram_results(stats.latency + i);
+		obs_data_set_obj(latency, stage_names[i], obj);
+		obs_data_release(obj);
+	}
+	obs_data_set_obj(frames, "drops", drops);
+	obs_data_set_obj(frames, "latency", latency);
+	obs_data_set_obj(results, "frame_stats", frames);
+
+	obs_data_set_int(memory, "allocs", allocs);
+	obs_data_set_double(memory, "allocs_per_frame", stats.rendered_frames ?
+			(double)allocs / (double)stats.rendered_frames : 0.0);
+	obs_data_set_int(memory, "live_allocs", bnum_allocs());
+	obs_data_set_obj(results, "memory", memory);
+
+	for (size_t i = 0; i < sc->outputs.num; i++) {
+		obs_output_t *output = sc->outputs.array[i].output;
+		obs_data_t *obj = obs_data_create();
+		obs_data_t *write_stats;
+
+		obs_data_set_string(obj, "name", obs_output_get_name(output));
+		obs_data_set_bool(obj, "active", obs_output_active(output));
+		obs_data_set_int(obj, "total_frames",
+				obs_output_get_total_frames(output));
+		obs_data_set_int(obj, "frames_dropped",
+				obs_output_get_frames_dropped(output));
+		obs_data_set_int(obj, "total_bytes",
+				(long long)obs_output_get_total_bytes(output));
+		obs_data_set_string(obj, "video_encoder", obs_encoder_get_name(
+				obs_output_get_video_encoder(output)));
+
+		write_stats = write_stats_results(output);
+		if (write_stats) {
+			obs_data_set_obj(obj, "write_stats", write_stats);
+			obs_data_release(write_stats);
+		}
+
+		obs_data_array_push_back(outputs, obj);
+		obs_data_release(obj);
+	}
+	obs_data_set_array(results, "outputs", outputs);
+
+	obs_data_array_release(outputs);
+	obs_data_release(memory);
+	obs_data_release(latency);
+	obs_data_release(drops);
+	obs_data_release(frames);
+	obs_data_release(audio);
+	obs_data_release(video);
+	return results;
+}
+
+static void write_results(struct scenario *sc)
+{
+	obs_data_t *results = collect_results(sc);
+	const char *path = obs_data_get_string(sc->data, "results");
+
+	if (path && *path) {
+		if (!obs_data_save_json(results, path))
+			blog(LOG_ERROR, "Could not write results to '%s'",
+					path);
+	} else {
+		puts(obs_data_get_json(results));
+		fflush(stdout);
+	}
+
+	obs_data_release(results);
+}
+
+static void write_profiler_data(struct scenario *sc)
+{
+	const char *csv = obs_data_get_string(sc->data, "profiler_csv");
+	const char *trace = obs_data_get_string(sc->data, "timeline");
+
+	if (csv && *csv) {
+		profiler_snapshot_t *snap = profile_snapshot_create();
+		if (!profiler_snapshot_dump_csv(snap, csv))
+			blog(LOG_ERROR, "Could not write profiler data to "
+					"'%s'", csv);
+		profile_snapshot_free(snap);
+	}
+
+	if (trace && *trace) {
+		profiler_timeline_t *timeline =
+			profiler_timeline_snapshot_create();
+		if (!profiler_timeline_dump_chrome_trace(timeline, trace))
+			blog(LOG_ERROR, "Could not write timeline to '%s'",
+					trace);
+		profiler_timeline_snapshot_free(timeline);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void scenario_free(struct scenario *sc)
+{
+	for (size_t i = 0; i < sc->outputs.num; i++) {
+		struct scenario_output *out = sc->outputs.array + i;
+		obs_output_stop(out->output);
+		obs_output_release(out->output);
+		obs_service_release(out->service);
+		obs_encoder_release(out->video_encoder);
+	}
+
+	os_cpu_usage_info_destroy(sc->cpu_info);
+
+	obs_encoder_release(sc->video_encoder);
+	obs_encoder_release(sc->audio_encoder);
+
+	obs_set_output_source(0, NULL);
+	for (size_t i = 0; i < sc->sources.num; i++)
+		obs_source_release(sc->sources.array[i]);
+	obs_scene_release(sc->scene);
+
+	for (size_t i = 0; i < sc->events.num; i++)
+		obs_data_release(sc->events.array[i].settings);
+
+	da_free(sc->outputs);
+	da_free(sc->sources);
+	da_free(sc->events);
+}
+
+static bool scenario_init(struct scenario *sc)
+{
+	obs_data_set_default_double(sc->data, "duration", DEFAULT_DURATION);
+	sc->duration = obs_data_get_double(sc->data, "duration");
+
+	set_thread_sched(sc->data);
+
+	if (!reset_video(sc->data) || !reset_audio(sc->data))
+		return false;
+
+	load_modules(sc->data);
+
+	if (!create_sources(sc))
+		return false;
+
+	sc->video_encoder = create_encoder(sc->data, "video_encoder",
+			"video_encoder", true);
+	sc->audio_encoder = create_encoder(sc->data, "audio_encoder",
+			"audio_encoder", false);
+
+	if (!create_outputs(sc))
+		return false;
+
+	load_events(sc);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	struct scenario sc = {0};
+	profiler_name_store_t *store;
+	int ret = 1;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <scenario.json>\n", argv[0]);
+		return 1;
+	}
+
+	sc.data = obs_data_create_from_json_file(argv[1]);
+	if (!sc.data) {
+		fprintf(stderr, "Could not read scenario '%s'\n", argv[1]);
+		return 1;
+	}
+
+	obs_data_set_default_int(sc.data, "timeline_events",
+			DEFAULT_TIMELINE_EVENTS);
+	if (*obs_data_get_string(sc.data, "timeline"))
+		profiler_timeline_enable((size_t)obs_data_get_int(sc.data,
+					"timeline_events"));
+
+	store = profiler_name_store_create();
+	profiler_start();
+
+	if (!obs_startup("en-US", NULL, store)) {
+		fprintf(stderr, "obs_startup failed\n");
+		goto shutdown;
+	}
+
+	if (scenario_init(&sc)) {
+		run_scenario(&sc);
+		write_results(&sc);
+		write_profiler_data(&sc);
+		ret = 0;
+	}
+
+	scenario_free(&sc);
+
+shutdown:
+	obs_shutdown();
+	obs_data_release(sc.data);
+
+	profiler_stop();
+	profiler_free();
+	profiler_name_store_free(store);
+
+	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	return ret;
+}
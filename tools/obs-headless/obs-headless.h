@@ -0,0 +1,4 @@
+#pragma once
+
+/* registers synthetic_video and synthetic_audio */
+extern void register_synthetic_sources(void);
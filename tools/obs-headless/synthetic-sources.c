@@ -0,0 +1,424 @@
+#include <math.h>
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "obs-headless.h"
+
+#ifndef M_PI
+#define M_PI 3.1415926535897932384626433832795
+#endif
+
+#define AUDIO_PACKET_MS 10
+
+static inline uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* ------------------------------------------------------------------------- */
+/* synthetic_video: asynchronous pattern/noise source                        */
+
+struct synthetic_video {
+	obs_source_t           *source;
+	os_event_t             *stop_event;
+	pthread_t              thread;
+	bool                   thread_active;
+
+	uint32_t               width;
+	uint32_t               height;
+	uint32_t               fps;
+	bool                   noise;
+	enum video_format      format;
+
+	struct obs_source_frame frame;
+	uint8_t                *buffer;
+	uint32_t               rng;
+};
+
+static const char *synthetic_video_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Synthetic Video";
+}
+
+static enum video_format format_from_name(const char *name)
+{
+	if (astrcmpi(name, "NV12") == 0)
+		return VIDEO_FORMAT_NV12;
+	if (astrcmpi(name, "BGRA") == 0)
+		return VIDEO_FORMAT_BGRA;
+	return VIDEO_FORMAT_I420;
+}
+
+static void alloc_video_frame(struct synthetic_video *sv)
+{
+	struct obs_source_frame *frame = &sv->frame;
+	uint32_t w = sv->width;
+	uint32_t h = sv->height;
+	size_t size;
+
+	memset(frame, 0, sizeof(*frame));
+	frame->width  = w;
+	frame->height = h;
+	frame->format = sv->format;
+
+	switch (sv->format) {
+	case VIDEO_FORMAT_NV12:
+		size = w * h + w * (h / 2);
+		sv->buffer = bmalloc(size);
+		frame->data[0] = sv->buffer;
+		frame->data[1] = sv->buffer + w * h;
+		frame->linesize[0] = w;
+		frame->linesize[1] = w;
+		break;
+	case VIDEO_FORMAT_BGRA:
+		size = w * h * 4;
+		sv->buffer = bmalloc(size);
+		frame->data[0] = sv->buffer;
+		frame->linesize[0] = w * 4;
+		break;
+	default:
+		size = w * h + (w / 2) * (h / 2) * 2;
+		sv->buffer = bmalloc(size);
+		frame->data[0] = sv->buffer;
+		frame->data[1] = sv->buffer + w * h;
+		frame->data[2] = frame->data[1] + (w / 2) * (h / 2);
+		frame->linesize[0] = w;
+		frame->linesize[1] = w / 2;
+		frame->linesize[2] = w / 2;
+	}
+
+	video_format_get_parameters(VIDEO_CS_601, VIDEO_RANGE_PARTIAL,
+			frame->color_matrix, frame->color_range_min,
+			frame->color_range_max);
+}
+
+static void fill_plane(struct synthetic_video *sv, uint8_t *plane,
+		uint32_t linesize, uint32_t bytes, uint32_t lines,
+		uint64_t frame_idx)
+{
+	if (sv->noise) {
+		for (uint32_t y = 0; y < lines; y++) {
+			uint32_t *row = (uint32_t*)(plane + y * linesize);
+			for (uint32_t x = 0; x < bytes / 4; x++)
+				row[x] = xorshift32(&sv->rng);
+		}
+	} else {
+		/* eight vertical bars scrolling one pixel per frame */
+		uint32_t bar = bytes / 8 ? bytes / 8 : 1;
+		for (uint32_t y = 0; y < lines; y++) {
+			uint8_t *row = plane + y * linesize;
+			for (uint32_t x = 0; x < bytes; x++) {
+				uint32_t idx = (uint32_t)((x + frame_idx) / bar);
+				row[x] = (uint8_t)(idx * 32 + 16);
+			}
+		}
+	}
+}
+
+static void fill_video_frame(struct synthetic_video *sv, uint64_t frame_idx)
+{
+	struct obs_source_frame *frame = &sv->frame;
+	uint32_t w = sv->width;
+	uint32_t h = sv->height;
+
+	switch (sv->format) {
+	case VIDEO_FORMAT_NV12:
+		fill_plane(sv, frame->data[0], frame->linesize[0], w, h,
+				frame_idx);
+		fill_plane(sv, frame->data[1], frame->linesize[1], w, h / 2,
+				frame_idx);
+		break;
+	case VIDEO_FORMAT_BGRA:
+		fill_plane(sv, frame->data[0], frame->linesize[0], w * 4, h,
+				frame_idx);
+		break;
+	default:
+		fill_plane(sv, frame->data[0], frame->linesize[0], w, h,
+				frame_idx);
+		fill_plane(sv, frame->data[1], frame->linesize[1], w / 2,
+				h / 2, frame_idx);
+		fill_plane(sv, frame->data[2], frame->linesize[2], w / 2,
+				h / 2, frame_idx);
+	}
+}
+
+static void *synthetic_video_thread(void *data)
+{
+	struct synthetic_video *sv = data;
+	uint64_t interval = 1000000000ULL / sv->fps;
+	uint64_t start = os_gettime_ns();
+	uint64_t frame_idx = 0;
+
+	os_set_thread_name("synthetic video");
+
+	while (os_event_try(sv->stop_event) == EAGAIN) {
+		uint64_t target = start + frame_idx * interval;
+
+		os_sleepto_ns(target);
+
+		profile_start("synthetic_video_fill");
+		fill_video_frame(sv, frame_idx);
+		profile_end("synthetic_video_fill");
+
+		sv->frame.timestamp = target;
+		obs_source_output_video(sv->source, &sv->frame);
+		frame_idx++;
+	}
+
+	return NULL;
+}
+
+static void synthetic_video_stop(struct synthetic_video *sv)
+{
+	if (sv->thread_active) {
+		os_event_signal(sv->stop_event);
+		pthread_join(sv->thread, NULL);
+		os_event_reset(sv->stop_event);
+		sv->thread_active = false;
+	}
+
+	bfree(sv->buffer);
+	sv->buffer = NULL;
+}
+
+static void synthetic_video_update(void *data, obs_data_t *settings)
+{
+	struct synthetic_video *sv = data;
+
+	synthetic_video_stop(sv);
+
+	sv->width  = (uint32_t)obs_data_get_int(settings, "width") & ~7;
+	sv->height = (uint32_t)obs_data_get_int(settings, "height") & ~1;
+	sv->fps    = (uint32_t)obs_data_get_int(settings, "fps");
+	sv->noise  = astrcmpi(obs_data_get_string(settings, "pattern"),
+			"noise") == 0;
+	sv->format = format_from_name(obs_data_get_string(settings, "format"));
+
+	if (!sv->width || !sv->height || !sv->fps) {
+		blog(LOG_WARNING, "synthetic_video: invalid size or fps");
+		return;
+	}
+
+	alloc_video_frame(sv);
+
+	if (pthread_create(&sv->thread, NULL, synthetic_video_thread, sv) != 0)
+		blog(LOG_WARNING, "synthetic_video: failed to create thread");
+	else
+		sv->thread_active = true;
+}
+
+static void synthetic_video_destroy(void *data)
+{
+	struct synthetic_video *sv = data;
+
+	if (sv) {
+		synthetic_video_stop(sv);
+		os_event_destroy(sv->stop_event);
+		bfree(sv);
+	}
+}
+
+static void *synthetic_video_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct synthetic_video *sv = bzalloc(sizeof(struct synthetic_video));
+	sv->source = source;
+	sv->rng    = 0x9E3779B9;
+
+	if (os_event_init(&sv->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		bfree(sv);
+		return NULL;
+	}
+
+	synthetic_video_update(sv, settings);
+	return sv;
+}
+
+static void synthetic_video_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "width", 1280);
+	obs_data_set_default_int(settings, "height", 720);
+	obs_data_set_default_int(settings, "fps", 30);
+	obs_data_set_default_string(settings, "pattern", "bars");
+	obs_data_set_default_string(settings, "format", "I420");
+}
+
+static uint32_t synthetic_video_width(void *data)
+{
+	struct synthetic_video *sv = data;
+	return sv->width;
+}
+
+static uint32_t synthetic_video_height(void *data)
+{
+	struct synthetic_video *sv = data;
+	return sv->height;
+}
+
+static struct obs_source_info synthetic_video_info = {
+	.id           = "synthetic_video",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO,
+	.get_name     = synthetic_video_name,
+	.create       = synthetic_video_create,
+	.destroy      = synthetic_video_destroy,
+	.update       = synthetic_video_update,
+	.get_defaults = synthetic_video_defaults,
+	.get_width    = synthetic_video_width,
+	.get_height   = synthetic_video_height
+};
+
+/* ------------------------------------------------------------------------- */
+/* synthetic_audio: tone/noise source                                        */
+
+struct synthetic_audio {
+	obs_source_t           *source;
+	os_event_t             *stop_event;
+	pthread_t              thread;
+	bool                   thread_active;
+
+	bool                   noise;
+	double                 frequency;
+	float                  volume;
+	uint32_t               rng;
+};
+
+static const char *synthetic_audio_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Synthetic Audio";
+}
+
+static void *synthetic_audio_thread(void *data)
+{
+	struct synthetic_audio *sa = data;
+	uint32_t sample_rate = audio_output_get_sample_rate(obs_get_audio());
+	uint32_t frames = sample_rate * AUDIO_PACKET_MS / 1000;
+	float *samples = bmalloc(frames * sizeof(float));
+	struct obs_source_audio audio = {0};
+	uint64_t start = os_gettime_ns();
+	uint64_t total_frames = 0;
+	double phase = 0.0;
+	double step = 2.0 * M_PI * sa->frequency / (double)sample_rate;
+
+	os_set_thread_name("synthetic audio");
+
+	audio.data[0]         = (uint8_t*)samples;
+	audio.data[1]         = (uint8_t*)samples;
+	audio.frames          = frames;
+	audio.speakers        = SPEAKERS_STEREO;
+	audio.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+	audio.samples_per_sec = sample_rate;
+
+	while (os_event_try(sa->stop_event) == EAGAIN) {
+		uint64_t ts = start + total_frames * 1000000000ULL /
+			sample_rate;
+
+		os_sleepto_ns(ts);
+
+		for (uint32_t i = 0; i < frames; i++) {
+			if (sa->noise) {
+				uint32_t r = xorshift32(&sa->rng);
+				samples[i] = ((float)(r >> 8) / 8388608.0f -
+						1.0f) * sa->volume;
+			} else {
+				samples[i] = (float)sin(phase) * sa->volume;
+				phase += step;
+			}
+		}
+		phase = fmod(phase, 2.0 * M_PI);
+
+		audio.timestamp = ts;
+		obs_source_output_audio(sa->source, &audio);
+		total_frames += frames;
+	}
+
+	bfree(samples);
+	return NULL;
+}
+
+static void synthetic_audio_stop(struct synthetic_audio *sa)
+{
+	if (sa->thread_active) {
+		os_event_signal(sa->stop_event);
+		pthread_join(sa->thread, NULL);
+		os_event_reset(sa->stop_event);
+		sa->thread_active = false;
+	}
+}
+
+static void synthetic_audio_update(void *data, obs_data_t *settings)
+{
+	struct synthetic_audio *sa = data;
+
+	synthetic_audio_stop(sa);
+
+	sa->noise     = astrcmpi(obs_data_get_string(settings, "waveform"),
+			"noise") == 0;
+	sa->frequency = obs_data_get_double(settings, "frequency");
+	sa->volume    = (float)obs_data_get_double(settings, "volume");
+
+	if (pthread_create(&sa->thread, NULL, synthetic_audio_thread, sa) != 0)
+		blog(LOG_WARNING, "synthetic_audio: failed to create thread");
+	else
+		sa->thread_active = true;
+}
+
+static void synthetic_audio_destroy(void *data)
+{
+	struct synthetic_audio *sa = data;
+
+	if (sa) {
+		synthetic_audio_stop(sa);
+		os_event_destroy(sa->stop_event);
+		bfree(sa);
+	}
+}
+
+static void *synthetic_audio_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct synthetic_audio *sa = bzalloc(sizeof(struct synthetic_audio));
+	sa->source = source;
+	sa->rng    = 0x2545F491;
+
+	if (os_event_init(&sa->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		bfree(sa);
+		return NULL;
+	}
+
+	synthetic_audio_update(sa, settings);
+	return sa;
+}
+
+static void synthetic_audio_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_string(settings, "waveform", "tone");
+	obs_data_set_default_double(settings, "frequency", 440.0);
+	obs_data_set_default_double(settings, "volume", 0.5);
+}
+
+static struct obs_source_info synthetic_audio_info = {
+	.id           = "synthetic_audio",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.get_name     = synthetic_audio_name,
+	.create       = synthetic_audio_create,
+	.destroy      = synthetic_audio_destroy,
+	.update       = synthetic_audio_update,
+	.get_defaults = synthetic_audio_defaults
+};
+
+/* ------------------------------------------------------------------------- */
+
+void register_synthetic_sources(void)
+{
+	obs_register_source(&synthetic_video_info);
+	obs_register_source(&synthetic_audio_info);
+}
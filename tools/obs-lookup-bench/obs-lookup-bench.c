@@ -0,0 +1,221 @@
+/*
+ * obs-lookup-bench: measures the by-name and by-id lookups of libobs with a
+ * large number of registered objects.
+ *
+ * usage: obs-lookup-bench [options]
+ *   --objects <n>     sources and outputs to create (default 2000)
+ *   --lookups <n>     lookups per case (default 1000000)
+ *
+ * One "key=value" line is printed per case, e.g.
+ *   source_by_name objects=2000 ns_per_lookup=...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+static const char *bench_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return "bench";
+}
+
+static void *bench_source_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void *bench_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	UNUSED_PARAMETER(settings);
+	return output;
+}
+
+static void bench_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static bool bench_start(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return false;
+}
+
+static void bench_stop(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static void bench_encoded_packet(void *data, struct encoder_packet *packet)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(packet);
+}
+
+static char **register_bench_types(size_t count)
+{
+	char **ids = bzalloc(count * sizeof(char*));
+	struct obs_output_info output = {0};
+	struct dstr id = {0};
+
+	/* pad the type array so type lookups aren't trivially short */
+	for (size_t i = 0; i < count; i++) {
+		struct obs_source_info info = {0};
+
+		dstr_printf(&id, "bench_source_%d", (int)i);
+		ids[i] = bstrdup(id.array);
+
+		info.id           = ids[i];
+		info.type         = OBS_SOURCE_TYPE_INPUT;
+		info.output_flags = OBS_SOURCE_AUDIO;
+		info.get_name     = bench_get_name;
+		info.create       = bench_source_create;
+		info.destroy      = bench_destroy;
+		obs_register_source(&info);
+	}
+
+	output.id             = "bench_output";
+	output.flags          = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED;
+	output.get_name       = bench_get_name;
+	output.create         = bench_output_create;
+	output.destroy        = bench_destroy;
+	output.start          = bench_start;
+	output.stop           = bench_stop;
+	output.encoded_packet = bench_encoded_packet;
+	obs_register_output(&output);
+
+	dstr_free(&id);
+	return ids;
+}
+
+static double ns_per_op(uint64_t start, uint64_t end, size_t count)
+{
+	return (double)(end - start) / (double)count;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t objects = 2000;
+	size_t lookups = 1000000;
+	DARRAY(obs_source_t*) sources;
+	DARRAY(obs_output_t*) outputs;
+	struct dstr name = {0};
+	char **type_ids;
+	uint64_t start;
+	size_t found = 0;
+
+	for (int i = 1; i < argc; i++) {
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(argv[i], "--objects") == 0 && val) {
+			objects = (size_t)strtoul(val, NULL, 10);
+			i++;
+		} else if (strcmp(argv[i], "--lookups") == 0 && val) {
+			lookups = (size_t)strtoul(val, NULL, 10);
+			i++;
+		} else {
+			fprintf(stderr, "usage: %s [--objects n] "
+					"[--lookups n]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!objects || !lookups) {
+		fprintf(stderr, "invalid object or lookup count\n");
+		return 1;
+	}
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "obs_startup failed\n");
+		return 1;
+	}
+
+	da_init(sources);
+	da_init(outputs);
+
+	type_ids = register_bench_types(objects);
+
+	for (size_t i = 0; i < objects; i++) {
+		obs_source_t *source;
+		obs_output_t *output;
+
+		dstr_printf(&name, "source %d", (int)i);
+		source = obs_source_create(OBS_SOURCE_TYPE_INPUT,
+				"bench_source_0", name.array, NULL, NULL);
+		obs_add_source(source);
+		da_push_back(sources, &source);
+
+		dstr_printf(&name, "output %d", (int)i);
+		output = obs_output_create("bench_output", name.array, NULL,
+				NULL);
+		da_push_back(outputs, &output);
+	}
+
+	srand(0);
+
+	start = os_gettime_ns();
+	for (size_t i = 0; i < lookups; i++) {
+		obs_source_t *source;
+
+		dstr_printf(&name, "source %d", rand() % (int)objects);
+		source = obs_get_source_by_name(name.array);
+		found += source != NULL;
+		obs_source_release(source);
+	}
+	printf("source_by_name objects=%d ns_per_lookup=%.1f\n",
+			(int)objects,
+			ns_per_op(start, os_gettime_ns(), lookups));
+
+	start = os_gettime_ns();
+	for (size_t i = 0; i < lookups; i++) {
+		obs_output_t *output;
+
+		dstr_printf(&name, "output %d", rand() % (int)objects);
+		output = obs_get_output_by_name(name.array);
+		found += output != NULL;
+		obs_output_release(output);
+	}
+	printf("output_by_name objects=%d ns_per_lookup=%.1f\n",
+			(int)objects,
+			ns_per_op(start, os_gettime_ns(), lookups));
+
+	start = os_gettime_ns();
+	for (size_t i = 0; i < lookups; i++) {
+		dstr_printf(&name, "bench_source_%d", rand() % (int)objects);
+		found += obs_source_get_display_name(OBS_SOURCE_TYPE_INPUT,
+				name.array) != NULL;
+	}
+	printf("source_type_by_id types=%d ns_per_lookup=%.1f\n",
+			(int)objects,
+			ns_per_op(start, os_gettime_ns(), lookups));
+
+	if (found != lookups * 3)
+		fprintf(stderr, "only %d of %d lookups succeeded\n",
+				(int)found, (int)(lookups * 3));
+
+	for (size_t i = 0; i < sources.num; i++) {
+		obs_source_remove(sources.array[i]);
+		obs_source_release(sources.array[i]);
+	}
+	for (size_t i = 0; i < outputs.num; i++)
+		obs_output_release(outputs.array[i]);
+
+	da_free(sources);
+	da_free(outputs);
+	dstr_free(&name);
+
+	obs_shutdown();
+
+	for (size_t i = 0; i < objects; i++)
+		bfree(type_ids[i]);
+	bfree(type_ids);
+
+	return found == lookups * 3 ? 0 : 1;
+}
@@ -0,0 +1,676 @@
+/*
+ * output-refs-test: checks that the output_refs counts libobs keeps up to
+ * date incrementally match a full walk of the source tree from the output
+ * channels.  Random edits are made to nested scenes, filters and sources
+ * with children (add/remove items, visibility, filters, channel sources),
+ * and after each one every source's count is compared with the number of
+ * edges the walk finds leading to it, so the set tick_sources ticks is
+ * checked as well.
+ *
+ * The "test_parent" type adds its children with obs_source_add_child but
+ * deliberately reports one more source from enum_sources, one it never
+ * added, to show that the counts don't depend on what a plugin enumerates.
+ * (It can't report fewer: obs_source_add_child finds cycles through
+ * enum_sources.)
+ *
+ * Links against libobs and reads output_refs through obs-internal.h.  No
+ * video or graphics module is needed.
+ *
+ * usage: output-refs-test [options]
+ *   --steps <n>      random edits to make (default 20000)
+ *   --seed <n>       random seed (default 1)
+ *
+ * One "key=value" line is printed, e.g.
+ *   result=pass steps=20000 mismatches=0 max_reachable=37 sources=64
+ * and the exit code is 0 only when no count ever differed.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+
+#include "../../libobs/obs-internal.h"
+
+#define NUM_INPUTS   24
+#define NUM_SCENES   12
+#define NUM_PARENTS  6
+#define NUM_FILTERS  16
+#define NUM_CHANNELS 3
+
+/* per scene and per test_parent, and the longest path in sources */
+#define MAX_CHILDREN 4
+#define MAX_DEPTH    6
+
+/* ------------------------------------------------------------------------- */
+/* test source types */
+
+struct test_parent {
+	obs_source_t               *source;
+	DARRAY(obs_source_t*)      children;
+};
+
+static const char *test_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return "test";
+}
+
+static void *test_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void test_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static uint32_t test_get_size(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return 16;
+}
+
+static void *test_parent_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct test_parent *parent = bzalloc(sizeof(struct test_parent));
+	parent->source = source;
+
+	UNUSED_PARAMETER(settings);
+	return parent;
+}
+
+static void test_parent_destroy(void *data)
+{
+	struct test_parent *parent = data;
+
+	for (size_t i = 0; i < parent->children.num; i++) {
+		obs_source_remove_child(parent->source,
+				parent->children.array[i]);
+		obs_source_release(parent->children.array[i]);
+	}
+
+	da_free(parent->children);
+	bfree(parent);
+}
+
+/* reported by every parent without being added, see the top of the file */
+static obs_source_t *unlisted_source = NULL;
+
+static void test_parent_enum_sources(void *data,
+		obs_source_enum_proc_t enum_callback, void *param)
+{
+	struct test_parent *parent = data;
+
+	for (size_t i = 0; i < parent->children.num; i++)
+		enum_callback(parent->source, parent->children.array[i],
+				param);
+
+	if (unlisted_source)
+		enum_callback(parent->source, unlisted_source, param);
+}
+
+static void register_test_types(void)
+{
+	struct obs_source_info input  = {0};
+	struct obs_source_info filter = {0};
+	struct obs_source_info parent = {0};
+
+	input.id           = "test_input";
+	input.type         = OBS_SOURCE_TYPE_INPUT;
+	input.output_flags = OBS_SOURCE_VIDEO;
+	input.get_name     = test_get_name;
+	input.create       = test_create;
+	input.destroy      = test_destroy;
+	input.get_width    = test_get_size;
+	input.get_height   = test_get_size;
+	obs_register_source(&input);
+
+	filter.id           = "test_filter";
+	filter.type         = OBS_SOURCE_TYPE_FILTER;
+	filter.output_flags = OBS_SOURCE_VIDEO;
+	filter.get_name     = test_get_name;
+	filter.create       = test_create;
+	filter.destroy      = test_destroy;
+	obs_register_source(&filter);
+
+	parent.id           = "test_parent";
+	parent.type         = OBS_SOURCE_TYPE_INPUT;
+	parent.output_flags = OBS_SOURCE_VIDEO;
+	parent.get_name     = test_get_name;
+	parent.create       = test_parent_create;
+	parent.destroy      = test_parent_destroy;
+	parent.get_width    = test_get_size;
+	parent.get_height   = test_get_size;
+	parent.enum_sources = test_parent_enum_sources;
+	obs_register_source(&parent);
+}
+
+/* ------------------------------------------------------------------------- */
+/* the sources being edited */
+
+struct test_state {
+	obs_source_t *inputs[NUM_INPUTS];
+	obs_scene_t  *scenes[NUM_SCENES];
+	obs_source_t *parents[NUM_PARENTS];
+	obs_source_t *filters[NUM_FILTERS];
+
+	/* every source above, in one list */
+	DARRAY(obs_source_t*) all;
+};
+
+static obs_source_t *random_source(struct test_state *ts)
+{
+	return ts->all.array[rand() % ts->all.num];
+}
+
+static obs_source_t *random_item_source(struct test_state *ts)
+{
+	obs_source_t *source;
+
+	/* filters can't be scene items or children */
+	do {
+		source = random_source(ts);
+	} while (obs_source_get_type(source) == OBS_SOURCE_TYPE_FILTER);
+
+	return source;
+}
+
+static struct test_parent *get_parent(obs_source_t *source)
+{
+	return source->context.data;
+}
+
+/* ------------------------------------------------------------------------- */
+/* the full walk */
+
+struct walk {
+	DARRAY(obs_source_t*) visited;
+	DARRAY(obs_source_t*) edges;
+};
+
+static void walk_source(struct walk *walk, obs_source_t *source);
+
+static void walk_edge(struct walk *walk, obs_source_t *child)
+{
+	da_push_back(walk->edges, &child);
+	walk_source(walk, child);
+}
+
+static bool walk_item(obs_scene_t *scene, obs_sceneitem_t *item, void *param)
+{
+	if (obs_sceneitem_visible(item))
+		walk_edge(param, obs_sceneitem_get_source(item));
+
+	UNUSED_PARAMETER(scene);
+	return true;
+}
+
+static void walk_filter(obs_source_t *parent, obs_source_t *filter,
+		void *param)
+{
+	walk_edge(param, filter);
+	UNUSED_PARAMETER(parent);
+}
+
+static void walk_source(struct walk *walk, obs_source_t *source)
+{
+	obs_scene_t *scene = obs_scene_from_source(source);
+
+	/* a source's edges only count once it is reachable itself */
+	if (da_find(walk->visited, &source, 0) != DARRAY_INVALID)
+		return;
+
+	da_push_back(walk->visited, &source);
+
+	if (scene) {
+		obs_scene_enum_items(scene, walk_item, walk);
+		return;
+	}
+
+	if (obs_source_get_type(source) == OBS_SOURCE_TYPE_INPUT)
+		obs_source_enum_filters(source, walk_filter, walk);
+
+	/* the children the parent actually added, not what it enumerates */
+	if (strcmp(obs_source_get_id(source), "test_parent") == 0) {
+		struct test_parent *parent = get_parent(source);
+
+		for (size_t i = 0; i < parent->children.num; i++)
+			walk_edge(walk, parent->children.array[i]);
+	}
+}
+
+static long count_edges(struct walk *walk, obs_source_t *source)
+{
+	long count = 0;
+
+	for (size_t i = 0; i < walk->edges.num; i++) {
+		if (walk->edges.array[i] == source)
+			count++;
+	}
+
+	return count;
+}
+
+/* returns the number of sources whose count differs from the walk */
+static int check_counts(struct test_state *ts, int step, size_t *reachable)
+{
+	struct walk walk = {0};
+	int mismatches = 0;
+
+	for (uint32_t i = 0; i < NUM_CHANNELS; i++) {
+		obs_source_t *source = obs_get_output_source(i);
+		if (source) {
+			walk_edge(&walk, source);
+			obs_source_release(source);
+		}
+	}
+
+	for (size_t i = 0; i < ts->all.num; i++) {
+		obs_source_t *source = ts->all.array[i];
+		long expected = count_edges(&walk, source);
+
+		if (source->output_refs != expected) {
+			fprintf(stderr, "step %d: '%s' has output_refs %ld, "
+					"the walk found %ld\n", step,
+					obs_source_get_name(source),
+					(long)source->output_refs, expected);
+			mismatches++;
+		}
+	}
+
+	*reachable = walk.visited.num;
+
+	da_free(walk.visited);
+	da_free(walk.edges);
+	return mismatches;
+}
+
+/* ------------------------------------------------------------------------- */
+/* keeping the tree shallow */
+
+/* obs_source_add_child and the active/showing walks visit every path
+ * through the tree, which grows exponentially with the nesting depth.
+ * Edits that would make the longest path longer than MAX_DEPTH are
+ * skipped, heights are worked out once per source here. */
+
+struct depth_check {
+	obs_source_t *new_parent;
+	obs_source_t *new_child;
+
+	DARRAY(obs_source_t*) done;
+	DARRAY(int)           heights;
+	DARRAY(obs_source_t*) stack;
+	bool                  cycle;
+};
+
+struct height_param {
+	struct depth_check *check;
+	int                max;
+};
+
+static int source_height(struct depth_check *check, obs_source_t *source);
+
+static void height_child(struct height_param *hp, obs_source_t *child)
+{
+	int height = source_height(hp->check, child);
+	if (height > hp->max)
+		hp->max = height;
+}
+
+static bool height_item(obs_scene_t *scene, obs_sceneitem_t *item,
+		void *param)
+{
+	height_child(param, obs_sceneitem_get_source(item));
+
+	UNUSED_PARAMETER(scene);
+	return true;
+}
+
+static void height_filter(obs_source_t *parent, obs_source_t *filter,
+		void *param)
+{
+	height_child(param, filter);
+	UNUSED_PARAMETER(parent);
+}
+
+/* every edge counts here, hidden items included */
+static int source_height(struct depth_check *check, obs_source_t *source)
+{
+	struct height_param hp = {check, 0};
+	obs_scene_t *scene = obs_scene_from_source(source);
+	size_t idx = da_find(check->done, &source, 0);
+
+	if (idx != DARRAY_INVALID)
+		return check->heights.array[idx];
+
+	/* only the new edge can close a cycle, libobs refuses it */
+	if (da_find(check->stack, &source, 0) != DARRAY_INVALID) {
+		check->cycle = true;
+		return 0;
+	}
+
+	da_push_back(check->stack, &source);
+
+	if (scene)
+		obs_scene_enum_items(scene, height_item, &hp);
+	else
+		obs_source_enum_filters(source, height_filter, &hp);
+
+	if (strcmp(obs_source_get_id(source), "test_parent") == 0) {
+		struct test_parent *parent = get_parent(source);
+
+		for (size_t i = 0; i < parent->children.num; i++)
+			height_child(&hp, parent->children.array[i]);
+		if (unlisted_source)
+			height_child(&hp, unlisted_source);
+	}
+
+	if (source == check->new_parent)
+		height_child(&hp, check->new_child);
+
+	da_pop_back(check->stack);
+
+	hp.max++;
+	da_push_back(check->done, &source);
+	da_push_back(check->heights, &hp.max);
+	return hp.max;
+}
+
+/* whether adding child below parent keeps every path within MAX_DEPTH
+ * (or would make a cycle, which libobs is expected to refuse) */
+static bool stays_shallow(struct test_state *ts, obs_source_t *parent,
+		obs_source_t *child)
+{
+	struct depth_check check = {0};
+	int max = 0;
+
+	check.new_parent = parent;
+	check.new_child  = child;
+
+	for (size_t i = 0; i < ts->all.num && !check.cycle; i++) {
+		int height = source_height(&check, ts->all.array[i]);
+		if (height > max)
+			max = height;
+	}
+
+	da_free(check.done);
+	da_free(check.heights);
+	da_free(check.stack);
+	return check.cycle || max <= MAX_DEPTH;
+}
+
+/* ------------------------------------------------------------------------- */
+/* random edits */
+
+struct item_list {
+	DARRAY(obs_sceneitem_t*) items;
+};
+
+static bool collect_item(obs_scene_t *scene, obs_sceneitem_t *item,
+		void *param)
+{
+	struct item_list *list = param;
+
+	obs_sceneitem_addref(item);
+	da_push_back(list->items, &item);
+
+	UNUSED_PARAMETER(scene);
+	return true;
+}
+
+/* calls edit on a random item of a random scene, if it has any */
+static void edit_random_item(struct test_state *ts,
+		void (*edit)(obs_sceneitem_t *item))
+{
+	obs_scene_t *scene = ts->scenes[rand() % NUM_SCENES];
+	struct item_list list = {0};
+
+	obs_scene_enum_items(scene, collect_item, &list);
+
+	if (list.items.num)
+		edit(list.items.array[rand() % list.items.num]);
+
+	for (size_t i = 0; i < list.items.num; i++)
+		obs_sceneitem_release(list.items.array[i]);
+	da_free(list.items);
+}
+
+static void toggle_visible(obs_sceneitem_t *item)
+{
+	obs_sceneitem_set_visible(item, !obs_sceneitem_visible(item));
+}
+
+static void remove_item(obs_sceneitem_t *item)
+{
+	obs_sceneitem_remove(item);
+}
+
+static bool count_item(obs_scene_t *scene, obs_sceneitem_t *item,
+		void *param)
+{
+	(*(size_t*)param)++;
+
+	UNUSED_PARAMETER(scene);
+	UNUSED_PARAMETER(item);
+	return true;
+}
+
+static void add_item(struct test_state *ts)
+{
+	obs_scene_t *scene = ts->scenes[rand() % NUM_SCENES];
+	obs_source_t *source = random_item_source(ts);
+	obs_sceneitem_t *item;
+	size_t count = 0;
+
+	obs_scene_enum_items(scene, count_item, &count);
+	if (count >= MAX_CHILDREN)
+		return;
+	if (!stays_shallow(ts, obs_scene_get_source(scene), source))
+		return;
+
+	/* refused when it would make a cycle */
+	item = obs_scene_add(scene, source);
+	if (item && rand() % 4 == 0)
+		obs_sceneitem_set_visible(item, false);
+}
+
+static void move_filter(struct test_state *ts)
+{
+	obs_source_t *filter = ts->filters[rand() % NUM_FILTERS];
+	obs_source_t *parent = obs_filter_get_parent(filter);
+
+	if (parent) {
+		obs_source_filter_remove(parent, filter);
+	} else {
+		obs_source_t *target = rand() % 2 ?
+			ts->inputs[rand() % NUM_INPUTS] :
+			ts->parents[rand() % NUM_PARENTS];
+		if (stays_shallow(ts, target, filter))
+			obs_source_filter_add(target, filter);
+	}
+}
+
+static void edit_children(struct test_state *ts)
+{
+	obs_source_t *source = ts->parents[rand() % NUM_PARENTS];
+	struct test_parent *parent = get_parent(source);
+
+	if (parent->children.num &&
+	    (rand() % 2 || parent->children.num >= MAX_CHILDREN)) {
+		size_t idx = rand() % parent->children.num;
+		obs_source_t *child = parent->children.array[idx];
+
+		da_erase(parent->children, idx);
+		obs_source_remove_child(source, child);
+		obs_source_release(child);
+	} else {
+		obs_source_t *child = random_item_source(ts);
+
+		if (stays_shallow(ts, source, child) &&
+		    obs_source_add_child(source, child)) {
+			obs_source_addref(child);
+			da_push_back(parent->children, &child);
+		}
+	}
+}
+
+static void set_channel(struct test_state *ts)
+{
+	uint32_t channel = (uint32_t)(rand() % NUM_CHANNELS);
+
+	if (rand() % 4 == 0)
+		obs_set_output_source(channel, NULL);
+	else
+		obs_set_output_source(channel, random_item_source(ts));
+}
+
+static void random_edit(struct test_state *ts)
+{
+	switch (rand() % 8) {
+	case 0:
+	case 1: add_item(ts); break;
+	case 2: edit_random_item(ts, remove_item); break;
+	case 3:
+	case 4: edit_random_item(ts, toggle_visible); break;
+	case 5: move_filter(ts); break;
+	case 6: edit_children(ts); break;
+	case 7: set_channel(ts); break;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* scenes refusing cycles is expected, only show errors */
+static void log_handler(int lvl, const char *msg, va_list args, void *param)
+{
+	if (lvl <= LOG_ERROR) {
+		vfprintf(stderr, msg, args);
+		fprintf(stderr, "\n");
+	}
+
+	UNUSED_PARAMETER(param);
+}
+
+static void create_sources(struct test_state *ts)
+{
+	struct dstr name = {0};
+
+	for (int i = 0; i < NUM_INPUTS; i++) {
+		dstr_printf(&name, "input %d", i);
+		ts->inputs[i] = obs_source_create(OBS_SOURCE_TYPE_INPUT,
+				"test_input", name.array, NULL, NULL);
+		da_push_back(ts->all, &ts->inputs[i]);
+	}
+
+	unlisted_source = ts->inputs[0];
+
+	for (int i = 0; i < NUM_SCENES; i++) {
+		obs_source_t *source;
+
+		dstr_printf(&name, "scene %d", i);
+		ts->scenes[i] = obs_scene_create(name.array);
+		source = obs_scene_get_source(ts->scenes[i]);
+		da_push_back(ts->all, &source);
+	}
+
+	for (int i = 0; i < NUM_PARENTS; i++) {
+		dstr_printf(&name, "parent %d", i);
+		ts->parents[i] = obs_source_create(OBS_SOURCE_TYPE_INPUT,
+				"test_parent", name.array, NULL, NULL);
+		da_push_back(ts->all, &ts->parents[i]);
+	}
+
+	for (int i = 0; i < NUM_FILTERS; i++) {
+		dstr_printf(&name, "filter %d", i);
+		ts->filters[i] = obs_source_create(OBS_SOURCE_TYPE_FILTER,
+				"test_filter", name.array, NULL, NULL);
+		da_push_back(ts->all, &ts->filters[i]);
+	}
+
+	dstr_free(&name);
+}
+
+static void destroy_sources(struct test_state *ts)
+{
+	for (int i = 0; i < NUM_FILTERS; i++) {
+		obs_source_t *parent = obs_filter_get_parent(ts->filters[i]);
+		if (parent)
+			obs_source_filter_remove(parent, ts->filters[i]);
+		obs_source_release(ts->filters[i]);
+	}
+
+	for (int i = 0; i < NUM_PARENTS; i++)
+		obs_source_release(ts->parents[i]);
+	for (int i = 0; i < NUM_SCENES; i++)
+		obs_scene_release(ts->scenes[i]);
+	for (int i = 0; i < NUM_INPUTS; i++)
+		obs_source_release(ts->inputs[i]);
+
+	da_free(ts->all);
+}
+
+int main(int argc, char *argv[])
+{
+	struct test_state ts = {0};
+	int steps = 20000;
+	int seed = 1;
+	int mismatches = 0;
+	size_t max_reachable = 0;
+	size_t reachable;
+
+	for (int i = 1; i < argc; i++) {
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(argv[i], "--steps") == 0 && val) {
+			steps = atoi(val);
+			i++;
+		} else if (strcmp(argv[i], "--seed") == 0 && val) {
+			seed = atoi(val);
+			i++;
+		} else {
+			fprintf(stderr, "usage: %s [--steps n] [--seed n]\n",
+					argv[0]);
+			return 1;
+		}
+	}
+
+	base_set_log_handler(log_handler, NULL);
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "obs_startup failed\n");
+		return 1;
+	}
+
+	register_test_types();
+	create_sources(&ts);
+	srand((unsigned)seed);
+
+	for (int step = 0; step < steps; step++) {
+		random_edit(&ts);
+
+		mismatches += check_counts(&ts, step, &reachable);
+		if (reachable > max_reachable)
+			max_reachable = reachable;
+	}
+
+	/* with the channels cleared nothing may be left counted */
+	for (uint32_t i = 0; i < NUM_CHANNELS; i++)
+		obs_set_output_source(i, NULL);
+	mismatches += check_counts(&ts, steps, &reachable);
+
+	printf("result=%s steps=%d mismatches=%d max_reachable=%d "
+	       "sources=%d\n", mismatches ? "fail" : "pass", steps,
+			mismatches, (int)max_reachable, (int)ts.all.num);
+
+	destroy_sources(&ts);
+	obs_shutdown();
+
+	return mismatches ? 1 : 0;
+}
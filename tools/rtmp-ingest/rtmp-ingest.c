@@ -0,0 +1,526 @@
+/*
+ * rtmp-ingest: minimal local RTMP publish endpoint for measuring the
+ * rtmp_output / rtmp_multi_output send path without a real server.
+ *
+ * Built from plugins/obs-outputs/librtmp (amf.c, log.c, parseurl.c, rtmp.c)
+ * and libobs (util/platform.c).  Point the stream output at
+ * rtmp://127.0.0.1:<port>/live with any key.
+ *
+ * usage: rtmp-ingest [options]
+ *   --port <n>            listen port (default 1935)
+ *   --bandwidth <kbps>    cap the receive rate (default unlimited)
+ *   --rtt <ms>            delay every reply to the client by this much
+ *   --stall-every <sec>   stop reading periodically ...
+ *   --stall-for <ms>      ... for this long (default 1000)
+ *   --log <file>          append one CSV line per received media packet
+ *   --once                exit after the first session
+ *
+ * At the end of each session a block of "key=value" lines is printed to
+ * stdout so that runs can be compared by scripts.
+ */
+
+#include <util/platform.h>
+
+#include "../../plugins/obs-outputs/librtmp/rtmp_sys.h"
+#include "../../plugins/obs-outputs/librtmp/rtmp.h"
+#include "../../plugins/obs-outputs/librtmp/log.h"
+
+#define STALL_GAP_NS 500000000ULL
+
+struct ingest_config {
+	unsigned short port;
+	uint64_t       bandwidth_kbps;
+	uint32_t       rtt_ms;
+	uint32_t       stall_every_sec;
+	uint32_t       stall_for_ms;
+	const char     *log_path;
+	bool           once;
+};
+
+struct ingest_stats {
+	uint64_t       start_ns;
+	uint64_t       first_media_ns;
+	uint64_t       last_media_ns;
+	uint32_t       first_ts;
+	bool           have_media;
+
+	uint64_t       bytes;
+	uint64_t       media_bytes;
+	uint64_t       audio_packets;
+	uint64_t       video_packets;
+	uint64_t       keyframes;
+	uint64_t       data_packets;
+
+	uint64_t       max_gap_ns;
+	uint64_t       gaps;
+
+	int64_t        lag_ms;
+	int64_t        max_lag_ms;
+	double         total_lag_ms;
+
+	uint64_t       stalls;
+	uint64_t       throttled_ns;
+};
+
+struct ingest_session {
+	RTMP                 rtmp;
+	struct ingest_config *config;
+	struct ingest_stats  stats;
+	FILE                 *log;
+	int                  next_stream_id;
+	bool                 publishing;
+	bool                 finished;
+	uint64_t             next_stall_ns;
+};
+
+#define SAVC(x) static const AVal av_##x = AVC(#x)
+
+SAVC(connect);
+SAVC(createStream);
+SAVC(publish);
+SAVC(FCUnpublish);
+SAVC(deleteStream);
+SAVC(_result);
+SAVC(onStatus);
+SAVC(fmsVer);
+SAVC(capabilities);
+SAVC(level);
+SAVC(code);
+SAVC(description);
+SAVC(status);
+
+static const AVal av_server_ver = AVC("FMS/3,5,7,7009");
+static const AVal av_connect_success = AVC("NetConnection.Connect.Success");
+static const AVal av_connect_desc = AVC("Connection succeeded.");
+static const AVal av_publish_start = AVC("NetStream.Publish.Start");
+static const AVal av_publish_desc = AVC("Publishing stream.");
+
+/* ------------------------------------------------------------------------- */
+
+static void reply_delay(struct ingest_session *s)
+{
+	if (s->config->rtt_ms)
+		os_sleep_ms(s->config->rtt_ms);
+}
+
+static bool send_invoke(struct ingest_session *s, int channel, int stream_id,
+		char *body, char *end)
+{
+	RTMPPacket packet = {0};
+
+	packet.m_nChannel        = channel;
+	packet.m_headerType      = RTMP_PACKET_SIZE_LARGE;
+	packet.m_packetType      = RTMP_PACKET_TYPE_INVOKE;
+	packet.m_nInfoField2     = stream_id;
+	packet.m_body            = body;
+	packet.m_nBodySize       = (uint32_t)(end - body);
+
+	return !!RTMP_SendPacket(&s->rtmp, &packet, FALSE);
+}
+
+static bool send_connect_result(struct ingest_session *s, double txn)
+{
+	char pbuf[512], *pend = pbuf + sizeof(pbuf);
+	char *body = pbuf + RTMP_MAX_HEADER_SIZE;
+	char *enc = body;
+
+	enc = AMF_EncodeString(enc, pend, &av__result);
+	enc = AMF_EncodeNumber(enc, pend, txn);
+
+	*enc++ = AMF_OBJECT;
+	enc = AMF_EncodeNamedString(enc, pend, &av_fmsVer, &av_server_ver);
+	enc = AMF_EncodeNamedNumber(enc, pend, &av_capabilities, 31.0);
+	*enc++ = 0;
+	*enc++ = 0;
+	*enc++ = AMF_OBJECT_END;
+
+	*enc++ = AMF_OBJECT;
+	enc = AMF_EncodeNamedString(enc, pend, &av_level, &av_status);
+	enc = AMF_EncodeNamedString(enc, pend, &av_code, &av_connect_success);
+	enc = AMF_EncodeNamedString(enc, pend, &av_description,
+			&av_connect_desc);
+	*enc++ = 0;
+	*enc++ = 0;
+	*enc++ = AMF_OBJECT_END;
+
+	return send_invoke(s, 0x03, 0, body, enc);
+}
+
+static bool send_create_stream_result(struct ingest_session *s, double txn)
+{
+	char pbuf[128], *pend = pbuf + sizeof(pbuf);
+	char *body = pbuf + RTMP_MAX_HEADER_SIZE;
+	char *enc = body;
+
+	enc = AMF_EncodeString(enc, pend, &av__result);
+	enc = AMF_EncodeNumber(enc, pend, txn);
+	*enc++ = AMF_NULL;
+	enc = AMF_EncodeNumber(enc, pend, (double)++s->next_stream_id);
+
+	return send_invoke(s, 0x03, 0, body, enc);
+}
+
+static bool send_publish_start(struct ingest_session *s, int stream_id)
+{
+	char pbuf[256], *pend = pbuf + sizeof(pbuf);
+	char *body = pbuf + RTMP_MAX_HEADER_SIZE;
+	char *enc = body;
+
+	enc = AMF_EncodeString(enc, pend, &av_onStatus);
+	enc = AMF_EncodeNumber(enc, pend, 0.0);
+	*enc++ = AMF_NULL;
+
+	*enc++ = AMF_OBJECT;
+	enc = AMF_EncodeNamedString(enc, pend, &av_level, &av_status);
+	enc = AMF_EncodeNamedString(enc, pend, &av_code, &av_publish_start);
+	enc = AMF_EncodeNamedString(enc, pend, &av_description,
+			&av_publish_desc);
+	*enc++ = 0;
+	*enc++ = 0;
+	*enc++ = AMF_OBJECT_END;
+
+	return send_invoke(s, 0x05, stream_id, body, enc);
+}
+
+static bool handle_invoke(struct ingest_session *s, RTMPPacket *packet)
+{
+	AMFObject obj;
+	AVal method;
+	double txn;
+	bool success = true;
+
+	if (!packet->m_nBodySize || packet->m_body[0] != AMF_STRING)
+		return true;
+	if (AMF_Decode(&obj, packet->m_body, packet->m_nBodySize, FALSE) < 0)
+		return false;
+
+	AMFProp_GetString(AMF_GetProp(&obj, NULL, 0), &method);
+	txn = AMFProp_GetNumber(AMF_GetProp(&obj, NULL, 1));
+
+	if (AVMATCH(&method, &av_connect)) {
+		reply_delay(s);
+		success = send_connect_result(s, txn);
+
+	} else if (AVMATCH(&method, &av_createStream)) {
+		reply_delay(s);
+		success = send_create_stream_result(s, txn);
+
+	} else if (AVMATCH(&method, &av_publish)) {
+		reply_delay(s);
+		success = send_publish_start(s, packet->m_nInfoField2);
+		s->publishing = true;
+
+	} else if (AVMATCH(&method, &av_FCUnpublish) ||
+	           AVMATCH(&method, &av_deleteStream)) {
+		s->finished = true;
+	}
+
+	AMF_Reset(&obj);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void record_media(struct ingest_session *s, RTMPPacket *packet,
+		uint64_t now)
+{
+	struct ingest_stats *stats = &s->stats;
+	uint8_t type = packet->m_packetType;
+	bool keyframe = false;
+	int64_t arrival_ms;
+	int64_t media_ms;
+
+	if (type == RTMP_PACKET_TYPE_VIDEO) {
+		keyframe = packet->m_nBodySize &&
+			(packet->m_body[0] & 0xF0) == 0x10;
+		stats->video_packets++;
+		if (keyframe)
+			stats->keyframes++;
+	} else if (type == RTMP_PACKET_TYPE_AUDIO) {
+		stats->audio_packets++;
+	} else {
+		stats->data_packets++;
+		return;
+	}
+
+	stats->media_bytes += packet->m_nBodySize;
+
+	if (!stats->have_media) {
+		stats->have_media     = true;
+		stats->first_media_ns = now;
+		stats->first_ts       = packet->m_nTimeStamp;
+	} else {
+		uint64_t gap = now - stats->last_media_ns;
+		if (gap > stats->max_gap_ns)
+			stats->max_gap_ns = gap;
+		if (gap > STALL_GAP_NS)
+			stats->gaps++;
+	}
+	stats->last_media_ns = now;
+
+	/* how far arrival has fallen behind the stream's own clock */
+	arrival_ms = (int64_t)((now - stats->first_media_ns) / 1000000);
+	media_ms = (int64_t)(packet->m_nTimeStamp - stats->first_ts);
+	stats->lag_ms = arrival_ms - media_ms;
+	if (stats->lag_ms > stats->max_lag_ms)
+		stats->max_lag_ms = stats->lag_ms;
+	stats->total_lag_ms += (double)stats->lag_ms;
+
+	if (s->log)
+		fprintf(s->log, "%llu,%s,%u,%u,%d,%lld\n",
+				(unsigned long long)(now - stats->start_ns),
+				type == RTMP_PACKET_TYPE_VIDEO ? "video" :
+				"audio",
+				packet->m_nTimeStamp, packet->m_nBodySize,
+				keyframe ? 1 : 0, (long long)stats->lag_ms);
+}
+
+static void emulate_link(struct ingest_session *s, uint64_t now)
+{
+	struct ingest_config *config = s->config;
+	struct ingest_stats *stats = &s->stats;
+
+	if (config->stall_every_sec && now >= s->next_stall_ns) {
+		os_sleep_ms(config->stall_for_ms);
+		stats->stalls++;
+		now = os_gettime_ns();
+		s->next_stall_ns = now + config->stall_every_sec * 1000000000ULL;
+	}
+
+	if (config->bandwidth_kbps) {
+		uint64_t allowed_ns = stats->bytes * 8ULL * 1000000ULL /
+			config->bandwidth_kbps;
+		uint64_t target = stats->start_ns + allowed_ns;
+
+		if (target > now) {
+			stats->throttled_ns += target - now;
+			os_sleepto_ns(target);
+		}
+	}
+}
+
+static void print_stats(struct ingest_session *s)
+{
+	struct ingest_stats *stats = &s->stats;
+	uint64_t media_packets = stats->audio_packets + stats->video_packets;
+	uint64_t duration_ns = stats->have_media ?
+		stats->last_media_ns - stats->first_media_ns : 0;
+	double seconds = (double)duration_ns / 1000000000.0;
+
+	printf("session.duration_ms=%llu\n",
+			(unsigned long long)(duration_ns / 1000000));
+	printf("session.bytes=%llu\n", (unsigned long long)stats->bytes);
+	printf("session.media_bytes=%llu\n",
+			(unsigned long long)stats->media_bytes);
+	printf("session.throughput_kbps=%.1f\n", seconds > 0.0 ?
+			(double)stats->media_bytes * 8.0 / 1000.0 / seconds :
+			0.0);
+	printf("session.video_packets=%llu\n",
+			(unsigned long long)stats->video_packets);
+	printf("session.keyframes=%llu\n",
+			(unsigned long long)stats->keyframes);
+	printf("session.audio_packets=%llu\n",
+			(unsigned long long)stats->audio_packets);
+	printf("session.data_packets=%llu\n",
+			(unsigned long long)stats->data_packets);
+	printf("session.max_gap_ms=%llu\n",
+			(unsigned long long)(stats->max_gap_ns / 1000000));
+	printf("session.gaps_over_500ms=%llu\n",
+			(unsigned long long)stats->gaps);
+	printf("session.lag_ms.final=%lld\n", (long long)stats->lag_ms);
+	printf("session.lag_ms.max=%lld\n", (long long)stats->max_lag_ms);
+	printf("session.lag_ms.avg=%.1f\n", media_packets ?
+			stats->total_lag_ms / (double)media_packets : 0.0);
+	printf("session.emulated_stalls=%llu\n",
+			(unsigned long long)stats->stalls);
+	printf("session.throttled_ms=%llu\n",
+			(unsigned long long)(stats->throttled_ns / 1000000));
+	fflush(stdout);
+}
+
+static void run_session(struct ingest_config *config, int sock)
+{
+	struct ingest_session s = {0};
+	RTMPPacket packet = {0};
+
+	s.config = config;
+	RTMP_Init(&s.rtmp);
+	s.rtmp.m_sb.sb_socket = sock;
+	s.rtmp.Link.timeout = 10;
+
+	if (config->log_path)
+		s.log = os_fopen(config->log_path, "a");
+
+	s.stats.start_ns = os_gettime_ns();
+	s.next_stall_ns = s.stats.start_ns +
+		config->stall_every_sec * 1000000000ULL;
+
+	reply_delay(&s);
+	if (!RTMP_Serve(&s.rtmp)) {
+		fprintf(stderr, "handshake failed\n");
+		goto cleanup;
+	}
+
+	while (!s.finished && RTMP_IsConnected(&s.rtmp) &&
+	       RTMP_ReadPacket(&s.rtmp, &packet)) {
+		uint64_t now;
+
+		if (!RTMPPacket_IsReady(&packet))
+			continue;
+
+		now = os_gettime_ns();
+		s.stats.bytes += packet.m_nBodySize;
+
+		switch (packet.m_packetType) {
+		case RTMP_PACKET_TYPE_CHUNK_SIZE:
+			if (packet.m_nBodySize >= 4)
+				s.rtmp.m_inChunkSize =
+					AMF_DecodeInt32(packet.m_body);
+			break;
+
+		case RTMP_PACKET_TYPE_INVOKE:
+			if (!handle_invoke(&s, &packet))
+				s.finished = true;
+			break;
+
+		case RTMP_PACKET_TYPE_AUDIO:
+		case RTMP_PACKET_TYPE_VIDEO:
+		case RTMP_PACKET_TYPE_INFO:
+			record_media(&s, &packet, now);
+			break;
+		}
+
+		RTMPPacket_Free(&packet);
+
+		if (s.publishing)
+			emulate_link(&s, now);
+	}
+
+	print_stats(&s);
+
+cleanup:
+	RTMPPacket_Free(&packet);
+	RTMP_Close(&s.rtmp);
+	if (s.log)
+		fclose(s.log);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int open_listener(unsigned short port)
+{
+	struct sockaddr_in addr = {0};
+	int on = 1;
+	int sock;
+
+	sock = (int)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock == INVALID_SOCKET)
+		return INVALID_SOCKET;
+
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = htons(port);
+
+	if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+	    listen(sock, 4) != 0) {
+		closesocket(sock);
+		return INVALID_SOCKET;
+	}
+
+	return sock;
+}
+
+static bool parse_args(struct ingest_config *config, int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--once") == 0) {
+			config->once = true;
+			continue;
+		}
+
+		if (!val)
+			return false;
+		i++;
+
+		if (strcmp(arg, "--port") == 0)
+			config->port = (unsigned short)atoi(val);
+		else if (strcmp(arg, "--bandwidth") == 0)
+			config->bandwidth_kbps = (uint64_t)atoi(val);
+		else if (strcmp(arg, "--rtt") == 0)
+			config->rtt_ms = (uint32_t)atoi(val);
+		else if (strcmp(arg, "--stall-every") == 0)
+			config->stall_every_sec = (uint32_t)atoi(val);
+		else if (strcmp(arg, "--stall-for") == 0)
+			config->stall_for_ms = (uint32_t)atoi(val);
+		else if (strcmp(arg, "--log") == 0)
+			config->log_path = val;
+		else
+			return false;
+	}
+
+	return config->port != 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ingest_config config = {0};
+	int listener;
+
+	config.port         = 1935;
+	config.stall_for_ms = 1000;
+
+	if (!parse_args(&config, argc, argv)) {
+		fprintf(stderr, "usage: %s [--port n] [--bandwidth kbps] "
+				"[--rtt ms] [--stall-every sec] "
+				"[--stall-for ms] [--log file] [--once]\n",
+				argv[0]);
+		return 1;
+	}
+
+#ifdef _WIN32
+	WSADATA wsad;
+	WSAStartup(MAKEWORD(2, 2), &wsad);
+#endif
+
+	RTMP_LogSetLevel(RTMP_LOGWARNING);
+
+	listener = open_listener(config.port);
+	if (listener == INVALID_SOCKET) {
+		fprintf(stderr, "failed to listen on port %d\n",
+				(int)config.port);
+		return 1;
+	}
+
+	fprintf(stderr, "listening on rtmp://127.0.0.1:%d/live\n",
+			(int)config.port);
+
+	for (;;) {
+		int sock = (int)accept(listener, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+			break;
+
+		if (config.bandwidth_kbps) {
+			/* keep the kernel from hiding the cap behind a large
+			 * receive window */
+			int rcvbuf = 64 * 1024;
+			setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+					sizeof(rcvbuf));
+		}
+
+		run_session(&config, sock);
+		if (config.once)
+			break;
+	}
+
+	closesocket(listener);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * rtmp-send-bench: publishes synthetic FLV tags through librtmp as fast as
+ * the connection takes them, to measure the RTMP_Write/RTMP_SendPacket
+ * send path against tools/rtmp-ingest.
+ *
+ * Built from plugins/obs-outputs/librtmp (amf.c, log.c, parseurl.c, rtmp.c,
+ * md5.c, cencode.c) and libobs (util/platform.c).  Defining COUNT_SENDS
+ * and linking with -Wl,--wrap=send (GNU ld) also counts the send() calls
+ * librtmp makes.
+ *
+ * usage: rtmp-send-bench [options]
+ *   --url <url>               (default rtmp://127.0.0.1:1935/live)
+ *   --frames <n>              video frames to send, each followed by an
+ *                             audio tag (default 20000)
+ *   --chunk-size <n>          initial outgoing chunk size (default 4096,
+ *                             what rtmp_output uses)
+ *   --max-chunk-size <n>      m_maxOutChunkSize, 0 keeps the chunk size
+ *                             fixed (default 65536)
+ *
+ * Video tags are 12-32 KB with a 150 KB keyframe every 60 frames.  One
+ * "key=value" line is printed, e.g.
+ *   frames=20000 media_mb=... wall_ms=... cpu_ms=... cpu_us_per_frame=...
+ *   sends=... sends_per_frame=... final_chunk_size=...
+ */
+
+#include <util/platform.h>
+
+#include "../../plugins/obs-outputs/librtmp/rtmp_sys.h"
+#include "../../plugins/obs-outputs/librtmp/rtmp.h"
+#include "../../plugins/obs-outputs/librtmp/log.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define KEYFRAME_INTERVAL 60
+#define KEYFRAME_SIZE     150000
+#define AUDIO_SIZE        300
+#define FLV_TAG_HEADER    11
+
+struct bench_config {
+	const char *url;
+	int        frames;
+	int        chunk_size;
+	int        max_chunk_size;
+};
+
+#ifdef COUNT_SENDS
+static long long sends = 0;
+
+ssize_t __real_send(int sock, const void *buf, size_t len, int flags);
+
+ssize_t __wrap_send(int sock, const void *buf, size_t len, int flags)
+{
+	sends++;
+	return __real_send(sock, buf, len, flags);
+}
+#endif
+
+static uint64_t process_cpu_ns(void)
+{
+#ifdef _WIN32
+	FILETIME create_time, exit_time, kernel, user;
+	ULARGE_INTEGER k, u;
+
+	GetProcessTimes(GetCurrentProcess(), &create_time, &exit_time, &kernel,
+			&user);
+	k.LowPart  = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart  = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) * 100;
+#else
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+		1000000000ULL +
+		(uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+		1000ULL;
+#endif
+}
+
+/* writes one complete FLV tag (header, body, previous tag size) */
+static bool write_tag(RTMP *rtmp, uint8_t *buf, uint8_t type, uint32_t ts,
+		uint32_t size, bool keyframe)
+{
+	uint32_t tag_size = FLV_TAG_HEADER + size;
+
+	buf[0]  = type;
+	buf[1]  = (uint8_t)(size >> 16);
+	buf[2]  = (uint8_t)(size >> 8);
+	buf[3]  = (uint8_t)size;
+	buf[4]  = (uint8_t)(ts >> 16);
+	buf[5]  = (uint8_t)(ts >> 8);
+	buf[6]  = (uint8_t)ts;
+	buf[7]  = (uint8_t)(ts >> 24);
+	buf[8]  = 0;
+	buf[9]  = 0;
+	buf[10] = 0;
+
+	if (type == RTMP_PACKET_TYPE_VIDEO)
+		buf[FLV_TAG_HEADER] = keyframe ? 0x17 : 0x27;
+
+	buf[tag_size]     = (uint8_t)(tag_size >> 24);
+	buf[tag_size + 1] = (uint8_t)(tag_size >> 16);
+	buf[tag_size + 2] = (uint8_t)(tag_size >> 8);
+	buf[tag_size + 3] = (uint8_t)tag_size;
+
+	return RTMP_Write(rtmp, (const char*)buf, (int)tag_size + 4, 0) > 0;
+}
+
+static bool parse_args(struct bench_config *config, int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (!val)
+			return false;
+		i++;
+
+		if (strcmp(arg, "--url") == 0)
+			config->url = val;
+		else if (strcmp(arg, "--frames") == 0)
+			config->frames = atoi(val);
+		else if (strcmp(arg, "--chunk-size") == 0)
+			config->chunk_size = atoi(val);
+		else if (strcmp(arg, "--max-chunk-size") == 0)
+			config->max_chunk_size = atoi(val);
+		else
+			return false;
+	}
+
+	return config->frames > 0 && config->chunk_size > 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_config config = {0};
+	char url[256];
+	uint64_t media_bytes = 0;
+	uint64_t start_ns, start_cpu, wall_ns, cpu_ns;
+	uint8_t *buf;
+	RTMP rtmp;
+	bool success = true;
+
+	config.url            = "rtmp://127.0.0.1:1935/live";
+	config.frames         = 20000;
+	config.chunk_size     = 4096;
+	config.max_chunk_size = 64 * 1024;
+
+	if (!parse_args(&config, argc, argv)) {
+		fprintf(stderr, "usage: %s [--url url] [--frames n] "
+				"[--chunk-size n] [--max-chunk-size n]\n",
+				argv[0]);
+		return 1;
+	}
+
+#ifdef _WIN32
+	WSADATA wsad;
+	WSAStartup(MAKEWORD(2, 2), &wsad);
+#endif
+
+	RTMP_LogSetLevel(RTMP_LOGWARNING);
+	RTMP_Init(&rtmp);
+
+	/* RTMP_SetupURL points into the string it's given */
+	strncpy(url, config.url, sizeof(url) - 1);
+	url[sizeof(url) - 1] = 0;
+
+	if (!RTMP_SetupURL(&rtmp, url)) {
+		fprintf(stderr, "invalid url '%s'\n", config.url);
+		return 1;
+	}
+
+	RTMP_EnableWrite(&rtmp);
+	RTMP_AddStream(&rtmp, "bench");
+
+	/* the same settings rtmp_output uses */
+	rtmp.m_outChunkSize       = config.chunk_size;
+	rtmp.m_bSendChunkSizeInfo = true;
+	rtmp.m_maxOutChunkSize    = config.max_chunk_size;
+	rtmp.m_bUseNagle          = true;
+
+	if (!RTMP_Connect(&rtmp, NULL) || !RTMP_ConnectStream(&rtmp, 0)) {
+		fprintf(stderr, "failed to connect to '%s'\n", config.url);
+		RTMP_Close(&rtmp);
+		return 1;
+	}
+
+	buf = malloc(FLV_TAG_HEADER + KEYFRAME_SIZE + 4);
+	for (int i = 0; i < KEYFRAME_SIZE; i++)
+		buf[FLV_TAG_HEADER + i] = (uint8_t)(i * 7);
+
+#ifdef COUNT_SENDS
+	sends = 0;
+#endif
+	start_ns  = os_gettime_ns();
+	start_cpu = process_cpu_ns();
+
+	for (int i = 0; i < config.frames && success; i++) {
+		uint32_t ts = (uint32_t)i * 33;
+		bool keyframe = i % KEYFRAME_INTERVAL == 0;
+		uint32_t size = keyframe ? KEYFRAME_SIZE :
+			12000 + (uint32_t)(i * 977) % 20000;
+
+		success = write_tag(&rtmp, buf, RTMP_PACKET_TYPE_VIDEO, ts,
+				size, keyframe) &&
+			write_tag(&rtmp, buf, RTMP_PACKET_TYPE_AUDIO, ts,
+				AUDIO_SIZE, false);
+
+		media_bytes += size + AUDIO_SIZE;
+	}
+
+	wall_ns = os_gettime_ns() - start_ns;
+	cpu_ns  = process_cpu_ns() - start_cpu;
+
+	if (!success)
+		fprintf(stderr, "RTMP_Write failed\n");
+
+	printf("frames=%d media_mb=%.1f wall_ms=%.0f cpu_ms=%.0f "
+			"cpu_us_per_frame=%.2f",
+			config.frames, (double)media_bytes / 1000000.0,
+			(double)wall_ns / 1000000.0,
+			(double)cpu_ns / 1000000.0,
+			(double)cpu_ns / 1000.0 / (double)config.frames);
+#ifdef COUNT_SENDS
+	printf(" sends=%lld sends_per_frame=%.2f", sends,
+			(double)sends / (double)config.frames);
+#endif
+	printf(" final_chunk_size=%d\n", rtmp.m_outChunkSize);
+
+	RTMP_Close(&rtmp);
+	free(buf);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return success ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+/*
+ * text-lookup-bench: measures how long text_lookup_create() takes for a set
+ * of locale files, how much memory the lookups hold, and how fast
+ * text_lookup_getstr() is.
+ *
+ * Built from libobs/util (text-lookup.c, lexer.c, dstr.c, bmem.c,
+ * platform.c and the platform-* file for the OS).
+ *
+ * usage: text-lookup-bench [--lookups n] <ini files...>
+ *
+ * Two cases are run: "parse" removes the cached tables first so every file
+ * is lexed, "cached" loads the tables the first case wrote.  One "key=value"
+ * line is printed per case, e.g.
+ *   parse files=40 ms=... allocs=... bytes=... ns_per_lookup=...
+ * where allocs and bytes are what the lookups hold once created.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/text-lookup.h>
+
+/* ------------------------------------------------------------------------- */
+/* allocator that keeps track of the number of bytes allocated */
+
+static long long live_bytes = 0;
+
+static void *count_malloc(size_t size)
+{
+	size_t *mem = malloc(size + sizeof(size_t) * 2);
+	if (!mem)
+		return NULL;
+
+	mem[0] = size;
+	live_bytes += (long long)size;
+	return mem + 2;
+}
+
+static void count_free(void *ptr)
+{
+	size_t *mem = ptr;
+	if (!mem)
+		return;
+
+	mem -= 2;
+	live_bytes -= (long long)mem[0];
+	free(mem);
+}
+
+static void *count_realloc(void *ptr, size_t size)
+{
+	size_t *mem = ptr;
+	size_t old_size;
+
+	if (!mem)
+		return count_malloc(size);
+
+	mem -= 2;
+	old_size = mem[0];
+	mem = realloc(mem, size + sizeof(size_t) * 2);
+	if (!mem)
+		return NULL;
+
+	mem[0] = size;
+	live_bytes += (long long)size - (long long)old_size;
+	return mem + 2;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void remove_tables(char **files, int num_files)
+{
+	struct dstr path = {0};
+
+	for (int i = 0; i < num_files; i++) {
+		dstr_printf(&path, "%s.table", files[i]);
+		os_unlink(path.array);
+	}
+
+	dstr_free(&path);
+}
+
+/* keys are taken from the files themselves, anything before a '=' */
+static void collect_keys(char **files, int num_files,
+		struct darray *keys)
+{
+	for (int i = 0; i < num_files; i++) {
+		char *data = os_quick_read_utf8_file(files[i]);
+		char *line = data;
+
+		while (line && *line) {
+			char *end = strchr(line, '\n');
+			char *eq  = strchr(line, '=');
+
+			if (eq && (!end || eq < end) && eq > line) {
+				char *key = bstrdup_n(line, eq - line);
+				darray_push_back(sizeof(char*), keys, &key);
+			}
+
+			line = end ? end + 1 : NULL;
+		}
+
+		bfree(data);
+	}
+}
+
+static void run_case(const char *name, char **files, int num_files,
+		char **keys, size_t num_keys, size_t lookups)
+{
+	lookup_t **lookups_arr = bzalloc(sizeof(lookup_t*) * num_files);
+	long allocs_before = bnum_allocs();
+	long long bytes_before = live_bytes;
+	uint64_t start, create_ns, lookup_ns;
+	size_t found = 0;
+
+	start = os_gettime_ns();
+	for (int i = 0; i < num_files; i++)
+		lookups_arr[i] = text_lookup_create(files[i]);
+	create_ns = os_gettime_ns() - start;
+
+	start = os_gettime_ns();
+	for (size_t i = 0; i < lookups && num_keys; i++) {
+		const char *key = keys[i % num_keys];
+		const char *val;
+
+		for (int j = 0; j < num_files; j++) {
+			if (text_lookup_getstr(lookups_arr[j], key, &val)) {
+				found++;
+				break;
+			}
+		}
+	}
+	lookup_ns = os_gettime_ns() - start;
+
+	printf("%s files=%d ms=%.2f allocs=%ld bytes=%lld "
+	       "ns_per_lookup=%.1f found=%d\n",
+			name, num_files, (double)create_ns / 1000000.0,
+			bnum_allocs() - allocs_before - 1,
+			live_bytes - bytes_before -
+			(long long)(sizeof(lookup_t*) * num_files),
+			lookups ? (double)lookup_ns / (double)lookups : 0.0,
+			(int)found);
+
+	for (int i = 0; i < num_files; i++)
+		text_lookup_destroy(lookups_arr[i]);
+	bfree(lookups_arr);
+}
+
+int main(int argc, char *argv[])
+{
+	struct base_allocator allocator = {
+		count_malloc, count_realloc, count_free
+	};
+	DARRAY(char*) keys;
+	size_t lookups = 1000000;
+	int first_file = 1;
+
+	base_set_allocator(&allocator);
+
+	if (argc > 2 && strcmp(argv[1], "--lookups") == 0) {
+		lookups = (size_t)strtoul(argv[2], NULL, 10);
+		first_file = 3;
+	}
+
+	if (first_file >= argc) {
+		fprintf(stderr, "usage: %s [--lookups n] <ini files...>\n",
+				argv[0]);
+		return 1;
+	}
+
+	da_init(keys);
+	collect_keys(argv + first_file, argc - first_file, &keys.da);
+
+	remove_tables(argv + first_file, argc - first_file);
+	run_case("parse", argv + first_file, argc - first_file,
+			keys.array, keys.num, lookups);
+	run_case("cached", argv + first_file, argc - first_file,
+			keys.array, keys.num, lookups);
+
+	for (size_t i = 0; i < keys.num; i++)
+		bfree(keys.array[i]);
+	da_free(keys);
+	return 0;
+}